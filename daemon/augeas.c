@@ -434,3 +434,160 @@ do_aug_label (const char *augpath)
 
   return ret;                   /* caller frees */
 }
+
+/* Initialize Augeas and load only the lenses needed for 'files'.
+ * This is the same as calling aug-init with AUG_NO_LOAD, removing
+ * every /augeas/load/* entry whose 'incl' doesn't match one of the
+ * files, and then calling aug-load, but in a single round trip.
+ */
+int
+do_aug_init_files (const char *root, int flags, char *const *files)
+{
+  size_t i, nr_files;
+  CLEANUP_FREE_STRING_LIST char **subexprs = NULL;
+  CLEANUP_FREE char *subexpr = NULL;
+  CLEANUP_FREE char *pathexpr = NULL;
+
+  nr_files = count_strings (files);
+  if (nr_files == 0) {
+    reply_with_error ("list of files must not be empty");
+    return -1;
+  }
+
+  subexprs = calloc (nr_files + 1, sizeof (char *));
+  if (subexprs == NULL) {
+    reply_with_perror ("calloc");
+    return -1;
+  }
+
+  for (i = 0; i < nr_files; ++i) {
+    if (files[i][0] != '/' || strchr (files[i], '"') != NULL) {
+      reply_with_error ("%s: file must be an absolute path and must not contain '\"'",
+                        files[i]);
+      return -1;
+    }
+    /* See https://bugzilla.redhat.com/show_bug.cgi?id=975412#c0
+     * Note the trailing '/' after the filename.
+     */
+    if (asprintf (&subexprs[i],
+                  "\"%s/\" !~ regexp('^') + glob(incl) + regexp('/.*')",
+                  files[i]) == -1) {
+      reply_with_perror ("asprintf");
+      return -1;
+    }
+  }
+
+  subexpr = join_strings (" and ", subexprs);
+  if (subexpr == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+  if (asprintf (&pathexpr, "/augeas/load/*[ %s ]", subexpr) == -1) {
+    reply_with_perror ("asprintf");
+    return -1;
+  }
+
+  if (do_aug_init (root, flags | AUG_NO_LOAD) == -1)
+    return -1;
+
+  if (aug_rm (aug, pathexpr) == -1) {
+    AUGEAS_ERROR ("aug_rm: %s", pathexpr);
+    goto error;
+  }
+
+  if (aug_load (aug) == -1) {
+    AUGEAS_ERROR ("aug_load");
+    goto error;
+  }
+
+  return 0;
+
+ error:
+  aug_close (aug);
+  aug = NULL;
+  return -1;
+}
+
+/* Append 'path' and its value, followed by all descendants of 'path'
+ * in document order, to 'ret'.  On error, reply_with_* has been
+ * called and the caller must free the buffer.
+ */
+static int
+get_tree (struct stringsbuf *ret, const char *path)
+{
+  const char *value = NULL;
+  char **children = NULL;
+  CLEANUP_FREE char *childexpr = NULL;
+  int r, i, n;
+
+  r = aug_get (aug, path, &value);
+  if (r == -1) {
+    AUGEAS_ERROR ("aug_get: %s", path);
+    return -1;
+  }
+
+  /* Nodes without a value (or not matching exactly one node, which
+   * cannot happen for paths returned by aug_match) are returned with
+   * an empty string value.
+   */
+  if (add_string (ret, path) == -1)
+    return -1;
+  if (add_string (ret, r == 1 && value ? value : "") == -1)
+    return -1;
+
+  if (asprintf (&childexpr, "%s/*", path) == -1) {
+    reply_with_perror ("asprintf");
+    return -1;
+  }
+
+  n = aug_match (aug, childexpr, &children);
+  if (n == -1) {
+    AUGEAS_ERROR ("aug_match: %s", childexpr);
+    return -1;
+  }
+
+  r = 0;
+  for (i = 0; i < n; ++i) {
+    if (r == 0 && get_tree (ret, children[i]) == -1)
+      r = -1;
+    free (children[i]);
+  }
+  free (children);
+
+  return r;
+}
+
+char **
+do_aug_get_tree (const char *augpath)
+{
+  DECLARE_STRINGSBUF (ret);
+  char **matches = NULL;
+  int r, i, n;
+
+  NEED_AUG (NULL);
+
+  n = aug_match (aug, augpath, &matches);
+  if (n == -1) {
+    AUGEAS_ERROR ("aug_match: %s", augpath);
+    return NULL;
+  }
+
+  r = 0;
+  for (i = 0; i < n; ++i) {
+    if (r == 0 && get_tree (&ret, matches[i]) == -1)
+      r = -1;
+    free (matches[i]);
+  }
+  free (matches);
+
+  if (r == -1) {
+    if (ret.argv != NULL)
+      free_stringslen (ret.argv, ret.size);
+    return NULL;
+  }
+
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return ret.argv;		/* Caller frees. */
+}
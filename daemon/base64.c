@@ -97,16 +97,21 @@ do_base64_in (const char *file)
   return 0;
 }
 
+/* Pass the output of the command straight through to the library. */
+static int
+send_file_cb (void *opaque, const void *buf, size_t len)
+{
+  return send_file_write (buf, len);
+}
+
 /* Has one FileOut parameter. */
 int
 do_base64_out (const char *file)
 {
   CLEANUP_FREE char *buf = NULL;
+  CLEANUP_FREE char *err = NULL;
   struct stat statbuf;
   int r;
-  FILE *fp;
-  CLEANUP_FREE char *cmd = NULL;
-  char buffer[GUESTFS_MAX_CHUNK_SIZE];
 
   /* Check the filename exists and is not a directory (RHBZ#908322). */
   buf = sysroot_path (file);
@@ -125,43 +130,18 @@ do_base64_out (const char *file)
     return -1;
   }
 
-  /* Construct the command. */
-  if (asprintf_nowarn (&cmd, "%s %Q", str_base64, buf) == -1) {
-    reply_with_perror ("asprintf");
-    return -1;
-  }
-
-  if (verbose)
-    fprintf (stderr, "%s\n", cmd);
-
-  fp = popen (cmd, "r");
-  if (fp == NULL) {
-    reply_with_perror ("%s", cmd);
-    return -1;
-  }
-
   /* Now we must send the reply message, before the file contents.  After
    * this there is no opportunity in the protocol to send any error
    * message back.  Instead we can only cancel the transfer.
    */
   reply (NULL, NULL);
 
-  while ((r = fread (buffer, 1, sizeof buffer, fp)) > 0) {
-    if (send_file_write (buffer, r) < 0) {
-      pclose (fp);
-      return -1;
-    }
-  }
-
-  if (ferror (fp)) {
-    fprintf (stderr, "fread: %s: %m\n", file);
-    send_file_end (1);		/* Cancel. */
-    pclose (fp);
+  const char *argv[] = { str_base64, buf, NULL };
+  r = commandrvf_stream (send_file_cb, NULL, &err, 0, argv);
+  if (r == -2)                  /* Cancelled by the library. */
     return -1;
-  }
-
-  if (pclose (fp) != 0) {
-    fprintf (stderr, "pclose: %s: %m\n", file);
+  if (r != 0) {
+    fprintf (stderr, "base64: %s: %s\n", file, err ? err : "");
     send_file_end (1);		/* Cancel. */
     return -1;
   }
@@ -0,0 +1,117 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Appliance boot milestones, see guestfs_launch_timings.  The
+ * appliance /init script appends "name seconds" lines (from
+ * /proc/uptime) to BOOT_TIMINGS_FILE, and the daemon adds its own
+ * milestones using the same clock.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "daemon.h"
+#include "actions.h"
+
+#define BOOT_TIMINGS_FILE "/run/guestfs-boot-times"
+
+#ifndef CLOCK_BOOTTIME
+#define CLOCK_BOOTTIME CLOCK_MONOTONIC
+#endif
+
+#define MAX_MILESTONES 2
+
+static struct {
+  const char *name;
+  int64_t usec;
+} milestones[MAX_MILESTONES];
+static size_t nr_milestones;
+
+/* Record that the daemon reached milestone 'name' (a string literal). */
+void
+boot_milestone (const char *name)
+{
+  struct timespec ts;
+
+  if (nr_milestones >= MAX_MILESTONES)
+    return;
+  if (clock_gettime (CLOCK_BOOTTIME, &ts) == -1)
+    return;
+
+  milestones[nr_milestones].name = name;
+  milestones[nr_milestones].usec =
+    (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  nr_milestones++;
+}
+
+/* Add 'name' and the time 'usec' to the list. */
+static int
+add_milestone (struct stringsbuf *sb, const char *name, int64_t usec)
+{
+  char *s;
+
+  if (add_string (sb, name) == -1)
+    return -1;
+  if (asprintf (&s, "%" PRIi64, usec) == -1) {
+    reply_with_perror ("asprintf");
+    free_stringslen (sb->argv, sb->size);
+    return -1;
+  }
+  return add_string_nodup (sb, s);
+}
+
+char **
+do_internal_boot_timings (void)
+{
+  DECLARE_STRINGSBUF (ret);
+  FILE *fp;
+  char name[64];
+  unsigned long secs, hundredths;
+  size_t i;
+
+  /* Not having the file is not an error: the appliance may not have
+   * been started by our /init script.
+   */
+  fp = fopen (BOOT_TIMINGS_FILE, "r");
+  if (fp != NULL) {
+    while (fscanf (fp, "%63s %lu.%lu", name, &secs, &hundredths) == 3) {
+      if (add_milestone (&ret, name,
+                         (int64_t) secs * 1000000 + hundredths * 10000) == -1) {
+        fclose (fp);
+        return NULL;
+      }
+    }
+    fclose (fp);
+  }
+
+  for (i = 0; i < nr_milestones; ++i) {
+    if (add_milestone (&ret, milestones[i].name, milestones[i].usec) == -1)
+      return NULL;
+  }
+
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return ret.argv;              /* caller frees */
+}
@@ -0,0 +1,176 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Run a sequence of calls in a single round trip.  The wrappers
+ * around each do_* function and the table of functions which can be
+ * called are generated, see compound_functions in stubs.c.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+#include "daemon.h"
+#include "actions.h"
+#include "xstrtol.h"
+
+int
+compound_parse_bool (const char *fn, const char *arg, int *r)
+{
+  if (STREQ (arg, "true") || STREQ (arg, "1")) {
+    *r = 1;
+    return 0;
+  }
+  if (STREQ (arg, "false") || STREQ (arg, "0")) {
+    *r = 0;
+    return 0;
+  }
+
+  reply_with_error ("%s: %s: expecting 'true' or 'false'", fn, arg);
+  return -1;
+}
+
+int
+compound_parse_int (const char *fn, const char *arg, int *r)
+{
+  long n;
+  char *p;
+
+  if (xstrtol (arg, &p, 0, &n, NULL) != LONGINT_OK || *p != '\0' ||
+      n < INT_MIN || n > INT_MAX) {
+    reply_with_error ("%s: %s: expecting an integer", fn, arg);
+    return -1;
+  }
+
+  *r = n;
+  return 0;
+}
+
+int
+compound_parse_int64 (const char *fn, const char *arg, int64_t *r)
+{
+  long long n;
+  char *p;
+
+  if (xstrtoll (arg, &p, 0, &n, NULL) != LONGINT_OK || *p != '\0') {
+    reply_with_error ("%s: %s: expecting an integer", fn, arg);
+    return -1;
+  }
+
+  *r = n;
+  return 0;
+}
+
+/* Compare function names, treating '-' and '_' as the same. */
+static int
+name_equal (const char *a, const char *b)
+{
+  for (; *a && *b; ++a, ++b) {
+    if (*a != *b && !((*a == '-' || *a == '_') && (*b == '-' || *b == '_')))
+      return 0;
+  }
+  return *a == *b;
+}
+
+static const struct compound_function *
+lookup_function (const char *name)
+{
+  const struct compound_function *f;
+
+  for (f = compound_functions; f->name != NULL; ++f)
+    if (name_equal (f->name, name))
+      return f;
+  return NULL;
+}
+
+char **
+do_compound (char *const *calls)
+{
+  DECLARE_STRINGSBUF (results);
+  const struct compound_function *f;
+  CLEANUP_FREE char **args = NULL;
+  size_t nr_calls = count_strings (calls);
+  size_t i, j;
+  unsigned long n;
+  char *result;
+  char *p;
+
+  for (i = 0; i < nr_calls; i += f->nr_args + 1) {
+    f = lookup_function (calls[i]);
+    if (f == NULL) {
+      reply_with_error ("%s: unknown function, or function cannot be used in a compound call",
+                        calls[i]);
+      goto error;
+    }
+    if (i + f->nr_args >= nr_calls) {
+      reply_with_error ("%s: not enough arguments (expecting %zu)",
+                        calls[i], f->nr_args);
+      goto error;
+    }
+
+    free (args);
+    args = malloc ((f->nr_args + 1) * sizeof (char *));
+    if (args == NULL) {
+      reply_with_perror ("malloc");
+      goto error;
+    }
+
+    /* Substitute the results of earlier calls. */
+    for (j = 0; j < f->nr_args; ++j) {
+      const char *arg = calls[i+1+j];
+
+      if (arg[0] == '$' && arg[1] == '$')
+        args[j] = (char *) &arg[1];
+      else if (arg[0] == '$') {
+        if (xstrtoul (&arg[1], &p, 10, &n, NULL) != LONGINT_OK ||
+            *p != '\0' || n < 1 || n > results.size) {
+          reply_with_error ("%s: %s: does not refer to the result of an earlier call",
+                            calls[i], arg);
+          goto error;
+        }
+        args[j] = results.argv[n-1];
+      }
+      else
+        args[j] = (char *) arg;
+    }
+    args[j] = NULL;
+
+    /* Optional arguments always take their default values. */
+    optargs_bitmask = 0;
+
+    if (f->fn (args, &result) == -1)
+      /* The function has already called reply_with_error. */
+      goto error;
+
+    if (add_string_nodup (&results, result) == -1)
+      return NULL;
+  }
+
+  if (end_stringsbuf (&results) == -1)
+    return NULL;
+
+  return results.argv;          /* caller frees */
+
+ error:
+  free_stringslen (results.argv, results.size);
+  return NULL;
+}
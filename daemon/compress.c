@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <fcntl.h>
 
 #include "guestfs_protocol.h"
@@ -32,6 +33,8 @@ GUESTFSD_EXT_CMD(str_gzip, gzip);
 GUESTFSD_EXT_CMD(str_bzip2, bzip2);
 GUESTFSD_EXT_CMD(str_xz, xz);
 GUESTFSD_EXT_CMD(str_lzop, lzop);
+GUESTFSD_EXT_CMD(str_zstd, zstd);
+GUESTFSD_EXT_CMD(str_pigz, pigz);
 
 /* Has one FileOut parameter. */
 static int
@@ -111,6 +114,57 @@ do_compressX_out (const char *file, const char *filter, int is_device)
     /* note: substring "not supported" must appear in this error */     \
     NOT_SUPPORTED (-1, "compression type %s is not supported, because external program '%s' is not available in the appliance", prog, prog);
 
+/* Number of threads used by parallel compressors.  This is the
+ * number of vCPUs in the appliance (see guestfs_set_smp).
+ */
+static int
+compress_threads (void)
+{
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  return n > 1 ? (int) n : 1;
+}
+
+/* Return the compression program to run for 'ctype' (which must be
+ * one of gzip, xz or zstd), without the -c flag or level.  If the
+ * appliance has more than one vCPU, the parallel variant is used:
+ * pigz instead of gzip (if installed), or multiple threads for xz
+ * and zstd.  Otherwise this is just the name of the program.
+ */
+int
+get_compress_program (const char *ctype, char *ret, size_t n)
+{
+  int threads = compress_threads ();
+
+  if (STREQ (ctype, "gzip")) {
+    CHECK_SUPPORTED ("gzip");
+    if (threads > 1 && prog_exists ("pigz"))
+      snprintf (ret, n, "%s -p %d", str_pigz, threads);
+    else
+      snprintf (ret, n, "%s", str_gzip);
+    return 0;
+  }
+  else if (STREQ (ctype, "xz")) {
+    CHECK_SUPPORTED ("xz");
+    if (threads > 1)
+      snprintf (ret, n, "%s -T %d", str_xz, threads);
+    else
+      snprintf (ret, n, "%s", str_xz);
+    return 0;
+  }
+  else if (STREQ (ctype, "zstd")) {
+    CHECK_SUPPORTED ("zstd");
+    if (threads > 1)
+      snprintf (ret, n, "%s -q -T%d", str_zstd, threads);
+    else
+      snprintf (ret, n, "%s -q", str_zstd);
+    return 0;
+  }
+
+  reply_with_error ("unknown compression type");
+  return -1;
+}
+
 static int
 get_filter (const char *ctype, int level, char *ret, size_t n)
 {
@@ -124,11 +178,14 @@ get_filter (const char *ctype, int level, char *ret, size_t n)
     return 0;
   }
   else if (STREQ (ctype, "gzip")) {
-    CHECK_SUPPORTED ("gzip");
+    char prog[32];
+
+    if (get_compress_program (ctype, prog, sizeof prog) == -1)
+      return -1;
     if (level == -1)
-      snprintf (ret, n, "%s -c", str_gzip);
+      snprintf (ret, n, "%s -c", prog);
     else if (level >= 1 && level <= 9)
-      snprintf (ret, n, "%s -c -%d", str_gzip, level);
+      snprintf (ret, n, "%s -c -%d", prog, level);
     else {
       reply_with_error ("gzip: incorrect value for level parameter");
       return -1;
@@ -148,11 +205,14 @@ get_filter (const char *ctype, int level, char *ret, size_t n)
     return 0;
   }
   else if (STREQ (ctype, "xz")) {
-    CHECK_SUPPORTED ("xz");
+    char prog[32];
+
+    if (get_compress_program (ctype, prog, sizeof prog) == -1)
+      return -1;
     if (level == -1)
-      snprintf (ret, n, "%s -c", str_xz);
+      snprintf (ret, n, "%s -c", prog);
     else if (level >= 0 && level <= 9)
-      snprintf (ret, n, "%s -c -%d", str_xz, level);
+      snprintf (ret, n, "%s -c -%d", prog, level);
     else {
       reply_with_error ("xz: incorrect value for level parameter");
       return -1;
@@ -171,6 +231,21 @@ get_filter (const char *ctype, int level, char *ret, size_t n)
     }
     return 0;
   }
+  else if (STREQ (ctype, "zstd")) {
+    char prog[32];
+
+    if (get_compress_program (ctype, prog, sizeof prog) == -1)
+      return -1;
+    if (level == -1)
+      snprintf (ret, n, "%s -c", prog);
+    else if (level >= 1 && level <= 19)
+      snprintf (ret, n, "%s -c -%d", prog, level);
+    else {
+      reply_with_error ("zstd: incorrect value for level parameter");
+      return -1;
+    }
+    return 0;
+  }
 
   reply_with_error ("unknown compression type");
   return -1;
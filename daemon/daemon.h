@@ -130,6 +130,11 @@ extern int commandvf (char **stdoutput, char **stderror, int flags,
 extern int commandrvf (char **stdoutput, char **stderror, int flags,
                        char const* const *argv);
 
+typedef int (*command_output_cb) (void *opaque, const void *buf, size_t len);
+extern int commandrvf_stream (command_output_cb cb, void *opaque,
+                              char **stderror, int flags,
+                              char const* const *argv);
+
 extern int is_power_of_2 (unsigned long v);
 
 extern void trim (char *str);
@@ -140,10 +145,15 @@ extern int parse_btrfsvol (const char *desc, mountable_t *mountable);
 
 extern int prog_exists (const char *prog);
 
-extern void udev_settle (void);
 
 extern int random_name (char *template);
 
+/*-- in udev.c --*/
+extern void udev_monitor_init (void);
+extern void udev_settle (void);
+extern void udev_settle_later (void);
+extern void udev_settle_pending (void);
+
 /* This just stops gcc from giving a warning about our custom printf
  * formatters %Q and %R.  See guestfs(3)/EXTENDING LIBGUESTFS for more
  * info about these.  In GCC 4.8.0 the warning is even harder to
@@ -182,6 +192,12 @@ extern int serial;
 extern uint64_t progress_hint;
 extern uint64_t optargs_bitmask;
 
+/*-- in rpc-stats.c --*/
+extern void rpc_stats_call (int proc, size_t bytes);
+extern void rpc_stats_reply (int error, size_t bytes);
+extern void rpc_stats_chunk (int sent, size_t bytes);
+extern void rpc_stats_done (int64_t elapsed_us);
+
 /*-- in mount.c --*/
 extern int is_root_mounted (void);
 extern int is_device_mounted (const char *device);
@@ -192,6 +208,45 @@ extern guestfs_int_lvm_pv_list *parse_command_line_pvs (void);
 extern guestfs_int_lvm_vg_list *parse_command_line_vgs (void);
 extern guestfs_int_lvm_lv_list *parse_command_line_lvs (void);
 
+/* Functions which can be called from guestfs_compound.  'fn' parses
+ * the 'nr_args' string arguments, makes the call and returns the
+ * result as a string in *result_r.  On error it has already called
+ * reply_with_error and returns -1.
+ */
+struct compound_function {
+  const char *name;
+  size_t nr_args;
+  int (*fn) (char *const *args, char **result_r);
+};
+extern const struct compound_function compound_functions[];
+
+/*-- in boot-timings.c --*/
+extern void boot_milestone (const char *name);
+
+/*-- in walk.c --*/
+struct walk_entry {
+  const char *path;             /* Relative to the top directory. */
+  size_t pathlen;
+  unsigned char type;           /* DT_* */
+  const struct stat *statbuf;   /* Only if WALK_STAT, else NULL. */
+};
+typedef int (*walk_cb) (void *opaque, const struct walk_entry *entries, size_t nr);
+#define WALK_STAT 1             /* lstat every entry. */
+extern int walk_tree (const char *dir, int flags, walk_cb cb, void *opaque);
+
+/*-- in jobs.c --*/
+typedef void (*job_fn) (size_t i, void *opaque);
+extern void run_jobs (size_t nr_jobs, size_t max_threads, job_fn fn,
+                      void *opaque, void (*progress) (void *opaque));
+#define PRIVATE_MOUNTPOINT_LEN 32
+extern int make_private_mountpoint (char *mp, const char *prefix);
+extern void remove_private_mountpoint (char *mp);
+
+/*-- in compound.c --*/
+extern int compound_parse_bool (const char *fn, const char *arg, int *r);
+extern int compound_parse_int (const char *fn, const char *arg, int *r);
+extern int compound_parse_int64 (const char *fn, const char *arg, int64_t *r);
+
 /*-- in optgroups.c (auto-generated) --*/
 struct optgroup {
   const char *group;            /* Name of the optional group. */
@@ -211,6 +266,9 @@ extern int sync_disks (void);
 #define EXT2_LABEL_MAX 16
 extern int fstype_is_extfs (const char *fstype);
 
+/*-- in compress.c --*/
+extern int get_compress_program (const char *ctype, char *ret, size_t n);
+
 /*-- in blkid.c --*/
 extern char *get_blkid_tag (const char *device, const char *tag);
 
@@ -45,6 +45,8 @@ foreach_block_device (block_dev_func_t func)
   char dev_path[256];
   int fd;
 
+  udev_settle_pending ();
+
   dir = opendir ("/sys/block");
   if (!dir) {
     reply_with_perror ("opendir: /sys/block");
@@ -315,6 +317,8 @@ do_list_disk_labels (void)
   char *rawdev = NULL;
   DECLARE_STRINGSBUF (ret);
 
+  udev_settle_pending ();
+
   dir = opendir (GUESTFSDIR);
   if (!dir) {
     reply_with_perror ("opendir: %s", GUESTFSDIR);
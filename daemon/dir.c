@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <glob.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -79,6 +80,124 @@ do_rm_rf (const char *path)
   return 0;
 }
 
+/* Number of paths passed to each rm -rf command. */
+#define RM_RF_GLOBS_BATCH 1024
+
+/* Expand all the globs and remove everything they match, running
+ * 'rm -rf' as few times as possible.  Paths matched by more than one
+ * glob are only counted once.  Returns the number of paths removed.
+ */
+int
+do_rm_rf_globs (char *const *globs)
+{
+  size_t i, j, n;
+  int r;
+  DECLARE_STRINGSBUF (paths);
+  CLEANUP_FREE const char **argv = NULL;
+
+  for (i = 0; globs[i] != NULL; ++i) {
+    glob_t buf = { .gl_pathc = 0, .gl_pathv = NULL, .gl_offs = 0 };
+    const char *base;
+
+    if (globs[i][0] != '/') {
+      reply_with_error ("%s: glob must be an absolute path", globs[i]);
+      goto error;
+    }
+
+    /* See do_glob_expand.  GLOB_MARK is not used here so that a
+     * symlink to a directory is removed, not the directory contents.
+     */
+    CHROOT_IN;
+    r = glob (globs[i], GLOB_BRACE, NULL, &buf);
+    CHROOT_OUT;
+
+    if (r == GLOB_NOMATCH)
+      continue;
+    if (r != 0) {
+      if (errno != 0)
+        reply_with_perror ("%s", globs[i]);
+      else
+        reply_with_error ("glob failed: %s", globs[i]);
+      goto error;
+    }
+
+    for (j = 0; j < buf.gl_pathc; ++j) {
+      char *path;
+
+      if (STREQ (buf.gl_pathv[j], "/")) {
+        reply_with_error ("%s: cannot remove root directory", globs[i]);
+        globfree (&buf);
+        goto error;
+      }
+
+      /* Patterns such as "/tmp/.*" also match "." and "..". */
+      base = strrchr (buf.gl_pathv[j], '/') + 1;
+      if (STREQ (base, ".") || STREQ (base, ".."))
+        continue;
+
+      path = sysroot_path (buf.gl_pathv[j]);
+      if (path == NULL) {
+        reply_with_perror ("malloc");
+        globfree (&buf);
+        goto error;
+      }
+      if (add_string_nodup (&paths, path) == -1) {
+        globfree (&buf);
+        return -1;
+      }
+    }
+
+    globfree (&buf);
+  }
+
+  if (paths.size == 0)
+    return 0;
+
+  /* Remove the duplicates. */
+  sort_strings (paths.argv, paths.size);
+  for (i = j = 0; i < paths.size; ++i) {
+    if (j > 0 && STREQ (paths.argv[i], paths.argv[j-1]))
+      free (paths.argv[i]);
+    else
+      paths.argv[j++] = paths.argv[i];
+  }
+  paths.size = j;
+
+  argv = malloc ((3 + RM_RF_GLOBS_BATCH + 1) * sizeof (char *));
+  if (argv == NULL) {
+    reply_with_perror ("malloc");
+    goto error;
+  }
+  argv[0] = str_rm;
+  argv[1] = "-rf";
+  argv[2] = "--";
+
+  for (i = 0; i < paths.size; i += n) {
+    CLEANUP_FREE char *err = NULL;
+
+    n = paths.size - i;
+    if (n > RM_RF_GLOBS_BATCH)
+      n = RM_RF_GLOBS_BATCH;
+    for (j = 0; j < n; ++j)
+      argv[3+j] = paths.argv[i+j];
+    argv[3+n] = NULL;
+
+    r = commandv (NULL, &err, argv);
+    /* As in do_rm_rf, rm -rf is never supposed to fail. */
+    if (r == -1) {
+      reply_with_error ("rm: %s", err);
+      goto error;
+    }
+  }
+
+  free_stringslen (paths.argv, paths.size);
+  return (int) paths.size;
+
+ error:
+  free_stringslen (paths.argv, paths.size);
+  return -1;
+}
+
 int
 do_mkdir (const char *path)
 {
@@ -23,19 +23,85 @@
 #include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
-GUESTFSD_EXT_CMD(str_du, du);
+/* Like 'du -s': count the blocks of every file and directory, but
+ * files with several hard links only once.
+ */
+struct inode {
+  dev_t dev;
+  ino_t ino;
+  int64_t blocks;
+};
+
+struct du_state {
+  int64_t blocks;               /* Total, in 512 byte units. */
+  struct inode *linked;         /* Files with st_nlink > 1. */
+  size_t nr_linked, alloc_linked;
+};
+
+static int
+du_count (struct du_state *state, const struct stat *statbuf)
+{
+  state->blocks += statbuf->st_blocks;
+
+  if (!S_ISDIR (statbuf->st_mode) && statbuf->st_nlink > 1) {
+    if (state->nr_linked >= state->alloc_linked) {
+      size_t n = state->alloc_linked ? state->alloc_linked * 2 : 256;
+      struct inode *p = realloc (state->linked, n * sizeof (struct inode));
+
+      if (p == NULL)
+        return -1;
+      state->linked = p;
+      state->alloc_linked = n;
+    }
+    state->linked[state->nr_linked].dev = statbuf->st_dev;
+    state->linked[state->nr_linked].ino = statbuf->st_ino;
+    state->linked[state->nr_linked].blocks = statbuf->st_blocks;
+    state->nr_linked++;
+  }
+
+  return 0;
+}
+
+static int
+du_cb (void *statev, const struct walk_entry *entries, size_t nr)
+{
+  struct du_state *state = statev;
+  size_t i;
+
+  for (i = 0; i < nr; ++i) {
+    if (du_count (state, entries[i].statbuf) == -1)
+      return -1;
+  }
+  return 0;
+}
+
+static int
+compare_inodes (const void *av, const void *bv)
+{
+  const struct inode *a = av, *b = bv;
+
+  if (a->dev != b->dev)
+    return a->dev < b->dev ? -1 : 1;
+  if (a->ino != b->ino)
+    return a->ino < b->ino ? -1 : 1;
+  return 0;
+}
 
 int64_t
 do_du (const char *path)
 {
-  int r;
-  int64_t rv;
-  CLEANUP_FREE char *out = NULL, *err = NULL, *buf = NULL;
+  struct du_state state = { .blocks = 0, .linked = NULL,
+                            .nr_linked = 0, .alloc_linked = 0 };
+  struct stat statbuf;
+  size_t i;
+  CLEANUP_FREE char *buf = NULL;
 
   /* Make the path relative to /sysroot. */
   buf = sysroot_path (path);
@@ -44,22 +110,34 @@ do_du (const char *path)
     return -1;
   }
 
+  if (lstat (buf, &statbuf) == -1) {
+    reply_with_perror ("%s", path);
+    return -1;
+  }
+
   pulse_mode_start ();
 
-  r = command (&out, &err, str_du, "-s", buf, NULL);
-  if (r == -1) {
+  if (du_count (&state, &statbuf) == -1 ||
+      (S_ISDIR (statbuf.st_mode) &&
+       walk_tree (buf, WALK_STAT, du_cb, &state) == -1)) {
     pulse_mode_cancel ();
-    reply_with_error ("%s: %s", path, err);
+    reply_with_perror ("%s", path);
+    free (state.linked);
     return -1;
   }
 
-  if (sscanf (out, "%"SCNi64, &rv) != 1) {
-    pulse_mode_cancel ();
-    reply_with_error ("%s: could not read output: %s", path, out);
-    return -1;
+  /* Subtract hard linked files which were counted more than once. */
+  if (state.nr_linked > 1)
+    qsort (state.linked, state.nr_linked, sizeof (struct inode),
+           compare_inodes);
+  for (i = 1; i < state.nr_linked; ++i) {
+    if (compare_inodes (&state.linked[i-1], &state.linked[i]) == 0)
+      state.blocks -= state.linked[i].blocks;
   }
+  free (state.linked);
 
   pulse_mode_end ();
 
-  return rv;
+  /* Kilobytes, rounded up. */
+  return (state.blocks + 1) / 2;
 }
@@ -24,31 +24,59 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <errno.h>
 #include <sys/stat.h>
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
 #include "actions.h"
 
-GUESTFSD_EXT_CMD(str_find, find);
+/* Paths are packed into FileOut chunks, NUL-terminated, and may be
+ * split across chunks.
+ */
+struct find0_state {
+  const char *prefix;           /* "/" or "" (see do_find0). */
+  char buf[GUESTFS_MAX_CHUNK_SIZE];
+  size_t len;
+  int send_failed;              /* Transfer was cancelled. */
+};
 
 static int
-input_to_nul (FILE *fp, char *buf, size_t maxlen)
+find0_write (struct find0_state *state, const char *str, size_t len)
 {
-  size_t i = 0;
-  int c;
-
-  while (i < maxlen) {
-    c = fgetc (fp);
-    if (c == EOF)
-      return 0;
-    buf[i++] = c;
-    if (c == '\0')
-      return i;
+  while (len > 0) {
+    size_t n = MIN (len, sizeof state->buf - state->len);
+
+    memcpy (&state->buf[state->len], str, n);
+    state->len += n;
+    str += n;
+    len -= n;
+
+    if (state->len == sizeof state->buf) {
+      if (send_file_write (state->buf, state->len) < 0) {
+        state->send_failed = 1;
+        return -1;
+      }
+      state->len = 0;
+    }
   }
+  return 0;
+}
+
+static int
+find0_cb (void *statev, const struct walk_entry *entries, size_t nr)
+{
+  struct find0_state *state = statev;
+  size_t i;
 
-  reply_with_error ("input_to_nul: input string too long");
-  return -1;
+  for (i = 0; i < nr; ++i) {
+    if (find0_write (state, state->prefix, strlen (state->prefix)) == -1 ||
+        find0_write (state, entries[i].path, entries[i].pathlen + 1) == -1) {
+      errno = EIO;
+      return -1;
+    }
+  }
+  return 0;
 }
 
 /* Has one FileOut parameter. */
@@ -57,11 +85,9 @@ do_find0 (const char *dir)
 {
   struct stat statbuf;
   int r;
-  FILE *fp;
-  CLEANUP_FREE char *cmd = NULL;
   CLEANUP_FREE char *sysrootdir = NULL;
+  CLEANUP_FREE struct find0_state *state = NULL;
   size_t sysrootdirlen;
-  char str[GUESTFS_MAX_CHUNK_SIZE];
 
   sysrootdir = sysroot_path (dir);
   if (!sysrootdir) {
@@ -79,21 +105,20 @@ do_find0 (const char *dir)
     return -1;
   }
 
-  sysrootdirlen = strlen (sysrootdir);
-
-  if (asprintf_nowarn (&cmd, "%s %Q -print0", str_find, sysrootdir) == -1) {
-    reply_with_perror ("asprintf");
+  state = malloc (sizeof *state);
+  if (state == NULL) {
+    reply_with_perror ("malloc");
     return -1;
   }
+  state->len = 0;
+  state->send_failed = 0;
 
-  if (verbose)
-    fprintf (stderr, "%s\n", cmd);
-
-  fp = popen (cmd, "r");
-  if (fp == NULL) {
-    reply_with_perror ("%s", cmd);
-    return -1;
-  }
+  /* This used to run 'find dir -print0' and remove 'dir' from each
+   * path, which leaves a leading '/' unless 'dir' ends with '/'.
+   * Keep the same output.
+   */
+  sysrootdirlen = strlen (sysrootdir);
+  state->prefix = sysrootdir[sysrootdirlen-1] == '/' ? "" : "/";
 
   /* Now we must send the reply message, before the file contents.  After
    * this there is no opportunity in the protocol to send any error
@@ -101,35 +126,16 @@ do_find0 (const char *dir)
    */
   reply (NULL, NULL);
 
-  /* The code below assumes each path returned can fit into a protocol
-   * chunk (if not you'll get a runtime protocol error).  If this
-   * turns out not to be a problem at some point in the future then
-   * we'll need to modify the code to handle it.  XXX
-   */
-  while ((r = input_to_nul (fp, str, GUESTFS_MAX_CHUNK_SIZE)) > 0) {
-    size_t len = strlen (str);
-    if (len <= sysrootdirlen)
-      continue;
-
-    /* Remove the directory part of the path before sending it. */
-    if (send_file_write (str + sysrootdirlen, r - sysrootdirlen) < 0) {
-      pclose (fp);
+  if (walk_tree (sysrootdir, 0, find0_cb, state) == -1) {
+    if (state->send_failed)
       return -1;
-    }
-  }
-
-  if (ferror (fp)) {
-    fprintf (stderr, "fgetc: %s: %m\n", dir);
+    fprintf (stderr, "find0: %s: %m\n", dir);
     send_file_end (1);                /* Cancel. */
-    pclose (fp);
     return -1;
   }
 
-  if (pclose (fp) != 0) {
-    fprintf (stderr, "pclose: %s: %m\n", dir);
-    send_file_end (1);                /* Cancel. */
+  if (state->len > 0 && send_file_write (state->buf, state->len) < 0)
     return -1;
-  }
 
   if (send_file_end (0))        /* Normal end of file. */
     return -1;
@@ -35,6 +35,8 @@ findfs (const char *tag, const char *label_or_uuid)
   CLEANUP_FREE char *err = NULL;
   int r;
 
+  udev_settle_pending ();
+
   /* Kill the cache file, forcing blkid to reread values from the
    * original filesystems.  In blkid there is a '-p' option which is
    * supposed to do this, but (a) it doesn't work and (b) that option
@@ -1,5 +1,5 @@
 /* libguestfs - the guestfsd daemon
- * Copyright (C) 2009 Red Hat Inc.
+ * Copyright (C) 2009-2014 Red Hat Inc.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -16,13 +16,40 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+/* The grep family of calls is implemented in the daemon rather than
+ * by running grep(1), since inspection calls them many times on small
+ * files and the cost is almost all in starting the external program.
+ *
+ * Patterns are compiled with the POSIX regex functions from glibc,
+ * which implement the same basic and extended (with GNU extensions)
+ * regular expressions as GNU grep.  Files are read into a buffer and
+ * scanned line by line.  gzip and xz compressed files are decompressed
+ * in the daemon when the library is available.  Other compressed
+ * formats understood by zgrep are passed to the external program.
+ */
+
 #include <config.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <regex.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_LIBLZMA
+#include <lzma.h>
+#endif
+
+#include "ignore-value.h"
 
 #include "guestfs_protocol.h"
 #include "daemon.h"
@@ -30,25 +57,431 @@
 
 #define MAX_ARGS 64
 
-static char **
-grep (const char *regex, const char *path,
-      int extended, int fixed, int insensitive, int compressed)
+#define BUFFER_SIZE 65536
+
+/* Same as the message printed by grep. */
+#define BINARY_FILE_MATCHES "Binary file (standard input) matches"
+
+struct matcher {
+  size_t nr_res;
+  regex_t *res;
+};
+
+struct grep_state {
+  const struct matcher *m;
+  const char *prefix;           /* prepended to each line, or NULL */
+  struct stringsbuf *ret;       /* matching lines are added here */
+  size_t first;                 /* first line in 'ret' from this file */
+  int binary;                   /* file contains NUL bytes */
+  int binary_matched;           /* ... and some line matched */
+  char *partial;                /* incomplete last line */
+  size_t partial_len, partial_alloc;
+};
+
+/* Escape a fixed string so it can be compiled as a basic regular
+ * expression.
+ */
+static char *
+escape_fixed (const char *str, size_t len)
 {
-  const char *argv[MAX_ARGS];
-  size_t i = 0;
-  CLEANUP_FREE char *out = NULL, *err = NULL;
-  int fd, flags, r;
-  char **lines;
+  char *ret, *p;
+  size_t i;
 
-  if (extended && fixed) {
-    reply_with_error ("can't use 'extended' and 'fixed' flags at the same time");
+  ret = p = malloc (2 * len + 1);
+  if (ret == NULL)
     return NULL;
+
+  for (i = 0; i < len; ++i) {
+    if (strchr ("\\.[]*^$", str[i]))
+      *p++ = '\\';
+    *p++ = str[i];
   }
+  *p = '\0';
 
-  if (!compressed)
-    ADD_ARG (argv, i, "grep");
-  else
-    ADD_ARG (argv, i, "zgrep");
+  return ret;
+}
+
+static void
+free_matcher (struct matcher *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->nr_res; ++i)
+    regfree (&m->res[i]);
+  free (m->res);
+  m->nr_res = 0;
+  m->res = NULL;
+}
+
+/* Compile 'regexes'.  As with grep, each regex may contain several
+ * patterns separated by newlines, and a line matches if it matches any
+ * pattern.  On error, reply with an error and return -1.
+ */
+static int
+compile_matcher (struct matcher *m, char *const *regexes,
+                 int extended, int fixed, int insensitive)
+{
+  size_t i, n, len;
+  const char *p;
+  int cflags, r;
+  regex_t *res;
+  char err[256];
+
+  cflags = REG_NOSUB;
+  if (extended)
+    cflags |= REG_EXTENDED;
+  if (insensitive)
+    cflags |= REG_ICASE;
+
+  m->nr_res = 0;
+  m->res = NULL;
+
+  for (i = 0; regexes[i] != NULL; ++i) {
+    p = regexes[i];
+    for (;;) {
+      CLEANUP_FREE char *pattern = NULL;
+
+      len = strcspn (p, "\n");
+      if (fixed)
+        pattern = escape_fixed (p, len);
+      else
+        pattern = strndup (p, len);
+      if (pattern == NULL) {
+        reply_with_perror ("malloc");
+        goto error;
+      }
+
+      n = m->nr_res + 1;
+      res = realloc (m->res, n * sizeof (regex_t));
+      if (res == NULL) {
+        reply_with_perror ("realloc");
+        goto error;
+      }
+      m->res = res;
+
+      r = regcomp (&m->res[m->nr_res], pattern, cflags);
+      if (r != 0) {
+        regerror (r, &m->res[m->nr_res], err, sizeof err);
+        reply_with_error ("%s: %s", regexes[i], err);
+        goto error;
+      }
+      m->nr_res = n;
+
+      if (p[len] == '\0')
+        break;
+      p += len + 1;
+    }
+  }
+
+  return 0;
+
+ error:
+  free_matcher (m);
+  return -1;
+}
+
+static int
+line_matches (const struct matcher *m, const char *line, size_t len)
+{
+  regmatch_t pmatch[1];
+  size_t i;
+
+  for (i = 0; i < m->nr_res; ++i) {
+    /* REG_STARTEND lets us match lines in place, without copying
+     * them to add a terminating \0.
+     */
+    pmatch[0].rm_so = 0;
+    pmatch[0].rm_eo = len;
+    if (regexec (&m->res[i], line, 1, pmatch, REG_STARTEND) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+static int
+add_line (struct grep_state *st, const char *line, size_t len)
+{
+  size_t prefix_len = st->prefix ? strlen (st->prefix) : 0;
+  char *str;
+
+  str = malloc (prefix_len + len + 1);
+  if (str == NULL) {
+    reply_with_perror ("malloc");
+    free_stringslen (st->ret->argv, st->ret->size);
+    st->ret->argv = NULL;
+    return -1;
+  }
+  if (prefix_len)
+    memcpy (str, st->prefix, prefix_len);
+  memcpy (&str[prefix_len], line, len);
+  str[prefix_len + len] = '\0';
+
+  return add_string_nodup (st->ret, str);
+}
+
+static int
+match_line (struct grep_state *st, const char *line, size_t len)
+{
+  if (!line_matches (st->m, line, len))
+    return 0;
+
+  /* Like grep, for binary files we only say whether it matched. */
+  if (st->binary) {
+    st->binary_matched = 1;
+    return 0;
+  }
+
+  return add_line (st, line, len);
+}
+
+/* Scan the next 'len' bytes of the file.  Lines may be split across
+ * calls.
+ */
+static int
+scan (struct grep_state *st, const char *data, size_t len)
+{
+  const char *end = data + len;
+  const char *nl;
+  char *p;
+
+  if (!st->binary && memchr (data, '\0', len) != NULL) {
+    st->binary = 1;
+
+    /* Throw away the lines we found already. */
+    if (st->ret->size > st->first) {
+      st->binary_matched = 1;
+      while (st->ret->size > st->first)
+        free (st->ret->argv[--st->ret->size]);
+    }
+  }
+
+  while (data < end) {
+    nl = memchr (data, '\n', end - data);
+    if (nl == NULL)
+      break;
+
+    if (st->partial_len > 0) {
+      if (st->partial_len + (nl - data) >= st->partial_alloc) {
+        st->partial_alloc = st->partial_len + (nl - data) + 1;
+        p = realloc (st->partial, st->partial_alloc);
+        if (p == NULL) {
+          reply_with_perror ("realloc");
+          return -1;
+        }
+        st->partial = p;
+      }
+      memcpy (&st->partial[st->partial_len], data, nl - data);
+      st->partial_len += nl - data;
+      st->partial[st->partial_len] = '\0';
+      if (match_line (st, st->partial, st->partial_len) == -1)
+        return -1;
+      st->partial_len = 0;
+    }
+    else {
+      if (match_line (st, data, nl - data) == -1)
+        return -1;
+    }
+
+    data = nl + 1;
+  }
+
+  /* Save any incomplete line for next time. */
+  if (data < end) {
+    if (st->partial_len + (end - data) >= st->partial_alloc) {
+      st->partial_alloc = 2 * (st->partial_len + (end - data)) + 1;
+      p = realloc (st->partial, st->partial_alloc);
+      if (p == NULL) {
+        reply_with_perror ("realloc");
+        return -1;
+      }
+      st->partial = p;
+    }
+    memcpy (&st->partial[st->partial_len], data, end - data);
+    st->partial_len += end - data;
+    st->partial[st->partial_len] = '\0';
+  }
+
+  return 0;
+}
+
+/* Called at the end of the file. */
+static int
+scan_end (struct grep_state *st)
+{
+  if (st->partial_len > 0) {
+    if (match_line (st, st->partial, st->partial_len) == -1)
+      return -1;
+    st->partial_len = 0;
+  }
+
+  if (st->binary_matched)
+    return add_line (st, BINARY_FILE_MATCHES, strlen (BINARY_FILE_MATCHES));
+
+  return 0;
+}
+
+/* The file is read rather than mapped into memory: if the file is
+ * truncated while we scan it, or the disk returns an I/O error, a
+ * mapping would kill the daemon with SIGBUS, whereas read(2) just
+ * returns a short count or an error.
+ */
+static int
+scan_fd (struct grep_state *st, int fd, const char *path)
+{
+  CLEANUP_FREE char *buf = NULL;
+  ssize_t r;
+
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_SEQUENTIAL)
+  ignore_value (posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL));
+#endif
+
+  buf = malloc (BUFFER_SIZE);
+  if (buf == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+
+  while ((r = read (fd, buf, BUFFER_SIZE)) > 0) {
+    if (scan (st, buf, r) == -1)
+      return -1;
+  }
+  if (r == -1) {
+    reply_with_perror ("read: %s", path);
+    return -1;
+  }
+
+  return 0;
+}
+
+#ifdef HAVE_ZLIB
+static int
+scan_gzip (struct grep_state *st, int fd, const char *path)
+{
+  gzFile gz;
+  CLEANUP_FREE char *buf = NULL;
+  const char *msg;
+  int errnum, r;
+
+  buf = malloc (BUFFER_SIZE);
+  if (buf == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+
+  fd = dup (fd);               /* because gzclose will close it */
+  if (fd == -1) {
+    reply_with_perror ("dup");
+    return -1;
+  }
+  gz = gzdopen (fd, "r");
+  if (gz == NULL) {
+    reply_with_perror ("gzdopen: %s", path);
+    close (fd);
+    return -1;
+  }
+
+  while ((r = gzread (gz, buf, BUFFER_SIZE)) > 0) {
+    if (scan (st, buf, r) == -1) {
+      gzclose (gz);
+      return -1;
+    }
+  }
+  if (r == -1) {
+    msg = gzerror (gz, &errnum);
+    if (errnum == Z_ERRNO)
+      reply_with_perror ("gzread: %s", path);
+    else
+      reply_with_error ("gzread: %s: %s", path, msg);
+    gzclose (gz);
+    return -1;
+  }
+
+  gzclose (gz);
+  return 0;
+}
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_LIBLZMA
+static int
+scan_xz (struct grep_state *st, int fd, const char *path)
+{
+  lzma_stream strm = LZMA_STREAM_INIT;
+  lzma_action action = LZMA_RUN;
+  lzma_ret lr;
+  CLEANUP_FREE uint8_t *inbuf = NULL, *outbuf = NULL;
+  ssize_t r;
+
+  inbuf = malloc (BUFFER_SIZE);
+  outbuf = malloc (BUFFER_SIZE);
+  if (inbuf == NULL || outbuf == NULL) {
+    reply_with_perror ("malloc");
+    return -1;
+  }
+
+  lr = lzma_stream_decoder (&strm, UINT64_MAX, LZMA_CONCATENATED);
+  if (lr != LZMA_OK) {
+    reply_with_error ("lzma_stream_decoder: %s: error %d", path, (int) lr);
+    return -1;
+  }
+
+  strm.next_out = outbuf;
+  strm.avail_out = BUFFER_SIZE;
+
+  for (;;) {
+    if (strm.avail_in == 0 && action == LZMA_RUN) {
+      r = read (fd, inbuf, BUFFER_SIZE);
+      if (r == -1) {
+        reply_with_perror ("read: %s", path);
+        goto error;
+      }
+      if (r == 0)
+        action = LZMA_FINISH;
+      strm.next_in = inbuf;
+      strm.avail_in = r;
+    }
+
+    lr = lzma_code (&strm, action);
+
+    if (strm.avail_out == 0 || lr == LZMA_STREAM_END) {
+      if (scan (st, (char *) outbuf, BUFFER_SIZE - strm.avail_out) == -1)
+        goto error;
+      strm.next_out = outbuf;
+      strm.avail_out = BUFFER_SIZE;
+    }
+
+    if (lr == LZMA_STREAM_END)
+      break;
+    if (lr != LZMA_OK) {
+      reply_with_error ("%s: xz decompression failed: error %d",
+                        path, (int) lr);
+      goto error;
+    }
+  }
+
+  lzma_end (&strm);
+  return 0;
+
+ error:
+  lzma_end (&strm);
+  return -1;
+}
+#endif /* HAVE_LIBLZMA */
+
+/* Run the external zgrep program, for compressed formats that we
+ * don't handle ourselves.  This closes 'fd'.
+ */
+static int
+zgrep_external (struct grep_state *st, int fd, char *const *regexes,
+                int extended, int fixed, int insensitive)
+{
+  const char *argv[MAX_ARGS];
+  size_t i = 0, j;
+  CLEANUP_FREE char *out = NULL, *err = NULL;
+  CLEANUP_FREE_STRING_LIST char **lines = NULL;
+  int flags, r;
+
+  ADD_ARG (argv, i, "zgrep");
 
   if (extended)
     ADD_ARG (argv, i, "-E");
@@ -59,32 +492,154 @@ grep (const char *regex, const char *path,
   if (insensitive)
     ADD_ARG (argv, i, "-i");
 
-  ADD_ARG (argv, i, regex);
+  for (j = 0; regexes[j] != NULL; ++j) {
+    ADD_ARG (argv, i, "-e");
+    ADD_ARG (argv, i, regexes[j]);
+  }
   ADD_ARG (argv, i, NULL);
 
+  /* Note that grep returns an error if no match.  We want to
+   * suppress this error and return an empty list.
+   */
+  flags = COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN | fd;
+  r = commandrvf (&out, &err, flags, argv);
+  if (r == -1 || r > 1) {
+    reply_with_error ("%s: %s", regexes[0], err);
+    return -1;
+  }
+
+  lines = split_lines (out);
+  if (lines == NULL)
+    return -1;
+
+  for (j = 0; lines[j] != NULL; ++j) {
+    if (add_line (st, lines[j], strlen (lines[j])) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/* Search the file 'path' and add matching lines to 'st->ret'.  On
+ * error, reply with an error and return -1.
+ */
+static int
+grep_file (struct grep_state *st, const char *path, char *const *regexes,
+           int extended, int fixed, int insensitive, int compressed)
+{
+  unsigned char magic[6];
+  int fd, r;
+
   CHROOT_IN;
   fd = open (path, O_RDONLY|O_CLOEXEC);
   CHROOT_OUT;
 
   if (fd == -1) {
     reply_with_perror ("%s", path);
-    return NULL;
+    return -1;
   }
 
-  /* Note that grep returns an error if no match.  We want to
-   * suppress this error and return an empty list.
+  st->first = st->ret->size;
+  st->binary = st->binary_matched = 0;
+  st->partial_len = 0;
+
+  /* zgrep (really gzip -cdfq) passes through files which are not
+   * compressed, so only the known compressed formats are special.
    */
-  flags = COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN | fd;
-  r = commandrvf (&out, &err, flags, argv);
-  if (r == -1 || r > 1) {
-    reply_with_error ("%s: %s", regex, err);
+  memset (magic, 0, sizeof magic);
+  if (compressed && pread (fd, magic, sizeof magic, 0) == -1)
+    memset (magic, 0, sizeof magic);
+
+  if (compressed && magic[0] == 0x1f && magic[1] == 0x8b) {
+#ifdef HAVE_ZLIB
+    r = scan_gzip (st, fd, path);
+#else
+    return zgrep_external (st, fd, regexes, extended, fixed, insensitive);
+#endif
+  }
+  else if (compressed && memcmp (magic, "\xfd" "7zXZ\0", 6) == 0) {
+#ifdef HAVE_LIBLZMA
+    r = scan_xz (st, fd, path);
+#else
+    return zgrep_external (st, fd, regexes, extended, fixed, insensitive);
+#endif
+  }
+  else if (compressed && magic[0] == 0x1f &&
+           (magic[1] == 0x9d || magic[1] == 0x1e || magic[1] == 0xa0))
+    /* compress, pack and lzh */
+    return zgrep_external (st, fd, regexes, extended, fixed, insensitive);
+  else
+    r = scan_fd (st, fd, path);
+
+  close (fd);
+
+  if (r == -1)
+    return -1;
+
+  return scan_end (st);
+}
+
+static char **
+grep (char *const *regexes, char *const *paths, int with_filename,
+      int extended, int fixed, int insensitive, int compressed)
+{
+  DECLARE_STRINGSBUF (ret);
+  struct matcher m;
+  struct grep_state st;
+  size_t i;
+
+  if (extended && fixed) {
+    reply_with_error ("can't use 'extended' and 'fixed' flags at the same time");
     return NULL;
   }
 
-  lines = split_lines (out);
-  if (lines == NULL) return NULL;
+  if (compile_matcher (&m, regexes, extended, fixed, insensitive) == -1)
+    return NULL;
+
+  memset (&st, 0, sizeof st);
+  st.m = &m;
+  st.ret = &ret;
+
+  for (i = 0; paths[i] != NULL; ++i) {
+    CLEANUP_FREE char *prefix = NULL;
+
+    if (with_filename) {
+      if (asprintf (&prefix, "%s:", paths[i]) == -1) {
+        reply_with_perror ("asprintf");
+        goto error;
+      }
+      st.prefix = prefix;
+    }
+
+    if (grep_file (&st, paths[i], regexes,
+                   extended, fixed, insensitive, compressed) == -1)
+      goto error;
+  }
+
+  free_matcher (&m);
+  free (st.partial);
 
-  return lines;
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return ret.argv;              /* caller frees */
+
+ error:
+  free_matcher (&m);
+  free (st.partial);
+  if (ret.argv)
+    free_stringslen (ret.argv, ret.size);
+  return NULL;
+}
+
+static char **
+grep1 (const char *regex, const char *path,
+       int extended, int fixed, int insensitive, int compressed)
+{
+  char *regexes[] = { (char *) regex, NULL };
+  char *paths[] = { (char *) path, NULL };
+
+  return grep (regexes, paths, 0, extended, fixed, insensitive, compressed);
 }
 
 /* Takes optional arguments, consult optargs_bitmask. */
@@ -101,71 +656,102 @@ do_grep (const char *regex, const char *path,
   if (!(optargs_bitmask & GUESTFS_GREP_COMPRESSED_BITMASK))
     compressed = 0;
 
-  return grep (regex, path, extended, fixed, insensitive, compressed);
+  return grep1 (regex, path, extended, fixed, insensitive, compressed);
+}
+
+/* Takes optional arguments, consult optargs_bitmask. */
+char **
+do_grep_files (char *const *regexes, char *const *paths,
+               int extended, int fixed, int insensitive, int compressed)
+{
+  size_t i;
+
+  if (!(optargs_bitmask & GUESTFS_GREP_FILES_EXTENDED_BITMASK))
+    extended = 0;
+  if (!(optargs_bitmask & GUESTFS_GREP_FILES_FIXED_BITMASK))
+    fixed = 0;
+  if (!(optargs_bitmask & GUESTFS_GREP_FILES_INSENSITIVE_BITMASK))
+    insensitive = 0;
+  if (!(optargs_bitmask & GUESTFS_GREP_FILES_COMPRESSED_BITMASK))
+    compressed = 0;
+
+  if (regexes[0] == NULL) {
+    reply_with_error ("list of regular expressions is empty");
+    return NULL;
+  }
+
+  for (i = 0; paths[i] != NULL; ++i) {
+    if (paths[i][0] != '/') {
+      reply_with_error ("%s: path must start with a / character", paths[i]);
+      return NULL;
+    }
+  }
+
+  return grep (regexes, paths, 1, extended, fixed, insensitive, compressed);
 }
 
 char **
 do_egrep (const char *regex, const char *path)
 {
-  return grep (regex, path, 1, 0, 0, 0);
+  return grep1 (regex, path, 1, 0, 0, 0);
 }
 
 char **
 do_fgrep (const char *regex, const char *path)
 {
-  return grep (regex, path, 0, 1, 0, 0);
+  return grep1 (regex, path, 0, 1, 0, 0);
 }
 
 char **
 do_grepi (const char *regex, const char *path)
 {
-  return grep (regex, path, 0, 0, 1, 0);
+  return grep1 (regex, path, 0, 0, 1, 0);
 }
 
 char **
 do_egrepi (const char *regex, const char *path)
 {
-  return grep (regex, path, 1, 0, 1, 0);
+  return grep1 (regex, path, 1, 0, 1, 0);
 }
 
 char **
 do_fgrepi (const char *regex, const char *path)
 {
-  return grep (regex, path, 0, 1, 1, 0);
+  return grep1 (regex, path, 0, 1, 1, 0);
 }
 
 char **
 do_zgrep (const char *regex, const char *path)
 {
-  return grep (regex, path, 0, 0, 0, 1);
+  return grep1 (regex, path, 0, 0, 0, 1);
 }
 
 char **
 do_zegrep (const char *regex, const char *path)
 {
-  return grep (regex, path, 1, 0, 0, 1);
+  return grep1 (regex, path, 1, 0, 0, 1);
 }
 
 char **
 do_zfgrep (const char *regex, const char *path)
 {
-  return grep (regex, path, 0, 1, 0, 1);
+  return grep1 (regex, path, 0, 1, 0, 1);
 }
 
 char **
 do_zgrepi (const char *regex, const char *path)
 {
-  return grep (regex, path, 0, 0, 1, 1);
+  return grep1 (regex, path, 0, 0, 1, 1);
 }
 
 char **
 do_zegrepi (const char *regex, const char *path)
 {
-  return grep (regex, path, 1, 0, 1, 1);
+  return grep1 (regex, path, 1, 0, 1, 1);
 }
 
 char **
 do_zfgrepi (const char *regex, const char *path)
 {
-  return grep (regex, path, 0, 1, 1, 1);
+  return grep1 (regex, path, 0, 1, 1, 1);
 }
@@ -36,12 +36,19 @@
 #include <signal.h>
 #include <netdb.h>
 #include <sys/select.h>
+#include <poll.h>
+#include <spawn.h>
 #include <sys/wait.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <errno.h>
 #include <assert.h>
 #include <termios.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+#include <linux/vm_sockets.h>
+#endif
 
 #ifdef HAVE_PRINTF_H
 # include <printf.h>
@@ -54,7 +61,6 @@
 
 #include "daemon.h"
 
-GUESTFSD_EXT_CMD(str_udevadm, udevadm);
 
 static char *read_cmdline (void);
 
@@ -81,6 +87,7 @@ int verbose = 0;
 int enable_network = 0;
 
 static void makeraw (const char *channel, int fd);
+static int connect_vsock (unsigned int port);
 static int print_shell_quote (FILE *stream, const struct printf_info *info, const void *const *args);
 static int print_sysroot_shell_quote (FILE *stream, const struct printf_info *info, const void *const *args);
 #ifdef HAVE_REGISTER_PRINTF_SPECIFIER
@@ -266,8 +273,23 @@ main (int argc, char *argv[])
    */
   copy_lvm ();
 
-  /* Connect to virtio-serial channel. */
+  int sock;
   char *channel, *p;
+
+  /* Connect back to the library over virtio-vsock? */
+  if (cmdline && (p = strstr (cmdline, "guestfs_vsock=")) != NULL) {
+    unsigned int port;
+
+    if (sscanf (p + 14, "%u", &port) != 1) {
+      fprintf (stderr, "guestfsd: cannot parse guestfs_vsock parameter\n");
+      exit (EXIT_FAILURE);
+    }
+    sock = connect_vsock (port);
+    free (cmdline);
+    goto connected;
+  }
+
+  /* Connect to virtio-serial channel. */
   if (cmdline && (p = strstr (cmdline, "guestfs_channel=")) != NULL) {
     p += 16;
     channel = strndup (p, strcspn (p, " \n"));
@@ -282,7 +304,7 @@ main (int argc, char *argv[])
   if (verbose)
     printf ("trying to open virtio-serial channel '%s'\n", channel);
 
-  int sock = open (channel, O_RDWR|O_CLOEXEC);
+  sock = open (channel, O_RDWR|O_CLOEXEC);
   if (sock == -1) {
     fprintf (stderr,
              "\n"
@@ -311,6 +333,7 @@ main (int argc, char *argv[])
   free (cmdline);
   free (channel);
 
+ connected:
   /* Wait for udev devices to be created.  If you start libguestfs,
    * especially with disks that contain complex (eg. mdadm) data
    * already, then it is possible for the 'mdadm' and LVM commands
@@ -320,8 +343,11 @@ main (int argc, char *argv[])
    * udev_settle, but do it as late as possible to minimize the chance
    * that we'll have to do any waiting here.
    */
+  udev_monitor_init ();
   udev_settle ();
 
+  boot_milestone ("daemon_ready");
+
   /* Send the magic length message which indicates that
    * userspace is up inside the guest.
    */
@@ -393,6 +419,52 @@ read_cmdline (void)
   return r;
 }
 
+/* Connect to the library on the host over virtio-vsock.  The library
+ * only passes guestfs_vsock if it is listening, so any failure here
+ * is fatal.
+ */
+static int
+connect_vsock (unsigned int port)
+{
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+  struct sockaddr_vm addr;
+  int sock;
+
+  if (verbose)
+    printf ("trying to connect to virtio-vsock port %u\n", port);
+
+  sock = socket (AF_VSOCK, SOCK_STREAM|SOCK_CLOEXEC, 0);
+  if (sock == -1) {
+    perror ("socket: AF_VSOCK");
+    exit (EXIT_FAILURE);
+  }
+
+  memset (&addr, 0, sizeof addr);
+  addr.svm_family = AF_VSOCK;
+  addr.svm_cid = VMADDR_CID_HOST;
+  addr.svm_port = port;
+
+  if (connect (sock, (struct sockaddr *) &addr, sizeof addr) == -1) {
+    fprintf (stderr,
+             "\n"
+             "Failed to connect to the library over virtio-vsock.\n"
+             "\n"
+             "This is a fatal error and the appliance will now exit.\n"
+             "\n"
+             "You can make libguestfs use virtio-serial instead by setting\n"
+             "LIBGUESTFS_BACKEND_SETTINGS=novsock\n"
+             "\n");
+    perror ("connect: AF_VSOCK");
+    exit (EXIT_FAILURE);
+  }
+
+  return sock;
+#else
+  fprintf (stderr, "guestfsd: virtio-vsock is not supported by this daemon\n");
+  exit (EXIT_FAILURE);
+#endif
+}
+
 /* Try to make the socket raw, but don't fail if it's not possible. */
 static void
 makeraw (const char *channel, int fd)
@@ -816,49 +888,150 @@ commandvf (char **stdoutput, char **stderror, int flags,
     return -1;
 }
 
-/* This is a more sane version of 'system(3)' for running external
- * commands.  It uses fork/execvp, so we don't need to worry about
- * quoting of parameters, and it allows us to capture any error
- * messages in a buffer.
- *
- * If stdoutput is not NULL, then *stdoutput will return the stdout
- * of the command.
- *
- * If stderror is not NULL, then *stderror will return the stderr
- * of the command.  If there is a final \n character, it is removed
- * so you can use the error string directly in a call to
- * reply_with_error.
- *
- * Flags:
- *
- * COMMAND_FLAG_FOLD_STDOUT_ON_STDERR: For broken external commands
- * that send error messages to stdout (hello, parted) but that don't
- * have any useful stdout information, use this flag to capture the
- * error messages in the *stderror buffer.  If using this flag,
- * you should pass stdoutput as NULL because nothing could ever be
- * captured in that buffer.
+/* Output of a command, in a buffer which grows geometrically so that
+ * commands producing megabytes of output don't cause quadratic
+ * copying.
+ */
+struct command_buffer {
+  char *data;
+  size_t len;
+  size_t alloc;
+};
+
+/* Make sure there is space for at least 'n' more bytes. */
+static int
+reserve_command_buffer (struct command_buffer *b, size_t n)
+{
+  size_t alloc;
+  char *p;
+
+  if (b->alloc - b->len >= n)
+    return 0;
+
+  alloc = b->alloc > 0 ? b->alloc : 16384;
+  while (alloc - b->len < n)
+    alloc *= 2;
+
+  p = realloc (b->data, alloc);
+  if (p == NULL) {
+    perror ("realloc");
+    return -1;
+  }
+  b->data = p;
+  b->alloc = alloc;
+  return 0;
+}
+
+/* Read what is available on 'fd' into the buffer.  Returns the
+ * number of bytes read, 0 on EOF or -1 on error.
+ */
+static ssize_t
+read_command_buffer (int fd, struct command_buffer *b, size_t maxlen)
+{
+  ssize_t r;
+
+  if (reserve_command_buffer (b, maxlen) == -1)
+    return -1;
+
+  do {
+    r = read (fd, b->data + b->len, maxlen);
+  } while (r == -1 && errno == EINTR);
+  if (r == -1) {
+    perror ("read");
+    return -1;
+  }
+  b->len += r;
+  return r;
+}
+
+/* Terminate the buffer with \0 and hand it over to the caller. */
+static char *
+finish_command_buffer (struct command_buffer *b)
+{
+  char *ret;
+
+  if (reserve_command_buffer (b, 1) == -1) {
+    free (b->data);
+    b->data = NULL;
+    return NULL;
+  }
+  b->data[b->len] = '\0';
+  ret = b->data;
+  b->data = NULL;
+  return ret;
+}
+
+/* Start the command with posix_spawnp.  This is much cheaper than
+ * forking the daemon, since the daemon's address space doesn't have
+ * to be duplicated.  The pipes are created close-on-exec and the
+ * file actions only dup them on to the standard fds, so nothing else
+ * leaks into the child.
  *
- * COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN: For running external
- * commands on chrooted files correctly (see RHBZ#579608) specifying
- * this flag causes another process to be forked which chroots into
- * sysroot and just copies the input file to stdin of the specified
- * command.  The file descriptor is ORed with the flags, and that file
- * descriptor is always closed by this function.  See hexdump.c for an
- * example of usage.
+ * Returns the pid, or -1 with errno set.
  */
-int
-commandrvf (char **stdoutput, char **stderror, int flags,
-            char const* const *argv)
+static pid_t
+spawn_command (int flags, char const* const *argv, int so_fd, int se_fd)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t sigs;
+  pid_t pid;
+  int r;
+
+  posix_spawn_file_actions_init (&actions);
+  posix_spawnattr_init (&attr);
+
+  if (flags & COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN)
+    posix_spawn_file_actions_adddup2 (&actions, flags & COMMAND_FLAG_FD_MASK,
+                                      STDIN_FILENO);
+  else
+    posix_spawn_file_actions_addopen (&actions, STDIN_FILENO,
+                                      "/dev/null", O_RDONLY, 0);
+  if (!(flags & COMMAND_FLAG_FOLD_STDOUT_ON_STDERR))
+    posix_spawn_file_actions_adddup2 (&actions, so_fd, STDOUT_FILENO);
+  else
+    posix_spawn_file_actions_adddup2 (&actions, se_fd, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2 (&actions, se_fd, STDERR_FILENO);
+
+  /* The daemon ignores SIGPIPE, restore the default in the command. */
+  sigemptyset (&sigs);
+  sigaddset (&sigs, SIGALRM);
+  sigaddset (&sigs, SIGPIPE);
+  posix_spawnattr_setsigdefault (&attr, &sigs);
+  sigemptyset (&sigs);
+  posix_spawnattr_setsigmask (&attr, &sigs);
+  posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGDEF|POSIX_SPAWN_SETSIGMASK);
+
+  /* The daemon's current directory is always "/" (see main), so the
+   * command inherits that.
+   */
+  r = posix_spawnp (&pid, argv[0], &actions, &attr,
+                    (char *const *) argv, environ);
+
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+
+  if (r != 0) {
+    errno = r;
+    return -1;
+  }
+  return pid;
+}
+
+static int
+run_command (char **stdoutput,
+             command_output_cb cb, void *opaque,
+             char **stderror, int flags, char const* const *argv)
 {
-  size_t so_size = 0, se_size = 0;
+  struct command_buffer so = { .data = NULL }, se = { .data = NULL };
   int so_fd[2], se_fd[2];
   int flag_copy_stdin = flags & COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN;
   int flag_copy_fd = flags & COMMAND_FLAG_FD_MASK;
+  /* Collect stdout if the caller wants it, or to form chunks. */
+  int want_stdout = stdoutput != NULL || cb != NULL;
   pid_t pid;
-  int r, quit, i;
-  fd_set rset, rset2;
-  char buf[256];
-  char *p;
+  int r, i, ret = -1;
+  struct pollfd fds[2];
 
   if (stdoutput) *stdoutput = NULL;
   if (stderror) *stderror = NULL;
@@ -870,187 +1043,212 @@ commandrvf (char **stdoutput, char **stderror, int flags,
     printf ("\n");
   }
 
-  /* Note: abort is used in a few places along the error paths early
-   * in this function.  This is because (a) cleaning up correctly is
-   * very complex at these places and (b) abort is used when a
-   * resource problems is indicated which would be due to much more
-   * serious issues - eg. memory or file descriptor leaks.  We
-   * wouldn't expect fork(2) or pipe(2) to fail in normal
-   * circumstances.
+  /* Note: abort is used if pipe(2) fails.  This would indicate a much
+   * more serious issue such as a file descriptor leak.
    */
-
-  if (pipe (so_fd) == -1 || pipe (se_fd) == -1) {
-    error (0, errno, "pipe");
+  if (pipe2 (so_fd, O_CLOEXEC) == -1 || pipe2 (se_fd, O_CLOEXEC) == -1) {
+    error (0, errno, "pipe2");
     abort ();
   }
 
-  pid = fork ();
+  pid = spawn_command (flags, argv, so_fd[PIPE_WRITE], se_fd[PIPE_WRITE]);
+  close (so_fd[PIPE_WRITE]);
+  close (se_fd[PIPE_WRITE]);
+  if (flag_copy_stdin && close (flag_copy_fd) == -1)
+    perror ("close");
+
   if (pid == -1) {
-    error (0, errno, "fork");
-    abort ();
-  }
+    /* Report the error the same way the shell would. */
+    int err = errno;
 
-  if (pid == 0) {		/* Child process running the command. */
-    signal (SIGALRM, SIG_DFL);
-    signal (SIGPIPE, SIG_DFL);
-    close (0);
-    if (flag_copy_stdin) {
-      dup2 (flag_copy_fd, STDIN_FILENO);
-    } else {
-      /* Set stdin to /dev/null (ignore failure) */
-      ignore_value (open ("/dev/null", O_RDONLY|O_CLOEXEC));
-    }
     close (so_fd[PIPE_READ]);
     close (se_fd[PIPE_READ]);
-    if (!(flags & COMMAND_FLAG_FOLD_STDOUT_ON_STDERR))
-      dup2 (so_fd[PIPE_WRITE], STDOUT_FILENO);
-    else
-      dup2 (se_fd[PIPE_WRITE], STDOUT_FILENO);
-    dup2 (se_fd[PIPE_WRITE], STDERR_FILENO);
-    close (so_fd[PIPE_WRITE]);
-    close (se_fd[PIPE_WRITE]);
-
-    ignore_value (chdir ("/"));
-
-    execvp (argv[0], (void *) argv);
-    perror (argv[0]);
-    _exit (EXIT_FAILURE);
+    fprintf (stderr, "%s: %s\n", argv[0], strerror (err));
+    if (stderror) {
+      if (asprintf (stderror, "%s: %s", argv[0], strerror (err)) == -1)
+        *stderror = NULL;
+    }
+    return -1;
   }
 
-  /* Parent process. */
-  close (so_fd[PIPE_WRITE]);
-  close (se_fd[PIPE_WRITE]);
-
-  FD_ZERO (&rset);
-  FD_SET (so_fd[PIPE_READ], &rset);
-  FD_SET (se_fd[PIPE_READ], &rset);
+  fds[0].fd = so_fd[PIPE_READ];
+  fds[0].events = POLLIN;
+  fds[1].fd = se_fd[PIPE_READ];
+  fds[1].events = POLLIN;
 
-  quit = 0;
-  while (quit < 2) {
-  again:
-    rset2 = rset;
-    r = select (MAX (so_fd[PIPE_READ], se_fd[PIPE_READ]) + 1, &rset2,
-                NULL, NULL, NULL);
+  while (fds[0].fd >= 0 || fds[1].fd >= 0) {
+    fds[0].revents = fds[1].revents = 0;
+    r = poll (fds, 2, -1);
     if (r == -1) {
       if (errno == EINTR)
-        goto again;
-
-      perror ("select");
-    quit:
-      if (stdoutput) {
-        free (*stdoutput);
-        *stdoutput = NULL;
-      }
-      if (stderror) {
-        free (*stderror);
-        /* Need to return non-NULL *stderror here since most callers
-         * will try to print and then free the err string.
-         * Unfortunately recovery from strdup failure here is not
-         * possible.
-         */
-        *stderror = strdup ("error running external command, "
-                            "see debug output for details");
-      }
-      close (so_fd[PIPE_READ]);
-      close (se_fd[PIPE_READ]);
-      if (flag_copy_stdin) close (flag_copy_fd);
-      waitpid (pid, NULL, 0);
-      return -1;
+        continue;
+      perror ("poll");
+      goto quit;
     }
 
-    if (FD_ISSET (so_fd[PIPE_READ], &rset2)) { /* something on stdout */
-      r = read (so_fd[PIPE_READ], buf, sizeof buf);
-      if (r == -1) {
-        perror ("read");
+    if (fds[0].revents != 0) { /* something on stdout */
+      ssize_t n;
+
+      if (want_stdout)
+        n = read_command_buffer (fds[0].fd, &so,
+                                 cb ? GUESTFS_MAX_CHUNK_SIZE - so.len : BUFSIZ * 8);
+      else {
+        /* Nobody wants it, but it must be drained. */
+        char buf[BUFSIZ];
+        do {
+          n = read (fds[0].fd, buf, sizeof buf);
+        } while (n == -1 && errno == EINTR);
+        if (n == -1)
+          perror ("read");
+      }
+      if (n == -1)
         goto quit;
+      if (n == 0) {
+        close (fds[0].fd);
+        fds[0].fd = -1;
       }
-      if (r == 0) { FD_CLR (so_fd[PIPE_READ], &rset); quit++; }
 
-      if (r > 0 && stdoutput) {
-        so_size += r;
-        p = realloc (*stdoutput, so_size);
-        if (p == NULL) {
-          perror ("realloc");
+      /* In streaming mode, pass on full chunks, and whatever is left
+       * at the end.
+       */
+      if (cb && so.len > 0 &&
+          (so.len == GUESTFS_MAX_CHUNK_SIZE || fds[0].fd == -1)) {
+        r = cb (opaque, so.data, so.len);
+        so.len = 0;
+        if (r < 0) {
+          ret = r;
+          kill (pid, SIGTERM);
           goto quit;
         }
-        *stdoutput = p;
-        memcpy (*stdoutput + so_size - r, buf, r);
       }
     }
 
-    if (FD_ISSET (se_fd[PIPE_READ], &rset2)) { /* something on stderr */
-      r = read (se_fd[PIPE_READ], buf, sizeof buf);
-      if (r == -1) {
-        perror ("read");
+    if (fds[1].revents != 0) { /* something on stderr */
+      size_t old_len = se.len;
+      ssize_t n = read_command_buffer (fds[1].fd, &se, BUFSIZ);
+
+      if (n == -1)
         goto quit;
+      if (n == 0) {
+        close (fds[1].fd);
+        fds[1].fd = -1;
       }
-      if (r == 0) { FD_CLR (se_fd[PIPE_READ], &rset); quit++; }
-
-      if (r > 0) {
-        if (verbose)
-          ignore_value (write (STDERR_FILENO, buf, r));
-
-        if (stderror) {
-          se_size += r;
-          p = realloc (*stderror, se_size);
-          if (p == NULL) {
-            perror ("realloc");
-            goto quit;
-          }
-          *stderror = p;
-          memcpy (*stderror + se_size - r, buf, r);
-        }
-      }
+      else if (verbose)
+        ignore_value (write (STDERR_FILENO, se.data + old_len, n));
+      /* Don't keep stderr if the caller doesn't want it. */
+      if (!stderror)
+        se.len = 0;
     }
   }
 
-  close (so_fd[PIPE_READ]);
-  close (se_fd[PIPE_READ]);
+  /* Get the exit status of the command. */
+  if (waitpid (pid, &r, 0) != pid) {
+    perror ("waitpid");
+    free (so.data);
+    free (se.data);
+    return -1;
+  }
 
   /* Make sure the output buffers are \0-terminated.  Also remove any
    * trailing \n characters from the error buffer (not from stdout).
    */
   if (stdoutput) {
-    void *q = realloc (*stdoutput, so_size+1);
-    if (q == NULL) {
-      perror ("realloc");
-      free (*stdoutput);
+    *stdoutput = finish_command_buffer (&so);
+    if (*stdoutput == NULL) {
+      free (se.data);
+      return -1;
     }
-    *stdoutput = q;
-    if (*stdoutput)
-      (*stdoutput)[so_size] = '\0';
   }
+  free (so.data);
   if (stderror) {
-    void *q = realloc (*stderror, se_size+1);
-    if (q == NULL) {
-      perror ("realloc");
-      free (*stderror);
-    }
-    *stderror = q;
-    if (*stderror) {
-      (*stderror)[se_size] = '\0';
-      while (se_size > 0 && (*stderror)[se_size-1] == '\n') {
-        se_size--;
-        (*stderror)[se_size] = '\0';
+    while (se.len > 0 && se.data[se.len-1] == '\n')
+      se.len--;
+    *stderror = finish_command_buffer (&se);
+    if (*stderror == NULL) {
+      if (stdoutput) {
+        free (*stdoutput);
+        *stdoutput = NULL;
       }
+      return -1;
     }
   }
+  free (se.data);
 
-  if (flag_copy_stdin && close (flag_copy_fd) == -1) {
-    perror ("close");
+  if (WIFEXITED (r))
+    return WEXITSTATUS (r);
+  else
     return -1;
-  }
 
-  /* Get the exit status of the command. */
-  if (waitpid (pid, &r, 0) != pid) {
-    perror ("waitpid");
-    return -1;
+ quit:
+  if (fds[0].fd >= 0)
+    close (fds[0].fd);
+  if (fds[1].fd >= 0)
+    close (fds[1].fd);
+  free (so.data);
+  free (se.data);
+  if (stderror) {
+    /* Need to return non-NULL *stderror here since most callers
+     * will try to print and then free the err string.
+     * Unfortunately recovery from strdup failure here is not
+     * possible.
+     */
+    *stderror = strdup ("error running external command, "
+                        "see debug output for details");
   }
+  waitpid (pid, NULL, 0);
+  return ret;
+}
 
-  if (WIFEXITED (r)) {
-    return WEXITSTATUS (r);
-  } else
-    return -1;
+/* This is a more sane version of 'system(3)' for running external
+ * commands.  It uses posix_spawnp, so we don't need to worry about
+ * quoting of parameters, and it allows us to capture any error
+ * messages in a buffer.
+ *
+ * If stdoutput is not NULL, then *stdoutput will return the stdout
+ * of the command.
+ *
+ * If stderror is not NULL, then *stderror will return the stderr
+ * of the command.  If there is a final \n character, it is removed
+ * so you can use the error string directly in a call to
+ * reply_with_error.
+ *
+ * Flags:
+ *
+ * COMMAND_FLAG_FOLD_STDOUT_ON_STDERR: For broken external commands
+ * that send error messages to stdout (hello, parted) but that don't
+ * have any useful stdout information, use this flag to capture the
+ * error messages in the *stderror buffer.  If using this flag,
+ * you should pass stdoutput as NULL because nothing could ever be
+ * captured in that buffer.
+ *
+ * COMMAND_FLAG_CHROOT_COPY_FILE_TO_STDIN: For running external
+ * commands on chrooted files correctly (see RHBZ#579608) specifying
+ * this flag causes another process to be forked which chroots into
+ * sysroot and just copies the input file to stdin of the specified
+ * command.  The file descriptor is ORed with the flags, and that file
+ * descriptor is always closed by this function.  See hexdump.c for an
+ * example of usage.
+ */
+int
+commandrvf (char **stdoutput, char **stderror, int flags,
+            char const* const *argv)
+{
+  return run_command (stdoutput, NULL, NULL, stderror, flags, argv);
+}
+
+/* Same as 'commandrvf', but instead of collecting stdout in a buffer,
+ * it is passed to 'cb' in blocks of up to GUESTFS_MAX_CHUNK_SIZE
+ * bytes as the command produces it.  This is intended for FileOut
+ * functions, which can pass the output straight to send_file_write.
+ *
+ * If the callback returns < 0, the command is killed and the
+ * callback's return value is returned.
+ */
+int
+commandrvf_stream (command_output_cb cb, void *opaque, char **stderror,
+                   int flags, char const* const *argv)
+{
+  return run_command (NULL, cb, opaque, stderror, flags, argv);
 }
 
 /* Split an output string into a NULL-terminated list of lines.
@@ -1214,6 +1412,8 @@ device_name_translation (const char *device)
   int fd;
   char *ret;
 
+  udev_settle_pending ();
+
   fd = open (device, O_RDONLY|O_CLOEXEC);
   if (fd >= 0) {
     close (fd);
@@ -1424,20 +1624,6 @@ random_name (char *template)
   return 0;
 }
 
-/* LVM and other commands aren't synchronous, especially when udev is
- * involved.  eg. You can create or remove some device, but the /dev
- * device node won't appear until some time later.  This means that
- * you get an error if you run one command followed by another.
- *
- * Use 'udevadm settle' after certain commands, but don't be too
- * fussed if it fails.
- */
-void
-udev_settle (void)
-{
-  (void) command (NULL, NULL, str_udevadm, "settle", NULL);
-}
-
 /* Use by the CLEANUP_* macros.  Do not call these directly. */
 void
 cleanup_free (void *ptr)
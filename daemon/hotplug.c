@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
@@ -30,6 +31,7 @@
 
 #define HOT_ADD_TIMEOUT 30 /* seconds */
 #define HOT_REMOVE_TIMEOUT HOT_ADD_TIMEOUT
+#define HOTPLUG_POLL_INTERVAL 100000 /* microseconds */
 
 static void
 hotplug_error (const char *op, const char *path, const char *verb,
@@ -41,54 +43,81 @@ hotplug_error (const char *op, const char *path, const char *verb,
                     op, path, verb, timeout);
 }
 
-/* Wait for /dev/disk/guestfs/<label> to appear.  Timeout (and error)
- * if it doesn't appear after a reasonable length of time.
+/* Wait until /dev/disk/guestfs/<label> exists (if 'appear') or
+ * doesn't exist (if '!appear') for every label.  Timeout (and error)
+ * if that doesn't happen after a reasonable length of time.  All the
+ * labels are checked together, so hotplugging several drives costs
+ * the same as one.
  */
-int
-do_internal_hot_add_drive (const char *label)
+static int
+wait_for_labels (char *const *labels, int appear)
 {
   time_t start_t, now_t;
-  size_t len = strlen (label);
-  char path[len+64];
+  const int timeout = appear ? HOT_ADD_TIMEOUT : HOT_REMOVE_TIMEOUT;
+  size_t i;
   int r;
 
-  snprintf (path, len+64, "/dev/disk/guestfs/%s", label);
-
   time (&start_t);
 
-  while (time (&now_t) - start_t <= HOT_ADD_TIMEOUT) {
-    udev_settle ();
+  for (i = 0; labels[i] != NULL; ) {
+    size_t len = strlen (labels[i]);
+    char path[len+64];
+
+    snprintf (path, len+64, "/dev/disk/guestfs/%s", labels[i]);
 
     r = access (path, F_OK);
     if (r == -1 && errno != ENOENT) {
       reply_with_perror ("%s", path);
       return -1;
     }
-    if (r == 0)
-      return 0;
+    if ((r == 0) == appear) {
+      /* This one is done, go on to the next label. */
+      i++;
+      continue;
+    }
+
+    if (time (&now_t) - start_t > timeout) {
+      hotplug_error (appear ? "hot-add" : "hot-remove", path,
+                     appear ? "appear" : "disappear", timeout);
+      return -1;
+    }
 
-    sleep (1);
+    /* udev_settle returns as soon as udev has processed the events
+     * which have happened, so only sleep if there were none.
+     */
+    udev_settle ();
+    r = access (path, F_OK);
+    if ((r == 0) != appear)
+      usleep (HOTPLUG_POLL_INTERVAL);
   }
 
-  hotplug_error ("hot-add", path, "appear", HOT_ADD_TIMEOUT);
-  return -1;
+  return 0;
 }
 
-GUESTFSD_EXT_CMD(str_fuser, fuser);
+int
+do_internal_hot_add_drive (const char *label)
+{
+  char *labels[] = { (char *) label, NULL };
+
+  return wait_for_labels (labels, 1);
+}
 
-/* This function is called before a drive is hot-unplugged. */
 int
-do_internal_hot_remove_drive_precheck (const char *label)
+do_internal_hot_add_drives (char *const *labels)
+{
+  return wait_for_labels (labels, 1);
+}
+
+GUESTFSD_EXT_CMD(str_fuser, fuser);
+
+static int
+check_not_in_use (const char *label)
 {
   size_t len = strlen (label);
   char path[len+64];
   int r;
   CLEANUP_FREE char *out = NULL, *err = NULL;
 
-  /* Ensure there are no requests in flight (thanks Paolo Bonzini). */
-  udev_settle ();
-  sync_disks ();
-
   snprintf (path, len+64, "/dev/disk/guestfs/%s", label);
 
   r = commandr (&out, &err, str_fuser, "-v", "-m", path, NULL);
@@ -115,39 +144,51 @@ do_internal_hot_remove_drive_precheck (const char *label)
   return 0;
 }
 
-/* This function is called after a drive is hot-unplugged.  It checks
- * that it has really gone and udev has finished processing the
- * events, in case the user immediately hotplugs a drive with an
- * identical label.
- */
+/* This function is called before drives are hot-unplugged. */
 int
-do_internal_hot_remove_drive (const char *label)
+do_internal_hot_remove_drives_precheck (char *const *labels)
 {
-  time_t start_t, now_t;
-  size_t len = strlen (label);
-  char path[len+64];
-  int r;
+  size_t i;
 
-  snprintf (path, len+64, "/dev/disk/guestfs/%s", label);
+  /* Ensure there are no requests in flight (thanks Paolo Bonzini). */
+  udev_settle ();
+  sync_disks ();
 
-  time (&start_t);
+  for (i = 0; labels[i] != NULL; ++i) {
+    if (check_not_in_use (labels[i]) == -1)
+      return -1;
+  }
 
-  while (time (&now_t) - start_t <= HOT_REMOVE_TIMEOUT) {
-    udev_settle ();
+  return 0;
+}
 
-    r = access (path, F_OK);
-    if (r == -1) {
-      if (errno != ENOENT) {
-        reply_with_perror ("%s", path);
-        return -1;
-      }
-      /* else udev has removed the file, so we can return */
-      return 0;
-    }
+int
+do_internal_hot_remove_drive_precheck (const char *label)
+{
+  char *labels[] = { (char *) label, NULL };
 
-    sleep (1);
-  }
+  return do_internal_hot_remove_drives_precheck (labels);
+}
+
+/* This function is called after drives are hot-unplugged.  It checks
+ * that they have really gone and udev has finished processing the
+ * events, in case the user immediately hotplugs a drive with an
+ * identical label.
+ */
+int
+do_internal_hot_remove_drives (char *const *labels)
+{
+  if (wait_for_labels (labels, 0) == -1)
+    return -1;
+
+  udev_settle ();
+  return 0;
+}
+
+int
+do_internal_hot_remove_drive (const char *label)
+{
+  char *labels[] = { (char *) label, NULL };
 
-  hotplug_error ("hot-remove", path, "disappear", HOT_REMOVE_TIMEOUT);
-  return -1;
+  return do_internal_hot_remove_drives (labels);
 }
@@ -0,0 +1,178 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Run a list of independent jobs on a few worker threads, for calls
+ * which process several filesystems or devices at the same time (see
+ * probe.c and sparsify.c).
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "daemon.h"
+
+struct job_runner {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t next;                  /* Next job to be picked up. */
+  size_t nr_done;
+  size_t nr_jobs;
+  job_fn fn;
+  void *opaque;
+};
+
+static void *
+job_worker (void *runnervp)
+{
+  struct job_runner *runner = runnervp;
+  size_t i;
+
+  for (;;) {
+    pthread_mutex_lock (&runner->lock);
+    i = runner->next++;
+    pthread_mutex_unlock (&runner->lock);
+
+    if (i >= runner->nr_jobs)
+      break;
+
+    runner->fn (i, runner->opaque);
+
+    pthread_mutex_lock (&runner->lock);
+    runner->nr_done++;
+    pthread_cond_signal (&runner->cond);
+    pthread_mutex_unlock (&runner->lock);
+  }
+
+  return NULL;
+}
+
+/* Run 'fn (i, opaque)' for each job 'i' from 0 to 'nr_jobs'-1, using
+ * up to 'max_threads' threads.  Each thread takes the next job which
+ * hasn't been started, so a slow job doesn't hold up the others.
+ *
+ * 'fn' runs in a worker thread, so it must not call reply_with_* nor
+ * any of the command* functions.
+ *
+ * If 'progress' is not NULL, it is called in this thread about once
+ * a second, and after every job which finishes, until all the jobs
+ * are done.
+ */
+void
+run_jobs (size_t nr_jobs, size_t max_threads, job_fn fn, void *opaque,
+          void (*progress) (void *opaque))
+{
+  struct job_runner runner;
+  pthread_t *threads;
+  size_t i, nr_threads;
+  struct timespec ts;
+  int err;
+
+  memset (&runner, 0, sizeof runner);
+  runner.nr_jobs = nr_jobs;
+  runner.fn = fn;
+  runner.opaque = opaque;
+  pthread_mutex_init (&runner.lock, NULL);
+  pthread_cond_init (&runner.cond, NULL);
+
+  nr_threads = nr_jobs;
+  if (nr_threads > max_threads)
+    nr_threads = max_threads;
+
+  threads = malloc (nr_threads * sizeof (pthread_t));
+  if (threads == NULL)
+    nr_threads = 0;
+
+  for (i = 0; i < nr_threads; ++i) {
+    err = pthread_create (&threads[i], NULL, job_worker, &runner);
+    if (err != 0) {
+      /* Threads already running will complete the remaining jobs. */
+      fprintf (stderr, "pthread_create: %s\n", strerror (err));
+      break;
+    }
+  }
+  nr_threads = i;
+
+  /* If no thread could be started, do the work in this thread. */
+  if (nr_threads == 0)
+    job_worker (&runner);
+
+  if (progress) {
+    pthread_mutex_lock (&runner.lock);
+    while (runner.nr_done < runner.nr_jobs) {
+      clock_gettime (CLOCK_REALTIME, &ts);
+      ts.tv_sec++;
+      pthread_cond_timedwait (&runner.cond, &runner.lock, &ts);
+      pthread_mutex_unlock (&runner.lock);
+      progress (opaque);
+      pthread_mutex_lock (&runner.lock);
+    }
+    pthread_mutex_unlock (&runner.lock);
+  }
+
+  for (i = 0; i < nr_threads; ++i) {
+    err = pthread_join (threads[i], NULL);
+    if (err != 0)
+      fprintf (stderr, "pthread_join: %s\n", strerror (err));
+  }
+  free (threads);
+
+  pthread_cond_destroy (&runner.cond);
+  pthread_mutex_destroy (&runner.lock);
+}
+
+/* Create a private mountpoint, "/tmp/<prefix>.XXXXXX", in 'mp' which
+ * must have space for PRIVATE_MOUNTPOINT_LEN bytes.  These are used
+ * instead of the sysroot when several filesystems are mounted at the
+ * same time.  On error this calls reply_with_perror, leaves 'mp'
+ * empty and returns -1.
+ */
+int
+make_private_mountpoint (char *mp, const char *prefix)
+{
+  if ((size_t) snprintf (mp, PRIVATE_MOUNTPOINT_LEN, "/tmp/%s.XXXXXX",
+                         prefix) >= PRIVATE_MOUNTPOINT_LEN) {
+    reply_with_error ("%s: mountpoint prefix is too long", prefix);
+    mp[0] = '\0';
+    return -1;
+  }
+  if (mkdtemp (mp) == NULL) {
+    reply_with_perror ("mkdtemp");
+    mp[0] = '\0';
+    return -1;
+  }
+  return 0;
+}
+
+/* Remove a mountpoint made by make_private_mountpoint, if 'mp' is not
+ * empty, and make it empty.  The filesystem must be unmounted.
+ */
+void
+remove_private_mountpoint (char *mp)
+{
+  if (mp[0] == '\0')
+    return;
+  if (rmdir (mp) == -1)
+    perror (mp);
+  mp[0] = '\0';
+}
@@ -124,7 +124,7 @@ luks_open (const char *device, const char *key, const char *mapname,
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -159,7 +159,7 @@ do_luks_close (const char *device)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -199,7 +199,7 @@ luks_format (const char *device, const char *key, int keyslot,
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
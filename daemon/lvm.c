@@ -110,6 +110,8 @@ do_pvs (void)
   CLEANUP_FREE char *err = NULL;
   int r;
 
+  udev_settle_pending ();
+
   r = command (&out, &err,
                str_lvm, "pvs", "-o", "pv_name", "--noheadings", NULL);
   if (r == -1) {
@@ -128,6 +130,8 @@ do_vgs (void)
   CLEANUP_FREE char *err = NULL;
   int r;
 
+  udev_settle_pending ();
+
   r = command (&out, &err,
                str_lvm, "vgs", "-o", "vg_name", "--noheadings", NULL);
   if (r == -1) {
@@ -146,6 +150,8 @@ do_lvs (void)
   CLEANUP_FREE char *err = NULL;
   int r;
 
+  udev_settle_pending ();
+
   r = command (&out, &err,
                str_lvm, "lvs",
                "-o", "vg_name,lv_name", "--noheadings",
@@ -166,18 +172,21 @@ do_lvs (void)
 guestfs_int_lvm_pv_list *
 do_pvs_full (void)
 {
+  udev_settle_pending ();
   return parse_command_line_pvs ();
 }
 
 guestfs_int_lvm_vg_list *
 do_vgs_full (void)
 {
+  udev_settle_pending ();
   return parse_command_line_vgs ();
 }
 
 guestfs_int_lvm_lv_list *
 do_lvs_full (void)
 {
+  udev_settle_pending ();
   return parse_command_line_lvs ();
 }
 
@@ -194,7 +203,7 @@ do_pvcreate (const char *device)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -224,7 +233,7 @@ do_vgcreate (const char *volgroup, char *const *physvols)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -246,7 +255,7 @@ do_lvcreate (const char *logvol, const char *volgroup, int mbytes)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -273,7 +282,7 @@ do_lvcreate_free (const char *logvol, const char *volgroup, int percent)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -407,7 +416,7 @@ do_lvm_remove_all (void)
     }
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   /* There, that was easy, sorry about your data. */
   return 0;
@@ -426,7 +435,7 @@ do_lvremove (const char *device)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -444,7 +453,7 @@ do_vgremove (const char *device)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -462,7 +471,7 @@ do_pvremove (const char *device)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -531,7 +540,7 @@ do_vg_activate (int activate, char *const *volgroups)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -557,7 +566,7 @@ do_lvrename (const char *logvol, const char *newlogvol)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -576,7 +585,7 @@ do_vgrename (const char *volgroup, const char *newvolgroup)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -763,6 +772,8 @@ do_list_dm_devices (void)
   DIR *dir;
   int r;
 
+  udev_settle_pending ();
+
   dir = opendir ("/dev/mapper");
   if (!dir) {
     reply_with_perror ("opendir: /dev/mapper");
@@ -928,7 +939,7 @@ do_pvchange_uuid (const char *device)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -946,7 +957,7 @@ do_pvchange_uuid_all (void)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -964,7 +975,7 @@ do_vgchange_uuid (const char *vg)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -982,7 +993,7 @@ do_vgchange_uuid_all (void)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -172,7 +172,7 @@ do_md_create (const char *name, char *const *devices,
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -216,6 +216,8 @@ do_list_md_devices (void)
 
   memset (&mds, 0, sizeof mds);
 
+  udev_settle_pending ();
+
 #define PREFIX "/sys/block/md"
 #define SUFFIX "/md"
 
@@ -44,7 +44,9 @@ GUESTFSD_EXT_CMD(str_sgdisk, sgdisk);
  * wait for this rule to finish running (from a previous operation)
  * since it holds the device open.  Since parted also closes the block
  * device, it can cause udev to run again, hence the call to
- * udev_settle afterwards.
+ * udev_settle_later afterwards.  (The wait itself is deferred until
+ * the next command which uses a device, so a series of parted
+ * commands only waits once between each one.)
  */
 
 static const char *
@@ -93,7 +95,7 @@ do_part_init (const char *device, const char *parttype)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -147,7 +149,7 @@ do_part_add (const char *device, const char *prlogex,
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -175,7 +177,7 @@ do_part_del (const char *device, int partnum)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -219,7 +221,7 @@ do_part_disk (const char *device, const char *parttype)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -249,7 +251,7 @@ do_part_set_bootable (const char *device, int partnum, int bootable)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -278,7 +280,7 @@ do_part_set_name (const char *device, int partnum, const char *name)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -709,7 +711,7 @@ do_part_get_mbr_id (const char *device, int partnum)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   /* It's printed in hex ... */
   int id;
@@ -747,7 +749,7 @@ do_part_set_mbr_id (const char *device, int partnum, int idbyte)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -0,0 +1,384 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mount.h>
+
+#include "daemon.h"
+#include "actions.h"
+
+GUESTFSD_EXT_CMD(str_blkid, blkid);
+
+/* Maximum number of filesystems which are probed at the same time.
+ * The work is almost entirely I/O (mounting and reading directories),
+ * so this is not related to the number of vCPUs.
+ */
+#define MAX_PROBE_THREADS 8
+
+/* Prefix for probe paths which should be resolved case insensitively. */
+#define NOCASE_PREFIX "nocase:"
+
+/* One filesystem to probe. */
+struct probe_job {
+  char *device;                 /* NULL if this can't be probed. */
+  char *vfstype;
+  char *volume;                 /* btrfs subvolume, or NULL. */
+  char mp[PRIVATE_MOUNTPOINT_LEN]; /* Private mountpoint. */
+  char *fingerprint;            /* Result. */
+};
+
+struct probe_state {
+  size_t nr_jobs;
+  struct probe_job *jobs;
+  char *const *paths;
+  size_t nr_paths;
+};
+
+/* Maximum number of symlinks followed while resolving a probe path,
+ * the same as the kernel limit.
+ */
+#define MAX_SYMLINKS 40
+
+/* Find the entry in directory 'dir' (relative to 'rootfd') whose name
+ * matches 'name' ignoring case.  The real name is copied to 'name'.
+ */
+static int
+find_nocase (int rootfd, const char *dir, char *name)
+{
+  DIR *dirp;
+  struct dirent *d;
+  int fd, found = 0;
+
+  fd = openat (rootfd, dir, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  dirp = fdopendir (fd);
+  if (dirp == NULL) {
+    close (fd);
+    return -1;
+  }
+
+  while ((d = readdir (dirp)) != NULL) {
+    if (strcasecmp (d->d_name, name) == 0) {
+      strcpy (name, d->d_name);
+      found = 1;
+      break;
+    }
+  }
+  closedir (dirp);
+
+  return found ? 0 : -1;
+}
+
+/* Look up 'path' in the filesystem whose root directory is 'rootfd',
+ * as if the process was chrooted into it, and lstat the result.  The
+ * daemon can't chroot while several threads are probing, so symlinks
+ * in the intermediate components are followed by hand, and absolute
+ * symlinks are resolved relative to the guest root, not the
+ * appliance root.  'cur' is always a path relative to 'rootfd'
+ * containing only real directories.  If 'nocase' is true, each
+ * component is matched ignoring case.
+ */
+static int
+lookup_in_root (int rootfd, const char *path, int nocase,
+                struct stat *statbuf)
+{
+  char cur[PATH_MAX] = ".";
+  char rest[PATH_MAX], next[PATH_MAX], target[PATH_MAX];
+  char name[NAME_MAX+1];
+  const char *p;
+  size_t elen;
+  ssize_t r;
+  int links = 0;
+  struct stat st;
+
+  if (strlen (path) >= sizeof rest)
+    return -1;
+  strcpy (rest, path);
+
+  for (;;) {
+    p = rest;
+    while (*p == '/')
+      p++;
+    elen = strcspn (p, "/");
+    if (elen == 0)
+      /* The path refers to the last directory reached. */
+      return fstatat (rootfd, cur, statbuf, AT_SYMLINK_NOFOLLOW);
+    if (elen > NAME_MAX)
+      return -1;
+    memcpy (name, p, elen);
+    name[elen] = '\0';
+    p += elen;
+    while (*p == '/')
+      p++;
+    memmove (rest, p, strlen (p) + 1);
+
+    if (STREQ (name, "."))
+      continue;
+    if (STREQ (name, "..")) {
+      /* ".." of the guest root is the guest root. */
+      char *slash = strrchr (cur, '/');
+      if (slash)
+        *slash = '\0';
+      continue;
+    }
+
+    if (nocase && find_nocase (rootfd, cur, name) == -1)
+      return -1;
+
+    if ((size_t) snprintf (next, sizeof next, "%s/%s", cur, name)
+        >= sizeof next)
+      return -1;
+
+    if (fstatat (rootfd, next, &st, AT_SYMLINK_NOFOLLOW) == -1)
+      return -1;
+
+    /* The last component is not followed, as in guestfs_is_file. */
+    if (rest[0] == '\0') {
+      *statbuf = st;
+      return 0;
+    }
+
+    if (S_ISLNK (st.st_mode)) {
+      if (++links > MAX_SYMLINKS)
+        return -1;
+      r = readlinkat (rootfd, next, target, sizeof target);
+      if (r <= 0 || (size_t) r >= sizeof target)
+        return -1;
+      target[r] = '\0';
+      if ((size_t) snprintf (next, sizeof next, "%s/%s", target, rest)
+          >= sizeof next)
+        return -1;
+      strcpy (rest, next);
+      if (target[0] == '/')
+        strcpy (cur, ".");
+      continue;
+    }
+
+    if (!S_ISDIR (st.st_mode))
+      return -1;
+    strcpy (cur, next);
+  }
+}
+
+/* Return a single character describing the type of 'path'. */
+static char
+probe_path (int rootfd, const char *path)
+{
+  struct stat statbuf;
+  int nocase = 0;
+
+  if (STRPREFIX (path, NOCASE_PREFIX)) {
+    path += strlen (NOCASE_PREFIX);
+    nocase = 1;
+  }
+
+  if (lookup_in_root (rootfd, path, nocase, &statbuf) == -1)
+    return '-';
+  if (S_ISREG (statbuf.st_mode))
+    return 'f';
+  if (S_ISDIR (statbuf.st_mode))
+    return 'd';
+  if (S_ISLNK (statbuf.st_mode))
+    return 'l';
+  return 'o';
+}
+
+/* Mount the filesystem read-only, check each path, unmount it.  This
+ * runs in a worker thread (see run_jobs).
+ */
+static void
+probe_one (size_t n, void *statevp)
+{
+  static const char *ufs_options[] = { "ufstype=ufs2", "ufstype=44bsd", NULL };
+  struct probe_state *state = statevp;
+  struct probe_job *job = &state->jobs[n];
+  char *const *paths = state->paths;
+  size_t nr_paths = state->nr_paths;
+  CLEANUP_FREE char *subvol_option = NULL;
+  const char *options = NULL;
+  size_t i;
+  int r, rootfd;
+
+  if (job->device == NULL)
+    return;
+
+  if (job->volume) {
+    if (asprintf (&subvol_option, "subvol=%s", job->volume) == -1)
+      return;
+    options = subvol_option;
+  }
+
+  if (STREQ (job->vfstype, "ufs")) {
+    r = -1;
+    for (i = 0; r == -1 && ufs_options[i] != NULL; ++i)
+      r = mount (job->device, job->mp, job->vfstype, MS_RDONLY, ufs_options[i]);
+  }
+  else
+    r = mount (job->device, job->mp, job->vfstype, MS_RDONLY, options);
+  if (r == -1) {
+    if (verbose)
+      fprintf (stderr, "probe: mount: %s (%s): %m\n",
+               job->device, job->vfstype);
+    return;
+  }
+
+  rootfd = open (job->mp, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (rootfd == -1)
+    perror (job->mp);
+  else {
+    for (i = 0; i < nr_paths; ++i)
+      job->fingerprint[i] = probe_path (rootfd, paths[i]);
+    job->fingerprint[nr_paths] = '\0';
+    close (rootfd);
+  }
+
+  if (umount (job->mp) == -1) {
+    perror (job->mp);
+    if (umount2 (job->mp, MNT_DETACH) == -1)
+      perror (job->mp);
+  }
+}
+
+/* Work out the device, type and mountpoint for a filesystem.  This
+ * runs in the main thread.  Filesystems which cannot be handled here
+ * are left with job->device == NULL and are reported as unprobed.
+ */
+static int
+prepare_job (struct probe_job *job, const char *mountable)
+{
+  char *out = NULL;
+  CLEANUP_FREE char *err = NULL;
+  size_t len;
+  int r;
+
+  if (STRPREFIX (mountable, "btrfsvol:")) {
+    mountable_t m = { .device = NULL, .volume = NULL };
+
+    if (parse_btrfsvol (mountable + strlen ("btrfsvol:"), &m) == -1)
+      return 0;
+    job->device = m.device;
+    job->volume = m.volume;
+  }
+  else {
+    job->device = device_name_translation (mountable);
+    if (job->device == NULL)
+      return 0;
+  }
+
+  if (is_root_device (job->device))
+    goto unprobed;
+
+  r = commandr (&out, &err, str_blkid,
+                "-c", "/dev/null", "-o", "value", "-s", "TYPE",
+                job->device, NULL);
+  if (r != 0) {
+    free (out);
+    goto unprobed;
+  }
+  len = strlen (out);
+  if (len > 0 && out[len-1] == '\n')
+    out[len-1] = '\0';
+  job->vfstype = out;
+
+  if (STREQ (job->vfstype, "") || STREQ (job->vfstype, "swap") ||
+      (job->volume && STRNEQ (job->vfstype, "btrfs")))
+    goto unprobed;
+
+  return make_private_mountpoint (job->mp, "probe");
+
+ unprobed:
+  free (job->device);
+  job->device = NULL;
+  return 0;
+}
+
+char **
+do_internal_probe_filesystems (char *const *mountables, char *const *paths)
+{
+  struct probe_state state;
+  size_t i;
+  char **ret = NULL;
+  int ok = 0;
+
+  state.nr_jobs = count_strings (mountables);
+  state.nr_paths = count_strings (paths);
+  state.paths = paths;
+
+  state.jobs = calloc (state.nr_jobs, sizeof (struct probe_job));
+  ret = calloc (state.nr_jobs + 1, sizeof (char *));
+  if (state.jobs == NULL || ret == NULL) {
+    reply_with_perror ("calloc");
+    goto out;
+  }
+
+  for (i = 0; i < state.nr_jobs; ++i) {
+    /* Unprobed filesystems are returned as "?". */
+    state.jobs[i].fingerprint = calloc (state.nr_paths + 2, 1);
+    if (state.jobs[i].fingerprint == NULL) {
+      reply_with_perror ("calloc");
+      goto out;
+    }
+    state.jobs[i].fingerprint[0] = '?';
+
+    if (prepare_job (&state.jobs[i], mountables[i]) == -1)
+      goto out;
+  }
+
+  run_jobs (state.nr_jobs, MAX_PROBE_THREADS, probe_one, &state, NULL);
+
+  for (i = 0; i < state.nr_jobs; ++i) {
+    if (verbose)
+      fprintf (stderr, "probe: %s: %s\n",
+               mountables[i], state.jobs[i].fingerprint);
+    ret[i] = state.jobs[i].fingerprint;
+    state.jobs[i].fingerprint = NULL;
+  }
+  ok = 1;
+
+ out:
+  if (state.jobs) {
+    for (i = 0; i < state.nr_jobs; ++i) {
+      remove_private_mountpoint (state.jobs[i].mp);
+      free (state.jobs[i].device);
+      free (state.jobs[i].vfstype);
+      free (state.jobs[i].volume);
+      free (state.jobs[i].fingerprint);
+    }
+    free (state.jobs);
+  }
+  if (!ok) {
+    /* On error paths no fingerprint has been moved into 'ret' yet. */
+    free (ret);
+    ret = NULL;
+  }
+
+  return ret;                   /* caller frees */
+}
@@ -178,6 +178,8 @@ main_loop (int _sock)
     progress_hint = hdr.progress_hint;
     optargs_bitmask = hdr.optargs_bitmask;
 
+    rpc_stats_call (proc_nr, len + 4);
+
     /* Clear errors before we call the stub functions.  This is just
      * to ensure that we can accurately report errors in cases where
      * error handling paths don't set errno correctly.
@@ -192,16 +194,20 @@ main_loop (int _sock)
     dispatch_incoming_message (&xdr);
     /* Note that dispatch_incoming_message will also send a reply. */
 
-    /* In verbose mode, display the time taken to run each command. */
-    if (verbose) {
-      struct timeval end_t;
-      gettimeofday (&end_t, NULL);
+    /* Account the time taken to run each command, and in verbose
+     * mode display it.
+     */
+    struct timeval end_t;
+    gettimeofday (&end_t, NULL);
 
-      int64_t start_us, end_us, elapsed_us;
-      start_us = (int64_t) start_t.tv_sec * 1000000 + start_t.tv_usec;
-      end_us = (int64_t) end_t.tv_sec * 1000000 + end_t.tv_usec;
-      elapsed_us = end_us - start_us;
+    int64_t start_us, end_us, elapsed_us;
+    start_us = (int64_t) start_t.tv_sec * 1000000 + start_t.tv_usec;
+    end_us = (int64_t) end_t.tv_sec * 1000000 + end_t.tv_usec;
+    elapsed_us = end_us - start_us;
 
+    rpc_stats_done (elapsed_us);
+
+    if (verbose) {
       fprintf (stderr,
 	       "guestfsd: main_loop: proc %d (%s) took %d.%02d seconds\n",
                proc_nr,
@@ -302,6 +308,8 @@ send_error (int errnum, const char *msg)
     fprintf (stderr, "guestfsd: xwrite failed\n");
     exit (EXIT_FAILURE);
   }
+
+  rpc_stats_reply (1, len + 4);
 }
 
 void
@@ -355,6 +363,8 @@ reply (xdrproc_t xdrp, char *ret)
     fprintf (stderr, "guestfsd: xwrite failed\n");
     exit (EXIT_FAILURE);
   }
+
+  rpc_stats_reply (0, len + 4);
 }
 
 /* Receive file chunks, repeatedly calling 'cb'. */
@@ -399,6 +409,8 @@ receive_file (receive_cb cb, void *opaque)
     if (xread (sock, buf, len) == -1)
       exit (EXIT_FAILURE);
 
+    rpc_stats_chunk (0, len + 4);
+
     xdrmem_create (&xdr, buf, len, XDR_DECODE);
     memset (&chunk, 0, sizeof chunk);
     if (!xdr_guestfs_chunk (&xdr, &chunk)) {
@@ -585,6 +597,8 @@ send_chunk (const guestfs_chunk *chunk)
     exit (EXIT_FAILURE);
   }
 
+  rpc_stats_chunk (1, len + 4);
+
   return err;
 }
 
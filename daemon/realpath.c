@@ -24,9 +24,13 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <time.h>
+#include <errno.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
+#include "c-ctype.h"
 #include "cloexec.h"
 
 #include "daemon.h"
@@ -63,10 +67,47 @@ OPTGROUP_REALPATH_NOT_AVAILABLE
 
 #endif /* !HAVE_REALPATH */
 
-static int find_path_element (int fd_cwd, int is_end, const char *name, char **name_ret);
-
-char *
-do_case_sensitive_path (const char *path)
+/* Windows inspection and the customization tools resolve many paths
+ * under the same few directories (eg. /Windows/System32), so rather
+ * than reading each directory for every path element, we keep a small
+ * cache of directory indexes: the names in a directory folded to
+ * lower case, sorted so they can be searched quickly.
+ *
+ * An index is reused only if the directory's device, inode, mtime and
+ * ctime are unchanged, so anything which adds, removes or renames
+ * names in the directory (through the daemon or not) makes it stale.
+ * Directories modified in the last couple of seconds are not cached,
+ * because on filesystems with coarse timestamps a further change
+ * might not alter the mtime.
+ */
+#define DIR_INDEX_SLOTS 64
+
+struct dir_index_entry {
+  char *folded;                 /* name folded to lower case */
+  char *name;                   /* real name */
+  size_t order;                 /* position in the directory */
+};
+
+struct dir_index {
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtim, ctim;
+  size_t nr_entries;
+  struct dir_index_entry *entries; /* sorted by folded name, order */
+};
+
+static struct dir_index dir_index_cache[DIR_INDEX_SLOTS];
+
+static int find_path_element (int fd_cwd, int is_end, const char *name, char **name_ret, int quiet);
+
+/* Errors are reported to the caller unless 'quiet' is set. */
+#define REPLY_WITH_ERROR(fs,...)                                \
+  do { if (!quiet) reply_with_error ((fs), ##__VA_ARGS__); } while (0)
+#define REPLY_WITH_PERROR(fs,...)                               \
+  do { if (!quiet) reply_with_perror ((fs), ##__VA_ARGS__); } while (0)
+
+static char *
+case_sensitive_path (const char *path, int quiet)
 {
   size_t next;
   int fd_cwd, fd2, err, is_end;
@@ -74,7 +115,7 @@ do_case_sensitive_path (const char *path)
 
   ret = strdup ("/");
   if (ret == NULL) {
-    reply_with_perror ("strdup");
+    REPLY_WITH_PERROR ("strdup");
     return NULL;
   }
   next = 1; /* next position in 'ret' buffer */
@@ -84,7 +125,7 @@ do_case_sensitive_path (const char *path)
    */
   fd_cwd = open (sysroot, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
   if (fd_cwd == -1) {
-    reply_with_perror ("%s", sysroot);
+    REPLY_WITH_PERROR ("%s", sysroot);
     goto error;
   }
 
@@ -104,13 +145,13 @@ do_case_sensitive_path (const char *path)
 
     if ((i == 1 && path[0] == '.') ||
         (i == 2 && path[0] == '.' && path[1] == '.')) {
-      reply_with_error ("path contained . or .. elements");
+      REPLY_WITH_ERROR ("path contained . or .. elements");
       goto error;
     }
 
     name_in = strndup (path, i);
     if (name_in == NULL) {
-      reply_with_perror ("strdup");
+      REPLY_WITH_PERROR ("strdup");
       goto error;
     }
 
@@ -118,11 +159,11 @@ do_case_sensitive_path (const char *path)
     path += i;
     is_end = *path == 0;
 
-    /* Read the current directory looking (case insensitively) for
-     * this element of the path.  This replaces 'name' with the
-     * correct case version.
+    /* Look in the current directory (case insensitively) for this
+     * element of the path.  This replaces 'name' with the correct
+     * case version.
      */
-    if (find_path_element (fd_cwd, is_end, name_in, &name_out) == -1)
+    if (find_path_element (fd_cwd, is_end, name_in, &name_out, quiet) == -1)
       goto error;
     len = strlen (name_out);
 
@@ -132,7 +173,7 @@ do_case_sensitive_path (const char *path)
 
     t = realloc (ret, next+len+1);
     if (t == NULL) {
-      reply_with_perror ("realloc");
+      REPLY_WITH_PERROR ("realloc");
       goto error;
     }
     ret = t;
@@ -151,7 +192,7 @@ do_case_sensitive_path (const char *path)
       if (is_end && (errno == ENOTDIR || errno == ENOENT))
         break;
 
-      reply_with_perror ("openat: %s", name_out);
+      REPLY_WITH_PERROR ("openat: %s", name_out);
       goto error;
     }
   }
@@ -169,31 +210,100 @@ do_case_sensitive_path (const char *path)
   return NULL;
 }
 
-/* 'fd_cwd' is a file descriptor pointing to an open directory.
- * 'name' is the path element to search for.  'is_end' is a flag
- * indicating if this is the last path element.
- *
- * We search the directory looking for a path element that case
- * insensitively matches 'name', returning the actual name in '*name_ret'.
- *
- * If this is successful, return 0.  If it fails, reply with an error
- * and return -1.
+char *
+do_case_sensitive_path (const char *path)
+{
+  return case_sensitive_path (path, 0);
+}
+
+char **
+do_case_sensitive_paths (char *const *paths)
+{
+  size_t i;
+  DECLARE_STRINGSBUF (ret);
+
+  for (i = 0; paths[i] != NULL; ++i) {
+    CLEANUP_FREE char *rpath = NULL;
+
+    if (paths[i][0] != '/') {
+      reply_with_error ("%s: path must start with a / character", paths[i]);
+      if (ret.argv)
+        free_stringslen (ret.argv, ret.size);
+      return NULL;
+    }
+
+    /* Paths which cannot be resolved are returned as empty strings. */
+    rpath = case_sensitive_path (paths[i], 1);
+    if (add_string (&ret, rpath ? rpath : "") == -1)
+      return NULL;
+  }
+
+  if (end_stringsbuf (&ret) == -1)
+    return NULL;
+
+  return ret.argv;              /* caller frees */
+}
+
+static char *
+fold_name (const char *name)
+{
+  char *ret;
+  size_t i;
+
+  ret = strdup (name);
+  if (ret == NULL)
+    return NULL;
+  for (i = 0; ret[i]; ++i)
+    ret[i] = c_tolower (ret[i]);
+  return ret;
+}
+
+static int
+compare_dir_index_entries (const void *av, const void *bv)
+{
+  const struct dir_index_entry *a = av;
+  const struct dir_index_entry *b = bv;
+  int r;
+
+  r = strcmp (a->folded, b->folded);
+  if (r != 0)
+    return r;
+  return a->order < b->order ? -1 : a->order > b->order;
+}
+
+static void
+free_dir_index (struct dir_index *idx)
+{
+  size_t i;
+
+  for (i = 0; i < idx->nr_entries; ++i) {
+    free (idx->entries[i].folded);
+    free (idx->entries[i].name);
+  }
+  free (idx->entries);
+  memset (idx, 0, sizeof *idx);
+}
+
+/* Read the directory 'fd_cwd' into 'idx'.  If it fails, reply with an
+ * error (unless 'quiet') and return -1.
  */
 static int
-find_path_element (int fd_cwd, int is_end, const char *name, char **name_ret)
+read_dir_index (int fd_cwd, struct dir_index *idx, int quiet)
 {
   int fd2;
   DIR *dir;
   struct dirent *d;
+  size_t alloc = 0;
+  struct dir_index_entry *p;
 
   fd2 = dup_cloexec (fd_cwd); /* because closedir will close it */
   if (fd2 == -1) {
-    reply_with_perror ("dup");
+    REPLY_WITH_PERROR ("dup");
     return -1;
   }
   dir = fdopendir (fd2);
   if (dir == NULL) {
-    reply_with_perror ("opendir");
+    REPLY_WITH_PERROR ("opendir");
     close (fd2);
     return -1;
   }
@@ -203,49 +313,154 @@ find_path_element (int fd_cwd, int is_end, const char *name, char **name_ret)
     d = readdir (dir);
     if (d == NULL)
       break;
-    if (STRCASEEQ (d->d_name, name))
-      break;
+
+    if (idx->nr_entries >= alloc) {
+      alloc = alloc ? alloc * 2 : 64;
+      p = realloc (idx->entries, alloc * sizeof (struct dir_index_entry));
+      if (p == NULL) {
+        REPLY_WITH_PERROR ("realloc");
+        goto error;
+      }
+      idx->entries = p;
+    }
+
+    p = &idx->entries[idx->nr_entries];
+    p->name = strdup (d->d_name);
+    p->folded = fold_name (d->d_name);
+    p->order = idx->nr_entries;
+    idx->nr_entries++;
+    if (p->name == NULL || p->folded == NULL) {
+      REPLY_WITH_PERROR ("strdup");
+      goto error;
+    }
+  }
+
+  if (errno != 0) {
+    REPLY_WITH_PERROR ("readdir");
+    goto error;
+  }
+
+  if (closedir (dir) == -1) {
+    REPLY_WITH_PERROR ("closedir");
+    free_dir_index (idx);
+    return -1;
+  }
+
+  qsort (idx->entries, idx->nr_entries, sizeof (struct dir_index_entry),
+         compare_dir_index_entries);
+  return 0;
+
+ error:
+  closedir (dir);
+  free_dir_index (idx);
+  return -1;
+}
+
+/* Return the index of the directory 'fd_cwd', from the cache if
+ * possible.  If the index cannot be cached it is returned in 'tmp',
+ * and the caller must free it.  On error, reply (unless 'quiet') and
+ * return NULL.
+ */
+static const struct dir_index *
+get_dir_index (int fd_cwd, struct dir_index *tmp, int quiet)
+{
+  struct stat statbuf;
+  struct dir_index *slot;
+  time_t now;
+
+  if (fstat (fd_cwd, &statbuf) == -1) {
+    REPLY_WITH_PERROR ("fstat");
+    return NULL;
   }
 
-  if (d == NULL && errno != 0) {
-    reply_with_perror ("readdir");
-    closedir (dir);
+  slot = &dir_index_cache[(statbuf.st_dev ^ statbuf.st_ino) % DIR_INDEX_SLOTS];
+  if (slot->entries != NULL &&
+      slot->dev == statbuf.st_dev && slot->ino == statbuf.st_ino &&
+      slot->mtim.tv_sec == statbuf.st_mtim.tv_sec &&
+      slot->mtim.tv_nsec == statbuf.st_mtim.tv_nsec &&
+      slot->ctim.tv_sec == statbuf.st_ctim.tv_sec &&
+      slot->ctim.tv_nsec == statbuf.st_ctim.tv_nsec)
+    return slot;
+
+  if (read_dir_index (fd_cwd, tmp, quiet) == -1)
+    return NULL;
+
+  time (&now);
+  if (statbuf.st_mtime >= now - 1 || statbuf.st_ctime >= now - 1)
+    return tmp;
+
+  free_dir_index (slot);
+  *slot = *tmp;
+  memset (tmp, 0, sizeof *tmp);
+  slot->dev = statbuf.st_dev;
+  slot->ino = statbuf.st_ino;
+  slot->mtim = statbuf.st_mtim;
+  slot->ctim = statbuf.st_ctim;
+  return slot;
+}
+
+/* 'fd_cwd' is a file descriptor pointing to an open directory.
+ * 'name' is the path element to search for.  'is_end' is a flag
+ * indicating if this is the last path element.
+ *
+ * We search the directory looking for a path element that case
+ * insensitively matches 'name', returning the actual name in '*name_ret'.
+ * If several names match, the first one in the directory is used.
+ *
+ * If this is successful, return 0.  If it fails, reply with an error
+ * (unless 'quiet') and return -1.
+ */
+static int
+find_path_element (int fd_cwd, int is_end, const char *name, char **name_ret,
+                   int quiet)
+{
+  struct dir_index tmp = { .entries = NULL };
+  const struct dir_index *idx;
+  CLEANUP_FREE char *folded = NULL;
+  size_t lo, hi, mid;
+  int r = -1;
+
+  idx = get_dir_index (fd_cwd, &tmp, quiet);
+  if (idx == NULL)
     return -1;
+
+  folded = fold_name (name);
+  if (folded == NULL) {
+    REPLY_WITH_PERROR ("strdup");
+    goto out;
   }
 
-  if (d == NULL && is_end) {
+  /* Find the first entry which is not less than 'folded'. */
+  lo = 0;
+  hi = idx->nr_entries;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (strcmp (idx->entries[mid].folded, folded) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < idx->nr_entries && STREQ (idx->entries[lo].folded, folded))
+    *name_ret = strdup (idx->entries[lo].name);
+  else if (is_end)
     /* Last path element: return it as-is, assuming that the user will
      * create a new file or directory (RHBZ#840115).
      */
-    closedir (dir);
     *name_ret = strdup (name);
-    if (*name_ret == NULL) {
-      reply_with_perror ("strdup");
-      return -1;
-    }
-    return 0;
-  }
-
-  if (d == NULL) {
-    reply_with_error ("%s: no file or directory found with this name", name);
-    closedir (dir);
-    return -1;
+  else {
+    REPLY_WITH_ERROR ("%s: no file or directory found with this name", name);
+    goto out;
   }
 
-  *name_ret = strdup (d->d_name);
   if (*name_ret == NULL) {
-    reply_with_perror ("strdup");
-    closedir (dir);
-    return -1;
+    REPLY_WITH_PERROR ("strdup");
+    goto out;
   }
 
-  /* NB: closedir frees the structure associated with 'd', so we must
-   * do this last.
-   */
-  if (closedir (dir) == -1) {
-    reply_with_perror ("closedir");
-    return -1;
-  }
+  r = 0;
 
-  return 0;
+ out:
+  free_dir_index (&tmp);
+  return r;
 }
@@ -0,0 +1,177 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Per-procedure statistics about calls handled by the daemon.  The
+ * hooks are called from proto.c.  See also src/rpc-stats.c.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "daemon.h"
+#include "actions.h"
+
+/* Latencies are counted in buckets: < 1ms, < 10ms, < 100ms, < 1s, >= 1s. */
+#define NR_LATENCY_BUCKETS 5
+
+struct rpc_stats {
+  uint64_t calls, errors;
+  uint64_t total_usec, max_usec;
+  uint64_t latency[NR_LATENCY_BUCKETS];
+  uint64_t bytes_sent, bytes_received;
+  uint64_t chunks_sent, chunks_received;
+};
+
+static struct rpc_stats stats[GUESTFS_MAX_PROC_NR + 1];
+
+/* Procedure number of the call being handled, or 0 between calls. */
+static int current_proc;
+
+void
+rpc_stats_call (int proc, size_t bytes)
+{
+  if (proc <= 0 || proc > GUESTFS_MAX_PROC_NR)
+    return;
+
+  current_proc = proc;
+  stats[proc].bytes_received += bytes;
+}
+
+void
+rpc_stats_reply (int error, size_t bytes)
+{
+  if (current_proc == 0)
+    return;
+
+  if (error)
+    stats[current_proc].errors++;
+  stats[current_proc].bytes_sent += bytes;
+}
+
+void
+rpc_stats_chunk (int sent, size_t bytes)
+{
+  if (current_proc == 0)
+    return;
+
+  if (sent) {
+    stats[current_proc].chunks_sent++;
+    stats[current_proc].bytes_sent += bytes;
+  }
+  else {
+    stats[current_proc].chunks_received++;
+    stats[current_proc].bytes_received += bytes;
+  }
+}
+
+void
+rpc_stats_done (int64_t elapsed_us)
+{
+  struct rpc_stats *st;
+  uint64_t usec;
+  size_t i;
+
+  if (current_proc == 0)
+    return;
+
+  st = &stats[current_proc];
+  current_proc = 0;
+
+  usec = elapsed_us > 0 ? elapsed_us : 0;
+  st->calls++;
+  st->total_usec += usec;
+  if (usec > st->max_usec)
+    st->max_usec = usec;
+
+  for (i = 0; i < NR_LATENCY_BUCKETS - 1 && usec >= 1000; ++i)
+    usec /= 10;
+  st->latency[i]++;
+}
+
+guestfs_int_rpc_stat_list *
+do_internal_rpc_stats (void)
+{
+  guestfs_int_rpc_stat_list *ret;
+  size_t i, j, n = 0;
+
+  for (i = 1; i <= GUESTFS_MAX_PROC_NR; ++i)
+    if (stats[i].calls > 0)
+      n++;
+
+  ret = malloc (sizeof *ret);
+  if (ret == NULL) {
+    reply_with_perror ("malloc");
+    return NULL;
+  }
+  ret->guestfs_int_rpc_stat_list_len = n;
+  ret->guestfs_int_rpc_stat_list_val =
+    calloc (n, sizeof (struct guestfs_int_rpc_stat));
+  if (n > 0 && ret->guestfs_int_rpc_stat_list_val == NULL) {
+    reply_with_perror ("calloc");
+    free (ret);
+    return NULL;
+  }
+
+  for (i = 1, j = 0; i <= GUESTFS_MAX_PROC_NR; ++i) {
+    const struct rpc_stats *st = &stats[i];
+    struct guestfs_int_rpc_stat *r;
+
+    if (st->calls == 0)
+      continue;
+
+    r = &ret->guestfs_int_rpc_stat_list_val[j++];
+    r->rpc_proc = i;
+    r->rpc_name = strdup (function_names[i] ? function_names[i] : "");
+    if (r->rpc_name == NULL) {
+      reply_with_perror ("strdup");
+      xdr_free ((xdrproc_t) xdr_guestfs_int_rpc_stat_list, (char *) ret);
+      free (ret);
+      return NULL;
+    }
+    r->rpc_calls = st->calls;
+    r->rpc_errors = st->errors;
+    r->rpc_total_usec = st->total_usec;
+    r->rpc_max_usec = st->max_usec;
+    r->rpc_lat_1ms = st->latency[0];
+    r->rpc_lat_10ms = st->latency[1];
+    r->rpc_lat_100ms = st->latency[2];
+    r->rpc_lat_1s = st->latency[3];
+    r->rpc_lat_slow = st->latency[4];
+    r->rpc_bytes_sent = st->bytes_sent;
+    r->rpc_bytes_received = st->bytes_received;
+    r->rpc_chunks_sent = st->chunks_sent;
+    r->rpc_chunks_received = st->chunks_received;
+  }
+
+  return ret;
+}
+
+int
+do_internal_rpc_stats_reset (void)
+{
+  memset (stats, 0, sizeof stats);
+
+  /* Don't count this call either. */
+  current_proc = 0;
+
+  return 0;
+}
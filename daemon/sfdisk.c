@@ -105,7 +105,7 @@ sfdisk (const char *device, int n, int cyls, int heads, int sectors,
    */
   (void) command (NULL, NULL, str_blockdev, "--rereadpt", device, NULL);
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
@@ -146,7 +146,7 @@ sfdisk_flag (const char *device, const char *flag)
     return NULL;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return out;			/* caller frees */
 }
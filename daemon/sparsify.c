@@ -0,0 +1,642 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Trim or zero several filesystems and devices at the same time, for
+ * virt-sparsify.
+ *
+ * The filesystems are mounted on private mountpoints by the main
+ * thread, and then the trimming, zeroing and discarding is done by
+ * worker threads, one device each.  This work is almost entirely
+ * I/O, so with several disks or filesystems it keeps them all busy
+ * instead of doing one after another.  The main thread sends
+ * progress messages for the total over all the devices.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/ioctl.h>
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+
+#include "daemon.h"
+#include "actions.h"
+#include "optargs.h"
+
+GUESTFSD_EXT_CMD(str_mount, mount);
+GUESTFSD_EXT_CMD(str_umount, umount);
+
+/* Default and maximum number of worker threads. */
+#define DEFAULT_SPARSIFY_THREADS 1
+#define MAX_SPARSIFY_THREADS 64
+
+/* Size of the buffer used for writing (and checking) zeroes. */
+#define ZERO_BUFSIZE (1024 * 1024)
+
+/* The swap header which is preserved by the swap-* operations. */
+#define SWAP_HEADER_SIZE 4096
+
+enum sparsify_op {
+  OP_NONE,                      /* Skipped. */
+  OP_TRIM,
+  OP_ZERO,
+  OP_DISCARD,
+  OP_ZERO_DEVICE,
+  OP_ZERO_DISCARD,
+  OP_SWAP_DISCARD,
+  OP_SWAP_ZERO,
+};
+
+static const struct {
+  const char *name;
+  enum sparsify_op op;
+  int mount;                    /* Operation needs a mounted filesystem. */
+} operations[] = {
+  { "trim",          OP_TRIM,         1 },
+  { "zero",          OP_ZERO,         1 },
+  { "discard",       OP_DISCARD,      0 },
+  { "zero-device",   OP_ZERO_DEVICE,  0 },
+  { "zero-discard",  OP_ZERO_DISCARD, 0 },
+  { "swap-discard",  OP_SWAP_DISCARD, 0 },
+  { "swap-zero",     OP_SWAP_ZERO,    0 },
+};
+
+struct sparsify_job {
+  enum sparsify_op op;
+  char *device;
+  char mp[PRIVATE_MOUNTPOINT_LEN]; /* Private mountpoint, or "". */
+  char *result;                 /* Returned to the caller. */
+
+  /* These are protected by the lock. */
+  uint64_t position, total;     /* Progress, in bytes. */
+  int err;                      /* errno if the job failed. */
+  char *errmsg;                 /* Error message if the job failed. */
+};
+
+struct sparsify_state {
+  pthread_mutex_t lock;
+  size_t nr_jobs;
+  struct sparsify_job *jobs;
+  int failed;                   /* Set if any job failed. */
+};
+
+/* The functions below run in worker threads (see run_jobs).  Errors
+ * are saved in the job and reported by the main thread.
+ */
+static void
+job_error (struct sparsify_state *state, struct sparsify_job *job,
+           int err, const char *fs, ...)
+{
+  va_list args;
+  char *msg;
+
+  va_start (args, fs);
+  if (vasprintf (&msg, fs, args) == -1)
+    msg = NULL;
+  va_end (args);
+
+  pthread_mutex_lock (&state->lock);
+  if (job->errmsg == NULL) {
+    job->err = err;
+    job->errmsg = msg;
+    msg = NULL;
+  }
+  state->failed = 1;
+  pthread_mutex_unlock (&state->lock);
+
+  free (msg);
+}
+
+static void
+job_progress (struct sparsify_state *state, struct sparsify_job *job,
+              uint64_t position, uint64_t total)
+{
+  pthread_mutex_lock (&state->lock);
+  job->position = position;
+  job->total = total;
+  pthread_mutex_unlock (&state->lock);
+}
+
+static int
+job_cancelled (struct sparsify_state *state)
+{
+  int r;
+
+  pthread_mutex_lock (&state->lock);
+  r = state->failed;
+  pthread_mutex_unlock (&state->lock);
+  return r;
+}
+
+static void
+trim_filesystem (struct sparsify_state *state, struct sparsify_job *job)
+{
+#ifdef FITRIM
+  struct fstrim_range range;
+  struct statvfs statbuf;
+  uint64_t total;
+  int fd;
+
+  fd = open (job->mp, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (fd == -1) {
+    job_error (state, job, errno, "open: %s", job->device);
+    return;
+  }
+
+  total = fstatvfs (fd, &statbuf) == 0 ?
+    (uint64_t) statbuf.f_bfree * statbuf.f_frsize : 1;
+  job_progress (state, job, 0, total);
+
+  /* See do_fstrim. */
+  syncfs (fd);
+
+  memset (&range, 0, sizeof range);
+  range.len = UINT64_MAX;
+  if (ioctl (fd, FITRIM, &range) == -1) {
+    job_error (state, job, errno, "fstrim: %s", job->device);
+    close (fd);
+    return;
+  }
+  close (fd);
+
+  job_progress (state, job, total, total);
+#else
+  job_error (state, job, ENOTSUP, "fstrim: %s", job->device);
+#endif
+}
+
+/* See do_zero_free_space. */
+static void
+zero_free_space (struct sparsify_state *state, struct sparsify_job *job,
+                 const char *zbuf)
+{
+  size_t len = strlen (job->mp);
+  char filename[len+14];        /* mp + "/" + 8.3 + "\0" */
+  struct statvfs statbuf;
+  uint64_t total, written = 0;
+  ssize_t r;
+  int fd;
+
+  /* random_name only reads /dev/urandom, so it is safe to call here. */
+  snprintf (filename, len+14, "%s/XXXXXXXX.XXX", job->mp);
+  if (random_name (filename) == -1) {
+    job_error (state, job, errno, "random_name");
+    return;
+  }
+
+  fd = open (filename, O_WRONLY|O_CREAT|O_EXCL|O_NOCTTY|O_CLOEXEC, 0600);
+  if (fd == -1) {
+    job_error (state, job, errno, "open: %s", job->device);
+    return;
+  }
+
+  total = fstatvfs (fd, &statbuf) == 0 ?
+    (uint64_t) statbuf.f_bfree * statbuf.f_frsize : 1;
+  job_progress (state, job, 0, total);
+
+  for (;;) {
+    r = write (fd, zbuf, ZERO_BUFSIZE);
+    if (r == -1) {
+      if (errno == ENOSPC)      /* expected error */
+        break;
+      job_error (state, job, errno, "write: %s", job->device);
+      close (fd);
+      unlink (filename);
+      return;
+    }
+    written += r;
+    job_progress (state, job, written < total ? written : total, total);
+    if (job_cancelled (state))
+      break;
+  }
+
+  /* Make sure the file is completely written to disk.  Expect
+   * errors, don't check them.
+   */
+  fdatasync (fd);
+  close (fd);
+
+  if (unlink (filename) == -1) {
+    job_error (state, job, errno, "unlink: %s", job->device);
+    return;
+  }
+
+  job_progress (state, job, total, total);
+}
+
+/* Write zeroes from 'start' to the end of the device, skipping blocks
+ * which are zero already.  See do_zero_device.
+ */
+static int
+zero_range (struct sparsify_state *state, struct sparsify_job *job,
+            int fd, uint64_t start, uint64_t size,
+            const char *zbuf, char *buf)
+{
+  uint64_t pos = start;
+  size_t n;
+  ssize_t r;
+
+  while (pos < size) {
+    n = size - pos > ZERO_BUFSIZE ? ZERO_BUFSIZE : size - pos;
+
+    r = pread (fd, buf, n, pos);
+    if (r == -1) {
+      job_error (state, job, errno, "pread: %s at offset %" PRIu64,
+                 job->device, pos);
+      return -1;
+    }
+    if (r == 0)
+      break;
+    n = r;
+
+    if (!is_zero (buf, n)) {
+      r = pwrite (fd, zbuf, n, pos);
+      if (r == -1) {
+        job_error (state, job, errno, "pwrite: %s at offset %" PRIu64,
+                   job->device, pos);
+        return -1;
+      }
+      n = r;
+    }
+    pos += n;
+
+    job_progress (state, job, pos, size);
+    if (job_cancelled (state))
+      return -1;
+  }
+
+  if (fdatasync (fd) == -1) {
+    job_error (state, job, errno, "fsync: %s", job->device);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+discard_range (struct sparsify_state *state, struct sparsify_job *job,
+               int fd, uint64_t start, uint64_t size)
+{
+#ifdef BLKDISCARD
+  uint64_t range[2];
+
+  if (start >= size)
+    return 0;
+
+  range[0] = start;
+  range[1] = size - start;
+  if (ioctl (fd, BLKDISCARD, range) == -1) {
+    job_error (state, job, errno, "ioctl: %s: BLKDISCARD", job->device);
+    return -1;
+  }
+  return 0;
+#else
+  job_error (state, job, ENOTSUP, "ioctl: %s: BLKDISCARD", job->device);
+  return -1;
+#endif
+}
+
+static int
+discard_zeroes (int fd)
+{
+#ifdef BLKDISCARDZEROES
+  unsigned int arg;
+
+  if (ioctl (fd, BLKDISCARDZEROES, &arg) == 0)
+    return arg != 0;
+#endif
+  return 0;
+}
+
+static void
+sparsify_device (struct sparsify_state *state, struct sparsify_job *job,
+                 const char *zbuf)
+{
+  CLEANUP_FREE char *buf = NULL;
+  char header[SWAP_HEADER_SIZE];
+  uint64_t size, start = 0;
+  off_t off;
+  int fd;
+
+  buf = malloc (ZERO_BUFSIZE);
+  if (buf == NULL) {
+    job_error (state, job, errno, "malloc");
+    return;
+  }
+
+  fd = open (job->device, O_RDWR|O_CLOEXEC);
+  if (fd == -1) {
+    job_error (state, job, errno, "open: %s", job->device);
+    return;
+  }
+
+  off = lseek (fd, 0, SEEK_END);
+  if (off == -1) {
+    job_error (state, job, errno, "lseek: %s", job->device);
+    goto out;
+  }
+  size = off;
+  job_progress (state, job, 0, size);
+
+  /* Don't use mkswap.  Just preserve the header containing the label,
+   * UUID and swap format version.
+   */
+  if (job->op == OP_SWAP_DISCARD || job->op == OP_SWAP_ZERO) {
+    if (pread (fd, header, sizeof header, 0) != sizeof header) {
+      job_error (state, job, errno, "pread: %s", job->device);
+      goto out;
+    }
+    start = sizeof header;
+  }
+
+  switch (job->op) {
+  case OP_DISCARD:
+    discard_range (state, job, fd, 0, size);
+    break;
+
+  case OP_ZERO_DEVICE:
+  case OP_SWAP_ZERO:
+    zero_range (state, job, fd, start, size, zbuf, buf);
+    break;
+
+  case OP_ZERO_DISCARD:
+    if (!discard_zeroes (fd) &&
+        zero_range (state, job, fd, 0, size, zbuf, buf) == -1)
+      break;
+    discard_range (state, job, fd, 0, size);
+    break;
+
+  case OP_SWAP_DISCARD:
+    if (discard_range (state, job, fd, 0, size) == -1)
+      break;
+    if (pwrite (fd, header, sizeof header, 0) != sizeof header)
+      job_error (state, job, errno,
+                 "pwrite: %s: restoring swap partition header", job->device);
+    break;
+
+  case OP_NONE: case OP_TRIM: case OP_ZERO:
+    abort ();
+  }
+
+  job_progress (state, job, size, size);
+
+ out:
+  close (fd);
+}
+
+static void
+sparsify_one (size_t i, void *statevp)
+{
+  struct sparsify_state *state = statevp;
+  struct sparsify_job *job = &state->jobs[i];
+  CLEANUP_FREE char *zbuf = NULL;
+
+  if (job->op == OP_NONE || job_cancelled (state))
+    return;
+
+  zbuf = calloc (1, ZERO_BUFSIZE);
+  if (zbuf == NULL)
+    job_error (state, job, errno, "calloc");
+  else if (job->op == OP_TRIM)
+    trim_filesystem (state, job);
+  else if (job->op == OP_ZERO)
+    zero_free_space (state, job, zbuf);
+  else
+    sparsify_device (state, job, zbuf);
+}
+
+/* Work out what to do for one device, and mount it if necessary.
+ * This runs in the main thread.  A filesystem which cannot be
+ * mounted is skipped, and the reason is returned to the caller.
+ */
+static int
+prepare_job (struct sparsify_job *job, const char *mountable,
+             const char *operation)
+{
+  size_t i;
+  int r;
+  CLEANUP_FREE char *err = NULL, *options = NULL;
+  mountable_t m = { .device = NULL, .volume = NULL };
+
+  for (i = 0; i < sizeof operations / sizeof operations[0]; ++i)
+    if (STREQ (operation, operations[i].name))
+      break;
+  if (i == sizeof operations / sizeof operations[0]) {
+    reply_with_error ("%s: unknown operation '%s'", mountable, operation);
+    return -1;
+  }
+  job->op = operations[i].op;
+
+  if (STRPREFIX (mountable, "btrfsvol:")) {
+    /* A subvolume is only a filesystem, not a device. */
+    if (!operations[i].mount) {
+      reply_with_error ("%s: operation '%s' cannot be used on a btrfs subvolume",
+                        mountable, operation);
+      return -1;
+    }
+    if (parse_btrfsvol (mountable + strlen ("btrfsvol:"), &m) == -1) {
+      reply_with_error ("%s: cannot parse btrfs subvolume", mountable);
+      return -1;
+    }
+    job->device = m.device;
+    if (asprintf (&options, "subvol=%s", m.volume) == -1) {
+      reply_with_perror ("asprintf");
+      free (m.volume);
+      return -1;
+    }
+    free (m.volume);
+  }
+  else {
+    job->device = device_name_translation (mountable);
+    if (job->device == NULL) {
+      reply_with_perror ("%s", mountable);
+      return -1;
+    }
+  }
+
+  if (is_root_device (job->device)) {
+    reply_with_error ("%s: device is the root device", mountable);
+    return -1;
+  }
+
+  job->result = strdup ("");
+  if (job->result == NULL) {
+    reply_with_perror ("strdup");
+    return -1;
+  }
+
+  if (!operations[i].mount)
+    return 0;
+
+  if (make_private_mountpoint (job->mp, "sparsify") == -1)
+    return -1;
+
+  /* Use the mount command so that eg. ntfs-3g is used for NTFS,
+   * the same as guestfs_mount.
+   */
+  if (options)
+    r = command (NULL, &err, str_mount, "-o", options,
+                 job->device, job->mp, NULL);
+  else
+    r = command (NULL, &err, str_mount, job->device, job->mp, NULL);
+  if (r == -1) {
+    if (verbose)
+      fprintf (stderr, "sparsify: mount: %s: %s\n", mountable, err);
+    free (job->result);
+    if (asprintf (&job->result, "cannot mount: %s", err) == -1)
+      job->result = NULL;
+    if (job->result == NULL) {
+      reply_with_perror ("asprintf");
+      return -1;
+    }
+    job->op = OP_NONE;
+    remove_private_mountpoint (job->mp);
+  }
+
+  return 0;
+}
+
+/* Unmount and remove the private mountpoint. */
+static void
+finish_job (struct sparsify_job *job)
+{
+  CLEANUP_FREE char *err = NULL;
+
+  if (job->mp[0] == '\0')
+    return;
+
+  if (job->op != OP_NONE &&
+      command (NULL, &err, str_umount, job->mp, NULL) == -1) {
+    fprintf (stderr, "umount: %s: %s\n", job->mp, err);
+    (void) command (NULL, NULL, str_umount, "-l", job->mp, NULL);
+  }
+  remove_private_mountpoint (job->mp);
+}
+
+/* Sum up the progress of all the jobs. */
+static void
+send_progress (void *statevp)
+{
+  struct sparsify_state *state = statevp;
+  uint64_t position = 0, total = 0;
+  size_t i;
+
+  pthread_mutex_lock (&state->lock);
+  for (i = 0; i < state->nr_jobs; ++i) {
+    position += state->jobs[i].position;
+    total += state->jobs[i].total;
+  }
+  pthread_mutex_unlock (&state->lock);
+  if (total > 0 && position < total)
+    notify_progress (position, total);
+}
+
+char **
+do_sparsify_devices (char *const *devices, char *const *ops, int maxthreads)
+{
+  struct sparsify_state state;
+  size_t i;
+  char **ret = NULL;
+
+  if (!(optargs_bitmask & GUESTFS_SPARSIFY_DEVICES_MAXTHREADS_BITMASK))
+    maxthreads = DEFAULT_SPARSIFY_THREADS;
+  else if (maxthreads <= 0) {
+    reply_with_error ("maxthreads must be > 0");
+    return NULL;
+  }
+  if (maxthreads > MAX_SPARSIFY_THREADS)
+    maxthreads = MAX_SPARSIFY_THREADS;
+
+  memset (&state, 0, sizeof state);
+  state.nr_jobs = count_strings (devices);
+  if (count_strings (ops) != state.nr_jobs) {
+    reply_with_error ("devices and operations lists must be the same length");
+    return NULL;
+  }
+  pthread_mutex_init (&state.lock, NULL);
+
+  state.jobs = calloc (state.nr_jobs, sizeof (struct sparsify_job));
+  ret = calloc (state.nr_jobs + 1, sizeof (char *));
+  if (state.jobs == NULL || ret == NULL) {
+    reply_with_perror ("calloc");
+    goto error;
+  }
+
+  for (i = 0; i < state.nr_jobs; ++i) {
+    if (prepare_job (&state.jobs[i], devices[i], ops[i]) == -1)
+      goto error;
+  }
+
+  /* See do_fstrim. */
+  sync_disks ();
+
+  /* Send progress messages until all the jobs have finished. */
+  run_jobs (state.nr_jobs, maxthreads, sparsify_one, &state, send_progress);
+
+  for (i = 0; i < state.nr_jobs; ++i)
+    finish_job (&state.jobs[i]);
+
+  sync_disks ();
+
+  for (i = 0; i < state.nr_jobs; ++i) {
+    if (state.jobs[i].errmsg) {
+      reply_with_perror_errno (state.jobs[i].err, "%s",
+                               state.jobs[i].errmsg);
+      goto error;
+    }
+  }
+
+  notify_progress (1, 1);
+
+  for (i = 0; i < state.nr_jobs; ++i) {
+    ret[i] = state.jobs[i].result;
+    state.jobs[i].result = NULL;
+  }
+  goto out;
+
+ error:
+  free (ret);
+  ret = NULL;
+ out:
+  if (state.jobs) {
+    for (i = 0; i < state.nr_jobs; ++i) {
+      finish_job (&state.jobs[i]);
+      free (state.jobs[i].device);
+      free (state.jobs[i].result);
+      free (state.jobs[i].errmsg);
+    }
+    free (state.jobs);
+  }
+  pthread_mutex_destroy (&state.lock);
+
+  return ret;                   /* caller frees */
+}
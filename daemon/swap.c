@@ -99,7 +99,7 @@ do_mkswap (const char *device, const char *label, const char *uuid)
     return -1;
   }
 
-  udev_settle ();
+  udev_settle_later ();
 
   return 0;
 }
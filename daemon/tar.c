@@ -34,6 +34,7 @@
 #include "optgroups.h"
 
 GUESTFSD_EXT_CMD(str_tar, tar);
+GUESTFSD_EXT_CMD(str_zstd, zstd);
 
 int
 optgroup_xz_available (void)
@@ -135,6 +136,7 @@ do_tar_in (const char *dir, const char *compress)
   int err, r;
   FILE *fp;
   CLEANUP_FREE char *cmd = NULL;
+  CLEANUP_FREE char *filter_buf = NULL;
   char error_file[] = "/tmp/tarXXXXXX";
   int fd, chown_supported;
 
@@ -153,6 +155,23 @@ do_tar_in (const char *dir, const char *compress)
       filter = " --xz";
     else if (STREQ (compress, "lzop"))
       filter = " --lzop";
+    else if (STREQ (compress, "zstd")) {
+      /* tar has no built-in option for zstd in all versions. */
+      if (!prog_exists ("zstd")) {
+        cancel_receive ();
+        /* note: substring "not supported" must appear in this error */
+        NOT_SUPPORTED (-1, "compression type %s is not supported, because external program '%s' is not available in the appliance", compress, "zstd");
+      }
+      if (asprintf_nowarn (&filter_buf, " --use-compress-program=%Q",
+                           str_zstd) == -1) {
+        err = errno;
+        r = cancel_receive ();
+        errno = err;
+        reply_with_perror ("asprintf");
+        return -1;
+      }
+      filter = filter_buf;
+    }
     else {
       reply_with_error ("unknown compression type: %s", compress);
       return -1;
@@ -320,19 +339,30 @@ do_tar_out (const char *dir, const char *compress, int numericowner,
   FILE *fp;
   CLEANUP_UNLINK_FREE char *exclude_from_file = NULL;
   CLEANUP_FREE char *cmd = NULL;
+  CLEANUP_FREE char *filter_buf = NULL;
   char buffer[GUESTFS_MAX_CHUNK_SIZE];
 
   if ((optargs_bitmask & GUESTFS_TAR_OUT_COMPRESS_BITMASK)) {
     if (STREQ (compress, "compress"))
       filter = " --compress";
-    else if (STREQ (compress, "gzip"))
-      filter = " --gzip";
     else if (STREQ (compress, "bzip2"))
       filter = " --bzip2";
-    else if (STREQ (compress, "xz"))
-      filter = " --xz";
     else if (STREQ (compress, "lzop"))
       filter = " --lzop";
+    else if (STREQ (compress, "gzip") || STREQ (compress, "xz") ||
+             STREQ (compress, "zstd")) {
+      /* These may use a parallel compressor, see compress.c. */
+      char prog[32];
+
+      if (get_compress_program (compress, prog, sizeof prog) == -1)
+        return -1;
+      if (asprintf_nowarn (&filter_buf, " --use-compress-program=%Q",
+                           prog) == -1) {
+        reply_with_perror ("asprintf");
+        return -1;
+      }
+      filter = filter_buf;
+    }
     else {
       reply_with_error ("unknown compression type: %s", compress);
       return -1;
@@ -0,0 +1,330 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Waiting for udev.
+ *
+ * LVM and other commands aren't synchronous, especially when udev is
+ * involved.  eg. You can create or remove some device, but the /dev
+ * device node won't appear until some time later.  This means that
+ * you get an error if you run one command followed by another.
+ *
+ * Instead of running 'udevadm settle' after each such command, the
+ * daemon listens on the udev netlink socket.  Every kernel uevent
+ * has a sequence number (see /sys/kernel/uevent_seqnum), and udevd
+ * rebroadcasts each event once it has finished running the rules for
+ * it.  So udev has settled when every sequence number up to the
+ * current kernel one has come back.  If the kernel sequence number
+ * hasn't changed since we last settled, there is nothing to wait for
+ * and udev_settle returns at once.
+ *
+ * Commands which only need udev to have settled before the next
+ * device is used call udev_settle_later instead.  The wait is then
+ * done by udev_settle_pending, which is called when a device is next
+ * looked up, so a sequence of partitioning or LVM calls waits once.
+ *
+ * If we cannot use the netlink socket, lose messages, or stop
+ * hearing from udevd, this falls back to 'udevadm settle'.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_LINUX_NETLINK_H
+#include <linux/netlink.h>
+#endif
+
+#include "daemon.h"
+
+GUESTFSD_EXT_CMD(str_udevadm, udevadm);
+
+#define UEVENT_SEQNUM_FILE "/sys/kernel/uevent_seqnum"
+
+/* Multicast group used by udevd for processed events, and the header
+ * of the messages it sends (see libudev-monitor.c in udev).
+ */
+#define UDEV_MONITOR_UDEV 2
+#define UDEV_MONITOR_MAGIC 0xfeedcafe
+
+struct udev_monitor_netlink_header {
+  char prefix[8];
+  unsigned int magic;
+  unsigned int header_size;
+  unsigned int properties_off;
+  unsigned int properties_len;
+  /* filter fields follow, which we don't need */
+};
+
+/* How many outstanding events we can keep track of. */
+#define SEQNUM_WINDOW 4096
+
+/* If udevd sends nothing for this long while we are waiting, give
+ * up and run 'udevadm settle'.
+ */
+#define INACTIVITY_TIMEOUT_MS 2000
+
+static int monitor_fd = -1;
+
+/* If have_settled is true, all events up to and including
+ * settled_seqnum have been processed by udev.  done_map records
+ * which of the following SEQNUM_WINDOW events have been processed.
+ */
+static int have_settled;
+static uint64_t settled_seqnum;
+static unsigned char done_map[SEQNUM_WINDOW / 8];
+
+/* Set if messages were lost, so settled_seqnum can't be trusted. */
+static int lost;
+
+/* Set by udev_settle_later. */
+static int pending;
+
+#define DONE_BIT(s) (done_map[((s) % SEQNUM_WINDOW) / 8])
+#define DONE_MASK(s) (1 << ((s) % 8))
+
+/* Open the netlink socket.  This must be called before the first
+ * call to udev_settle.  Failure is not fatal.
+ */
+void
+udev_monitor_init (void)
+{
+#ifdef HAVE_LINUX_NETLINK_H
+  struct sockaddr_nl addr;
+  int bufsize = 1024 * 1024;
+
+  monitor_fd = socket (AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC|SOCK_NONBLOCK,
+                       NETLINK_KOBJECT_UEVENT);
+  if (monitor_fd == -1) {
+    if (verbose)
+      perror ("udev_monitor_init: socket");
+    return;
+  }
+
+  /* Make sure a burst of events doesn't overflow the socket. */
+  if (setsockopt (monitor_fd, SOL_SOCKET, SO_RCVBUFFORCE,
+                  &bufsize, sizeof bufsize) == -1)
+    (void) setsockopt (monitor_fd, SOL_SOCKET, SO_RCVBUF,
+                       &bufsize, sizeof bufsize);
+
+  memset (&addr, 0, sizeof addr);
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = UDEV_MONITOR_UDEV;
+  if (bind (monitor_fd, (struct sockaddr *) &addr, sizeof addr) == -1) {
+    if (verbose)
+      perror ("udev_monitor_init: bind");
+    close (monitor_fd);
+    monitor_fd = -1;
+  }
+#endif
+}
+
+static int
+read_kernel_seqnum (uint64_t *seqnum)
+{
+  FILE *fp;
+  int r;
+
+  fp = fopen (UEVENT_SEQNUM_FILE, "r");
+  if (fp == NULL)
+    return -1;
+  r = fscanf (fp, "%" SCNu64, seqnum);
+  fclose (fp);
+  return r == 1 ? 0 : -1;
+}
+
+/* Move settled_seqnum past the events which are already done. */
+static void
+advance_settled (void)
+{
+  while (DONE_BIT (settled_seqnum+1) & DONE_MASK (settled_seqnum+1)) {
+    settled_seqnum++;
+    DONE_BIT (settled_seqnum) &= ~DONE_MASK (settled_seqnum);
+  }
+}
+
+/* Record that udev has processed event 'seqnum'. */
+static void
+event_done (uint64_t seqnum)
+{
+  if (!have_settled || seqnum <= settled_seqnum)
+    return;
+
+  if (seqnum - settled_seqnum > SEQNUM_WINDOW) {
+    lost = 1;
+    return;
+  }
+
+  DONE_BIT (seqnum) |= DONE_MASK (seqnum);
+  advance_settled ();
+}
+
+/* Find SEQNUM=... in a message from udevd. */
+static void
+parse_message (const char *buf, size_t len)
+{
+  const struct udev_monitor_netlink_header *h =
+    (const struct udev_monitor_netlink_header *) buf;
+  const char *p, *end;
+  uint64_t seqnum;
+
+  if (len < sizeof *h ||
+      memcmp (h->prefix, "libudev", 8) != 0 ||
+      ntohl (h->magic) != UDEV_MONITOR_MAGIC ||
+      h->properties_off >= len ||
+      h->properties_len > len - h->properties_off)
+    return;
+
+  p = buf + h->properties_off;
+  end = p + h->properties_len;
+  while (p < end) {
+    if (STRPREFIX (p, "SEQNUM=") &&
+        sscanf (p + 7, "%" SCNu64, &seqnum) == 1) {
+      event_done (seqnum);
+      return;
+    }
+    p += strlen (p) + 1;
+  }
+}
+
+/* Read all the messages waiting on the socket. */
+static void
+drain_monitor (void)
+{
+  char buf[8192];
+  ssize_t r;
+
+  for (;;) {
+    r = recv (monitor_fd, buf, sizeof buf - 1, MSG_DONTWAIT);
+    if (r == -1) {
+      if (errno == EINTR)
+        continue;
+      /* ENOBUFS means the socket overflowed. */
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        lost = 1;
+      return;
+    }
+    buf[r] = '\0';
+    parse_message (buf, r);
+  }
+}
+
+/* Run 'udevadm settle', and then start counting events again from
+ * the kernel sequence number as it was before.
+ */
+static void
+fallback_settle (void)
+{
+  uint64_t seqnum;
+  int r;
+
+  r = read_kernel_seqnum (&seqnum);
+
+  (void) command (NULL, NULL, str_udevadm, "settle", NULL);
+
+  if (monitor_fd == -1 || r == -1) {
+    have_settled = 0;
+    return;
+  }
+
+  /* Keep what we know about later events, unless we lost track. */
+  if (lost || !have_settled || seqnum > settled_seqnum + SEQNUM_WINDOW) {
+    memset (done_map, 0, sizeof done_map);
+    settled_seqnum = seqnum;
+  }
+  else {
+    while (settled_seqnum < seqnum) {
+      settled_seqnum++;
+      DONE_BIT (settled_seqnum) &= ~DONE_MASK (settled_seqnum);
+    }
+    advance_settled ();
+  }
+  lost = 0;
+  have_settled = 1;
+  drain_monitor ();
+}
+
+/* Wait until udev has processed all the events which the kernel has
+ * sent so far.  Don't be too fussed if it fails.
+ */
+void
+udev_settle (void)
+{
+  uint64_t seqnum;
+  struct pollfd pfd;
+  int r;
+
+  pending = 0;
+
+  if (monitor_fd == -1 || !have_settled ||
+      read_kernel_seqnum (&seqnum) == -1) {
+    fallback_settle ();
+    return;
+  }
+
+  drain_monitor ();
+
+  while (!lost && settled_seqnum < seqnum) {
+    pfd.fd = monitor_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    r = poll (&pfd, 1, INACTIVITY_TIMEOUT_MS);
+    if (r == -1 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      break;
+    drain_monitor ();
+  }
+
+  if (lost || settled_seqnum < seqnum) {
+    if (verbose)
+      fprintf (stderr, "udev_settle: waiting for events up to %" PRIu64
+               " (have %" PRIu64 "), using udevadm settle\n",
+               seqnum, settled_seqnum);
+    fallback_settle ();
+  }
+}
+
+/* Called after a command which may cause uevents, when nothing in
+ * the same call depends on the devices having settled.
+ */
+void
+udev_settle_later (void)
+{
+  pending = 1;
+}
+
+/* Called before devices are looked up, to finish any wait deferred
+ * by udev_settle_later.
+ */
+void
+udev_settle_pending (void)
+{
+  if (pending)
+    udev_settle ();
+}
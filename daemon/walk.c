@@ -0,0 +1,493 @@
+/* libguestfs - the guestfsd daemon
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Walk a directory tree using several threads, for find, du and
+ * other calls which visit every file.
+ *
+ * Directories waiting to be read are kept on a shared stack.  Each
+ * thread takes a directory, reads it using large getdents64 calls,
+ * pushes the subdirectories it finds, and passes the entries to the
+ * caller's callback in batches.  Several directories are read at the
+ * same time, which keeps the disk queue busy.
+ *
+ * Each directory is opened relative to its parent's file descriptor,
+ * so there is no limit on the depth of the tree (paths longer than
+ * PATH_MAX are only ever passed to the callback).  A directory's fd
+ * is kept open until all of the subdirectories it pushed have been
+ * opened.
+ *
+ * The callback is called with a lock held, so it doesn't need to be
+ * thread safe (it may send FileOut chunks, for example).  The order
+ * of entries is not defined.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "daemon.h"
+
+/* Number of threads.  Like probe.c, the work is almost entirely I/O,
+ * so this is not related to the number of vCPUs.
+ */
+#define WALK_THREADS 8
+
+/* Size of the buffer passed to each getdents64 call. */
+#define DIRENT_BUFSIZE (128 * 1024)
+
+/* Maximum number of entries passed to the callback at once. */
+#define BATCH_SIZE 1024
+
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+/* A directory waiting to be read, or being read. */
+struct walk_dir {
+  struct walk_dir *parent;      /* NULL for the root, or after opening. */
+  int fd;                       /* -1 until opened. */
+  char *path;                   /* Relative to the root, "" for the root. */
+  const char *name;             /* Last component of 'path'. */
+  size_t refs;                  /* Protected by walk_state.lock. */
+};
+
+struct walk_state {
+  int rootfd;
+  int flags;
+  walk_cb cb;
+  void *opaque;
+
+  pthread_mutex_t lock;         /* Protects the fields below. */
+  pthread_cond_t cond;
+  struct walk_dir **dirs;       /* Stack of directories to read. */
+  size_t nr_dirs, alloc_dirs;
+  size_t active;                /* Threads reading a directory. */
+  int err;                      /* First errno, or 0. */
+
+  pthread_mutex_t cb_lock;      /* Serializes calls to cb. */
+};
+
+/* A batch of entries read by one thread. */
+struct batch {
+  struct walk_entry entries[BATCH_SIZE];
+  struct stat stats[BATCH_SIZE];
+  size_t offsets[BATCH_SIZE];   /* Offset of each path in 'names'. */
+  size_t nr;
+  char *names;
+  size_t names_len, names_alloc;
+};
+
+static void
+set_error (struct walk_state *state, int err)
+{
+  pthread_mutex_lock (&state->lock);
+  if (state->err == 0)
+    state->err = err;
+  pthread_cond_broadcast (&state->cond);
+  pthread_mutex_unlock (&state->lock);
+}
+
+/* Drop a reference to a directory, closing and freeing it when the
+ * last reference goes.
+ */
+static void
+put_dir (struct walk_state *state, struct walk_dir *wd)
+{
+  int last;
+
+  pthread_mutex_lock (&state->lock);
+  last = --wd->refs == 0;
+  pthread_mutex_unlock (&state->lock);
+
+  if (last) {
+    if (wd->parent)
+      put_dir (state, wd->parent);
+    if (wd->fd >= 0)
+      close (wd->fd);
+    free (wd->path);
+    free (wd);
+  }
+}
+
+/* Push a directory 'path' whose parent is 'parent' (NULL for the
+ * root).  Takes ownership of 'path', and takes a reference to
+ * 'parent' which is dropped when the new directory has been opened.
+ */
+static int
+push_dir (struct walk_state *state, struct walk_dir *parent, char *path)
+{
+  struct walk_dir *wd;
+  const char *p;
+
+  wd = malloc (sizeof *wd);
+  if (wd == NULL) {
+    free (path);
+    return -1;
+  }
+  wd->parent = parent;
+  wd->fd = -1;
+  wd->path = path;
+  p = strrchr (path, '/');
+  wd->name = p ? p+1 : path;
+  wd->refs = 1;
+
+  pthread_mutex_lock (&state->lock);
+  if (state->nr_dirs >= state->alloc_dirs) {
+    size_t n = state->alloc_dirs ? state->alloc_dirs * 2 : 64;
+    struct walk_dir **dirs = realloc (state->dirs, n * sizeof *dirs);
+
+    if (dirs == NULL) {
+      pthread_mutex_unlock (&state->lock);
+      free (path);
+      free (wd);
+      return -1;
+    }
+    state->dirs = dirs;
+    state->alloc_dirs = n;
+  }
+  if (parent)
+    parent->refs++;
+  state->dirs[state->nr_dirs++] = wd;
+  pthread_cond_signal (&state->cond);
+  pthread_mutex_unlock (&state->lock);
+  return 0;
+}
+
+/* Pass the batch to the callback and empty it. */
+static int
+flush_batch (struct walk_state *state, struct batch *b)
+{
+  size_t i;
+  int r;
+
+  if (b->nr == 0)
+    return 0;
+
+  for (i = 0; i < b->nr; ++i)
+    b->entries[i].path = &b->names[b->offsets[i]];
+
+  pthread_mutex_lock (&state->cb_lock);
+  r = state->cb (state->opaque, b->entries, b->nr);
+  pthread_mutex_unlock (&state->cb_lock);
+
+  b->nr = 0;
+  b->names_len = 0;
+  return r;
+}
+
+/* Add "dir/name" to the batch. */
+static int
+add_to_batch (struct walk_state *state, struct batch *b,
+              const char *dir, const char *name, unsigned char type,
+              const struct stat *statbuf)
+{
+  size_t dirlen = strlen (dir), namelen = strlen (name);
+  size_t len = dirlen + (dirlen > 0) + namelen;
+  struct walk_entry *e;
+  char *p;
+
+  if (b->names_len + len + 1 > b->names_alloc) {
+    size_t n = b->names_alloc ? b->names_alloc * 2 : 65536;
+
+    while (n < b->names_len + len + 1)
+      n *= 2;
+    p = realloc (b->names, n);
+    if (p == NULL)
+      return -1;
+    b->names = p;
+    b->names_alloc = n;
+  }
+
+  p = &b->names[b->names_len];
+  memcpy (p, dir, dirlen);
+  if (dirlen > 0)
+    p[dirlen] = '/';
+  memcpy (&p[dirlen + (dirlen > 0)], name, namelen + 1);
+
+  e = &b->entries[b->nr];
+  e->pathlen = len;
+  e->type = type;
+  if (statbuf) {
+    b->stats[b->nr] = *statbuf;
+    e->statbuf = &b->stats[b->nr];
+  }
+  else
+    e->statbuf = NULL;
+  b->offsets[b->nr] = b->names_len;
+  b->names_len += len + 1;
+  b->nr++;
+
+  if (b->nr == BATCH_SIZE)
+    return flush_batch (state, b);
+  return 0;
+}
+
+static unsigned char
+mode_to_dtype (mode_t mode)
+{
+  if (S_ISREG (mode)) return DT_REG;
+  if (S_ISDIR (mode)) return DT_DIR;
+  if (S_ISLNK (mode)) return DT_LNK;
+  if (S_ISCHR (mode)) return DT_CHR;
+  if (S_ISBLK (mode)) return DT_BLK;
+  if (S_ISFIFO (mode)) return DT_FIFO;
+  if (S_ISSOCK (mode)) return DT_SOCK;
+  return DT_UNKNOWN;
+}
+
+/* Read one directory.  Returns 0 or an errno. */
+static int
+read_dir (struct walk_state *state, struct batch *b, char *dirbuf,
+          struct walk_dir *wd)
+{
+  const char *dir = wd->path;
+  int fd;
+  long n;
+  long pos;
+  int err = 0;
+
+  if (wd->parent)
+    fd = openat (wd->parent->fd, wd->name,
+                 O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+  else
+    fd = openat (state->rootfd, ".", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  err = errno;
+
+  /* The parent's fd is no longer needed by this directory. */
+  if (wd->parent) {
+    put_dir (state, wd->parent);
+    wd->parent = NULL;
+  }
+
+  if (fd == -1) {
+    /* A subdirectory deleted or replaced while we were walking the
+     * tree is skipped, as in the stat call below.
+     */
+    if (dir[0] && (err == ENOENT || err == ENOTDIR))
+      return 0;
+    fprintf (stderr, "walk: open: %s: %s\n", dir, strerror (err));
+    return err;
+  }
+  wd->fd = fd;
+  err = 0;
+
+  while ((n = syscall (SYS_getdents64, fd, dirbuf, DIRENT_BUFSIZE)) > 0) {
+    for (pos = 0; pos < n; ) {
+      struct linux_dirent64 *d = (struct linux_dirent64 *) &dirbuf[pos];
+      unsigned char type = d->d_type;
+      struct stat statbuf;
+      int have_stat = 0;
+
+      pos += d->d_reclen;
+
+      if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+        continue;
+
+      if ((state->flags & WALK_STAT) || type == DT_UNKNOWN) {
+        if (fstatat (fd, d->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+          if (errno == ENOENT)  /* Deleted while we were reading. */
+            continue;
+          err = errno;
+          fprintf (stderr, "walk: stat: %s/%s: %m\n", dir, d->d_name);
+          goto out;
+        }
+        type = mode_to_dtype (statbuf.st_mode);
+        have_stat = 1;
+      }
+
+      if (type == DT_DIR) {
+        char *subdir;
+
+        if (dir[0]) {
+          if (asprintf (&subdir, "%s/%s", dir, d->d_name) == -1)
+            subdir = NULL;
+        }
+        else
+          subdir = strdup (d->d_name);
+        if (subdir == NULL || push_dir (state, wd, subdir) == -1) {
+          err = ENOMEM;
+          goto out;
+        }
+      }
+
+      if (add_to_batch (state, b, dir, d->d_name, type,
+                        have_stat && (state->flags & WALK_STAT) ?
+                        &statbuf : NULL) == -1) {
+        err = errno ? errno : EIO;
+        goto out;
+      }
+    }
+  }
+  if (n == -1) {
+    err = errno;
+    fprintf (stderr, "walk: getdents64: %s: %m\n", dir);
+  }
+
+ out:
+  /* The fd is closed by put_dir, when any subdirectories have been
+   * opened.
+   */
+  return err;
+}
+
+static void *
+walk_worker (void *statev)
+{
+  struct walk_state *state = statev;
+  struct batch *b;
+  char *dirbuf;
+  struct walk_dir *wd;
+  int err;
+
+  b = calloc (1, sizeof *b);
+  dirbuf = malloc (DIRENT_BUFSIZE);
+  if (b == NULL || dirbuf == NULL) {
+    set_error (state, ENOMEM);
+    goto out;
+  }
+
+  for (;;) {
+    pthread_mutex_lock (&state->lock);
+    while (state->err == 0 && state->nr_dirs == 0 && state->active > 0)
+      pthread_cond_wait (&state->cond, &state->lock);
+    if (state->err != 0 || state->nr_dirs == 0) {
+      /* An error, or no directories left and nothing running which
+       * could add more: we're done.
+       */
+      pthread_cond_broadcast (&state->cond);
+      pthread_mutex_unlock (&state->lock);
+      break;
+    }
+    wd = state->dirs[--state->nr_dirs];
+    state->active++;
+    pthread_mutex_unlock (&state->lock);
+
+    err = read_dir (state, b, dirbuf, wd);
+    put_dir (state, wd);
+    if (err == 0 && flush_batch (state, b) == -1)
+      err = errno ? errno : EIO;
+    if (err != 0)
+      set_error (state, err);
+
+    pthread_mutex_lock (&state->lock);
+    state->active--;
+    if (state->active == 0 && state->nr_dirs == 0)
+      pthread_cond_broadcast (&state->cond);
+    pthread_mutex_unlock (&state->lock);
+  }
+
+ out:
+  if (b)
+    free (b->names);
+  free (b);
+  free (dirbuf);
+  return NULL;
+}
+
+/* Walk the tree under 'dir' (a path in the appliance, normally
+ * prefixed with the sysroot).  'dir' itself is not passed to the
+ * callback.
+ *
+ * 'cb' is called with batches of entries.  It should return 0, or -1
+ * (with errno set) to stop the walk.
+ *
+ * Returns 0 on success.  On error this returns -1 with errno set,
+ * and does not call reply_with_*, so it can be used by functions
+ * which have already sent their reply.
+ */
+int
+walk_tree (const char *dir, int flags, walk_cb cb, void *opaque)
+{
+  struct walk_state state;
+  pthread_t threads[WALK_THREADS];
+  size_t i, nr_threads;
+  char *root;
+  int err;
+
+  memset (&state, 0, sizeof state);
+  state.flags = flags;
+  state.cb = cb;
+  state.opaque = opaque;
+  pthread_mutex_init (&state.lock, NULL);
+  pthread_cond_init (&state.cond, NULL);
+  pthread_mutex_init (&state.cb_lock, NULL);
+
+  state.rootfd = open (dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (state.rootfd == -1) {
+    state.err = errno;
+    goto out;
+  }
+
+  root = strdup ("");
+  if (root == NULL || push_dir (&state, NULL, root) == -1) {
+    state.err = ENOMEM;
+    goto out;
+  }
+
+  for (i = 0; i < WALK_THREADS; ++i) {
+    err = pthread_create (&threads[i], NULL, walk_worker, &state);
+    if (err != 0) {
+      /* Threads already running will do the work. */
+      fprintf (stderr, "pthread_create: %s\n", strerror (err));
+      break;
+    }
+  }
+  nr_threads = i;
+
+  /* If no thread could be started, do the work in this thread. */
+  if (nr_threads == 0)
+    walk_worker (&state);
+
+  for (i = 0; i < nr_threads; ++i) {
+    err = pthread_join (threads[i], NULL);
+    if (err != 0)
+      fprintf (stderr, "pthread_join: %s\n", strerror (err));
+  }
+
+ out:
+  /* Directories left on the stack after an error. */
+  for (i = 0; i < state.nr_dirs; ++i)
+    put_dir (&state, state.dirs[i]);
+  if (state.rootfd >= 0)
+    close (state.rootfd);
+  free (state.dirs);
+  pthread_mutex_destroy (&state.lock);
+  pthread_cond_destroy (&state.cond);
+  pthread_mutex_destroy (&state.cb_lock);
+
+  if (state.err != 0) {
+    errno = state.err;
+    return -1;
+  }
+  return 0;
+}
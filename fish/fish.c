@@ -581,6 +581,9 @@ main (int argc, char *argv[])
   else
     cmdline (argv, optind, argc);
 
+  if (remote_control)
+    rc_remote_close ();
+
   if (guestfs_shutdown (g) == -1)
     exit (EXIT_FAILURE);
 
@@ -1200,6 +1203,12 @@ issue_command (const char *cmd, char *argv[], const char *pipecmd,
   }
 
   if (pipecmd) {
+    /* The remote server holds the write end of the pipe for as long
+     * as we are connected to it.
+     */
+    if (remote_control)
+      rc_remote_close ();
+
     close (1);
     if (dup2 (stdout_saved_fd, 1) < 0) {
       perror ("failed to dup2 standard output");
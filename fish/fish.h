@@ -100,6 +100,7 @@ extern int vg_lv_parse (const char *device, char **vg, char **lv);
 extern void rc_listen (void);
 extern int rc_remote (int pid, const char *cmd, size_t argc, char *argv[],
                       int exit_on_error);
+extern void rc_remote_close (void);
 
 /* in tilde.c */
 extern char *try_tilde_expansion (char *path);
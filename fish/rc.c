@@ -29,11 +29,14 @@
 #include <sys/un.h>
 #include <signal.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <errno.h>
 
 #include <rpc/types.h>
 #include <rpc/xdr.h>
 
+#include "freadahead.h"
+
 #include "fish.h"
 #include "rc_protocol.h"
 
@@ -87,7 +90,10 @@ create_sockpath (pid_t pid, char *sockpath, size_t len,
 
 static const socklen_t controllen = CMSG_LEN (sizeof (int));
 
-static void
+/* Receive the client's stdout.  Returns the file descriptor, or -1
+ * if the client didn't send one.
+ */
+static int
 receive_stdout (int s)
 {
   static struct cmsghdr *cmptr = NULL, *h;
@@ -130,17 +136,12 @@ receive_stdout (int s)
   h = CMSG_FIRSTHDR(&msg);
   if (NULL == h) {
     fprintf (stderr, "didn't receive a stdout file descriptor\n");
+    return -1;
   }
 
-  else {
-    /* Extract the transferred file descriptor from the control data */
-    void *data = CMSG_DATA (h);
-    int fd = *(int *)data;
-
-    /* Duplicate the received file descriptor to stdout */
-    dup2 (fd, STDOUT_FILENO);
-    close (fd);
-  }
+  /* Extract the transferred file descriptor from the control data */
+  void *data = CMSG_DATA (h);
+  return *(int *)data;
 }
 
 static void
@@ -207,25 +208,180 @@ close_stdout (void)
   }
 }
 
-/* Remote control server. */
-void
-rc_listen (void)
+/* Remote control server.
+ *
+ * Clients may keep their connection open between commands (see
+ * rc_remote below), so the server has to serve several connections
+ * at once, otherwise one long-lived client would lock out everyone
+ * else.  Commands are still run one at a time, taking one command
+ * from each client which is ready in turn.
+ */
+struct rc_client {
+  FILE *fp;                     /* Reading commands. */
+  FILE *fp_out;                 /* Writing replies. */
+  XDR xdr;                      /* Decoding commands from fp. */
+  int stdout_fd;                /* The client's stdout. */
+};
+
+static void
+free_client (struct rc_client *c)
 {
-  char sockpath[UNIX_PATH_MAX];
-  pid_t pid;
-  struct sockaddr_un addr;
-  int sock, s;
-  size_t i;
-  FILE *fp;
-  XDR xdr, xdr2;
+  xdr_destroy (&c->xdr);        /* NB. This doesn't close 'fp'. */
+  fclose (c->fp_out);           /* Closes the duplicate socket. */
+  fclose (c->fp);               /* Closes the underlying socket. */
+  if (c->stdout_fd >= 0)
+    close (c->stdout_fd);
+  free (c);
+}
+
+/* Accept a new client, receive its stdout and read the greeting.
+ * Returns NULL if the connection could not be set up.
+ */
+static struct rc_client *
+accept_client (int sock)
+{
+  struct rc_client *c;
   guestfish_hello hello;
+  int s, s2;
+
+  s = accept4 (sock, NULL, NULL, SOCK_CLOEXEC);
+  if (s == -1) {
+    perror ("accept");
+    return NULL;
+  }
+
+  c = malloc (sizeof *c);
+  if (c == NULL) {
+    perror ("malloc");
+    exit (EXIT_FAILURE);
+  }
+  c->stdout_fd = receive_stdout (s);
+
+  /* Use separate streams for reading commands and writing replies,
+   * since ISO C doesn't allow switching from reading to writing on
+   * one stream without an intervening fseek.
+   */
+  s2 = fcntl (s, F_DUPFD_CLOEXEC, 0);
+  if (s2 == -1) {
+    perror ("dup");
+    if (c->stdout_fd >= 0)
+      close (c->stdout_fd);
+    close (s);
+    free (c);
+    return NULL;
+  }
+  c->fp = fdopen (s, "r");
+  c->fp_out = fdopen (s2, "w");
+  if (c->fp == NULL || c->fp_out == NULL) {
+    perror ("fdopen");
+    exit (EXIT_FAILURE);
+  }
+  xdrstdio_create (&c->xdr, c->fp, XDR_DECODE);
+
+  memset (&hello, 0, sizeof hello);
+  if (!xdr_guestfish_hello (&c->xdr, &hello)) {
+    fprintf (stderr, _("guestfish: protocol error: could not read 'hello' message\n"));
+    free_client (c);
+    return NULL;
+  }
+
+  if (STRNEQ (hello.vers, PACKAGE_VERSION)) {
+    fprintf (stderr, _("guestfish: protocol error: version mismatch, server version '%s' does not match client version '%s'.  The two versions must match exactly.\n"),
+             PACKAGE_VERSION,
+             hello.vers);
+    xdr_free ((xdrproc_t) xdr_guestfish_hello, (char *) &hello);
+    free_client (c);
+    return NULL;
+  }
+  xdr_free ((xdrproc_t) xdr_guestfish_hello, (char *) &hello);
+
+  return c;
+}
+
+/* Read one command from the client, run it and send the reply.
+ * Returns -1 if the connection should be closed, because the client
+ * disconnected or the handle has been closed by 'quit'.
+ */
+static int
+serve_call (struct rc_client *c, pid_t pid, const char *sockpath)
+{
   guestfish_call call;
   guestfish_reply reply;
+  XDR xdr2;
   char **argv;
-  size_t argc;
+  size_t argc, i;
+  int exit_on_error;
 
-  memset (&hello, 0, sizeof hello);
   memset (&call, 0, sizeof call);
+  if (!xdr_guestfish_call (&c->xdr, &call))
+    return -1;
+
+  /* We have to extend and NULL-terminate the argv array. */
+  argc = call.args.args_len;
+  argv = realloc (call.args.args_val, (argc+1) * sizeof (char *));
+  if (argv == NULL) {
+    perror ("realloc");
+    exit (EXIT_FAILURE);
+  }
+  call.args.args_val = argv;
+  argv[argc] = NULL;
+
+  if (verbose) {
+    fprintf (stderr, "guestfish(%d): %s", pid, call.cmd);
+    for (i = 0; i < argc; ++i)
+      fprintf (stderr, " %s", argv[i]);
+    fprintf (stderr, "\n");
+  }
+
+  /* Run the command with its output going to the client's stdout.
+   * Flush the output before replying, since the client may be
+   * sending a whole script over this connection and expects the
+   * output of each command to appear before the next one starts.
+   */
+  if (c->stdout_fd >= 0)
+    dup2 (c->stdout_fd, STDOUT_FILENO);
+  reply.r = issue_command (call.cmd, argv, NULL, 0);
+  fflush (stdout);
+  close_stdout ();
+
+  exit_on_error = call.exit_on_error;
+  xdr_free ((xdrproc_t) xdr_guestfish_call, (char *) &call);
+
+  /* RHBZ#802389: If the command is quit, close the handle right
+   * away.  Note that the main while loop will exit preventing 'g'
+   * from being reused.
+   */
+  if (quit) {
+    guestfs_close (g);
+    g = NULL;
+  }
+
+  /* Send the reply. */
+  xdrstdio_create (&xdr2, c->fp_out, XDR_ENCODE);
+  (void) xdr_guestfish_reply (&xdr2, &reply);
+  xdr_destroy (&xdr2);          /* Flushes the reply. */
+
+  /* Exit on error? */
+  if (exit_on_error && reply.r == -1) {
+    unlink (sockpath);
+    exit (EXIT_FAILURE);
+  }
+
+  /* The handle has gone, so don't read any more commands. */
+  return quit ? -1 : 0;
+}
+
+void
+rc_listen (void)
+{
+  char sockpath[UNIX_PATH_MAX];
+  pid_t pid;
+  struct sockaddr_un addr;
+  int sock, timeout;
+  size_t i, j;
+  struct rc_client **clients = NULL, *c;
+  size_t nr_clients = 0;
+  struct pollfd *fds = NULL;
 
   create_sockdir ();
 
@@ -274,109 +430,116 @@ rc_listen (void)
     exit (EXIT_FAILURE);
   }
 
+  /* Close stdout and substitute /dev/null.  This is necessary so that
+   * eval `guestfish --listen` doesn't block forever.  Commands write
+   * to the stdout of the client which sent them.
+   */
+  close_stdout ();
+
   /* Read commands and execute them. */
   while (!quit) {
-    /* Before waiting, close stdout and substitute /dev/null.  This is
-     * necessary so that eval `guestfish --listen` doesn't block
-     * forever.
+    /* fds[0] is the listening socket, fds[i+1] is clients[i].
+     * Commands which have already been read into a client's stdio
+     * buffer (eg. the first command, which arrives along with the
+     * greeting) won't show up in poll, so don't wait if there are
+     * any.
      */
-    close_stdout ();
-
-    s = accept4 (sock, NULL, NULL, SOCK_CLOEXEC);
-    if (s == -1)
-      perror ("accept");
-    else {
-      receive_stdout(s);
-
-      fp = fdopen (s, "r+");
-      xdrstdio_create (&xdr, fp, XDR_DECODE);
+    fds = realloc (fds, (nr_clients+1) * sizeof (struct pollfd));
+    if (fds == NULL) {
+      perror ("realloc");
+      exit (EXIT_FAILURE);
+    }
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    timeout = -1;
+    for (i = 0; i < nr_clients; ++i) {
+      fds[i+1].fd = fileno (clients[i]->fp);
+      fds[i+1].events = POLLIN;
+      if (freadahead (clients[i]->fp) > 0)
+        timeout = 0;
+    }
 
-      if (!xdr_guestfish_hello (&xdr, &hello)) {
-        fprintf (stderr, _("guestfish: protocol error: could not read 'hello' message\n"));
-        goto error;
-      }
+    if (poll (fds, nr_clients+1, timeout) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror ("poll");
+      exit (EXIT_FAILURE);
+    }
 
-      if (STRNEQ (hello.vers, PACKAGE_VERSION)) {
-        fprintf (stderr, _("guestfish: protocol error: version mismatch, server version '%s' does not match client version '%s'.  The two versions must match exactly.\n"),
-                 PACKAGE_VERSION,
-                 hello.vers);
-        xdr_free ((xdrproc_t) xdr_guestfish_hello, (char *) &hello);
-        goto error;
+    /* Serve one command from each client which is ready. */
+    for (i = j = 0; i < nr_clients; ++i) {
+      c = clients[i];
+      if (!quit &&
+          (fds[i+1].revents != 0 || freadahead (c->fp) > 0) &&
+          serve_call (c, pid, sockpath) == -1) {
+        free_client (c);
+        continue;
       }
-      xdr_free ((xdrproc_t) xdr_guestfish_hello, (char *) &hello);
+      clients[j++] = c;
+    }
+    nr_clients = j;
 
-      while (xdr_guestfish_call (&xdr, &call)) {
-        /* We have to extend and NULL-terminate the argv array. */
-        argc = call.args.args_len;
-        argv = realloc (call.args.args_val, (argc+1) * sizeof (char *));
-        if (argv == NULL) {
+    if (!quit && (fds[0].revents & POLLIN) != 0) {
+      c = accept_client (sock);
+      if (c) {
+        clients = realloc (clients, (nr_clients+1) * sizeof (c));
+        if (clients == NULL) {
           perror ("realloc");
           exit (EXIT_FAILURE);
         }
-        call.args.args_val = argv;
-        argv[argc] = NULL;
-
-        if (verbose) {
-          fprintf (stderr, "guestfish(%d): %s", pid, call.cmd);
-          for (i = 0; i < argc; ++i)
-            fprintf (stderr, " %s", argv[i]);
-          fprintf (stderr, "\n");
-        }
-
-        /* Run the command. */
-        reply.r = issue_command (call.cmd, argv, NULL, 0);
-
-        xdr_free ((xdrproc_t) xdr_guestfish_call, (char *) &call);
-
-        /* RHBZ#802389: If the command is quit, close the handle right
-         * away.  Note that the main while loop will exit preventing
-         * 'g' from being reused.
-         */
-        if (quit) {
-          guestfs_close (g);
-          g = NULL;
-        }
-
-        /* Send the reply. */
-        xdrstdio_create (&xdr2, fp, XDR_ENCODE);
-        (void) xdr_guestfish_reply (&xdr2, &reply);
-        xdr_destroy (&xdr2);
-
-        /* Exit on error? */
-        if (call.exit_on_error && reply.r == -1) {
-          unlink (sockpath);
-          exit (EXIT_FAILURE);
-        }
+        clients[nr_clients++] = c;
       }
-
-    error:
-      xdr_destroy (&xdr);	/* NB. This doesn't close 'fp'. */
-      fclose (fp);		/* Closes the underlying socket 's'. */
     }
   }
 
+  for (i = 0; i < nr_clients; ++i)
+    free_client (clients[i]);
+  free (clients);
+  free (fds);
+
   unlink (sockpath);
   close (sock);
 
   /* This returns to 'fish.c', where it jumps to global cleanups and exits. */
 }
 
-/* Remote control client. */
-int
-rc_remote (int pid, const char *cmd, size_t argc, char *argv[],
-           int exit_on_error)
+/* Remote control client.
+ *
+ * The connection to the server is kept open between commands, so
+ * that a script sent with 'guestfish --remote < script' only pays
+ * for connecting, passing stdout and the greeting once.  The
+ * connection is dropped if the server or our stdout changes (eg.
+ * because of '| pipecmd'), after errors, and after 'quit'.
+ */
+static FILE *rc_fp = NULL;       /* Reading replies. */
+static FILE *rc_fp_out = NULL;   /* Writing commands. */
+static int rc_pid;
+static dev_t rc_stdout_dev;
+static ino_t rc_stdout_ino;
+
+void
+rc_remote_close (void)
+{
+  if (rc_fp) {
+    fclose (rc_fp_out);         /* Closes the duplicate socket. */
+    fclose (rc_fp);             /* Closes the underlying socket. */
+    rc_fp = rc_fp_out = NULL;
+  }
+}
+
+/* Connect to the server and send the greeting.  On success, the
+ * streams for reading and writing are stored in rc_fp and rc_fp_out.
+ */
+static int
+rc_connect (int pid)
 {
   guestfish_hello hello;
-  guestfish_call call;
-  guestfish_reply reply;
   char sockpath[UNIX_PATH_MAX];
   struct sockaddr_un addr;
-  int sock;
-  FILE *fp;
+  int sock, sock2;
+  FILE *fp, *fp_out;
   XDR xdr;
 
-  memset (&reply, 0, sizeof reply);
-
   /* This is fine as long as we never try to xdr_free this struct. */
   hello.vers = (char *) PACKAGE_VERSION;
 
@@ -403,44 +566,100 @@ rc_remote (int pid, const char *cmd, size_t argc, char *argv[],
 
   send_stdout(sock);
 
+  /* Use separate streams for writing commands and reading replies,
+   * see rc_listen.
+   */
+  sock2 = fcntl (sock, F_DUPFD_CLOEXEC, 0);
+  if (sock2 == -1) {
+    perror ("dup");
+    close (sock);
+    return -1;
+  }
+  fp = fdopen (sock, "r");
+  fp_out = fdopen (sock2, "w");
+  if (fp == NULL || fp_out == NULL) {
+    perror ("fdopen");
+    exit (EXIT_FAILURE);
+  }
+
   /* Send the greeting. */
-  fp = fdopen (sock, "r+");
-  xdrstdio_create (&xdr, fp, XDR_ENCODE);
+  xdrstdio_create (&xdr, fp_out, XDR_ENCODE);
 
   if (!xdr_guestfish_hello (&xdr, &hello)) {
     fprintf (stderr, _("guestfish: protocol error: could not send initial greeting to server\n"));
     xdr_destroy (&xdr);
+    fclose (fp_out);
     fclose (fp);
     return -1;
   }
+  xdr_destroy (&xdr);
 
-  /* Send the command.  The server supports reading multiple commands
-   * per connection, but this code only ever sends one command.
-   */
+  rc_fp = fp;
+  rc_fp_out = fp_out;
+  return 0;
+}
+
+int
+rc_remote (int pid, const char *cmd, size_t argc, char *argv[],
+           int exit_on_error)
+{
+  guestfish_call call;
+  guestfish_reply reply;
+  struct stat statbuf;
+  int stdout_ok;
+  XDR xdr;
+
+  memset (&reply, 0, sizeof reply);
+
+  stdout_ok = fstat (STDOUT_FILENO, &statbuf) == 0;
+  if (rc_fp &&
+      (pid != rc_pid || !stdout_ok ||
+       statbuf.st_dev != rc_stdout_dev || statbuf.st_ino != rc_stdout_ino))
+    rc_remote_close ();
+
+  if (rc_fp == NULL) {
+    if (rc_connect (pid) == -1)
+      return -1;
+    rc_pid = pid;
+    rc_stdout_dev = stdout_ok ? statbuf.st_dev : 0;
+    rc_stdout_ino = stdout_ok ? statbuf.st_ino : 0;
+  }
+
+  /* Send the command. */
+  xdrstdio_create (&xdr, rc_fp_out, XDR_ENCODE);
   call.cmd = (char *) cmd;
   call.args.args_len = argc;
   call.args.args_val = argv;
   call.exit_on_error = exit_on_error;
   if (!xdr_guestfish_call (&xdr, &call)) {
-    fprintf (stderr, _("guestfish: protocol error: could not send initial greeting to server\n"));
+    fprintf (stderr, _("guestfish: protocol error: could not send command to server\n"));
     xdr_destroy (&xdr);
-    fclose (fp);
+    rc_remote_close ();
     return -1;
   }
-  xdr_destroy (&xdr);
+  xdr_destroy (&xdr);           /* Flushes the command. */
 
   /* Wait for the reply. */
-  xdrstdio_create (&xdr, fp, XDR_DECODE);
+  xdrstdio_create (&xdr, rc_fp, XDR_DECODE);
 
   if (!xdr_guestfish_reply (&xdr, &reply)) {
     fprintf (stderr, _("guestfish: protocol error: could not decode reply from server\n"));
     xdr_destroy (&xdr);
-    fclose (fp);
+    rc_remote_close ();
     return -1;
   }
 
   xdr_destroy (&xdr);
-  fclose (fp);
+
+  /* In these cases the server has closed its end or exited. */
+  if (reply.r == -1 && exit_on_error)
+    rc_remote_close ();
+  else if (STRCASEEQ (cmd, "quit") ||
+           STRCASEEQ (cmd, "exit") ||
+           STRCASEEQ (cmd, "q"))
+    rc_remote_close ();
+  else if (!stdout_ok)
+    rc_remote_close ();
 
   return reply.r;
 }
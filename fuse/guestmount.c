@@ -108,6 +108,7 @@ usage (int status)
              "Options:\n"
              "  -a|--add image       Add image\n"
              "  -c|--connect uri     Specify libvirt URI for -d option\n"
+             "  --dir-cache-max-entries N  Limit size of readdir cache\n"
              "  --dir-cache-timeout  Set readdir cache timeout (default 5 sec)\n"
              "  -d|--domain guest    Add disks from libvirt guest\n"
              "  --echo-keys          Don't turn off echo for passphrases\n"
@@ -152,6 +153,7 @@ main (int argc, char *argv[])
   static const struct option long_options[] = {
     { "add", 1, 0, 'a' },
     { "connect", 1, 0, 'c' },
+    { "dir-cache-max-entries", 1, 0, 0 },
     { "dir-cache-timeout", 1, 0, 0 },
     { "domain", 1, 0, 'd' },
     { "echo-keys", 0, 0, 0 },
@@ -186,6 +188,7 @@ main (int argc, char *argv[])
   struct sigaction sa;
 
   int debug_calls = 0;
+  int dir_cache_max_entries = -1;
   int dir_cache_timeout = -1;
   int do_fork = 1;
   char *fuse_options = NULL;
@@ -215,6 +218,8 @@ main (int argc, char *argv[])
     case 0:			/* options which are long only */
       if (STREQ (long_options[option_index].name, "long-options"))
         display_long_options (long_options);
+      else if (STREQ (long_options[option_index].name, "dir-cache-max-entries"))
+        dir_cache_max_entries = atoi (optarg);
       else if (STREQ (long_options[option_index].name, "dir-cache-timeout"))
         dir_cache_timeout = atoi (optarg);
       else if (STREQ (long_options[option_index].name, "fuse-help"))
@@ -391,6 +396,10 @@ main (int argc, char *argv[])
     optargs.bitmask |= GUESTFS_MOUNT_LOCAL_CACHETIMEOUT_BITMASK;
     optargs.cachetimeout = dir_cache_timeout;
   }
+  if (dir_cache_max_entries > 0) {
+    optargs.bitmask |= GUESTFS_MOUNT_LOCAL_CACHEMAXENTRIES_BITMASK;
+    optargs.cachemaxentries = dir_cache_max_entries;
+  }
   if (fuse_options != NULL) {
     optargs.bitmask |= GUESTFS_MOUNT_LOCAL_OPTIONS_BITMASK;
     optargs.options = fuse_options;
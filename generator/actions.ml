@@ -1286,7 +1286,7 @@ not all belong to a single logical operating system
 
   { defaults with
     name = "add_drive";
-    style = RErr, [String "filename"], [OBool "readonly"; OString "format"; OString "iface"; OString "name"; OString "label"; OString "protocol"; OStringList "server"; OString "username"; OString "secret"; OString "cachemode"; OString "discard"];
+    style = RErr, [String "filename"], [OBool "readonly"; OString "format"; OString "iface"; OString "name"; OString "label"; OString "protocol"; OStringList "server"; OString "username"; OString "secret"; OString "cachemode"; OString "discard"; OBool "detectzeroes"];
     once_had_no_optargs = true;
     blocking = false;
     fish_alias = ["add"];
@@ -1534,6 +1534,17 @@ possible, but don't mind if it doesn't work.
 
 =back
 
+=item C<detectzeroes>
+
+If true, qemu checks every write to this drive for blocks of zeroes
+and turns them into discards, so that writing zeroes (for example
+using C<guestfs_zero_device> or C<guestfs_copy_device_to_device>)
+makes the host file sparse.  Checking the data costs CPU time on
+every write, so this is off by default.
+
+This requires C<discard> to be C<enable> or C<besteffort>.  It is
+ignored if qemu is older than 2.1.
+
 =back" };
 
   { defaults with
@@ -2278,7 +2289,7 @@ This returns the number of virtual CPUs assigned to the appliance." };
 
   { defaults with
     name = "mount_local";
-    style = RErr, [String "localmountpoint"], [OBool "readonly"; OString "options"; OInt "cachetimeout"; OBool "debugcalls"];
+    style = RErr, [String "localmountpoint"], [OBool "readonly"; OString "options"; OInt "cachetimeout"; OBool "debugcalls"; OInt "cachemaxentries"];
     shortdesc = "mount on the local filesystem";
     longdesc = "\
 This call exports the libguestfs-accessible filesystem to
@@ -2288,14 +2299,25 @@ C<localmountpoint> are redirected through libguestfs.
 
 If the optional C<readonly> flag is set to true, then
 writes to the filesystem return error C<EROFS>.
+Since nothing can then change the filesystem, directory
+listings, attributes, extended attributes and symbolic links are
+cached until they are evicted (see C<cachemaxentries>; cached
+directory listings are also limited to 32 MB in total), file
+contents are kept in the kernel page cache between opens, and the
+kernel is allowed to cache names and attributes for a long time.
 
 C<options> is a comma-separated list of mount options.
 See L<guestmount(1)> for some useful options.
 
 C<cachetimeout> sets the timeout (in seconds) for cached directory
-entries.  The default is 60 seconds.  See L<guestmount(1)>
+entries.  The default is 60 seconds, or no timeout if C<readonly>
+is set.  See L<guestmount(1)>
 for further information.
 
+C<cachemaxentries> sets the maximum number of entries kept in
+each of the directory caches.  When a cache is full, the least
+recently used entries are discarded.  The default is 100000.
+
 If C<debugcalls> is set to true, then additional debugging
 information is generated for every FUSE call.
 
@@ -2437,7 +2459,14 @@ or C<guestfs_download> functions." };
         [["mkdir_p"; "/find/b/c"];
          ["touch"; "/find/b/c/d"];
          ["find"; "/find/b/"]],
-        "is_string_list (ret, 2, \"c\", \"c/d\")"), []
+        "is_string_list (ret, 2, \"c\", \"c/d\")"), [];
+      (* Enough names to need several FileOut chunks. *)
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/find2"];
+         ["fill_dir"; "/find2"; "1500"];
+         ["find"; "/find2"]],
+        "ret[1499] != NULL && ret[1500] == NULL && "^
+        "STREQ (ret[0], \"00000000\") && STREQ (ret[1499], \"00001499\")"), []
     ];
     shortdesc = "find all files and directories";
     longdesc = "\
@@ -2789,6 +2818,41 @@ unplug the drive: see L<guestfs(3)/HOTPLUGGING>.  The disk B<must not>
 be in use (eg. mounted) when you do this.  We try to detect if the
 disk is in use and stop you from doing this." };
 
+  { defaults with
+    name = "add_drives";
+    style = RErr, [StringList "filenames"; StringList "labels"], [OBool "readonly"; OString "format"; OString "cachemode"];
+    blocking = false;
+    shortdesc = "add several disk images, with labels";
+    longdesc = "\
+This adds each of the disk images in C<filenames>, with the
+corresponding disk label from C<labels>.  The two lists must be
+the same length.  The optional arguments apply to every drive and
+have the same meaning as in C<guestfs_add_drive_opts>.
+
+Before launch this is the same as calling C<guestfs_add_drive_opts>
+on each drive.  After launch, if the backend supports it, the drives
+are hot-plugged (see L<guestfs(3)/HOTPLUGGING>): they are all
+attached first, and then the appliance waits for all of them to
+appear at the same time, which is much faster than adding them one
+by one.
+
+If one of the drives cannot be added, the drives before it have
+already been added and an error is returned." };
+
+  { defaults with
+    name = "remove_drives";
+    style = RErr, [StringList "labels"], [];
+    blocking = false;
+    shortdesc = "remove several disk images";
+    longdesc = "\
+This removes all the drives with the given C<labels>, like calling
+C<guestfs_remove_drive> for each one.
+
+After launch the drives are hot-unplugged together: the check that
+none of the disks is in use is done for all of them first, and the
+appliance waits once for all of them to go away.  If any label is
+not found, or any of the disks is in use, nothing is removed." };
+
   { defaults with
     name = "set_libvirt_supported_credentials";
     style = RErr, [StringList "creds"], [];
@@ -3206,6 +3270,190 @@ This call returns the number of strings which were removed
 
 See L<guestfs(3)/BACKEND>, L<guestfs(3)/BACKEND SETTINGS>." };
 
+  { defaults with
+    name = "rpc_stats";
+    style = RStructList ("stats", "rpc_stat"), [], [OBool "daemon"];
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["rpc_stats_reset"];
+         ["ping_daemon"];
+         ["rpc_stats"; ""]],
+        "ret->len == 1 && STREQ (ret->val[0].rpc_name, \"ping_daemon\") && ret->val[0].rpc_calls == 1 && ret->val[0].rpc_errors == 0"), [];
+      InitEmpty, Always, TestResult (
+        [["rpc_stats_reset"];
+         ["ping_daemon"];
+         ["ping_daemon"];
+         ["rpc_stats"; "true"]],
+        "ret->len == 1 && STREQ (ret->val[0].rpc_name, \"ping_daemon\") && ret->val[0].rpc_calls == 2"), []
+    ];
+    shortdesc = "return statistics about calls made to the daemon";
+    longdesc = "\
+Return counters for each procedure which has been called in the
+appliance, for finding out which calls dominate the time taken by
+a program.  The counters are always collected.  They are kept until
+the handle is closed or C<guestfs_rpc_stats_reset> is called.
+
+By default this returns the statistics measured by the library.
+The latency of each call is the time from sending the call to
+receiving the reply, so it includes the round trip to the
+appliance.  If the optional C<daemon> flag is true, this returns
+the statistics measured by the daemon instead, where the latency is
+the time spent handling the call.  The daemon statistics are lost if
+the appliance is relaunched.
+
+Each entry contains:
+
+=over 4
+
+=item C<rpc_proc>
+
+=item C<rpc_name>
+
+The procedure number and the API name.
+
+=item C<rpc_calls>
+
+=item C<rpc_errors>
+
+The number of calls, and how many of those returned an error.
+
+=item C<rpc_total_usec>
+
+=item C<rpc_max_usec>
+
+The total and maximum latency, in microseconds.
+
+=item C<rpc_lat_1ms>
+
+=item C<rpc_lat_10ms>
+
+=item C<rpc_lat_100ms>
+
+=item C<rpc_lat_1s>
+
+=item C<rpc_lat_slow>
+
+A latency histogram: the number of calls taking less than 1ms,
+less than 10ms, less than 100ms, less than 1s, and 1s or more.
+
+=item C<rpc_bytes_sent>
+
+=item C<rpc_bytes_received>
+
+Bytes sent and received on the RPC channel for this procedure,
+including FileIn and FileOut data, from the point of view of the
+side collecting the statistics.
+
+=item C<rpc_chunks_sent>
+
+=item C<rpc_chunks_received>
+
+The number of FileIn or FileOut chunks sent and received.
+
+=back
+
+Only procedures which have been called are returned." };
+
+  { defaults with
+    name = "rpc_stats_reset";
+    style = RErr, [], [];
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["ping_daemon"];
+         ["rpc_stats_reset"];
+         ["rpc_stats"; ""]],
+        "ret->len == 0"), []
+    ];
+    shortdesc = "reset RPC statistics";
+    longdesc = "\
+Reset the statistics returned by C<guestfs_rpc_stats>.  If the
+appliance is running, the daemon statistics are reset too." };
+
+  { defaults with
+    name = "launch_timings";
+    style = RStructList ("timings", "launch_timing"), [], [];
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["launch_timings"]],
+        "ret->len >= 1 && STREQ (ret->val[ret->len-1].lt_phase, \"total\")"), []
+    ];
+    shortdesc = "return how long each phase of the last launch took";
+    longdesc = "\
+Return how long each phase of the last call to C<guestfs_launch>
+took, in microseconds.  This is the same information as the
+timestamped messages printed when launching in verbose mode, but
+does not require debugging to be enabled.
+
+The phases are returned in order.  The durations of all the phases
+except the last one add up to the total.  Phases measured in the
+library are:
+
+=over 4
+
+=item C<appliance>
+
+Finding or building the appliance.
+
+=item C<qemu>
+
+Starting the hypervisor, including finding out which features it
+supports.
+
+=item C<boot>
+
+From starting the hypervisor until the daemon in the appliance
+has contacted the library.
+
+=item C<total>
+
+The whole launch.
+
+=back
+
+If the appliance is running and reports its own boot milestones,
+C<boot> is replaced by the following phases.  The appliance times
+are measured by the appliance kernel clock, so C<firmware> is the
+remainder of the boot time that the appliance cannot account for.
+
+=over 4
+
+=item C<firmware>
+
+Hypervisor start up and the BIOS, until the appliance kernel starts
+(and the time taken for the daemon's first message to reach the
+library).
+
+=item C<kernel>
+
+The appliance kernel, until the C</init> script starts.
+
+=item C<init>
+
+Early C</init> script, until udev is started.
+
+=item C<udev>
+
+Waiting for udev to settle.
+
+=item C<devices>
+
+The rest of the C</init> script: setting up the network and scanning
+for MD, LVM and Windows dynamic disks.
+
+=item C<daemon>
+
+Starting the daemon, until it contacts the library.
+
+=back
+
+Phases may be added in future, so callers should look for the names
+they are interested in, and should not rely on the number of
+phases.
+
+The backend may not measure every phase, in which case those phases
+are missing.  Calling this before launching the handle returns an
+error." };
+
 ]
 
 (* daemon_functions are any functions which cause some action
@@ -4704,7 +4952,8 @@ This command uploads and unpacks local file C<tarfile> into C<directory>.
 The optional C<compress> flag controls compression.  If not given,
 then the input should be an uncompressed tar file.  Otherwise one
 of the following strings may be given to select the compression
-type of the input file: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>.
+type of the input file: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>,
+C<zstd>.
 (Note that not all builds of libguestfs will support all of these
 compression types)." };
 
@@ -4722,10 +4971,20 @@ it to local file C<tarfile>.
 The optional C<compress> flag controls compression.  If not given,
 then the output will be an uncompressed tar file.  Otherwise one
 of the following strings may be given to select the compression
-type of the output file: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>.
+type of the output file: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>,
+C<zstd>.
 (Note that not all builds of libguestfs will support all of these
 compression types).
 
+If the appliance has more than one vCPU (see C<guestfs_set_smp>)
+then C<gzip>, C<xz> and C<zstd> compression use all of them.
+
+For C<gzip>, C<xz> and C<zstd>, L<tar(1)> runs the compression
+program through its I<--use-compress-program> option: L<gzip(1)>
+(or L<pigz(1)> if it is installed and there is more than one vCPU),
+L<xz(1)> or L<zstd(1)>.  That program must be present in the
+appliance, otherwise this call returns an error.
+
 The other optional arguments are:
 
 =over 4
@@ -5940,8 +6199,8 @@ Use C<guestfs_statvfs> from programs." };
     ];
     shortdesc = "estimate file space usage";
     longdesc = "\
-This command runs the C<du -s> command to estimate file space
-usage for C<path>.
+This command estimates file space usage for C<path>, in the same
+way as the C<du -s> command.
 
 C<path> can be a file or a directory.  If C<path> is a directory
 then the estimate includes the contents of the directory and all
@@ -6453,8 +6712,10 @@ for full details." };
     ];
     shortdesc = "return lines matching a pattern";
     longdesc = "\
-This calls the external C<grep> program and returns the
-matching lines.
+This returns the lines of C<path> which match the regular
+expression C<regex>, in the same way as the external C<grep>
+program.  As with C<grep>, C<regex> may contain several patterns
+separated by newlines.
 
 The optional flags are:
 
@@ -6477,7 +6738,12 @@ Match case-insensitive.  This is the same as using the I<-i> flag.
 =item C<compressed>
 
 Use C<zgrep> instead of C<grep>.  This allows the input to be
-compress- or gzip-compressed.
+compress-, gzip- or xz-compressed.
+
+gzip and xz files are decompressed in the daemon using zlib and
+liblzma, if the daemon was built with them.  Otherwise they are
+passed to the external C<zgrep> program, as are compress-compressed
+files.
 
 =back" };
 
@@ -9245,14 +9511,22 @@ This command compresses C<file> and writes it out to the local
 file C<zfile>.
 
 The compression program used is controlled by the C<ctype> parameter.
-Currently this includes: C<compress>, C<gzip>, C<bzip2>, C<xz> or C<lzop>.
+Currently this includes: C<compress>, C<gzip>, C<bzip2>, C<xz>, C<lzop>
+or C<zstd>.
 Some compression types may not be supported by particular builds of
 libguestfs, in which case you will get an error containing the
 substring \"not supported\".
 
 The optional C<level> parameter controls compression level.  The
 meaning and default for this parameter depends on the compression
-program being used." };
+program being used.
+
+Compression is usually limited by the speed of a single CPU.  If the
+appliance has more than one vCPU (see C<guestfs_set_smp>) then
+C<gzip> (if L<pigz(1)> is available in the appliance), C<xz> and
+C<zstd> compress using multiple threads, one per vCPU.  For fast
+export of large filesystems, C<zstd> with a low level is
+recommended." };
 
   { defaults with
     name = "compress_device_out";
@@ -11882,6 +12156,387 @@ blocks of zero bytes when read the next time.
 If it returns false, then it may be that discarded blocks are
 read as stale or random data." };
 
+  { defaults with
+    name = "aug_init_files";
+    style = RErr, [Pathname "root"; Int "flags"; StringList "files"], [];
+    proc_nr = Some 419;
+    optional = Some "augeas";
+    tests = [
+      InitBasicFS, Always, TestResultString (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hostname"; "test.example.org"];
+         ["write"; "/etc/hosts"; "127.0.0.1 localhost\n"];
+         ["aug_init_files"; "/"; "0"; "/etc/hostname"];
+         ["aug_get"; "/files/etc/hostname/hostname"]], "test.example.org"), [["aug_close"]];
+      InitBasicFS, Always, TestResult (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hostname"; "test.example.org"];
+         ["write"; "/etc/hosts"; "127.0.0.1 localhost\n"];
+         ["aug_init_files"; "/"; "0"; "/etc/hostname"];
+         ["aug_match"; "/files/etc/hosts"]], "is_string_list (ret, 0)"), [["aug_close"]]
+    ];
+    shortdesc = "create a new Augeas handle and load only some files";
+    longdesc = "\
+This is the same as calling C<guestfs_aug_init> with the
+C<AUG_NO_LOAD> flag, removing every lens from C</augeas/load>
+which is not needed to parse one of the C<files>, and then
+calling C<guestfs_aug_load>, except that it is done in
+a single call.
+
+C<files> is a non-empty list of absolute paths of configuration
+files (relative to C<root>).  Only these files are loaded
+into the tree, which is much faster than loading every
+configuration file known to Augeas, and also prevents very
+large or complicated unrelated files from being parsed.
+
+C<root> and C<flags> have the same meaning as in
+C<guestfs_aug_init>.  The C<AUG_NO_LOAD> flag is always added." };
+
+  { defaults with
+    name = "aug_get_tree";
+    style = RStringList "tree", [String "augpath"], [];
+    proc_nr = Some 420;
+    optional = Some "augeas";
+    tests = [
+      InitBasicFS, Always, TestResult (
+        [["mkdir"; "/etc"];
+         ["write"; "/etc/hostname"; "test.example.org"];
+         ["aug_init"; "/"; "0"];
+         ["aug_get_tree"; "/files/etc/hostname"]],
+         "is_string_list (ret, 4, \"/files/etc/hostname\", \"\", \"/files/etc/hostname/hostname\", \"test.example.org\")"), [["aug_close"]]
+    ];
+    shortdesc = "return all Augeas nodes and values under a path";
+    longdesc = "\
+This returns every node matching the Augeas path expression
+C<augpath>, and all of the descendants of those nodes, together
+with their values, in a single call.
+
+The returned list is a flat list of pairs of strings: the path
+of a node followed by its value.  The nodes are in document
+order, and the descendants of a node always follow it directly.
+Nodes which do not have a value are returned with an empty
+string as the value.
+
+This is useful for reading a whole configuration file (for example
+C</files/etc/fstab/*>) without having to call C<guestfs_aug_match>
+and C<guestfs_aug_get> once for every node." };
+
+  { defaults with
+    name = "internal_probe_filesystems";
+    style = RStringList "fingerprints", [StringList "mountables"; StringList "paths"], [];
+    proc_nr = Some 421;
+    visibility = VInternal;
+    test_excuse = "used by inspection, tested by tests/regressions and inspection tests";
+    shortdesc = "probe many filesystems for the existence of paths";
+    longdesc = "\
+This function is used internally by inspection.  Each filesystem
+in C<mountables> is mounted read-only on a private mountpoint, and
+each path in C<paths> is checked with L<lstat(2)>.  Several
+filesystems are probed in parallel.
+
+The result is a list with one fingerprint string per filesystem.
+Each fingerprint has one character per path: C<f> (regular file),
+C<d> (directory), C<l> (symbolic link), C<o> (other) or C<->
+(does not exist).  Paths prefixed by C<nocase:> are looked up
+ignoring the case of each path element.  A fingerprint of C<?>
+means that the filesystem could not be probed and the caller
+must check it some other way." };
+
+  { defaults with
+    name = "internal_rpc_stats";
+    style = RStructList ("stats", "rpc_stat"), [], [];
+    proc_nr = Some 422;
+    visibility = VInternal;
+    test_excuse = "tested by guestfs_rpc_stats";
+    shortdesc = "return daemon RPC statistics";
+    longdesc = "\
+This returns the daemon side RPC statistics.
+See C<guestfs_rpc_stats>." };
+
+  { defaults with
+    name = "internal_rpc_stats_reset";
+    style = RErr, [], [];
+    proc_nr = Some 423;
+    visibility = VInternal;
+    test_excuse = "tested by guestfs_rpc_stats";
+    shortdesc = "reset daemon RPC statistics";
+    longdesc = "\
+This resets the daemon side RPC statistics.
+See C<guestfs_rpc_stats_reset>." };
+
+  { defaults with
+    name = "compound";
+    style = RStringList "results", [StringList "calls"], [];
+    proc_nr = Some 424;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["compound"; "mkdir /compound touch /compound/a is_file /compound/a"]],
+        "is_string_list (ret, 3, \"\", \"\", \"true\")"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/compound2"];
+         ["touch"; "/compound2/a"];
+         ["compound"; "case_sensitive_path /COMPOUND2/A is_file $1"]],
+        "is_string_list (ret, 2, \"/compound2/a\", \"true\")"), [];
+      InitScratchFS, Always, TestLastFail
+        [["compound"; "mkdir /compound3 mkdir /compound3 rmdir /compound3"]], []
+    ];
+    shortdesc = "run a sequence of calls in the daemon";
+    longdesc = "\
+This runs a sequence of calls in the daemon in a single round trip,
+which is much faster than making the calls one at a time when the
+calls depend on each other.
+
+C<calls> is a flat list.  Each call is the name of the function
+(eg. C<\"case_sensitive_path\">) followed by exactly as many
+arguments as the function has required parameters.  Optional
+arguments cannot be passed and take their default values.  Integer
+and boolean parameters are written as strings (eg. C<\"1024\">,
+C<\"true\">).
+
+An argument C<$I<n>> refers to the result of the I<n>th call in the
+list (counting from 1).  To pass an argument which starts with a
+C<$> character, double it (eg. C<$$x> is passed as C<$x>).
+
+The return value is the list of results of each call, converted to
+strings: C<\"\"> for functions which return nothing, decimal for
+integers, and C<\"true\"> or C<\"false\"> for booleans.
+
+The calls stop at the first error, and this returns that error.
+
+Only functions whose parameters and return value can be written as
+strings can be used: functions which take lists, buffers or
+C<FileIn>/C<FileOut> parameters, or which return lists, buffers or
+structs cannot.
+
+For example, to find the Windows software hive and open it:
+
+ compound \"case_sensitive_path /windows/system32/config/software hivex_open $1 hivex_root\"
+
+returns the real path of the hive, an empty string and the handle of
+the root node." };
+
+  { defaults with
+    name = "internal_boot_timings";
+    style = RHashtable "timings", [], [];
+    proc_nr = Some 425;
+    visibility = VInternal;
+    test_excuse = "tested by guestfs_launch_timings";
+    shortdesc = "return appliance boot milestones";
+    longdesc = "\
+This returns the times (in microseconds since the appliance kernel
+started) at which the appliance reached each boot milestone.
+See C<guestfs_launch_timings>." };
+
+  { defaults with
+    name = "case_sensitive_paths";
+    style = RStringList "rpaths", [StringList "paths"], [];
+    proc_nr = Some 426;
+    tests = [
+      (* The ISO directories are old, so the first call caches their
+       * indexes and the second call is answered from the cache.
+       *)
+      InitISOFS, Always, TestResult (
+        [["case_sensitive_paths"; "/DIRECTORY /Known-1 /Known-1/ /new_FILE"];
+         ["case_sensitive_paths"; "/DIRECTORY /Known-1 /Known-1/ /new_FILE"]],
+        "is_string_list (ret, 4, \"/directory\", \"/known-1\", \"\", \"/new_FILE\")"), [];
+      (* Directories changed in the last two seconds are not cached,
+       * so wait before the first lookup.  Then check that creating a
+       * file invalidates the cached index.
+       *)
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/case_sensitive_paths"];
+         ["mkdir"; "/case_sensitive_paths/bbb"];
+         ["touch"; "/case_sensitive_paths/bbb/c"];
+         ["sleep"; "3"];
+         ["case_sensitive_paths"; "/CASE_SENSITIVE_paths/bbB/C /case_sensitive_PATHS/BBB /case_sensitive_paths/x/c"];
+         ["case_sensitive_paths"; "/CASE_SENSITIVE_paths/bbB/C /case_sensitive_PATHS/BBB /case_sensitive_paths/x/c"];
+         ["touch"; "/case_sensitive_paths/bbb/D"];
+         ["case_sensitive_paths"; "/CASE_SENSITIVE_paths/bbB/C /CASE_SENSITIVE_paths/bbB/d"]],
+        "is_string_list (ret, 2, \"/case_sensitive_paths/bbb/c\", \"/case_sensitive_paths/bbb/D\")"), []
+    ];
+    shortdesc = "return true paths of many files on case-insensitive filesystem";
+    longdesc = "\
+This resolves each path in C<paths> in the same way as
+C<guestfs_case_sensitive_path>, but in a single call.
+
+The returned list has one element for each path.  Paths which
+cannot be resolved (for example because a parent directory does
+not exist) are returned as empty strings instead of causing the
+whole call to fail." };
+
+  { defaults with
+    name = "grep_files";
+    style = RStringList "lines", [StringList "regexes"; StringList "paths"], [OBool "extended"; OBool "fixed"; OBool "insensitive"; OBool "compressed"];
+    proc_nr = Some 427;
+    protocol_limit_warning = true;
+    tests = [
+      InitISOFS, Always, TestResult (
+        [["grep_files"; "abc def"; "/test-grep.txt /test-grep.txt.gz"; ""; ""; ""; "true"]],
+        "is_string_list (ret, 6, \"/test-grep.txt:abc\", \"/test-grep.txt:def\", \"/test-grep.txt:abc123\", \"/test-grep.txt.gz:abc\", \"/test-grep.txt.gz:def\", \"/test-grep.txt.gz:abc123\")"), [];
+      InitISOFS, Always, TestResult (
+        [["grep_files"; "C1"; "/test-grep.txt /known-1"; ""; "true"; "true"; ""]],
+        "is_string_list (ret, 1, \"/test-grep.txt:abc123\")"), [];
+      InitISOFS, Always, TestLastFail (
+        [["grep_files"; "abc"; "/test-grep.txt /nosuchfile"; ""; ""; ""; ""]]), []
+    ];
+    shortdesc = "return lines matching patterns in many files";
+    longdesc = "\
+This is like C<guestfs_grep>, but it searches every file in
+C<paths> for lines matching any of the regular expressions in
+C<regexes>, in a single call.
+
+Each line returned is prefixed with the name of the file (exactly
+as given in C<paths>) and a C<:> character, like the I<-H> flag
+of C<grep>.  Lines are returned in the order of C<paths>.
+
+The optional flags are the same as for C<guestfs_grep>." };
+
+  { defaults with
+    name = "rm_rf_globs";
+    style = RInt "count", [StringList "globs"], [];
+    proc_nr = Some 428;
+    tests = [
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/rm_rf_globs"];
+         ["mkdir"; "/rm_rf_globs/dir"];
+         ["touch"; "/rm_rf_globs/dir/file"];
+         ["touch"; "/rm_rf_globs/a.log"];
+         ["touch"; "/rm_rf_globs/b.log"];
+         ["touch"; "/rm_rf_globs/keep"];
+         ["rm_rf_globs"; "/rm_rf_globs/*.log /rm_rf_globs/a* /rm_rf_globs/dir /rm_rf_globs/nomatch*"]],
+        "ret == 3"), [];
+      InitScratchFS, Always, TestResult (
+        [["mkdir"; "/rm_rf_globs2"];
+         ["mkdir"; "/rm_rf_globs2/dir"];
+         ["touch"; "/rm_rf_globs2/dir/file"];
+         ["touch"; "/rm_rf_globs2/.hidden"];
+         ["touch"; "/rm_rf_globs2/keep"];
+         ["rm_rf_globs"; "/rm_rf_globs2/d* /rm_rf_globs2/.*"];
+         ["ls"; "/rm_rf_globs2"]],
+        "is_string_list (ret, 1, \"keep\")"), [];
+      InitScratchFS, Always, TestLastFail (
+        [["rm_rf_globs"; "/"]]), []
+    ];
+    shortdesc = "remove all files and directories matching globs";
+    longdesc = "\
+Expand each of the wildcard patterns in C<globs> (as in
+C<guestfs_glob_expand>) and remove every matching file and
+directory recursively, like C<guestfs_rm_rf>.  Patterns which
+match nothing are ignored, and the C<.> and C<..> entries matched
+by patterns such as C</tmp/.*> are skipped.
+
+The return value is the number of paths which were removed.
+
+This is much faster than calling C<guestfs_glob_expand> and
+C<guestfs_rm_rf> on each path when there are many patterns or
+matches, since all the removals are done in a single call." };
+
+
+  { defaults with
+    name = "internal_hot_add_drives";
+    style = RErr, [StringList "labels"], [];
+    proc_nr = Some 429;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
+    longdesc = "\
+This function is used internally when hotplugging drives." };
+
+  { defaults with
+    name = "internal_hot_remove_drives_precheck";
+    style = RErr, [StringList "labels"], [];
+    proc_nr = Some 430;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
+    longdesc = "\
+This function is used internally when hotplugging drives." };
+
+  { defaults with
+    name = "internal_hot_remove_drives";
+    style = RErr, [StringList "labels"], [];
+    proc_nr = Some 431;
+    visibility = VInternal;
+    shortdesc = "internal hotplugging operation";
+    longdesc = "\
+This function is used internally when hotplugging drives." };
+
+  { defaults with
+    name = "sparsify_devices";
+    style = RStringList "results", [StringList "devices"; StringList "operations"], [OInt "maxthreads"];
+    proc_nr = Some 432;
+    progress = true;
+    tests = [
+      InitEmpty, Always, TestResult (
+        [["part_init"; "/dev/sda"; "mbr"];
+         ["part_add"; "/dev/sda"; "p"; "64"; "204799"];
+         ["part_add"; "/dev/sda"; "p"; "204800"; "-64"];
+         ["mkfs"; "ext2"; "/dev/sda1"; ""; "NOARG"; ""; ""];
+         ["sparsify_devices"; "/dev/sda1 /dev/sda2"; "zero zero-device"; "2"]],
+        "is_string_list (ret, 2, \"\", \"\")"), [];
+      InitPartition, Always, TestResult (
+        [["sparsify_devices"; "/dev/sda1"; "zero"; ""]],
+        "ret[0] != NULL && STRPREFIX (ret[0], \"cannot mount\")"), [];
+      InitPartition, Always, TestLastFail (
+        [["sparsify_devices"; "/dev/sda1"; "shred"; ""]]), [];
+      InitPartition, Always, TestLastFail (
+        [["sparsify_devices"; "/dev/sda1"; "zero zero"; ""]]), [];
+      InitPartition, Always, TestLastFail (
+        [["sparsify_devices"; "btrfsvol:/dev/sda1/sub"; "discard"; ""]]), []
+    ];
+    shortdesc = "trim or zero several devices in parallel";
+    longdesc = "\
+This is used by L<virt-sparsify(1)> to trim or zero several
+filesystems and devices at the same time.
+
+C<devices> is a list of devices or mountables, and C<operations>
+is a list of the same length saying what to do with each one:
+
+=over 4
+
+=item C<trim>
+
+Mount the filesystem and trim its free space, as in C<guestfs_fstrim>.
+
+=item C<zero>
+
+Mount the filesystem and fill its free space with zeroes, as in
+C<guestfs_zero_free_space>.
+
+=item C<discard>
+
+Discard the whole device, as in C<guestfs_blkdiscard>.
+
+=item C<zero-device>
+
+Zero the whole device, as in C<guestfs_zero_device>.
+
+=item C<zero-discard>
+
+Zero the device (unless discarded blocks read as zeroes,
+see C<guestfs_blkdiscardzeroes>) and then discard it.
+
+=item C<swap-discard>
+
+=item C<swap-zero>
+
+Discard or zero a Linux swap partition, preserving the header
+which contains the label, UUID and swap version.
+
+=back
+
+The filesystems must not be mounted already.  Each is mounted
+on a private mountpoint while it is being processed, and unmounted
+afterwards.  A btrfs subvolume (C<btrfsvol:...>) can only be used
+with the C<trim> and C<zero> operations.
+
+Up to C<maxthreads> (default 1) devices are processed at the
+same time.  Progress notifications cover the total over all
+the devices.
+
+The return value is a list of the same length as C<devices>.
+Each element is an empty string if the operation was done, or
+a message saying why it was skipped, which can only happen if a
+filesystem could not be mounted.  Any other error stops all the
+operations and is returned as an error from this call." };
 ]
 
 (* Non-API meta-commands available only in guestfish.
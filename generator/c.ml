@@ -56,6 +56,22 @@ let public_functions_sorted =
 let private_functions_sorted =
   List.filter is_private all_functions_sorted
 
+(* Daemon functions which also have an asynchronous variant,
+ * guestfs_<name>_async_send and guestfs_<name>_async_recv.  See
+ * "ASYNCHRONOUS CALLS" in guestfs(3).  FileIn and FileOut functions
+ * are left out because they stream data between the call and the
+ * reply.
+ *)
+let async_functions_sorted =
+  List.filter (
+    function
+    | { visibility = VPublic; deprecated_by = None; proc_nr = Some _;
+        style = _, args, _ } ->
+      not (List.exists (function FileIn _ | FileOut _ -> true | _ -> false)
+             args)
+    | _ -> false
+  ) all_functions_sorted
+
 (* Generate a C function prototype. *)
 let rec generate_prototype ?(extern = true) ?(static = false)
     ?(semicolon = true)
@@ -724,6 +740,29 @@ extern GUESTFS_DLL_PUBLIC void *guestfs_next_private (guestfs_h *g, const char *
 
   generate_all_headers public_functions_sorted;
 
+  pr "\
+/* Asynchronous calls.  See \"ASYNCHRONOUS CALLS\" in guestfs(3). */
+#define GUESTFS_HAVE_ASYNC_FDS 1
+#define GUESTFS_ASYNC_MAX_FDS 2
+extern GUESTFS_DLL_PUBLIC int guestfs_async_fds (guestfs_h *g, int fds[GUESTFS_ASYNC_MAX_FDS]);
+#define GUESTFS_HAVE_ASYNC_POLL 1
+extern GUESTFS_DLL_PUBLIC int guestfs_async_poll (guestfs_h *g);
+
+";
+
+  List.iter (
+    fun { c_name = c_name; style = ret, args, optargs } ->
+      generate_prototype ~single_line:true ~newline:true ~handle:"g"
+        ~prefix:"guestfs_" ~suffix:"_async_send" ~optarg_proto:Argv
+        ~dll_public:true
+        c_name (RErr, args, optargs);
+      generate_prototype ~single_line:true ~newline:true ~handle:"g"
+        ~prefix:"guestfs_" ~suffix:"_async_recv"
+        ~dll_public:true
+        c_name (ret, [], [])
+  ) async_functions_sorted;
+  pr "\n";
+
   pr "\
 #if GUESTFS_PRIVATE
 /* Symbols protected by GUESTFS_PRIVATE are NOT part of the public,
@@ -1630,103 +1669,14 @@ and generate_client_actions hash () =
       () (* no wrapper *)
   ) non_daemon_functions;
 
-  (* Client-side stubs for each function. *)
-  let generate_daemon_stub { name = name; c_name = c_name;
-                             style = ret, args, optargs as style } =
-    let errcode =
-      match errcode_of_ret ret with
-      | `CannotReturnError -> assert false
-      | (`ErrorIsMinusOne | `ErrorIsNULL) as e -> e in
-
-    (* Generate the action stub. *)
-    if optargs = [] then
-      generate_prototype ~extern:false ~semicolon:false ~newline:true
-        ~handle:"g" ~prefix:"guestfs_"
-        ~dll_public:true
-        c_name style
-    else
-      generate_prototype ~extern:false ~semicolon:false ~newline:true
-        ~handle:"g" ~prefix:"guestfs_" ~suffix:"_argv"
-        ~optarg_proto:Argv
-        ~dll_public:true
-        c_name style;
-
-    pr "{\n";
-
-    handle_null_optargs optargs c_name;
-
+  (* Generate code to marshal the arguments and send the call to the
+   * daemon, setting 'serial'.
+   *)
+  let send_call name c_name ((_, args, optargs) as style) errcode =
     let args_passed_to_daemon =
       List.filter (function FileIn _ | FileOut _ -> false | _ -> true)
         args in
-    (match args_passed_to_daemon with
-    | [] -> ()
-    | _ -> pr "  struct guestfs_%s_args args;\n" name
-    );
 
-    pr "  guestfs_message_header hdr;\n";
-    pr "  guestfs_message_error err;\n";
-    let has_ret =
-      match ret with
-      | RErr -> false
-      | RConstString _ | RConstOptString _ ->
-        failwithf "RConstString|RConstOptString cannot be used by daemon functions"
-      | RInt _ | RInt64 _
-      | RBool _ | RString _ | RStringList _
-      | RStruct _ | RStructList _
-      | RHashtable _ | RBufferOut _ ->
-        pr "  struct guestfs_%s_ret ret;\n" name;
-        true in
-
-    pr "  int serial;\n";
-    pr "  int r;\n";
-    pr "  int trace_flag = g->trace;\n";
-    pr "  struct trace_buffer trace_buffer;\n";
-    (match ret with
-    | RErr | RInt _ | RBool _ -> pr "  int ret_v;\n"
-    | RInt64 _ -> pr "  int64_t ret_v;\n"
-    | RConstString _ | RConstOptString _ -> pr "  const char *ret_v;\n"
-    | RString _ | RBufferOut _ -> pr "  char *ret_v;\n"
-    | RStringList _ | RHashtable _ -> pr "  char **ret_v;\n"
-    | RStruct (_, typ) -> pr "  struct guestfs_%s *ret_v;\n" typ
-    | RStructList (_, typ) -> pr "  struct guestfs_%s_list *ret_v;\n" typ
-    );
-
-    let has_filein =
-      List.exists (function FileIn _ -> true | _ -> false) args in
-    if has_filein then (
-      pr "  uint64_t progress_hint = 0;\n";
-      pr "  struct stat progress_stat;\n";
-    ) else
-      pr "  const uint64_t progress_hint = 0;\n";
-
-    pr "\n";
-    enter_event name;
-    check_null_strings c_name style;
-    reject_unknown_optargs c_name style;
-    check_args_validity c_name style;
-    trace_call name c_name style;
-
-    (* Calculate the total size of all FileIn arguments to pass
-     * as a progress bar hint.
-     *)
-    List.iter (
-      function
-      | FileIn n ->
-        pr "  if (stat (%s, &progress_stat) == 0 &&\n" n;
-        pr "      S_ISREG (progress_stat.st_mode))\n";
-        pr "    progress_hint += progress_stat.st_size;\n";
-        pr "\n";
-      | _ -> ()
-    ) args;
-
-    (* This is a daemon_function so check the appliance is up. *)
-    pr "  if (guestfs___check_appliance_up (g, \"%s\") == -1) {\n" name;
-    trace_return_error ~indent:4 name style errcode;
-    pr "    return %s;\n" (string_of_errcode errcode);
-    pr "  }\n";
-    pr "\n";
-
-    (* Send the main header and arguments. *)
     if args_passed_to_daemon = [] && optargs = [] then (
       pr "  serial = guestfs___send (g, GUESTFS_PROC_%s, progress_hint, 0,\n"
         (String.uppercase name);
@@ -1802,45 +1752,12 @@ and generate_client_actions hash () =
     pr "    return %s;\n" (string_of_errcode errcode);
     pr "  }\n";
     pr "\n";
+  in
 
-    (* Send any additional files (FileIn) requested. *)
-    let need_read_reply_label = ref false in
-    List.iter (
-      function
-      | FileIn n ->
-        pr "  r = guestfs___send_file (g, %s);\n" n;
-        pr "  if (r == -1) {\n";
-        trace_return_error ~indent:4 name style errcode;
-        pr "    /* daemon will send an error reply which we discard */\n";
-        pr "    guestfs___recv_discard (g, \"%s\");\n" name;
-        pr "    return %s;\n" (string_of_errcode errcode);
-        pr "  }\n";
-        pr "  if (r == -2) /* daemon cancelled */\n";
-        pr "    goto read_reply;\n";
-        need_read_reply_label := true;
-        pr "\n";
-      | _ -> ()
-    ) args;
-
-    (* Wait for the reply from the remote end. *)
-    if !need_read_reply_label then pr " read_reply:\n";
-    pr "  memset (&hdr, 0, sizeof hdr);\n";
-    pr "  memset (&err, 0, sizeof err);\n";
-    if has_ret then pr "  memset (&ret, 0, sizeof ret);\n";
-    pr "\n";
-    pr "  r = guestfs___recv (g, \"%s\", &hdr, &err,\n        " name;
-    if not has_ret then
-      pr "NULL, NULL"
-    else
-      pr "(xdrproc_t) xdr_guestfs_%s_ret, (char *) &ret" name;
-    pr ");\n";
-
-    pr "  if (r == -1) {\n";
-    trace_return_error ~indent:4 name style errcode;
-    pr "    return %s;\n" (string_of_errcode errcode);
-    pr "  }\n";
-    pr "\n";
-
+  (* Generate code to check the reply header and turn an error reply
+   * from the daemon into an error on the handle.
+   *)
+  let check_reply name style errcode =
     pr "  if (guestfs___check_reply_header (g, &hdr, GUESTFS_PROC_%s, serial) == -1) {\n"
       (String.uppercase name);
     trace_return_error ~indent:4 name style errcode;
@@ -1866,19 +1783,10 @@ and generate_client_actions hash () =
     pr "    return %s;\n" (string_of_errcode errcode);
     pr "  }\n";
     pr "\n";
+  in
 
-    (* Expecting to receive further files (FileOut)? *)
-    List.iter (
-      function
-      | FileOut n ->
-        pr "  if (guestfs___recv_file (g, %s) == -1) {\n" n;
-        trace_return_error ~indent:4 name style errcode;
-        pr "    return %s;\n" (string_of_errcode errcode);
-        pr "  }\n";
-        pr "\n";
-      | _ -> ()
-    ) args;
-
+  (* Generate code to return the reply to the caller. *)
+  let return_reply name ((ret, _, _) as style) =
     (match ret with
     | RErr ->
       pr "  ret_v = 0;\n"
@@ -1920,13 +1828,260 @@ and generate_client_actions hash () =
     );
     trace_return name style "ret_v";
     pr "  return ret_v;\n";
+  in
+
+  let has_ret_struct = function
+    | RErr -> false
+    | RConstString _ | RConstOptString _ ->
+      failwithf "RConstString|RConstOptString cannot be used by daemon functions"
+    | RInt _ | RInt64 _
+    | RBool _ | RString _ | RStringList _
+    | RStruct _ | RStructList _
+    | RHashtable _ | RBufferOut _ -> true
+  in
+
+  let declare_ret_v = function
+    | RErr | RInt _ | RBool _ -> pr "  int ret_v;\n"
+    | RInt64 _ -> pr "  int64_t ret_v;\n"
+    | RConstString _ | RConstOptString _ -> pr "  const char *ret_v;\n"
+    | RString _ | RBufferOut _ -> pr "  char *ret_v;\n"
+    | RStringList _ | RHashtable _ -> pr "  char **ret_v;\n"
+    | RStruct (_, typ) -> pr "  struct guestfs_%s *ret_v;\n" typ
+    | RStructList (_, typ) -> pr "  struct guestfs_%s_list *ret_v;\n" typ
+  in
+
+  (* Client-side stubs for each function. *)
+  let generate_daemon_stub { name = name; c_name = c_name;
+                             style = ret, args, optargs as style } =
+    let errcode =
+      match errcode_of_ret ret with
+      | `CannotReturnError -> assert false
+      | (`ErrorIsMinusOne | `ErrorIsNULL) as e -> e in
+
+    (* Generate the action stub. *)
+    if optargs = [] then
+      generate_prototype ~extern:false ~semicolon:false ~newline:true
+        ~handle:"g" ~prefix:"guestfs_"
+        ~dll_public:true
+        c_name style
+    else
+      generate_prototype ~extern:false ~semicolon:false ~newline:true
+        ~handle:"g" ~prefix:"guestfs_" ~suffix:"_argv"
+        ~optarg_proto:Argv
+        ~dll_public:true
+        c_name style;
+
+    pr "{\n";
+
+    handle_null_optargs optargs c_name;
+
+    let args_passed_to_daemon =
+      List.filter (function FileIn _ | FileOut _ -> false | _ -> true)
+        args in
+    (match args_passed_to_daemon with
+    | [] -> ()
+    | _ -> pr "  struct guestfs_%s_args args;\n" name
+    );
+
+    pr "  guestfs_message_header hdr;\n";
+    pr "  guestfs_message_error err;\n";
+    let has_ret = has_ret_struct ret in
+    if has_ret then pr "  struct guestfs_%s_ret ret;\n" name;
+
+    pr "  int serial;\n";
+    pr "  int r;\n";
+    pr "  int trace_flag = g->trace;\n";
+    pr "  struct trace_buffer trace_buffer;\n";
+    declare_ret_v ret;
+
+    let has_filein =
+      List.exists (function FileIn _ -> true | _ -> false) args in
+    if has_filein then (
+      pr "  uint64_t progress_hint = 0;\n";
+      pr "  struct stat progress_stat;\n";
+    ) else
+      pr "  const uint64_t progress_hint = 0;\n";
+
+    pr "\n";
+    enter_event name;
+    check_null_strings c_name style;
+    reject_unknown_optargs c_name style;
+    check_args_validity c_name style;
+    trace_call name c_name style;
+
+    (* Calculate the total size of all FileIn arguments to pass
+     * as a progress bar hint.
+     *)
+    List.iter (
+      function
+      | FileIn n ->
+        pr "  if (stat (%s, &progress_stat) == 0 &&\n" n;
+        pr "      S_ISREG (progress_stat.st_mode))\n";
+        pr "    progress_hint += progress_stat.st_size;\n";
+        pr "\n";
+      | _ -> ()
+    ) args;
+
+    (* This is a daemon_function so check the appliance is up. *)
+    pr "  if (guestfs___check_appliance_up (g, \"%s\") == -1) {\n" name;
+    trace_return_error ~indent:4 name style errcode;
+    pr "    return %s;\n" (string_of_errcode errcode);
+    pr "  }\n";
+    pr "\n";
+
+    send_call name c_name style errcode;
+
+    (* Send any additional files (FileIn) requested. *)
+    let need_read_reply_label = ref false in
+    List.iter (
+      function
+      | FileIn n ->
+        pr "  r = guestfs___send_file (g, %s);\n" n;
+        pr "  if (r == -1) {\n";
+        trace_return_error ~indent:4 name style errcode;
+        pr "    /* daemon will send an error reply which we discard */\n";
+        pr "    guestfs___recv_discard (g, \"%s\");\n" name;
+        pr "    return %s;\n" (string_of_errcode errcode);
+        pr "  }\n";
+        pr "  if (r == -2) /* daemon cancelled */\n";
+        pr "    goto read_reply;\n";
+        need_read_reply_label := true;
+        pr "\n";
+      | _ -> ()
+    ) args;
+
+    (* Wait for the reply from the remote end. *)
+    if !need_read_reply_label then pr " read_reply:\n";
+    pr "  memset (&hdr, 0, sizeof hdr);\n";
+    pr "  memset (&err, 0, sizeof err);\n";
+    if has_ret then pr "  memset (&ret, 0, sizeof ret);\n";
+    pr "\n";
+    pr "  r = guestfs___recv (g, \"%s\", &hdr, &err,\n        " name;
+    if not has_ret then
+      pr "NULL, NULL"
+    else
+      pr "(xdrproc_t) xdr_guestfs_%s_ret, (char *) &ret" name;
+    pr ");\n";
+
+    pr "  if (r == -1) {\n";
+    trace_return_error ~indent:4 name style errcode;
+    pr "    return %s;\n" (string_of_errcode errcode);
+    pr "  }\n";
+    pr "\n";
+
+    check_reply name style errcode;
+
+    (* Expecting to receive further files (FileOut)? *)
+    List.iter (
+      function
+      | FileOut n ->
+        pr "  if (guestfs___recv_file (g, %s) == -1) {\n" n;
+        trace_return_error ~indent:4 name style errcode;
+        pr "    return %s;\n" (string_of_errcode errcode);
+        pr "  }\n";
+        pr "\n";
+      | _ -> ()
+    ) args;
+
+    return_reply name style;
+    pr "}\n\n"
+  in
+
+  (* Generate the asynchronous variant of a daemon function.  This is
+   * the daemon stub above, split in two where it waits for the reply.
+   *)
+  let generate_async_stubs { name = name; c_name = c_name;
+                             style = ret, args, optargs as style } =
+    let send_style = RErr, args, optargs in
+    let errcode =
+      match errcode_of_ret ret with
+      | `CannotReturnError -> assert false
+      | (`ErrorIsMinusOne | `ErrorIsNULL) as e -> e in
+
+    generate_prototype ~extern:false ~semicolon:false ~newline:true
+      ~handle:"g" ~prefix:"guestfs_" ~suffix:"_async_send"
+      ~optarg_proto:Argv
+      ~dll_public:true
+      c_name send_style;
+
+    pr "{\n";
+
+    handle_null_optargs optargs c_name;
+
+    if args <> [] then
+      pr "  struct guestfs_%s_args args;\n" name;
+    pr "  int serial;\n";
+    pr "  int trace_flag = g->trace;\n";
+    pr "  struct trace_buffer trace_buffer;\n";
+    pr "  const uint64_t progress_hint = 0;\n";
+    pr "\n";
+    enter_event name;
+    check_null_strings c_name send_style;
+    reject_unknown_optargs c_name send_style;
+    check_args_validity c_name send_style;
+    trace_call name c_name send_style;
+
+    pr "  if (guestfs___check_appliance_up (g, \"%s\") == -1) {\n" name;
+    trace_return_error ~indent:4 name send_style `ErrorIsMinusOne;
+    pr "    return -1;\n";
+    pr "  }\n";
+    pr "\n";
+
+    send_call name c_name send_style `ErrorIsMinusOne;
+
+    pr "  guestfs___async_sent (g, GUESTFS_PROC_%s, serial);\n"
+      (String.uppercase name);
+    pr "  return 0;\n";
+    pr "}\n\n";
+
+    generate_prototype ~extern:false ~semicolon:false ~newline:true
+      ~handle:"g" ~prefix:"guestfs_" ~suffix:"_async_recv"
+      ~dll_public:true
+      c_name (ret, [], []);
+
+    pr "{\n";
+    pr "  guestfs_message_header hdr;\n";
+    pr "  guestfs_message_error err;\n";
+    let has_ret = has_ret_struct ret in
+    if has_ret then pr "  struct guestfs_%s_ret ret;\n" name;
+    pr "  int serial;\n";
+    pr "  int r;\n";
+    pr "  int trace_flag = g->trace;\n";
+    pr "  struct trace_buffer trace_buffer;\n";
+    declare_ret_v ret;
+    pr "\n";
+    pr "  memset (&hdr, 0, sizeof hdr);\n";
+    pr "  memset (&err, 0, sizeof err);\n";
+    if has_ret then pr "  memset (&ret, 0, sizeof ret);\n";
+    pr "\n";
+    pr "  r = guestfs___async_recv (g, \"%s\", GUESTFS_PROC_%s, &serial,\n"
+      name (String.uppercase name);
+    pr "                            &hdr, &err,\n        ";
+    if not has_ret then
+      pr "NULL, NULL"
+    else
+      pr "(xdrproc_t) xdr_guestfs_%s_ret, (char *) &ret" name;
+    pr ");\n";
+    pr "  if (r == -1) {\n";
+    trace_return_error ~indent:4 name style errcode;
+    pr "    return %s;\n" (string_of_errcode errcode);
+    pr "  }\n";
+    pr "\n";
+
+    check_reply name style errcode;
+    return_reply name style;
     pr "}\n\n"
   in
 
   List.iter (
     fun f ->
       if hash_matches hash f then generate_daemon_stub f
-  ) daemon_functions
+  ) daemon_functions;
+
+  List.iter (
+    fun f ->
+      if hash_matches hash f then generate_async_stubs f
+  ) async_functions_sorted
 
 (* Functions which have optional arguments have two or three
  * generated variants.
@@ -2150,6 +2305,8 @@ and generate_linker_script () =
   generate_header HashStyle GPLv2plus;
 
   let globals = [
+    "guestfs_async_fds";
+    "guestfs_async_poll";
     "guestfs_create";
     "guestfs_create_flags";
     "guestfs_close";
@@ -2203,6 +2360,13 @@ and generate_linker_script () =
              "guestfs_" ^ c_name ^ "_argv"]
       ) all_functions
     ) in
+  let async_functions =
+    List.concat (
+      List.map (fun { c_name = c_name } ->
+        ["guestfs_" ^ c_name ^ "_async_send";
+         "guestfs_" ^ c_name ^ "_async_recv"]
+      ) async_functions_sorted
+    ) in
   let struct_frees =
     List.concat (
       List.map (fun { s_name = typ } ->
@@ -2216,6 +2380,7 @@ and generate_linker_script () =
     ) in
   let globals = List.sort compare (globals @
                                      functions @
+                                     async_functions @
                                      struct_frees) in
 
   pr "{\n";
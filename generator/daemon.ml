@@ -29,6 +29,27 @@ open Actions
 open Structs
 open C
 
+(* Daemon functions which can be called from guestfs_compound: those
+ * whose parameters and return value can be written as strings.
+ *)
+let compound_functions =
+  List.filter (
+    function
+    | { name = "compound" } -> false
+    | { visibility = VInternal } -> false
+    | { style = ret, args, _ } ->
+      (match ret with
+       | RErr | RInt _ | RInt64 _ | RBool _ | RString _ -> true
+       | _ -> false) &&
+      List.for_all (
+        function
+        | Pathname _ | Device _ | Mountable _ | Dev_or_Path _
+        | Mountable_or_Path _ | String _ | Key _ | GUID _
+        | Bool _ | Int _ | Int64 _ -> true
+        | _ -> false
+      ) args
+  ) daemon_functions
+
 (* Generate daemon/actions.h. *)
 let generate_daemon_actions_h () =
   generate_header CStyle GPLv2plus;
@@ -514,6 +535,147 @@ cleanup_free_mountable (mountable_t *mountable)
   pr "}\n";
   pr "\n";
 
+  (* Wrappers for the functions which can be called from
+   * guestfs_compound.  See daemon/compound.c.
+   *)
+  List.iter (
+    fun { name = name; style = ret, args, optargs; optional = optional } ->
+      pr "static int\n";
+      pr "compound_%s (char *const *argv, char **result_r)\n" name;
+      pr "{\n";
+      (match ret with
+       | RErr | RInt _ | RBool _ -> pr "  int r;\n"
+       | RInt64 _ -> pr "  int64_t r;\n"
+       | RString _ -> pr "  char *r;\n"
+       | _ -> assert false
+      );
+      List.iteri (
+        fun i ->
+          function
+          | Device n | Dev_or_Path n ->
+            pr "  CLEANUP_FREE char *%s = NULL;\n" n
+          | Pathname n | String n | Key n | GUID n ->
+            pr "  const char *%s = argv[%d];\n" n i
+          | Mountable n | Mountable_or_Path n ->
+            pr "  CLEANUP_FREE_MOUNTABLE mountable_t %s\n" n;
+            pr "      = { .device = NULL, .volume = NULL };\n"
+          | Bool n | Int n -> pr "  int %s;\n" n
+          | Int64 n -> pr "  int64_t %s;\n" n
+          | _ -> assert false
+      ) args;
+      (* Optional arguments are not passed (optargs_bitmask is 0), so
+       * these are just placeholders.
+       *)
+      List.iter (
+        function
+        | OBool n | OInt n -> pr "  int %s = 0;\n" n
+        | OInt64 n -> pr "  int64_t %s = 0;\n" n
+        | OString n -> pr "  const char *%s = \"\";\n" n
+        | OStringList n -> pr "  char *const %s[] = { NULL };\n" n
+      ) optargs;
+      pr "\n";
+
+      (match optional with
+      | Some group ->
+        pr "  if (! optgroup_%s_available ()) {\n" group;
+        pr "    reply_with_error_errno (ENOTSUP,\n";
+        pr "       \"feature '%%s' is not available in this\\n\"\n";
+        pr "       \"build of libguestfs.  Read 'AVAILABILITY' in the guestfs(3) man page for\\n\"\n";
+        pr "       \"how to check for the availability of features.\",\n";
+        pr "       \"%s\");\n" group;
+        pr "    return -1;\n";
+        pr "  }\n";
+        pr "\n"
+      | None -> ()
+      );
+
+      List.iteri (
+        fun i ->
+          function
+          | Pathname n -> pr "  ABS_PATH (%s, , return -1);\n" n
+          | Device n ->
+            pr "  RESOLVE_DEVICE (argv[%d], %s, , return -1);\n" i n
+          | Mountable n ->
+            pr "  RESOLVE_MOUNTABLE (argv[%d], %s, , return -1);\n" i n
+          | Dev_or_Path n ->
+            pr "  REQUIRE_ROOT_OR_RESOLVE_DEVICE (argv[%d], %s, , return -1);\n"
+              i n
+          | Mountable_or_Path n ->
+            pr "  REQUIRE_ROOT_OR_RESOLVE_MOUNTABLE (argv[%d], %s, , return -1);\n"
+              i n
+          | String _ | Key _ | GUID _ -> ()
+          | Bool n ->
+            pr "  if (compound_parse_bool (\"%s\", argv[%d], &%s) == -1)\n"
+              name i n;
+            pr "    return -1;\n"
+          | Int n ->
+            pr "  if (compound_parse_int (\"%s\", argv[%d], &%s) == -1)\n"
+              name i n;
+            pr "    return -1;\n"
+          | Int64 n ->
+            pr "  if (compound_parse_int64 (\"%s\", argv[%d], &%s) == -1)\n"
+              name i n;
+            pr "    return -1;\n"
+          | _ -> assert false
+      ) args;
+      if List.exists (function Pathname _ -> true | _ -> false) args then
+        pr "  NEED_ROOT (, return -1);\n";
+      pr "\n";
+
+      pr "  r = do_%s " name;
+      generate_c_call_args ~in_daemon:true
+        (ret, args @ args_of_optargs optargs, []);
+      pr ";\n";
+      (match errcode_of_ret ret with
+       | `CannotReturnError -> assert false
+       | (`ErrorIsMinusOne | `ErrorIsNULL) as e ->
+         pr "  if (r == %s)\n" (string_of_errcode e);
+         pr "    /* do_%s has already called reply_with_error */\n" name;
+         pr "    return -1;\n"
+      );
+      pr "\n";
+
+      (match ret with
+       | RErr ->
+         pr "  *result_r = strdup (\"\");\n";
+         pr "  if (*result_r == NULL) {\n";
+         pr "    reply_with_perror (\"strdup\");\n";
+         pr "    return -1;\n";
+         pr "  }\n"
+       | RBool _ ->
+         pr "  *result_r = strdup (r ? \"true\" : \"false\");\n";
+         pr "  if (*result_r == NULL) {\n";
+         pr "    reply_with_perror (\"strdup\");\n";
+         pr "    return -1;\n";
+         pr "  }\n"
+       | RInt _ ->
+         pr "  if (asprintf (result_r, \"%%d\", r) == -1) {\n";
+         pr "    reply_with_perror (\"asprintf\");\n";
+         pr "    return -1;\n";
+         pr "  }\n"
+       | RInt64 _ ->
+         pr "  if (asprintf (result_r, \"%%\" PRIi64, r) == -1) {\n";
+         pr "    reply_with_perror (\"asprintf\");\n";
+         pr "    return -1;\n";
+         pr "  }\n"
+       | RString _ ->
+         pr "  *result_r = r;\n"
+       | _ -> assert false
+      );
+      pr "  return 0;\n";
+      pr "}\n";
+      pr "\n"
+  ) compound_functions;
+
+  pr "const struct compound_function compound_functions[] = {\n";
+  List.iter (
+    fun { name = name; style = _, args, _ } ->
+      pr "  { \"%s\", %d, compound_%s },\n" name (List.length args) name
+  ) compound_functions;
+  pr "  { NULL, 0, NULL }\n";
+  pr "};\n";
+  pr "\n";
+
   (* LVM columns and tokenization functions. *)
   (* XXX This generates crap code.  We should rethink how we
    * do this parsing.
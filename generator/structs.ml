@@ -360,6 +360,37 @@ let structs = [
     "hivex_value_h", FInt64;
     ];
     s_camel_name = "HivexValue" };
+
+  (* RPC statistics, see guestfs_rpc_stats. *)
+  { defaults with
+    s_name = "rpc_stat";
+    s_cols = [
+    "rpc_proc", FInt32;
+    "rpc_name", FString;
+    "rpc_calls", FUInt64;
+    "rpc_errors", FUInt64;
+    "rpc_total_usec", FUInt64;
+    "rpc_max_usec", FUInt64;
+    "rpc_lat_1ms", FUInt64;
+    "rpc_lat_10ms", FUInt64;
+    "rpc_lat_100ms", FUInt64;
+    "rpc_lat_1s", FUInt64;
+    "rpc_lat_slow", FUInt64;
+    "rpc_bytes_sent", FUInt64;
+    "rpc_bytes_received", FUInt64;
+    "rpc_chunks_sent", FUInt64;
+    "rpc_chunks_received", FUInt64;
+    ];
+    s_camel_name = "RPCStat" };
+
+  (* Launch timings, see guestfs_launch_timings. *)
+  { defaults with
+    s_name = "launch_timing";
+    s_cols = [
+    "lt_phase", FString;
+    "lt_usec", FInt64;
+    ];
+    s_camel_name = "LaunchTiming" };
   { defaults with
     s_name = "internal_mountable";
     s_internal = true;
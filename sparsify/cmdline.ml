@@ -29,6 +29,7 @@ let error ?exit_code fs = error ~prog ?exit_code fs
 type mode_t =
 | Mode_copying of string * check_t * bool * string option * string option
 | Mode_in_place
+| Mode_direct of string * string option
 and check_t = [`Ignore|`Continue|`Warn|`Fail]
 
 let parse_cmdline () =
@@ -53,11 +54,13 @@ let parse_cmdline () =
   let compress = ref false in
   let convert = ref "" in
   let debug_gc = ref false in
+  let direct = ref false in
   let format = ref "" in
   let ignores = ref [] in
   let in_place = ref false in
   let machine_readable = ref false in
   let option = ref "" in
+  let parallel = ref 1 in
   let quiet = ref false in
   let verbose = ref false in
   let trace = ref false in
@@ -69,6 +72,7 @@ let parse_cmdline () =
     "--compress", Arg.Set compress,         " " ^ s_"Compressed output format";
     "--convert", Arg.Set_string convert,    s_"format" ^ " " ^ s_"Format of output disk (default: same as input)";
     "--debug-gc", Arg.Set debug_gc,         " " ^ s_"Debug GC and memory allocations";
+    "--direct",  Arg.Set direct,            " " ^ s_"Copy straight to the output disk without an overlay";
     "--format",  Arg.Set_string format,     s_"format" ^ " " ^ s_"Format of input disk";
     "--ignore",  Arg.String (add ignores),  s_"fs" ^ " " ^ s_"Ignore filesystem";
     "--in-place", Arg.Set in_place,         " " ^ s_"Modify the disk image in-place";
@@ -76,6 +80,7 @@ let parse_cmdline () =
     "--long-options", Arg.Unit display_long_options, " " ^ s_"List long options";
     "--machine-readable", Arg.Set machine_readable, " " ^ s_"Make output machine readable";
     "-o",        Arg.Set_string option,     s_"option" ^ " " ^ s_"Add qemu-img options";
+    "--parallel", Arg.Set_int parallel,     "n" ^ " " ^ s_"Process n filesystems in parallel";
     "-q",        Arg.Set quiet,             " " ^ s_"Quiet output";
     "--quiet",   Arg.Set quiet,             ditto;
     "-v",        Arg.Set verbose,           " " ^ s_"Enable debugging messages";
@@ -107,11 +112,13 @@ read the man page virt-sparsify(1).
   let compress = !compress in
   let convert = match !convert with "" -> None | str -> Some str in
   let debug_gc = !debug_gc in
+  let direct = !direct in
   let format = match !format with "" -> None | str -> Some str in
   let ignores = List.rev !ignores in
   let in_place = !in_place in
   let machine_readable = !machine_readable in
   let option = match !option with "" -> None | str -> Some str in
+  let parallel = !parallel in
   let quiet = !quiet in
   let verbose = !verbose in
   let trace = !trace in
@@ -126,6 +133,8 @@ read the man page virt-sparsify(1).
     printf "zero\n";
     printf "check-tmpdir\n";
     printf "in-place\n";
+    printf "parallel\n";
+    printf "direct\n";
     let g = new G.guestfs () in
     g#add_drive "/dev/null";
     g#launch ();
@@ -145,6 +154,9 @@ read the man page virt-sparsify(1).
       error "usage is: %s [--options] indisk outdisk OR %s --in-place disk"
         prog prog in
 
+  if parallel < 1 then
+    error (f_"--parallel parameter must be >= 1");
+
   (* Simple-minded check that the user isn't trying to use the
    * same disk for input and output.
    *)
@@ -171,6 +183,17 @@ read the man page virt-sparsify(1).
         error (f_"output '%s' cannot be a character device, it must be a regular file")
           outdisk;
 
+      if direct then (
+        if check_tmpdir <> `Warn then
+          error (f_"you cannot use --direct and --check-tmpdir options together");
+
+        if compress then
+          error (f_"you cannot use --direct and --compress options together");
+
+        if option <> None then
+          error (f_"you cannot use --direct and -o options together");
+      );
+
       indisk
     )
     else (                              (* --in-place checks *)
@@ -186,14 +209,19 @@ read the man page virt-sparsify(1).
       if option <> None then
         error (f_"you cannot use --in-place and -o options together");
 
+      if direct then
+        error (f_"you cannot use --in-place and --direct options together");
+
       indisk
     ) in
 
   let mode =
-    if not in_place then
-      Mode_copying (outdisk, check_tmpdir, compress, convert, option)
+    if in_place then
+      Mode_in_place
+    else if direct then
+      Mode_direct (outdisk, convert)
     else
-      Mode_in_place in
+      Mode_copying (outdisk, check_tmpdir, compress, convert, option) in
 
-  indisk, debug_gc, format, ignores, machine_readable,
+  indisk, debug_gc, format, ignores, machine_readable, parallel,
     quiet, verbose, trace, zeroes, mode
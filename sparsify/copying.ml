@@ -29,12 +29,14 @@ module G = Guestfs
 
 open Common_utils
 open Cmdline
+open Utils
 
 external statvfs_free_space : string -> int64 =
   "virt_sparsify_statvfs_free_space"
 
 let run indisk outdisk check_tmpdir compress convert
-    format ignores machine_readable option quiet verbose trace zeroes =
+    format ignores machine_readable option parallel quiet verbose trace
+    zeroes =
 
   (* Once we have got past argument parsing and start to create
    * temporary files (including the potentially massive overlay file), we
@@ -148,6 +150,9 @@ You can ignore this warning or change it to a hard failure using the
     (* Note that the temporary overlay disk is always qcow2 format. *)
     g#add_drive ~format:"qcow2" ~readonly:false ~cachemode:"unsafe" overlaydisk;
 
+    (* Give the appliance a vCPU for each filesystem processed at once. *)
+    if parallel > 1 then g#set_smp parallel;
+
     if not quiet then Progress.set_up_progress_bar ~machine_readable g;
     g#launch ();
 
@@ -164,7 +169,6 @@ You can ignore this warning or change it to a hard failure using the
    * and selected swap partitions.
    *)
   let filesystems = g#list_filesystems () in
-  let filesystems = List.map fst filesystems in
   let filesystems = List.sort compare filesystems in
 
   let is_ignored fs =
@@ -172,62 +176,38 @@ You can ignore this warning or change it to a hard failure using the
     List.exists (fun fs' -> fs = g#canonical_device_name fs') ignores
   in
 
-  List.iter (
-    fun fs ->
-      if not (is_ignored fs) then (
-        if List.mem fs zeroes then (
-          if not quiet then
-            printf (f_"Zeroing %s ...\n%!") fs;
-
-          g#zero_device fs
-        ) else (
-          let mounted =
-            try g#mount fs "/"; true
-            with _ -> false in
-
-          if mounted then (
-            if not quiet then
-              printf (f_"Fill free space in %s with zero ...\n%!") fs;
-
-            g#zero_free_space "/"
-          ) else (
-            let is_linux_x86_swap =
-              (* Look for the signature for Linux swap on i386.
-               * Location depends on page size, so it definitely won't
-               * work on non-x86 architectures (eg. on PPC, page size is
-               * 64K).  Also this avoids hibernated swap space: in those,
-               * the signature is moved to a different location.
-               *)
-              try g#pread_device fs 10 4086L = "SWAPSPACE2"
-              with _ -> false in
-
-            if is_linux_x86_swap then (
-              if not quiet then
-                printf (f_"Clearing Linux swap on %s ...\n%!") fs;
-
-              (* Don't use mkswap.  Just preserve the header containing
-               * the label, UUID and swap format version (libguestfs
-               * mkswap may differ from guest's own).
-               *)
-              let header = g#pread_device fs 4096 0L in
-              g#zero_device fs;
-              if g#pwrite_device fs header 0L <> 4096 then
-                error (f_"pwrite: short write restoring swap partition header")
-            )
-          )
-        );
-
-        g#umount_all ()
-      )
-  ) filesystems;
+  (* Work out what to do with each filesystem, then do them all in
+   * one call so the appliance can process up to 'parallel' of them
+   * at the same time.  Filesystems which cannot be mounted are
+   * skipped by the daemon.
+   *)
+  let jobs = filter_map (
+    fun (fs, vfs_type) ->
+      if is_ignored fs then None
+      else if List.mem fs zeroes then
+        Some (fs, "zero-device", sprintf (f_"Zeroing %s ...\n%!") fs)
+      else if is_linux_x86_swap g fs then
+        (* Don't use mkswap.  The daemon preserves the header containing
+         * the label, UUID and swap format version (libguestfs mkswap may
+         * differ from guest's own).
+         *)
+        Some (fs, "swap-zero",
+              sprintf (f_"Clearing Linux swap on %s ...\n%!") fs)
+      else if vfs_type = "unknown" then None
+      else
+        Some (fs, "zero",
+              sprintf (f_"Fill free space in %s with zero ...\n%!") fs)
+  ) filesystems in
+  sparsify_devices g parallel quiet jobs;
 
   (* Fill unused space in volume groups. *)
   let vgs = g#vgs () in
   let vgs = Array.to_list vgs in
   let vgs = List.sort compare vgs in
-  List.iter (
+  let lvjobs = filter_map (
     fun vg ->
-      if not (List.mem vg ignores) then (
+      if List.mem vg ignores then None
+      else (
         let lvname = string_random8 () in
         let lvdev = "/dev/" ^ vg ^ "/" ^ lvname in
 
@@ -235,16 +215,16 @@ You can ignore this warning or change it to a hard failure using the
           try g#lvcreate_free lvname vg 100; true
           with _ -> false in
 
-        if created then (
-          if not quiet then
-            printf (f_"Fill free space in volgroup %s with zero ...\n%!") vg;
-
-          g#zero_device lvdev;
-          g#sync ();
-          g#lvremove lvdev
-        )
+        if created then
+          Some (lvdev, "zero-device",
+                sprintf (f_"Fill free space in volgroup %s with zero ...\n%!")
+                  vg)
+        else None
       )
-  ) vgs;
+  ) vgs in
+  sparsify_devices g parallel quiet lvjobs;
+  if lvjobs <> [] then g#sync ();
+  List.iter (fun (lvdev, _, _) -> g#lvremove lvdev) lvjobs;
 
   (* Don't need libguestfs now. *)
   g#shutdown ();
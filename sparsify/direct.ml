@@ -0,0 +1,225 @@
+(* virt-sparsify
+ * Copyright (C) 2011-2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+(* This is the --direct mode: We copy from the source disk straight
+ * into the destination disk inside the appliance, skipping blocks of
+ * zeroes, and then discard the free space in the destination.  There
+ * is no overlay and no qemu-img convert, so the source is only read
+ * once and no temporary space is needed.
+ *)
+
+open Unix
+open Printf
+
+open Common_gettext.Gettext
+
+module G = Guestfs
+
+open Common_utils
+open Cmdline
+open Utils
+
+(* The source and destination disks, as seen by the appliance. *)
+let srcdev = "/dev/sda"
+let destdev = "/dev/sdb"
+
+let rec run indisk outdisk convert format ignores machine_readable
+    parallel quiet verbose trace zeroes =
+
+  (* As in copying mode, exit cleanly on ^C so that the partially
+   * written output disk is deleted.
+   *)
+  let do_sigint _ = exit 1 in
+  Sys.set_signal Sys.sigint (Sys.Signal_handle do_sigint);
+
+  (* What should the output format be?  See Copying.run. *)
+  let output_format =
+    match convert with
+    | Some fmt -> fmt
+    | None ->
+      match format with
+      | Some fmt -> fmt
+      | None ->
+        match (new G.guestfs ())#disk_format indisk  with
+        | "unknown" ->
+          error (f_"cannot detect input disk format; use the --format parameter")
+        | fmt -> fmt in
+
+  (* The output disk is created by guestfs_disk_create, which only
+   * supports these formats.
+   *)
+  if output_format <> "raw" && output_format <> "qcow2" then
+    error (f_"--direct can only write raw or qcow2 output.  Use --convert raw or --convert qcow2.");
+
+  (* Get virtual size of the input disk. *)
+  let virtual_size = (new G.guestfs ())#disk_virtual_size indisk in
+  if not quiet then
+    printf (f_"Input disk virtual size = %Ld bytes (%s)\n%!")
+      virtual_size (human_size virtual_size);
+
+  (* Connect to libguestfs. *)
+  let g = new G.guestfs () in
+  if trace then g#set_trace true;
+  if verbose then g#set_verbose true;
+
+  if not quiet then
+    printf (f_"Create output disk ...\n%!");
+
+  let compat = if output_format = "qcow2" then Some "1.1" else None in
+  g#disk_create ?compat outdisk output_format virtual_size;
+
+  (* Delete the output disk if we don't get to the end. *)
+  let delete_on_exit = ref true in
+  at_exit (fun () -> if !delete_on_exit then try unlink outdisk with _ -> ());
+
+  try
+    perform g indisk outdisk output_format format ignores machine_readable
+      parallel quiet zeroes;
+    delete_on_exit := false
+  with
+    G.Error msg as exn ->
+      if g#last_errno () = G.Errno.errno_ENOTSUP then (
+        (* for exit code 3, see man page *)
+        error ~exit_code:3 (f_"discard/trim is not supported: %s") msg;
+      )
+      else raise exn
+
+and perform g indisk outdisk output_format format ignores machine_readable
+    parallel quiet zeroes =
+  (* The output disk needs discard, so that trimming the filesystems
+   * on it punches holes in the output file.  Where qemu supports it,
+   * writes of zeroes are discarded too.
+   *)
+  g#add_drive ?format ~readonly:true indisk;
+  g#add_drive ~format:output_format ~discard:"enable" ~detectzeroes:true
+    outdisk;
+
+  (* Give the appliance a vCPU for each filesystem processed at once. *)
+  if parallel > 1 then g#set_smp parallel;
+
+  if not quiet then Progress.set_up_progress_bar ~machine_readable g;
+  g#launch ();
+
+  (* Modify SIGINT handler (set first above) to cancel the handle. *)
+  let do_sigint _ =
+    g#user_cancel ();
+    exit 1
+  in
+  Sys.set_signal Sys.sigint (Sys.Signal_handle do_sigint);
+
+  (* After the copy, the source and destination contain identical
+   * PVs and VGs.  Make LVM only see the destination.
+   *)
+  let have_lvm = g#feature_available [| "lvm2" |] in
+  if have_lvm then g#lvm_set_filter [| destdev |];
+
+  if not quiet then
+    printf (f_"Copy to destination ...\n%!");
+
+  (* The destination is newly created, so it reads as zeroes, and
+   * blocks of zeroes in the source don't need to be written.
+   *)
+  g#copy_device_to_device ~sparse:true srcdev destdev;
+  g#blockdev_rereadpt destdev;
+  if have_lvm then g#lvm_set_filter [| destdev |];
+
+  (* The user refers to filesystems by their names in the source.
+   * Partitions have the same numbers in the destination, and logical
+   * volumes have the same names.
+   *)
+  let source_name fs =
+    if string_prefix fs destdev then
+      srcdev ^ String.sub fs (String.length destdev)
+        (String.length fs - String.length destdev)
+    else fs
+  in
+  let is_on_destination fs =
+    string_prefix fs destdev ||
+      (have_lvm && string_prefix fs "/dev/" && not (string_prefix fs srcdev) &&
+         g#is_lv fs)
+  in
+
+  let ignores = List.map g#canonical_device_name ignores in
+  let zeroes = List.map g#canonical_device_name zeroes in
+
+  (* Discard free space in non-ignored filesystems that we are able to
+   * mount, and selected swap partitions.
+   *)
+  let filesystems = g#list_filesystems () in
+  let filesystems =
+    List.filter (fun (fs, _) -> is_on_destination fs) filesystems in
+  let filesystems = List.sort compare filesystems in
+
+  let jobs = filter_map (
+    fun (fs, vfs_type) ->
+      let name = source_name fs in
+      if List.mem (g#canonical_device_name name) ignores then None
+      else if List.mem (g#canonical_device_name name) zeroes then
+        Some (fs, "zero-discard", sprintf (f_"Zeroing %s ...\n%!") name)
+      else if is_linux_x86_swap g fs then
+        Some (fs, "swap-discard",
+              sprintf (f_"Clearing Linux swap on %s ...\n%!") name)
+      else if vfs_type = "unknown" then None
+      (* The copy of a btrfs filesystem has the same fsid as the
+       * source, and the kernel cannot tell which device belongs to
+       * which filesystem, so mounting the copy might use the source
+       * device instead.  Leave btrfs alone (see the man page).
+       *)
+      else if vfs_type = "btrfs" then (
+        eprintf (f_"%s: warning: cannot trim btrfs filesystem %s in --direct mode; use copying mode instead\n%!")
+          prog name;
+        None
+      )
+      else
+        Some (fs, "trim", sprintf (f_"Trimming %s ...\n%!") name)
+  ) filesystems in
+  sparsify_devices ~name:source_name g parallel quiet jobs;
+
+  (* Discard unused space in volume groups. *)
+  let vgs = g#vgs () in
+  let vgs = Array.to_list vgs in
+  let vgs = List.sort compare vgs in
+  let lvjobs = filter_map (
+    fun vg ->
+      if List.mem vg ignores then None
+      else (
+        let lvname = string_random8 () in
+        let lvdev = "/dev/" ^ vg ^ "/" ^ lvname in
+
+        let created =
+          try g#lvcreate_free lvname vg 100; true
+          with _ -> false in
+
+        if created then
+          Some (lvdev, "discard",
+                sprintf (f_"Discard space in volgroup %s ...\n%!") vg)
+        else None
+      )
+  ) vgs in
+  sparsify_devices g parallel quiet lvjobs;
+  if lvjobs <> [] then g#sync ();
+  List.iter (fun (lvdev, _, _) -> g#lvremove lvdev) lvjobs;
+
+  g#shutdown ();
+  g#close ();
+
+  (* Finished. *)
+  if not quiet then (
+    print_newline ();
+    wrap (s_"Sparsify operation completed with no errors.  Before deleting the old disk, carefully check that the target disk boots and works correctly.\n");
+  )
@@ -27,15 +27,17 @@ module G = Guestfs
 
 open Common_utils
 open Cmdline
+open Utils
 
-let rec run disk format ignores machine_readable quiet verbose trace zeroes =
+let rec run disk format ignores machine_readable parallel quiet verbose trace
+    zeroes =
   (* Connect to libguestfs. *)
   let g = new G.guestfs () in
   if trace then g#set_trace true;
   if verbose then g#set_verbose true;
 
   try
-    perform g disk format ignores machine_readable quiet zeroes
+    perform g disk format ignores machine_readable parallel quiet zeroes
   with
     G.Error msg as exn ->
       if g#last_errno () = G.Errno.errno_ENOTSUP then (
@@ -44,7 +46,7 @@ let rec run disk format ignores machine_readable quiet verbose trace zeroes =
       )
       else raise exn
 
-and perform g disk format ignores machine_readable quiet zeroes =
+and perform g disk format ignores machine_readable parallel quiet zeroes =
   (* XXX Current limitation of the API.  Can remove this hunk in future. *)
   let format =
     match format with
@@ -53,6 +55,9 @@ and perform g disk format ignores machine_readable quiet zeroes =
 
   g#add_drive ?format ~discard:"enable" disk;
 
+  (* Give the appliance a vCPU for each filesystem processed at once. *)
+  if parallel > 1 then g#set_smp parallel;
+
   if not quiet then Progress.set_up_progress_bar ~machine_readable g;
   g#launch ();
 
@@ -60,7 +65,6 @@ and perform g disk format ignores machine_readable quiet zeroes =
    * selected swap partitions.
    *)
   let filesystems = g#list_filesystems () in
-  let filesystems = List.map fst filesystems in
   let filesystems = List.sort compare filesystems in
 
   let is_ignored fs =
@@ -68,64 +72,37 @@ and perform g disk format ignores machine_readable quiet zeroes =
     List.exists (fun fs' -> fs = g#canonical_device_name fs') ignores
   in
 
-  List.iter (
-    fun fs ->
-      if not (is_ignored fs) then (
-        if List.mem fs zeroes then (
-          if not quiet then
-            printf (f_"Zeroing %s ...\n%!") fs;
-
-          if not (g#blkdiscardzeroes fs) then
-            g#zero_device fs;
-          g#blkdiscard fs
-        ) else (
-          let mounted =
-            try g#mount_options "discard" fs "/"; true
-            with _ -> false in
-
-          if mounted then (
-            if not quiet then
-              printf (f_"Trimming %s ...\n%!") fs;
-
-            g#fstrim "/"
-          ) else (
-            let is_linux_x86_swap =
-              (* Look for the signature for Linux swap on i386.
-               * Location depends on page size, so it definitely won't
-               * work on non-x86 architectures (eg. on PPC, page size is
-               * 64K).  Also this avoids hibernated swap space: in those,
-               * the signature is moved to a different location.
-               *)
-              try g#pread_device fs 10 4086L = "SWAPSPACE2"
-              with _ -> false in
-
-            if is_linux_x86_swap then (
-              if not quiet then
-                printf (f_"Clearing Linux swap on %s ...\n%!") fs;
-
-              (* Don't use mkswap.  Just preserve the header containing
-               * the label, UUID and swap format version (libguestfs
-               * mkswap may differ from guest's own).
-               *)
-              let header = g#pread_device fs 4096 0L in
-              g#blkdiscard fs;
-              if g#pwrite_device fs header 0L <> 4096 then
-                error (f_"pwrite: short write restoring swap partition header")
-            )
-          )
-        );
-
-        g#umount_all ()
-      )
-  ) filesystems;
+  (* Work out what to do with each filesystem, then do them all in
+   * one call so the appliance can process up to 'parallel' of them
+   * at the same time.  Filesystems which cannot be mounted are
+   * skipped by the daemon.
+   *)
+  let jobs = filter_map (
+    fun (fs, vfs_type) ->
+      if is_ignored fs then None
+      else if List.mem fs zeroes then
+        Some (fs, "zero-discard", sprintf (f_"Zeroing %s ...\n%!") fs)
+      else if is_linux_x86_swap g fs then
+        (* Don't use mkswap.  The daemon preserves the header containing
+         * the label, UUID and swap format version (libguestfs mkswap may
+         * differ from guest's own).
+         *)
+        Some (fs, "swap-discard",
+              sprintf (f_"Clearing Linux swap on %s ...\n%!") fs)
+      else if vfs_type = "unknown" then None
+      else
+        Some (fs, "trim", sprintf (f_"Trimming %s ...\n%!") fs)
+  ) filesystems in
+  sparsify_devices g parallel quiet jobs;
 
   (* Discard unused space in volume groups. *)
   let vgs = g#vgs () in
   let vgs = Array.to_list vgs in
   let vgs = List.sort compare vgs in
-  List.iter (
+  let lvjobs = filter_map (
     fun vg ->
-      if not (List.mem vg ignores) then (
+      if List.mem vg ignores then None
+      else (
         let lvname = string_random8 () in
         let lvdev = "/dev/" ^ vg ^ "/" ^ lvname in
 
@@ -133,16 +110,15 @@ and perform g disk format ignores machine_readable quiet zeroes =
           try g#lvcreate_free lvname vg 100; true
           with _ -> false in
 
-        if created then (
-          if not quiet then
-            printf (f_"Discard space in volgroup %s ...\n%!") vg;
-
-          g#blkdiscard lvdev;
-          g#sync ();
-          g#lvremove lvdev
-        )
+        if created then
+          Some (lvdev, "discard",
+                sprintf (f_"Discard space in volgroup %s ...\n%!") vg)
+        else None
       )
-  ) vgs;
+  ) vgs in
+  sparsify_devices g parallel quiet lvjobs;
+  if lvjobs <> [] then g#sync ();
+  List.iter (fun (lvdev, _, _) -> g#lvremove lvdev) lvjobs;
 
   g#shutdown ();
   g#close ();
@@ -29,17 +29,20 @@ open Cmdline
 let () = Random.self_init ()
 
 let rec main () =
-  let indisk, debug_gc, format, ignores, machine_readable,
+  let indisk, debug_gc, format, ignores, machine_readable, parallel,
     quiet, verbose, trace, zeroes, mode =
     parse_cmdline () in
 
   (match mode with
   | Mode_copying (outdisk, check_tmpdir, compress, convert, option) ->
     Copying.run indisk outdisk check_tmpdir compress convert
-      format ignores machine_readable option quiet verbose trace zeroes
+      format ignores machine_readable option parallel quiet verbose trace zeroes
   | Mode_in_place ->
-    In_place.run indisk format ignores machine_readable
+    In_place.run indisk format ignores machine_readable parallel
       quiet verbose trace zeroes
+  | Mode_direct (outdisk, convert) ->
+    Direct.run indisk outdisk convert format ignores machine_readable
+      parallel quiet verbose trace zeroes
   );
 
   if debug_gc then
@@ -0,0 +1,100 @@
+#!/bin/bash -
+# libguestfs virt-sparsify --direct test script
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+export LANG=C
+set -e
+
+if [ -n "$SKIP_TEST_VIRT_SPARSIFY_DIRECT_SH" ]; then
+    echo "$0: skipping test (environment variable set)"
+    exit 77
+fi
+
+if [ "$(../fish/guestfish get-backend)" = "uml" ]; then
+    echo "$0: skipping test because uml backend does not support discard"
+    exit 77
+fi
+
+rm -f test-virt-sparsify-direct-1.img test-virt-sparsify-direct-2.img
+
+# Create a filesystem, fill it with data, then delete most of the
+# data.  Then prove that sparsifying it reduces the size of the final
+# filesystem, and that the files which were not deleted survive.
+
+$VG ../fish/guestfish \
+    -N test-virt-sparsify-direct-1.img=bootrootlv:/dev/VG/LV:ext4:ext4:400M:32M:gpt <<EOF
+mount /dev/VG/LV /
+mkdir /boot
+mount /dev/sda1 /boot
+fill 1 300M /big
+fill 1 10M /boot/big
+write /keep "hello from the root filesystem"
+write /boot/keep "hello from the boot filesystem"
+sync
+rm /big
+rm /boot/big
+umount-all
+EOF
+
+$VG ./virt-sparsify --debug-gc --direct test-virt-sparsify-direct-1.img --convert raw test-virt-sparsify-direct-2.img || {
+    if [ "$?" -eq 3 ]; then
+        rm -f test-virt-sparsify-direct-1.img test-virt-sparsify-direct-2.img
+        echo "$0: discard not supported in virt-sparsify"
+        exit 77
+    fi
+    exit 1
+}
+
+size_before=$(du -s test-virt-sparsify-direct-1.img | awk '{print $1}')
+size_after=$(du -s test-virt-sparsify-direct-2.img | awk '{print $1}')
+
+echo "test virt-sparsify --direct: $size_before K -> $size_after K"
+
+if [ $size_before -lt 310000 ]; then
+    echo "test virt-sparsify --direct: size_before ($size_before) too small"
+    exit 1
+fi
+
+# As for --in-place, recovering more than 300 MB of the 310 MB which
+# was deleted shows that sparsification is working.
+
+if [ $((size_before-size_after)) -le 300000 ]; then
+    echo "test virt-sparsify --direct: size_after ($size_after) too large"
+    echo "sparsification failed"
+    exit 1
+fi
+
+# Check the files which were not deleted are intact.
+
+output="$(
+$VG ../fish/guestfish --ro -a test-virt-sparsify-direct-2.img <<EOF
+run
+mount /dev/VG/LV /
+mount /dev/sda1 /boot
+cat /keep
+cat /boot/keep
+EOF
+)"
+
+if [ "$output" != "hello from the root filesystem
+hello from the boot filesystem" ]; then
+    echo "test virt-sparsify --direct: unexpected file contents in output:"
+    echo "$output"
+    exit 1
+fi
+
+rm test-virt-sparsify-direct-1.img test-virt-sparsify-direct-2.img
@@ -0,0 +1,58 @@
+(* virt-sparsify
+ * Copyright (C) 2011-2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *)
+
+(* Utilities used by all of the virt-sparsify modes. *)
+
+open Printf
+
+open Common_gettext.Gettext
+
+let is_linux_x86_swap (g : Guestfs.guestfs) fs =
+  (* Look for the signature for Linux swap on i386.
+   * Location depends on page size, so it definitely won't
+   * work on non-x86 architectures (eg. on PPC, page size is
+   * 64K).  Also this avoids hibernated swap space: in those,
+   * the signature is moved to a different location.
+   *)
+  try g#pread_device fs 10 4086L = "SWAPSPACE2"
+  with _ -> false
+
+(* Run the operations in 'jobs', a list of (device, operation, message)
+ * triples, with up to 'parallel' running at the same time in the
+ * appliance.  Afterwards 'message' is printed for each device which
+ * was processed, or the reason why the daemon skipped it (because it
+ * could not be mounted).  'name' maps devices to the names shown in
+ * messages.
+ *)
+let sparsify_devices ?(name = fun dev -> dev) (g : Guestfs.guestfs)
+    parallel quiet jobs =
+  if jobs <> [] then (
+    let jobs = Array.of_list jobs in
+    let devices = Array.map (fun (dev, _, _) -> dev) jobs in
+    let operations = Array.map (fun (_, op, _) -> op) jobs in
+    let results = g#sparsify_devices ~maxthreads:parallel devices operations in
+    if not quiet then
+      Array.iteri (
+        fun i result ->
+          let _, _, message = jobs.(i) in
+          if result = "" then
+            printf "%s%!" message
+          else
+            printf (f_"Skipped %s: %s\n%!") (name devices.(i)) result
+      ) results
+  )
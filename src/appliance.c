@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
@@ -54,6 +55,14 @@ static int contains_fixed_appliance (guestfs_h *g, const char *path, void *data)
 static int contains_supermin_appliance (guestfs_h *g, const char *path, void *data);
 static int build_supermin_appliance (guestfs_h *g, const char *supermin_path, uid_t uid, char **kernel, char **dtb, char **initrd, char **appliance);
 static int run_supermin_build (guestfs_h *g, const char *lockfile, const char *appliancedir, const char *supermin_path);
+static char *appliance_stamp (guestfs_h *g, const char *supermin_path, const char *appliancedir);
+static int lock_appliance (guestfs_h *g, const char *lockfile);
+
+/* Serializes threads in this process which are checking or building
+ * the supermin appliance.  This is needed as well as the lock on the
+ * lock file, because fcntl locks belong to the process.
+ */
+gl_lock_define_initialized (static, appliance_lock);
 
 /* Locate or build the appliance.
  *
@@ -222,8 +231,10 @@ build_supermin_appliance (guestfs_h *g,
 			  char **initrd, char **appliance)
 {
   CLEANUP_FREE char *tmpdir = guestfs_get_cachedir (g);
+  CLEANUP_FREE char *stamp = NULL, *cached_stamp = NULL;
   struct stat statbuf;
   size_t len;
+  int lockfd;
 
   /* len must be longer than the length of any pathname we can
    * generate in this function.
@@ -264,15 +275,54 @@ build_supermin_appliance (guestfs_h *g,
   if (g->verbose)
     guestfs___print_timestamped_message (g, "begin building supermin appliance");
 
-  /* Build the appliance if it needs to be built. */
-  if (g->verbose)
-    guestfs___print_timestamped_message (g, "run supermin");
+  gl_lock_lock (appliance_lock);
 
-  if (run_supermin_build (g, lockfile, appliancedir, supermin_path) == -1)
-    return -1;
+  /* If nothing that the appliance is built from has changed since
+   * the last time we ran supermin, don't run it again.  We hold a
+   * shared lock on the supermin lock file while looking at the
+   * appliance, so that another process cannot be half way through
+   * replacing it.
+   */
+  lockfd = lock_appliance (g, lockfile);
+  if (lockfd >= 0) {
+    stamp = appliance_stamp (g, supermin_path, appliancedir);
+    if (stamp)
+      cached_stamp = guestfs___cache_lookup (g, "appliance.stamp", stamp);
+  }
 
-  if (g->verbose)
-    guestfs___print_timestamped_message (g, "finished building supermin appliance");
+  if (cached_stamp) {
+    if (g->verbose)
+      guestfs___print_timestamped_message (g, "supermin appliance is up to date");
+  }
+  else {
+    /* supermin takes an exclusive lock on the same file. */
+    if (lockfd >= 0) {
+      close (lockfd);
+      lockfd = -1;
+    }
+
+    /* Build the appliance if it needs to be built. */
+    if (g->verbose)
+      guestfs___print_timestamped_message (g, "run supermin");
+
+    if (run_supermin_build (g, lockfile, appliancedir, supermin_path) == -1) {
+      gl_lock_unlock (appliance_lock);
+      return -1;
+    }
+
+    if (g->verbose)
+      guestfs___print_timestamped_message (g, "finished building supermin appliance");
+
+    /* The stamp includes the appliance files, so recalculate it. */
+    free (stamp);
+    stamp = NULL;
+    lockfd = lock_appliance (g, lockfile);
+    if (lockfd >= 0) {
+      stamp = appliance_stamp (g, supermin_path, appliancedir);
+      if (stamp)
+        guestfs___cache_store (g, "appliance.stamp", stamp, "");
+    }
+  }
 
   /* Return the appliance filenames. */
   *kernel = safe_malloc (g, len);
@@ -312,9 +362,175 @@ build_supermin_appliance (guestfs_h *g,
   if (STRNEQ (g->backend, "uml"))
     (void) utimes (*appliance, NULL);
 
+  if (lockfd >= 0)
+    close (lockfd);
+  gl_lock_unlock (appliance_lock);
+
   return 0;
 }
 
+/* Take a shared lock on the supermin lock file, waiting if supermin
+ * is running.  Returns the file descriptor, or -1 if the lock could
+ * not be taken, in which case the caller must not trust the stamp.
+ */
+static int
+lock_appliance (guestfs_h *g, const char *lockfile)
+{
+  int fd;
+  struct flock fl;
+
+  fd = open (lockfile, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+  if (fd == -1) {
+    debug (g, "open: %s: %m", lockfile);
+    return -1;
+  }
+
+  fl.l_type = F_RDLCK;
+  fl.l_whence = SEEK_SET;
+  fl.l_start = 0;
+  fl.l_len = 0;
+  while (fcntl (fd, F_SETLKW, &fl) == -1) {
+    if (errno != EINTR) {
+      debug (g, "fcntl: F_SETLKW: %s: %m", lockfile);
+      close (fd);
+      return -1;
+    }
+  }
+
+  return fd;
+}
+
+/* Files which supermin --if-newer looks at to decide if the appliance
+ * must be rebuilt (apart from supermin.d): the package databases, and
+ * the kernel and modules.  Files which don't exist on this host are
+ * recorded as missing.
+ */
+static const char *stamp_host_files[] = {
+  "/var/lib/rpm/Packages",
+  "/var/lib/rpm/rpmdb.sqlite",
+  "/var/lib/dpkg/status",
+  "/var/lib/pacman/local",
+  "/boot",
+  "/lib/modules",
+  NULL
+};
+
+/* Environment variables which change the kernel that supermin
+ * copies into the appliance.  Those naming a file or directory are
+ * stat'd as well.
+ */
+static const struct {
+  const char *name;
+  int is_path;
+} stamp_env_vars[] = {
+  { "SUPERMIN_KERNEL", 1 },
+  { "SUPERMIN_KERNEL_VERSION", 0 },
+  { "SUPERMIN_MODULES", 1 },
+  { "SUPERMIN_DTB", 1 },
+  { NULL, 0 }
+};
+
+static void
+add_stamp (guestfs_h *g, struct stringsbuf *sb, const char *path,
+           int with_mtime)
+{
+  struct stat statbuf;
+
+  if (stat (path, &statbuf) == -1)
+    guestfs___add_sprintf (g, sb, "%s:-", path);
+  else if (with_mtime)
+    guestfs___add_sprintf (g, sb, "%s:%ju:%ju:%jd:%jd",
+                           path,
+                           (uintmax_t) statbuf.st_dev,
+                           (uintmax_t) statbuf.st_ino,
+                           (intmax_t) statbuf.st_size,
+                           (intmax_t) statbuf.st_mtime);
+  else
+    guestfs___add_sprintf (g, sb, "%s:%ju:%ju:%jd",
+                           path,
+                           (uintmax_t) statbuf.st_dev,
+                           (uintmax_t) statbuf.st_ino,
+                           (intmax_t) statbuf.st_size);
+}
+
+static int
+compare (const void *vp1, const void *vp2)
+{
+  char * const *p1 = (char * const *) vp1;
+  char * const *p2 = (char * const *) vp2;
+  return strcmp (*p1, *p2);
+}
+
+/* Return a single line describing the inputs and outputs of
+ * supermin, which changes if the appliance might need to be rebuilt.
+ * Returns NULL if it cannot be calculated, in which case supermin
+ * must always be run.
+ *
+ * The outputs are recorded without their mtime, because we touch
+ * them on every launch (see below).
+ */
+static char *
+appliance_stamp (guestfs_h *g, const char *supermin_path,
+                 const char *appliancedir)
+{
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (inputs);
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (outputs);
+  CLEANUP_FREE_STRINGSBUF DECLARE_STRINGSBUF (ret);
+  CLEANUP_FREE char *supermin_d = NULL;
+  DIR *dir;
+  struct dirent *d;
+  size_t i;
+
+  supermin_d = safe_asprintf (g, "%s/supermin.d", supermin_path);
+  dir = opendir (supermin_d);
+  if (dir == NULL)
+    return NULL;
+  while ((d = readdir (dir)) != NULL) {
+    if (d->d_name[0] == '.')
+      continue;
+    guestfs___add_sprintf (g, &inputs, "%s/%s", supermin_d, d->d_name);
+  }
+  closedir (dir);
+  qsort (inputs.argv, inputs.size, sizeof (char *), compare);
+
+  guestfs___add_string (g, &ret, SUPERMIN);
+  guestfs___add_string (g, &ret, host_cpu);
+  for (i = 0; i < inputs.size; ++i)
+    add_stamp (g, &ret, inputs.argv[i], 1);
+  for (i = 0; stamp_host_files[i] != NULL; ++i)
+    add_stamp (g, &ret, stamp_host_files[i], 1);
+  for (i = 0; stamp_env_vars[i].name != NULL; ++i) {
+    const char *value = getenv (stamp_env_vars[i].name);
+
+    if (value == NULL)
+      guestfs___add_sprintf (g, &ret, "%s:-", stamp_env_vars[i].name);
+    else {
+      guestfs___add_sprintf (g, &ret, "%s=%s", stamp_env_vars[i].name, value);
+      if (stamp_env_vars[i].is_path)
+        add_stamp (g, &ret, value, 1);
+    }
+  }
+
+  guestfs___add_sprintf (g, &outputs, "%s/kernel", appliancedir);
+  guestfs___add_sprintf (g, &outputs, "%s/initrd", appliancedir);
+  guestfs___add_sprintf (g, &outputs, "%s/root", appliancedir);
+#ifdef DTB_WILDCARD
+  guestfs___add_sprintf (g, &outputs, "%s/dtb", appliancedir);
+#endif
+  for (i = 0; i < outputs.size; ++i) {
+    if (access (outputs.argv[i], R_OK) == -1)
+      return NULL;
+    add_stamp (g, &ret, outputs.argv[i], 0);
+  }
+
+  guestfs___end_stringsbuf (g, &ret);
+  for (i = 0; i < ret.size - 1; ++i)
+    if (strchr (ret.argv[i], '\n') != NULL)
+      return NULL;
+
+  return guestfs___join_strings (" ", ret.argv);
+}
+
 /* Run supermin --build and tell it to generate the
  * appliance.
  */
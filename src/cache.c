@@ -0,0 +1,165 @@
+/* libguestfs
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Small files cached in $cachedir/.guestfs-$UID, used to remember the
+ * results of probing the host (eg. qemu -help) between processes.
+ *
+ * Each file starts with a line containing a key which describes what
+ * the data was derived from (eg. the qemu binary and its size and
+ * mtime).  If the key doesn't match, the cached data is stale and is
+ * ignored.  Files are replaced atomically using rename(2), so several
+ * processes can read and update the cache at the same time.
+ *
+ * Nothing here is fatal: if the cache cannot be used for any reason
+ * the caller just does the probing again.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "full-write.h"
+#include "ignore-value.h"
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+
+/* Return the path of the cache file 'name', or NULL if the cache
+ * directory doesn't exist and can't be created, or fails the same
+ * security checks as are done on the cached appliance.
+ */
+static char *
+cache_file_path (guestfs_h *g, const char *name)
+{
+  CLEANUP_FREE char *tmpdir = guestfs_get_cachedir (g);
+  CLEANUP_FREE char *cachedir = NULL;
+  uid_t uid = geteuid ();
+  struct stat statbuf;
+
+  cachedir = safe_asprintf (g, "%s/.guestfs-%d", tmpdir, uid);
+  ignore_value (mkdir (cachedir, 0755));
+
+  if (lstat (cachedir, &statbuf) == -1 ||
+      statbuf.st_uid != uid ||
+      !S_ISDIR (statbuf.st_mode) ||
+      (statbuf.st_mode & 0022) != 0) {
+    debug (g, "cache: not using %s", cachedir);
+    return NULL;
+  }
+
+  return safe_asprintf (g, "%s/%s", cachedir, name);
+}
+
+/* Read the cache file 'name'.  If it exists and was written with the
+ * same 'key', return the data (the caller must free it).  Otherwise
+ * return NULL.
+ */
+char *
+guestfs___cache_lookup (guestfs_h *g, const char *name, const char *key)
+{
+  CLEANUP_FREE char *path = cache_file_path (g, name);
+  CLEANUP_FREE char *buf = NULL;
+  struct stat statbuf;
+  size_t keylen = strlen (key);
+  size_t n = 0;
+  ssize_t r;
+  int fd;
+
+  if (path == NULL)
+    return NULL;
+
+  fd = open (path, O_RDONLY|O_CLOEXEC);
+  if (fd == -1)
+    return NULL;
+
+  if (fstat (fd, &statbuf) == -1 || !S_ISREG (statbuf.st_mode) ||
+      (size_t) statbuf.st_size <= keylen) {
+    close (fd);
+    return NULL;
+  }
+
+  buf = safe_malloc (g, statbuf.st_size + 1);
+  while (n < (size_t) statbuf.st_size) {
+    r = read (fd, &buf[n], statbuf.st_size - n);
+    if (r <= 0)
+      break;
+    n += r;
+  }
+  close (fd);
+  buf[n] = '\0';
+
+  if (n <= keylen || memcmp (buf, key, keylen) != 0 || buf[keylen] != '\n') {
+    debug (g, "cache: %s is stale", path);
+    return NULL;
+  }
+
+  debug (g, "cache: using %s", path);
+  return safe_strdup (g, &buf[keylen+1]);
+}
+
+/* Write 'data' to the cache file 'name' with 'key'.  Errors are
+ * ignored.
+ */
+void
+guestfs___cache_store (guestfs_h *g, const char *name, const char *key,
+                       const char *data)
+{
+  CLEANUP_FREE char *path = cache_file_path (g, name);
+  CLEANUP_FREE char *tmppath = NULL;
+  int fd;
+
+  if (path == NULL)
+    return;
+
+  tmppath = safe_asprintf (g, "%s.XXXXXX", path);
+  fd = mkostemp (tmppath, O_CLOEXEC);
+  if (fd == -1) {
+    debug (g, "cache: %s: %m", tmppath);
+    return;
+  }
+
+  if (full_write (fd, key, strlen (key)) != strlen (key) ||
+      full_write (fd, "\n", 1) != 1 ||
+      full_write (fd, data, strlen (data)) != strlen (data)) {
+    debug (g, "cache: write: %s: %m", tmppath);
+    close (fd);
+    goto error;
+  }
+  if (close (fd) == -1) {
+    debug (g, "cache: close: %s: %m", tmppath);
+    goto error;
+  }
+
+  if (rename (tmppath, path) == -1) {
+    debug (g, "cache: rename: %s: %m", path);
+    goto error;
+  }
+
+  return;
+
+ error:
+  unlink (tmppath);
+}
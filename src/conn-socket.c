@@ -32,6 +32,10 @@
 #include <sys/types.h>
 #include <assert.h>
 
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+#include <linux/vm_sockets.h>
+#endif
+
 #include "guestfs.h"
 #include "guestfs-internal.h"
 
@@ -45,8 +49,16 @@ struct connection_socket {
    * before and during accept_connection.
    */
   int daemon_accept_sock;
+
+  /* For AF_VSOCK connections, the context ID of our appliance.  Any
+   * other guest can connect to the listening socket, so connections
+   * from other CIDs are rejected.  0 for other socket types.
+   */
+  unsigned int peer_cid;
 };
 
+static int check_peer (guestfs_h *g, struct connection_socket *conn, int sock);
+
 static int handle_log_message (guestfs_h *g, struct connection_socket *conn);
 
 static int
@@ -112,6 +124,10 @@ accept_connection (guestfs_h *g, struct connection *connv)
         perrorf (g, "accept_connection: accept");
         return -1;
       }
+      if (check_peer (g, conn, sock) == 0) {
+        close (sock);
+        sock = -1;
+      }
     }
   }
 
@@ -131,6 +147,32 @@ accept_connection (guestfs_h *g, struct connection *connv)
   return 1;
 }
 
+/* Returns 1 if the connection on 'sock' comes from our appliance,
+ * 0 if it should be dropped.
+ */
+static int
+check_peer (guestfs_h *g, struct connection_socket *conn, int sock)
+{
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+  struct sockaddr_vm addr;
+  socklen_t addrlen = sizeof addr;
+
+  if (conn->peer_cid == 0)
+    return 1;
+
+  if (getpeername (sock, (struct sockaddr *) &addr, &addrlen) == -1) {
+    debug (g, "accept_connection: getpeername: %m");
+    return 0;
+  }
+  if (addr.svm_family != AF_VSOCK || addr.svm_cid != conn->peer_cid) {
+    debug (g, "accept_connection: dropping connection from vsock CID %u",
+           (unsigned) addr.svm_cid);
+    return 0;
+  }
+#endif
+  return 1;
+}
+
 static ssize_t
 read_data (guestfs_h *g, struct connection *connv, void *bufv, size_t len)
 {
@@ -234,6 +276,86 @@ can_read_data (guestfs_h *g, struct connection *connv)
   return (fd.revents & POLLIN) != 0 ? 1 : 0;
 }
 
+static ssize_t
+try_read_data (guestfs_h *g, struct connection *connv, void *buf, size_t len)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+  struct pollfd fds[2];
+  nfds_t nfds = 1;
+  ssize_t n;
+  int r;
+
+  if (conn->daemon_sock == -1) {
+    error (g, _("try_read_data: socket not connected"));
+    return -1;
+  }
+
+  fds[0].fd = conn->daemon_sock;
+  fds[0].events = POLLIN;
+  fds[0].revents = 0;
+
+  if (conn->console_sock >= 0) {
+    fds[1].fd = conn->console_sock;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    nfds++;
+  }
+
+ again:
+  r = poll (fds, nfds, 0);
+  if (r == -1) {
+    if (errno == EINTR || errno == EAGAIN)
+      goto again;
+    perrorf (g, "try_read_data: poll");
+    return -1;
+  }
+
+  /* Log message? */
+  if (nfds > 1 && (fds[1].revents & POLLIN) != 0) {
+    r = handle_log_message (g, conn);
+    if (r <= 0)
+      return r;
+  }
+
+  if ((fds[0].revents & POLLIN) == 0)
+    return -2;
+
+  n = read (conn->daemon_sock, buf, len);
+  if (n == -1) {
+    if (errno == EINTR || errno == EAGAIN)
+      return -2;
+    if (errno != ECONNRESET) {
+      perrorf (g, "try_read_data: read");
+      return -1;
+    }
+    n = 0;                      /* same as EOF, see read_data */
+  }
+  if (n == 0 && g->verbose && conn->console_sock >= 0) {
+    while (handle_log_message (g, conn) == 1)
+      ;
+  }
+
+  return n;
+}
+
+static int
+get_fds (guestfs_h *g, struct connection *connv, int *fds)
+{
+  struct connection_socket *conn = (struct connection_socket *) connv;
+  int n = 0;
+
+  if (conn->daemon_sock == -1) {
+    error (g, _("get_fds: socket not connected"));
+    return -1;
+  }
+
+  fds[n++] = conn->daemon_sock;
+  if (conn->console_sock >= 0)
+    fds[n++] = conn->console_sock;
+
+  return n;
+}
+
 static ssize_t
 write_data (guestfs_h *g, struct connection *connv,
             const void *bufv, size_t len)
@@ -387,6 +509,8 @@ static struct connection_ops ops = {
   .read_data = read_data,
   .write_data = write_data,
   .can_read_data = can_read_data,
+  .try_read_data = try_read_data,
+  .get_fds = get_fds,
 };
 
 /* Create a new socket connection, listening.
@@ -428,6 +552,33 @@ guestfs___new_conn_socket_listening (guestfs_h *g,
   conn->console_sock = console_sock;
   conn->daemon_sock = -1;
   conn->daemon_accept_sock = daemon_accept_sock;
+  conn->peer_cid = 0;
+
+  return (struct connection *) conn;
+}
+
+/* Create a new virtio-vsock connection, listening.
+ *
+ * This is the same as guestfs___new_conn_socket_listening, except
+ * that daemon_accept_sock is an AF_VSOCK socket and only a connection
+ * coming from the guest with context ID 'guest_cid' is accepted.
+ */
+struct connection *
+guestfs___new_conn_vsock_listening (guestfs_h *g,
+                                    int daemon_accept_sock,
+                                    int console_sock,
+                                    unsigned int guest_cid)
+{
+  struct connection_socket *conn;
+
+  assert (guest_cid > 0);
+
+  conn = (struct connection_socket *)
+    guestfs___new_conn_socket_listening (g, daemon_accept_sock, console_sock);
+  if (conn == NULL)
+    return NULL;
+
+  conn->peer_cid = guest_cid;
 
   return (struct connection *) conn;
 }
@@ -467,6 +618,7 @@ guestfs___new_conn_socket_connected (guestfs_h *g,
   conn->console_sock = console_sock;
   conn->daemon_sock = daemon_sock;
   conn->daemon_accept_sock = -1;
+  conn->peer_cid = 0;
 
   return (struct connection *) conn;
 }
@@ -291,6 +291,16 @@ disk_create_qcow2 (guestfs_h *g, const char *orig_filename, int64_t size,
     }
   }
 
+  /* The common case of a plain image or an overlay on a local raw or
+   * qcow2 file can be done without running qemu-img.
+   */
+  if (!preallocation && !compat && clustersize == -1) {
+    r = guestfs___native_create_qcow2 (g, orig_filename, size,
+                                       backingfile, backingformat);
+    if (r != -2)
+      return r;
+  }
+
   /* Assemble the qemu-img command line. */
   guestfs___cmd_add_arg (cmd, "qemu-img");
   guestfs___cmd_add_arg (cmd, "create");
@@ -34,6 +34,7 @@
 #include <arpa/inet.h>
 #include <assert.h>
 #include <sys/types.h>
+#include <sys/time.h>
 
 #include <pcre.h>
 
@@ -62,6 +63,7 @@ struct drive_create_data {
   const char *disk_label;
   const char *cachemode;
   enum discard discard;
+  bool detect_zeroes;
 };
 
 /* Compile all the regular expressions once when the shared library is
@@ -146,6 +148,7 @@ create_drive_file (guestfs_h *g,
   drv->disk_label = data->disk_label ? safe_strdup (g, data->disk_label) : NULL;
   drv->cachemode = data->cachemode ? safe_strdup (g, data->cachemode) : NULL;
   drv->discard = data->discard;
+  drv->detect_zeroes = data->detect_zeroes;
 
   if (data->readonly) {
     if (create_overlay (g, drv) == -1) {
@@ -181,6 +184,7 @@ create_drive_non_file (guestfs_h *g,
   drv->disk_label = data->disk_label ? safe_strdup (g, data->disk_label) : NULL;
   drv->cachemode = data->cachemode ? safe_strdup (g, data->cachemode) : NULL;
   drv->discard = data->discard;
+  drv->detect_zeroes = data->detect_zeroes;
 
   if (data->readonly) {
     if (create_overlay (g, drv) == -1) {
@@ -477,6 +481,7 @@ create_drive_dev_null (guestfs_h *g,
 
   data->exportname = tmpfile;
   data->discard = discard_disable;
+  data->detect_zeroes = false;
 
   return create_drive_file (g, data);
 }
@@ -542,7 +547,7 @@ static char *
 drive_to_string (guestfs_h *g, const struct drive *drv)
 {
   return safe_asprintf
-    (g, "%s%s%s%s protocol=%s%s%s%s%s%s%s%s%s%s",
+    (g, "%s%s%s%s protocol=%s%s%s%s%s%s%s%s%s%s%s",
      drv->src.u.path,
      drv->readonly ? " readonly" : "",
      drv->src.format ? " format=" : "",
@@ -557,7 +562,8 @@ drive_to_string (guestfs_h *g, const struct drive *drv)
      drv->cachemode ? " cache=" : "",
      drv->cachemode ? : "",
      drv->discard == discard_disable ? "" :
-     drv->discard == discard_enable ? " discard=enable" : " discard=besteffort");
+     drv->discard == discard_enable ? " discard=enable" : " discard=besteffort",
+     drv->detect_zeroes ? " detectzeroes" : "");
 }
 
 /* Add struct drive to the g->drives vector at the given index. */
@@ -817,6 +823,15 @@ guestfs__add_drive_opts (guestfs_h *g, const char *filename,
   else
     data.discard = discard_disable;
 
+  data.detect_zeroes =
+    optargs->bitmask & GUESTFS_ADD_DRIVE_OPTS_DETECTZEROES_BITMASK
+    ? optargs->detectzeroes : false;
+  if (data.detect_zeroes && data.discard == discard_disable) {
+    error (g, _("detectzeroes requires discard to be 'enable' or 'besteffort'"));
+    free_drive_servers (data.servers, data.nr_servers);
+    return -1;
+  }
+
   if (data.readonly && data.discard == discard_enable) {
     error (g, _("discard support cannot be enabled on read-only drives"));
     free_drive_servers (data.servers, data.nr_servers);
@@ -966,6 +981,10 @@ guestfs__add_drive_opts (guestfs_h *g, const char *filename,
   add_drive_to_handle_at (g, drv, drv_index);
   /* drv is now owned by the handle */
 
+  /* guestfs_add_drives waits for all the drives at the end. */
+  if (g->hotplug_batch)
+    return 0;
+
   /* Call into the appliance to wait for the new drive to appear. */
   if (guestfs_internal_hot_add_drive (g, drv->disk_label) == -1)
     return -1;
@@ -973,6 +992,69 @@ guestfs__add_drive_opts (guestfs_h *g, const char *filename,
   return 0;
 }
 
+int
+guestfs__add_drives (guestfs_h *g, char *const *filenames,
+                     char *const *labels,
+                     const struct guestfs_add_drives_argv *optargs)
+{
+  struct guestfs_add_drive_opts_argv add_drive_optargs = { .bitmask = 0 };
+  size_t i, n = guestfs___count_strings (filenames);
+  struct timeval start_t, end_t;
+  int r = 0;
+
+  if (guestfs___count_strings (labels) != n) {
+    error (g, _("the filenames and labels lists must be the same length"));
+    return -1;
+  }
+
+  if (optargs->bitmask & GUESTFS_ADD_DRIVES_READONLY_BITMASK) {
+    add_drive_optargs.bitmask |= GUESTFS_ADD_DRIVE_OPTS_READONLY_BITMASK;
+    add_drive_optargs.readonly = optargs->readonly;
+  }
+  if (optargs->bitmask & GUESTFS_ADD_DRIVES_FORMAT_BITMASK) {
+    add_drive_optargs.bitmask |= GUESTFS_ADD_DRIVE_OPTS_FORMAT_BITMASK;
+    add_drive_optargs.format = optargs->format;
+  }
+  if (optargs->bitmask & GUESTFS_ADD_DRIVES_CACHEMODE_BITMASK) {
+    add_drive_optargs.bitmask |= GUESTFS_ADD_DRIVE_OPTS_CACHEMODE_BITMASK;
+    add_drive_optargs.cachemode = optargs->cachemode;
+  }
+  add_drive_optargs.bitmask |= GUESTFS_ADD_DRIVE_OPTS_LABEL_BITMASK;
+
+  gettimeofday (&start_t, NULL);
+
+  /* When hotplugging, attach all the drives first, then wait for
+   * them all in a single call into the appliance.
+   */
+  g->hotplug_batch = g->state != CONFIG;
+  for (i = 0; i < n; ++i) {
+    add_drive_optargs.label = labels[i];
+    if (guestfs_add_drive_opts_argv (g, filenames[i],
+                                     &add_drive_optargs) == -1) {
+      r = -1;
+      break;
+    }
+  }
+  g->hotplug_batch = false;
+
+  /* Even if one failed, wait for the drives which were added. */
+  if (g->state != CONFIG && i > 0) {
+    /* Only the array is freed, the strings belong to the caller. */
+    CLEANUP_FREE char **added = safe_malloc (g, (i+1) * sizeof (char *));
+
+    memcpy (added, labels, i * sizeof (char *));
+    added[i] = NULL;
+    if (guestfs_internal_hot_add_drives (g, added) == -1)
+      r = -1;
+
+    gettimeofday (&end_t, NULL);
+    debug (g, "hot-added %zu drive(s) in %" PRIi64 " ms",
+           i, guestfs___timeval_diff (&start_t, &end_t));
+  }
+
+  return r;
+}
+
 int
 guestfs__add_drive_ro (guestfs_h *g, const char *filename)
 {
@@ -1109,6 +1191,86 @@ guestfs__remove_drive (guestfs_h *g, const char *label)
   }
 }
 
+int
+guestfs__remove_drives (guestfs_h *g, char *const *labels)
+{
+  size_t i, j, n = guestfs___count_strings (labels);
+  CLEANUP_FREE size_t *indexes = NULL;
+  struct drive *drv;
+  struct timeval start_t, end_t;
+  int r = 0;
+
+  if (n == 0)
+    return 0;
+
+  /* Find all the drives before removing any of them. */
+  indexes = safe_malloc (g, n * sizeof (size_t));
+  for (i = 0; i < n; ++i) {
+    ITER_DRIVES (g, indexes[i], drv) {
+      if (drv->disk_label && STREQ (labels[i], drv->disk_label))
+        break;
+    }
+    if (indexes[i] == g->nr_drives) {
+      error (g, _("disk with label '%s' not found"), labels[i]);
+      return -1;
+    }
+    for (j = 0; j < i; ++j) {
+      if (indexes[j] == indexes[i]) {
+        error (g, _("disk with label '%s' given more than once"), labels[i]);
+        return -1;
+      }
+    }
+  }
+
+  if (g->state == CONFIG) {     /* Not hotplugging. */
+    for (i = 0; i < n; ++i)
+      if (guestfs_remove_drive (g, labels[i]) == -1)
+        return -1;
+    return 0;
+  }
+
+  if (!g->backend_ops->hot_remove_drive) {
+    error (g, _("the current backend does not support hotplugging drives"));
+    return -1;
+  }
+
+  gettimeofday (&start_t, NULL);
+
+  if (guestfs_internal_hot_remove_drives_precheck (g, labels) == -1)
+    return -1;
+
+  for (i = 0; i < n; ++i) {
+    drv = g->drives[indexes[i]];
+    if (g->backend_ops->hot_remove_drive (g, g->backend_data,
+                                          drv, indexes[i]) == -1) {
+      r = -1;
+      break;
+    }
+    free_drive_struct (drv);
+    g->drives[indexes[i]] = NULL;
+  }
+
+  while (g->nr_drives > 0 && g->drives[g->nr_drives-1] == NULL)
+    g->nr_drives--;
+
+  /* Wait for the drives which were removed, even if one failed. */
+  if (i > 0) {
+    /* Only the array is freed, the strings belong to the caller. */
+    CLEANUP_FREE char **removed = safe_malloc (g, (i+1) * sizeof (char *));
+
+    memcpy (removed, labels, i * sizeof (char *));
+    removed[i] = NULL;
+    if (guestfs_internal_hot_remove_drives (g, removed) == -1)
+      r = -1;
+
+    gettimeofday (&end_t, NULL);
+    debug (g, "hot-removed %zu drive(s) in %" PRIi64 " ms",
+           i, guestfs___timeval_diff (&start_t, &end_t));
+  }
+
+  return r;
+}
+
 /* Checkpoint and roll back drives, so that groups of drives can be
  * added atomicly.  Only used by guestfs_add_domain.
  */
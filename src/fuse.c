@@ -57,9 +57,14 @@ static void dir_cache_invalidate (guestfs_h *, const char *path);
 static int lsc_insert (guestfs_h *, const char *path, const char *name, time_t now, struct stat const *statbuf);
 static int xac_insert (guestfs_h *, const char *path, const char *name, time_t now, struct guestfs_xattr_list *xattrs);
 static int rlc_insert (guestfs_h *, const char *path, const char *name, time_t now, char *link);
+static int rdc_insert (guestfs_h *, const char *path, const char *name, time_t now, struct guestfs_dirent_list *ents);
 static const struct stat *lsc_lookup (guestfs_h *, const char *pathname);
 static const struct guestfs_xattr_list *xac_lookup (guestfs_h *, const char *pathname);
 static const char *rlc_lookup (guestfs_h *, const char *pathname);
+static const struct guestfs_dirent_list *rdc_lookup (guestfs_h *, const char *pathname);
+
+/* FUSE options added when mounting read-only. */
+#define ML_READ_ONLY_FUSE_OPTIONS "entry_timeout=86400,attr_timeout=86400"
 
 /* This lock protects access to g->localmountpoint. */
 gl_lock_define_initialized (static, mount_local_lock);
@@ -115,24 +120,11 @@ copy_xattr_list (guestfs_h *g, const struct guestfs_xattr *first, size_t num)
   return xattrs;
 }
 
-static int
-mount_local_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
-                     off_t offset, struct fuse_file_info *fi)
+static void
+fill_dir (const struct guestfs_dirent_list *ents,
+          void *buf, fuse_fill_dir_t filler)
 {
-  time_t now;
   size_t i;
-  char **names;
-  CLEANUP_FREE_DIRENT_LIST struct guestfs_dirent_list *ents = NULL;
-  DECL_G ();
-  DEBUG_CALL ("%s, %p, %ld", path, buf, (long) offset);
-
-  time (&now);
-
-  dir_cache_remove_all_expired (g, now);
-
-  ents = guestfs_readdir (g, path);
-  if (ents == NULL)
-    RETURN_ERRNO;
 
   for (i = 0; i < ents->len; ++i) {
     struct stat stat;
@@ -159,6 +151,40 @@ mount_local_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
     if (filler (buf, ents->val[i].name, &stat, 0))
       break;
   }
+}
+
+static int
+mount_local_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
+                     off_t offset, struct fuse_file_info *fi)
+{
+  time_t now;
+  size_t i;
+  char **names;
+  const struct guestfs_dirent_list *cached;
+  CLEANUP_FREE_DIRENT_LIST struct guestfs_dirent_list *ents = NULL;
+  DECL_G ();
+  DEBUG_CALL ("%s, %p, %ld", path, buf, (long) offset);
+
+  time (&now);
+
+  dir_cache_remove_all_expired (g, now);
+
+  /* In read-only mode nothing can change the directory, so the
+   * listing itself is cached too.
+   */
+  if (g->ml_read_only) {
+    cached = rdc_lookup (g, path);
+    if (cached) {
+      fill_dir (cached, buf, filler);
+      return 0;
+    }
+  }
+
+  ents = guestfs_readdir (g, path);
+  if (ents == NULL)
+    RETURN_ERRNO;
+
+  fill_dir (ents, buf, filler);
 
   /* Now prepopulate the directory caches.  This step is just an
    * optimization, don't worry if it fails.
@@ -239,6 +265,12 @@ mount_local_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
     free (names);
   }
 
+  if (g->ml_read_only) {
+    /* Note that rdc_insert owns the list after this. */
+    rdc_insert (g, "/", &path[1], now, ents);
+    ents = NULL;
+  }
+
   return 0;
 }
 
@@ -275,6 +307,9 @@ mount_local_getattr (const char *path, struct stat *statbuf)
   statbuf->st_mtime = r->mtime;
   statbuf->st_ctime = r->ctime;
 
+  if (g->ml_read_only)
+    lsc_insert (g, "/", &path[1], time (NULL), statbuf);
+
   return 0;
 }
 
@@ -334,7 +369,15 @@ mount_local_readlink (const char *path, char *buf, size_t size)
     r = guestfs_readlink (g, path);
     if (r == NULL)
       RETURN_ERRNO;
-    free_it = 1;
+    if (g->ml_read_only) {
+      /* Note that rlc_insert owns the string after this. */
+      rlc_insert (g, "/", &path[1], time (NULL), (char *) r);
+      r = rlc_lookup (g, path);
+      if (r == NULL)
+        return -ENOMEM;
+    }
+    else
+      free_it = 1;
   }
 
   /* Note this is different from the real readlink(2) syscall.  FUSE wants
@@ -593,6 +636,12 @@ mount_local_open (const char *path, struct fuse_file_info *fi)
   if (g->ml_read_only && flags != O_RDONLY)
     return -EROFS;
 
+  /* Files can't change under a read-only mount, so let the kernel
+   * keep the page cache between opens.
+   */
+  if (g->ml_read_only)
+    fi->keep_cache = 1;
+
   return 0;
 }
 
@@ -727,6 +776,33 @@ mount_local_setxattr (const char *path, const char *name, const char *value,
   return 0;
 }
 
+/* Get the xattrs of 'path', from the cache if possible.  If
+ * '*free_attrs' is set on return, the caller must free the list.
+ */
+static const struct guestfs_xattr_list *
+lookup_xattrs (guestfs_h *g, const char *path, int *free_attrs)
+{
+  const struct guestfs_xattr_list *xattrs;
+  struct guestfs_xattr_list *r;
+
+  xattrs = xac_lookup (g, path);
+  if (xattrs)
+    return xattrs;
+
+  r = guestfs_lgetxattrs (g, path);
+  if (r == NULL)
+    return NULL;
+
+  if (!g->ml_read_only) {
+    *free_attrs = 1;
+    return r;
+  }
+
+  /* Note that xac_insert owns the list after this. */
+  xac_insert (g, "/", &path[1], time (NULL), r);
+  return xac_lookup (g, path);
+}
+
 /* The guestfs(3) API for getting xattrs is much easier to use
  * than the real syscall.  Unfortunately we now have to emulate
  * the real syscall using that API :-(
@@ -742,13 +818,9 @@ mount_local_getxattr (const char *path, const char *name, char *value,
   DECL_G ();
   DEBUG_CALL ("%s, %s, %p, %zu", path, name, value, size);
 
-  xattrs = xac_lookup (g, path);
-  if (xattrs == NULL) {
-    xattrs = guestfs_lgetxattrs (g, path);
-    if (xattrs == NULL)
-      RETURN_ERRNO;
-    free_attrs = 1;
-  }
+  xattrs = lookup_xattrs (g, path, &free_attrs);
+  if (xattrs == NULL)
+    RETURN_ERRNO;
 
   /* Find the matching attribute (index in 'i'). */
   for (i = 0; i < xattrs->len; ++i) {
@@ -802,13 +874,9 @@ mount_local_listxattr (const char *path, char *list, size_t size)
   DECL_G ();
   DEBUG_CALL ("%s, %p, %zu", path, list, size);
 
-  xattrs = xac_lookup (g, path);
-  if (xattrs == NULL) {
-    xattrs = guestfs_lgetxattrs (g, path);
-    if (xattrs == NULL)
-      RETURN_ERRNO;
-    free_attrs = 1;
-  }
+  xattrs = lookup_xattrs (g, path, &free_attrs);
+  if (xattrs == NULL)
+    RETURN_ERRNO;
 
   /* Calculate how much space is required to hold the result. */
   for (i = 0; i < xattrs->len; ++i) {
@@ -934,8 +1002,19 @@ guestfs__mount_local (guestfs_h *g, const char *localmountpoint,
     g->ml_read_only = 0;
   if (optargs->bitmask & GUESTFS_MOUNT_LOCAL_CACHETIMEOUT_BITMASK)
     g->ml_dir_cache_timeout = optargs->cachetimeout;
+  else if (g->ml_read_only)
+    g->ml_dir_cache_timeout = -1; /* never expire */
   else
     g->ml_dir_cache_timeout = 60;
+  if (optargs->bitmask & GUESTFS_MOUNT_LOCAL_CACHEMAXENTRIES_BITMASK) {
+    if (optargs->cachemaxentries <= 0) {
+      error (g, _("cachemaxentries must be greater than zero"));
+      return -1;
+    }
+    g->ml_dir_cache_max_entries = optargs->cachemaxentries;
+  }
+  else
+    g->ml_dir_cache_max_entries = 100000;
   if (optargs->bitmask & GUESTFS_MOUNT_LOCAL_DEBUGCALLS_BITMASK)
     g->ml_debug_calls = optargs->debugcalls;
   else
@@ -955,6 +1034,16 @@ guestfs__mount_local (guestfs_h *g, const char *localmountpoint,
     return -1;
   }
 
+  /* In read-only mode, let the kernel cache names and attributes for
+   * a long time.  Options passed by the caller come later, so they
+   * can override these.
+   */
+  if (g->ml_read_only) {
+    if (fuse_opt_add_arg (&args, "-o") == -1 ||
+        fuse_opt_add_arg (&args, ML_READ_ONLY_FUSE_OPTIONS) == -1)
+      goto arg_error;
+  }
+
   if (optargs->bitmask & GUESTFS_MOUNT_LOCAL_OPTIONS_BITMASK) {
     if (fuse_opt_add_arg (&args, "-o") == -1 ||
         fuse_opt_add_arg (&args, optargs->options) == -1)
@@ -1123,13 +1212,32 @@ guestfs__umount_local (guestfs_h *g,
  * immediately afterwards, which is usually the case when the user is
  * doing an "ls"-like operation.
  *
+ * As well as being in a hash table, each entry is on two lists.  The
+ * expiry list is in order of insertion, which (since the timeout is
+ * the same for every entry) is also the order in which entries
+ * expire, so removing expired entries only has to look at the head
+ * of the list.  The LRU list is in order of last use, and when a
+ * cache grows beyond g->ml_dir_cache_max_entries the least recently
+ * used entries are evicted from the head of it.
+ *
+ * Directory listings can be arbitrarily large, so the readdir cache
+ * is also limited by the number of bytes it holds (RDC_MAX_BYTES).
+ * Least recently used listings are evicted to stay under the limit,
+ * and a single listing bigger than the limit is not cached at all.
+ *
  * You can still use FUSE attribute caching on top of this mechanism
  * if you like.
  */
 
+enum { EXPIRY_LIST, LRU_LIST, NR_LISTS };
+
 struct entry_common {
   char *pathname;               /* full path to the file */
   time_t timeout;               /* when this entry expires */
+  size_t size;                  /* bytes used (only if max_bytes != 0) */
+  struct {
+    struct entry_common *prev, *next;
+  } list[NR_LISTS];             /* expiry and LRU lists */
 };
 
 struct lsc_entry {              /* lstat cache entry */
@@ -1147,6 +1255,22 @@ struct rlc_entry {              /* readlink cache entry */
   char *link;
 };
 
+struct rdc_entry {              /* readdir cache entry (read-only mode) */
+  struct entry_common c;
+  struct guestfs_dirent_list *ents;
+};
+
+/* Maximum bytes of directory listings held by the readdir cache. */
+#define RDC_MAX_BYTES (32 * 1024 * 1024)
+
+struct ml_dir_cache {
+  Hash_table *ht;
+  Hash_data_freer freer;
+  size_t nr_entries;
+  size_t bytes, max_bytes;      /* max_bytes == 0 means no limit */
+  struct entry_common *head[NR_LISTS], *tail[NR_LISTS];
+};
+
 static size_t
 gen_hash (void const *x, size_t table_size)
 {
@@ -1195,14 +1319,79 @@ rlc_free (void *x)
   }
 }
 
+static void
+rdc_free (void *x)
+{
+  if (x) {
+    struct rdc_entry *p = x;
+
+    guestfs_free_dirent_list (p->ents);
+    lsc_free (x);
+  }
+}
+
+static void
+list_append (struct ml_dir_cache *cache, int l, struct entry_common *p)
+{
+  p->list[l].prev = cache->tail[l];
+  p->list[l].next = NULL;
+  if (cache->tail[l])
+    cache->tail[l]->list[l].next = p;
+  else
+    cache->head[l] = p;
+  cache->tail[l] = p;
+}
+
+static void
+list_unlink (struct ml_dir_cache *cache, int l, struct entry_common *p)
+{
+  if (p->list[l].prev)
+    p->list[l].prev->list[l].next = p->list[l].next;
+  else
+    cache->head[l] = p->list[l].next;
+  if (p->list[l].next)
+    p->list[l].next->list[l].prev = p->list[l].prev;
+  else
+    cache->tail[l] = p->list[l].prev;
+}
+
+static struct ml_dir_cache *
+new_dir_cache (Hash_data_freer freer, size_t max_bytes)
+{
+  struct ml_dir_cache *cache;
+
+  cache = calloc (1, sizeof *cache);
+  if (cache == NULL)
+    return NULL;
+  cache->freer = freer;
+  cache->max_bytes = max_bytes;
+  cache->ht = hash_initialize (1024, NULL, gen_hash, gen_compare, freer);
+  if (cache->ht == NULL) {
+    free (cache);
+    return NULL;
+  }
+  return cache;
+}
+
+static void
+free_dir_cache (struct ml_dir_cache *cache)
+{
+  if (cache) {
+    hash_free (cache->ht);      /* also frees the entries */
+    free (cache);
+  }
+}
+
 static int
 init_dir_caches (guestfs_h *g)
 {
-  g->lsc_ht = hash_initialize (1024, NULL, gen_hash, gen_compare, lsc_free);
-  g->xac_ht = hash_initialize (1024, NULL, gen_hash, gen_compare, xac_free);
-  g->rlc_ht = hash_initialize (1024, NULL, gen_hash, gen_compare, rlc_free);
-  if (!g->lsc_ht || !g->xac_ht || !g->rlc_ht) {
+  g->lsc = new_dir_cache (lsc_free, 0);
+  g->xac = new_dir_cache (xac_free, 0);
+  g->rlc = new_dir_cache (rlc_free, 0);
+  g->rdc = new_dir_cache (rdc_free, RDC_MAX_BYTES);
+  if (!g->lsc || !g->xac || !g->rlc || !g->rdc) {
     error (g, _("could not initialize dir cache hashtables"));
+    free_dir_caches (g);
     return -1;
   }
   return 0;
@@ -1211,80 +1400,81 @@ init_dir_caches (guestfs_h *g)
 static void
 free_dir_caches (guestfs_h *g)
 {
-  if (g->lsc_ht)
-    hash_free (g->lsc_ht);
-  if (g->xac_ht)
-    hash_free (g->xac_ht);
-  if (g->rlc_ht)
-    hash_free (g->rlc_ht);
-  g->lsc_ht = NULL;
-  g->xac_ht = NULL;
-  g->rlc_ht = NULL;
+  free_dir_cache (g->lsc);
+  free_dir_cache (g->xac);
+  free_dir_cache (g->rlc);
+  free_dir_cache (g->rdc);
+  g->lsc = NULL;
+  g->xac = NULL;
+  g->rlc = NULL;
+  g->rdc = NULL;
 }
 
-struct gen_remove_data {
-  time_t now;
-  Hash_table *ht;
-  Hash_data_freer freer;
-};
-
-static bool
-gen_remove_if_expired (void *x, void *data)
+/* Remove an entry which is in the cache, and free it. */
+static void
+gen_delete (struct ml_dir_cache *cache, struct entry_common *entry)
 {
-  /* XXX hash_do_for_each was observed calling this function
-   * with x == NULL.
-   */
-  if (x) {
-    struct entry_common *p = x;
-    struct gen_remove_data *d = data;
-
-    if (p->timeout < d->now)
-      d->freer (hash_delete (d->ht, x));
-  }
-
-  return 1;
+  hash_delete (cache->ht, entry);
+  list_unlink (cache, EXPIRY_LIST, entry);
+  list_unlink (cache, LRU_LIST, entry);
+  cache->nr_entries--;
+  cache->bytes -= entry->size;
+  cache->freer (entry);
 }
 
 static void
-gen_remove_all_expired (Hash_table *ht, Hash_data_freer freer, time_t now)
+gen_remove_all_expired (struct ml_dir_cache *cache, time_t now)
 {
-  struct gen_remove_data data;
-  data.now = now;
-  data.ht = ht;
-  data.freer = freer;
-
-  /* Careful reading of the documentation to hash _seems_ to indicate
-   * that this is safe, _provided_ we use the default thresholds (in
-   * particular, no shrink threshold).
-   */
-  hash_do_for_each (ht, gen_remove_if_expired, &data);
+  while (cache->head[EXPIRY_LIST] &&
+         cache->head[EXPIRY_LIST]->timeout < now)
+    gen_delete (cache, cache->head[EXPIRY_LIST]);
 }
 
 static void
 dir_cache_remove_all_expired (guestfs_h *g, time_t now)
 {
-  gen_remove_all_expired (g->lsc_ht, lsc_free, now);
-  gen_remove_all_expired (g->xac_ht, xac_free, now);
-  gen_remove_all_expired (g->rlc_ht, rlc_free, now);
+  if (g->ml_dir_cache_timeout < 0)
+    return;
+
+  gen_remove_all_expired (g->lsc, now);
+  gen_remove_all_expired (g->xac, now);
+  gen_remove_all_expired (g->rlc, now);
+  gen_remove_all_expired (g->rdc, now);
 }
 
 static int
-gen_replace (guestfs_h *g, Hash_table *ht,
-             struct entry_common *new_entry, Hash_data_freer freer)
+gen_replace (guestfs_h *g, struct ml_dir_cache *cache,
+             struct entry_common *new_entry)
 {
   struct entry_common *old_entry;
 
-  old_entry = hash_delete (ht, new_entry);
-  freer (old_entry);
+  old_entry = hash_lookup (cache->ht, new_entry);
+  if (old_entry)
+    gen_delete (cache, old_entry);
 
-  old_entry = hash_insert (ht, new_entry);
+  if (cache->max_bytes > 0 && new_entry->size > cache->max_bytes) {
+    cache->freer (new_entry);
+    return 0;
+  }
+
+  old_entry = hash_insert (cache->ht, new_entry);
   if (old_entry == NULL) {
     perrorf (g, "hash_insert");
-    freer (new_entry);
+    cache->freer (new_entry);
     return -1;
   }
   /* assert (old_entry == new_entry); */
 
+  list_append (cache, EXPIRY_LIST, new_entry);
+  list_append (cache, LRU_LIST, new_entry);
+  cache->nr_entries++;
+  cache->bytes += new_entry->size;
+
+  while (cache->nr_entries > g->ml_dir_cache_max_entries)
+    gen_delete (cache, cache->head[LRU_LIST]);
+  while (cache->max_bytes > 0 && cache->bytes > cache->max_bytes)
+    gen_delete (cache, cache->head[LRU_LIST]);
+
   return 0;
 }
 
@@ -1317,8 +1507,9 @@ lsc_insert (guestfs_h *g,
   memcpy (&entry->statbuf, statbuf, sizeof entry->statbuf);
 
   entry->c.timeout = now + g->ml_dir_cache_timeout;
+  entry->c.size = 0;
 
-  return gen_replace (g, g->lsc_ht, (struct entry_common *) entry, lsc_free);
+  return gen_replace (g, g->lsc, (struct entry_common *) entry);
 }
 
 static int
@@ -1332,6 +1523,7 @@ xac_insert (guestfs_h *g,
   entry = malloc (sizeof *entry);
   if (entry == NULL) {
     perrorf (g, "malloc");
+    guestfs_free_xattr_list (xattrs);
     return -1;
   }
 
@@ -1340,6 +1532,7 @@ xac_insert (guestfs_h *g,
   if (entry->c.pathname == NULL) {
     perrorf (g, "malloc");
     free (entry);
+    guestfs_free_xattr_list (xattrs);
     return -1;
   }
   if (STREQ (path, "/"))
@@ -1350,8 +1543,9 @@ xac_insert (guestfs_h *g,
   entry->xattrs = xattrs;
 
   entry->c.timeout = now + g->ml_dir_cache_timeout;
+  entry->c.size = 0;
 
-  return gen_replace (g, g->xac_ht, (struct entry_common *) entry, xac_free);
+  return gen_replace (g, g->xac, (struct entry_common *) entry);
 }
 
 static int
@@ -1365,6 +1559,7 @@ rlc_insert (guestfs_h *g,
   entry = malloc (sizeof *entry);
   if (entry == NULL) {
     perrorf (g, "malloc");
+    free (link);
     return -1;
   }
 
@@ -1373,6 +1568,7 @@ rlc_insert (guestfs_h *g,
   if (entry->c.pathname == NULL) {
     perrorf (g, "malloc");
     free (entry);
+    free (link);
     return -1;
   }
   if (STREQ (path, "/"))
@@ -1383,75 +1579,129 @@ rlc_insert (guestfs_h *g,
   entry->link = link;
 
   entry->c.timeout = now + g->ml_dir_cache_timeout;
+  entry->c.size = 0;
 
-  return gen_replace (g, g->rlc_ht, (struct entry_common *) entry, rlc_free);
+  return gen_replace (g, g->rlc, (struct entry_common *) entry);
 }
 
-static const struct stat *
-lsc_lookup (guestfs_h *g, const char *pathname)
+static int
+rdc_insert (guestfs_h *g,
+            const char *path, const char *name, time_t now,
+            struct guestfs_dirent_list *ents)
+{
+  struct rdc_entry *entry;
+  size_t len, i;
+
+  entry = malloc (sizeof *entry);
+  if (entry == NULL) {
+    perrorf (g, "malloc");
+    guestfs_free_dirent_list (ents);
+    return -1;
+  }
+
+  len = strlen (path) + strlen (name) + 2;
+  entry->c.pathname = malloc (len);
+  if (entry->c.pathname == NULL) {
+    perrorf (g, "malloc");
+    free (entry);
+    guestfs_free_dirent_list (ents);
+    return -1;
+  }
+  if (STREQ (path, "/"))
+    snprintf (entry->c.pathname, len, "/%s", name);
+  else
+    snprintf (entry->c.pathname, len, "%s/%s", path, name);
+
+  entry->ents = ents;
+
+  entry->c.timeout = now + g->ml_dir_cache_timeout;
+  entry->c.size = sizeof *entry + len + sizeof *ents +
+    ents->len * sizeof ents->val[0];
+  for (i = 0; i < ents->len; ++i)
+    entry->c.size += strlen (ents->val[i].name) + 1;
+
+  return gen_replace (g, g->rdc, (struct entry_common *) entry);
+}
+
+/* Look up 'pathname' in the cache.  An expired entry is removed and
+ * not returned.  A hit makes the entry the most recently used.
+ */
+static struct entry_common *
+gen_lookup (guestfs_h *g, struct ml_dir_cache *cache, const char *pathname)
 {
   const struct entry_common key = { .pathname = (char *) pathname };
-  struct lsc_entry *entry;
+  struct entry_common *entry;
   time_t now;
 
-  time (&now);
+  entry = hash_lookup (cache->ht, &key);
+  if (entry == NULL)
+    return NULL;
 
-  entry = hash_lookup (g->lsc_ht, &key);
-  if (entry && entry->c.timeout >= now)
-    return &entry->statbuf;
-  else
+  time (&now);
+  if (g->ml_dir_cache_timeout >= 0 && entry->timeout < now) {
+    gen_delete (cache, entry);
     return NULL;
+  }
+
+  list_unlink (cache, LRU_LIST, entry);
+  list_append (cache, LRU_LIST, entry);
+  return entry;
+}
+
+static const struct stat *
+lsc_lookup (guestfs_h *g, const char *pathname)
+{
+  struct lsc_entry *entry;
+
+  entry = (struct lsc_entry *) gen_lookup (g, g->lsc, pathname);
+  return entry ? &entry->statbuf : NULL;
 }
 
 static const struct guestfs_xattr_list *
 xac_lookup (guestfs_h *g, const char *pathname)
 {
-  const struct entry_common key = { .pathname = (char *) pathname };
   struct xac_entry *entry;
-  time_t now;
 
-  time (&now);
-
-  entry = hash_lookup (g->xac_ht, &key);
-  if (entry && entry->c.timeout >= now)
-    return entry->xattrs;
-  else
-    return NULL;
+  entry = (struct xac_entry *) gen_lookup (g, g->xac, pathname);
+  return entry ? entry->xattrs : NULL;
 }
 
 static const char *
 rlc_lookup (guestfs_h *g, const char *pathname)
 {
-  const struct entry_common key = { .pathname = (char *) pathname };
   struct rlc_entry *entry;
-  time_t now;
 
-  time (&now);
+  entry = (struct rlc_entry *) gen_lookup (g, g->rlc, pathname);
+  return entry ? entry->link : NULL;
+}
 
-  entry = hash_lookup (g->rlc_ht, &key);
-  if (entry && entry->c.timeout >= now)
-    return entry->link;
-  else
-    return NULL;
+static const struct guestfs_dirent_list *
+rdc_lookup (guestfs_h *g, const char *pathname)
+{
+  struct rdc_entry *entry;
+
+  entry = (struct rdc_entry *) gen_lookup (g, g->rdc, pathname);
+  return entry ? entry->ents : NULL;
 }
 
 static void
-gen_remove (Hash_table *ht, const char *pathname, Hash_data_freer freer)
+gen_remove (struct ml_dir_cache *cache, const char *pathname)
 {
   const struct entry_common key = { .pathname = (char *) pathname };
   struct entry_common *entry;
 
-  entry = hash_delete (ht, &key);
-
-  freer (entry);
+  entry = hash_lookup (cache->ht, &key);
+  if (entry)
+    gen_delete (cache, entry);
 }
 
 static void
 dir_cache_invalidate (guestfs_h *g, const char *path)
 {
-  gen_remove (g->lsc_ht, path, lsc_free);
-  gen_remove (g->xac_ht, path, xac_free);
-  gen_remove (g->rlc_ht, path, rlc_free);
+  gen_remove (g->lsc, path);
+  gen_remove (g->xac, path);
+  gen_remove (g->rlc, path);
+  gen_remove (g->rdc, path);
 }
 
 #else /* !HAVE_FUSE */
@@ -262,6 +262,7 @@ struct drive {
   char *disk_label;
   char *cachemode;
   enum discard discard;
+  bool detect_zeroes;
 };
 
 /* Extra hv parameters (from guestfs_config). */
@@ -343,6 +344,44 @@ struct connection_ops {
    * Returns: 1 = yes, 0 = no, -1 = error
    */
   int (*can_read_data) (guestfs_h *g, struct connection *);
+
+  /* Read up to len bytes from the daemon socket, but only as much as
+   * is available without blocking.  Log messages are handled as in
+   * read_data.
+   *
+   * Returns: number of bytes read, 0 = appliance closed connection,
+   * -1 = error, -2 = no data available
+   */
+  ssize_t (*try_read_data) (guestfs_h *g, struct connection *, void *buf, size_t len);
+
+  /* Return the file descriptors which should be polled for input in
+   * order to call try_read_data, up to 2 of them.
+   *
+   * Returns: number of file descriptors, or -1 = error
+   */
+  int (*get_fds) (guestfs_h *g, struct connection *, int *fds);
+};
+
+/* Counters for one RPC procedure, see src/rpc-stats.c.  Latencies
+ * are also counted in buckets: < 1ms, < 10ms, < 100ms, < 1s, >= 1s.
+ */
+#define NR_RPC_LATENCY_BUCKETS 5
+
+struct rpc_stats {
+  const char *name;             /* NULL if never called. */
+  uint64_t calls, errors;
+  uint64_t total_usec, max_usec;
+  uint64_t latency[NR_RPC_LATENCY_BUCKETS];
+  uint64_t bytes_sent, bytes_received;
+  uint64_t chunks_sent, chunks_received;
+};
+
+/* Milestones recorded by the backends during launch. */
+enum launch_milestone {
+  LAUNCH_APPLIANCE_BUILT,       /* guestfs___build_appliance returned */
+  LAUNCH_HV_STARTED,            /* qemu process (or domain) started */
+  LAUNCH_APPLIANCE_UP,          /* daemon sent GUESTFS_LAUNCH_FLAG */
+  NR_LAUNCH_MILESTONES
 };
 
 /* Stack of old error handlers. */
@@ -400,6 +439,11 @@ struct guestfs_h
   struct drive **drives;
   size_t nr_drives;
 
+  /* Set by guestfs_add_drives while it hot-adds a batch of drives,
+   * so that guestfs_add_drive_opts doesn't wait for each one.
+   */
+  bool hotplug_batch;
+
 #define ITER_DRIVES(g,i,drv)              \
   for (i = 0; i < (g)->nr_drives; ++i)    \
     if (((drv) = (g)->drives[i]) != NULL)
@@ -454,6 +498,14 @@ struct guestfs_h
 
   struct timeval launch_t;      /* The time that we called guestfs_launch. */
 
+  /* Launch milestones (see guestfs_launch_timings).  Each is the time
+   * in microseconds since launch_t, or 0 if not reached.  boot_timings
+   * is the list returned by guestfs_internal_boot_timings, fetched on
+   * demand.
+   */
+  int64_t launch_milestones[NR_LAUNCH_MILESTONES];
+  char **boot_timings;
+
   /* Used by bindtests. */
   FILE *test_fp;
 
@@ -473,12 +525,34 @@ struct guestfs_h
   struct connection *conn;              /* Connection to appliance. */
   int msg_next_serial;
 
+  /* RPC statistics (see src/rpc-stats.c).  rpc_stats is indexed by
+   * procedure number and is allocated on the first call.  rpc_proc
+   * is the procedure number of the most recent call (0 if none),
+   * which file chunks are accounted to.
+   */
+  struct rpc_stats *rpc_stats;
+  int rpc_proc;
+  struct timeval rpc_start_t;           /* When rpc_proc was sent. */
+
+  /* Asynchronous call in progress (see "Asynchronous calls" in
+   * src/proto.c).  async_proc is 0 if there is none.  The reply is
+   * read into async_lenbuf (the length word) and then async_buf.
+   */
+  int async_proc;
+  int async_serial;
+  char async_lenbuf[4];
+  uint32_t async_len;                   /* Decoded length word. */
+  char *async_buf;
+  size_t async_size, async_pos;
+  bool async_done;                      /* Reply is in async_buf. */
+
 #if HAVE_FUSE
   /**** Used by the mount-local APIs. ****/
   const char *localmountpoint;
   struct fuse *fuse;                    /* FUSE handle. */
   int ml_dir_cache_timeout;             /* Directory cache timeout. */
-  Hash_table *lsc_ht, *xac_ht, *rlc_ht; /* Directory cache. */
+  size_t ml_dir_cache_max_entries;      /* Max entries in each cache. */
+  struct ml_dir_cache *lsc, *xac, *rlc, *rdc; /* Directory cache. */
   int ml_read_only;                     /* If mounted read-only. */
   int ml_debug_calls;        /* Extra debug info on each FUSE call. */
 #endif
@@ -697,10 +771,19 @@ extern int guestfs___recv_file (guestfs_h *g, const char *filename);
 extern int guestfs___recv_from_daemon (guestfs_h *g, uint32_t *size_rtn, void **buf_rtn);
 extern void guestfs___progress_message_callback (guestfs_h *g, const struct guestfs_progress *message);
 extern void guestfs___log_message_callback (guestfs_h *g, const char *buf, size_t len);
+extern void guestfs___async_sent (guestfs_h *g, int proc_nr, int serial);
+extern int guestfs___async_recv (guestfs_h *g, const char *fn, int proc_nr, int *serial_rtn, struct guestfs_message_header *hdr, struct guestfs_message_error *err, xdrproc_t xdrp, char *ret);
+extern void guestfs___async_reset (guestfs_h *g);
+
+/* rpc-stats.c */
+extern void guestfs___rpc_stats_call (guestfs_h *g, int proc_nr, size_t bytes);
+extern void guestfs___rpc_stats_reply (guestfs_h *g, const char *fn, int status, size_t bytes);
+extern void guestfs___rpc_stats_chunk (guestfs_h *g, int sent, size_t bytes);
 
 /* conn-socket.c */
 extern struct connection *guestfs___new_conn_socket_listening (guestfs_h *g, int daemon_accept_sock, int console_sock);
 extern struct connection *guestfs___new_conn_socket_connected (guestfs_h *g, int daemon_sock, int console_sock);
+extern struct connection *guestfs___new_conn_vsock_listening (guestfs_h *g, int daemon_accept_sock, int console_sock, unsigned int guest_cid);
 
 /* events.c */
 extern void guestfs___call_callbacks_void (guestfs_h *g, uint64_t event);
@@ -713,6 +796,14 @@ extern int guestfs___lazy_make_tmpdir (guestfs_h *g);
 extern void guestfs___remove_tmpdir (guestfs_h *g);
 extern void guestfs___recursive_remove_dir (guestfs_h *g, const char *dir);
 
+/* cache.c */
+extern char *guestfs___cache_lookup (guestfs_h *g, const char *name, const char *key);
+extern void guestfs___cache_store (guestfs_h *g, const char *name, const char *key, const char *data);
+
+/* qcow2.c */
+extern int guestfs___native_disk_info (guestfs_h *g, const char *filename, char **format_r, int64_t *size_r, int *has_backing_file_r);
+extern int guestfs___native_create_qcow2 (guestfs_h *g, const char *filename, int64_t size, const char *backingfile, const char *backingformat);
+
 /* drives.c */
 extern size_t guestfs___checkpoint_drives (guestfs_h *g);
 extern void guestfs___rollback_drives (guestfs_h *g, size_t);
@@ -727,8 +818,10 @@ extern int guestfs___build_appliance (guestfs_h *g, char **kernel, char **dtb, c
 extern int64_t guestfs___timeval_diff (const struct timeval *x, const struct timeval *y);
 extern void guestfs___print_timestamped_message (guestfs_h *g, const char *fs, ...) __attribute__((format (printf,2,3)));
 extern void guestfs___launch_send_progress (guestfs_h *g, int perdozen);
-extern char *guestfs___appliance_command_line (guestfs_h *g, const char *appliance_dev, int flags);
+extern void guestfs___launch_milestone (guestfs_h *g, enum launch_milestone m);
+extern char *guestfs___appliance_command_line (guestfs_h *g, const char *appliance_dev, int flags, unsigned int vsock_port);
 #define APPLIANCE_COMMAND_LINE_IS_TCG 1
+#define APPLIANCE_COMMAND_LINE_DAX 2
 extern void guestfs___register_backend (const char *name, const struct backend_ops *);
 extern int guestfs___set_backend (guestfs_h *g, const char *method);
 
@@ -740,8 +833,10 @@ extern struct inspect_fs *guestfs___search_for_root (guestfs_h *g, const char *r
 /* inspect-fs.c */
 extern int guestfs___is_file_nocase (guestfs_h *g, const char *);
 extern int guestfs___is_dir_nocase (guestfs_h *g, const char *);
+extern char **guestfs___probe_filesystems (guestfs_h *g, char *const *mountables);
 extern int guestfs___check_for_filesystem_on (guestfs_h *g,
-                                              const char *mountable);
+                                              const char *mountable,
+                                              const char *fingerprint);
 extern int guestfs___parse_unsigned_int (guestfs_h *g, const char *str);
 extern int guestfs___parse_unsigned_int_ignore_trailing (guestfs_h *g, const char *str);
 extern int guestfs___parse_major_minor (guestfs_h *g, struct inspect_fs *fs);
@@ -758,6 +853,7 @@ extern int guestfs___check_hurd_root (guestfs_h *g, struct inspect_fs *fs);
 
 /* inspect-fs-windows.c */
 extern char *guestfs___case_sensitive_path_silently (guestfs_h *g, const char *);
+extern char **guestfs___case_sensitive_paths_silently (guestfs_h *g, char *const *);
 extern char * guestfs___get_windows_systemroot (guestfs_h *g);
 extern int guestfs___check_windows_root (guestfs_h *g, struct inspect_fs *fs, char *windows_systemroot);
 
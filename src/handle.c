@@ -374,6 +374,8 @@ guestfs_close (guestfs_h *g)
   free (g->backend_data);
   guestfs___free_string_list (g->backend_settings);
   free (g->append);
+  free (g->rpc_stats);
+  guestfs___free_string_list (g->boot_timings);
   free (g);
 }
 
@@ -428,6 +430,7 @@ shutdown_backend (guestfs_h *g, int check_for_errors)
     g->conn->ops->free_connection (g, g->conn);
     g->conn = NULL;
   }
+  guestfs___async_reset (g);
 
   guestfs___free_drives (g);
 
@@ -53,6 +53,11 @@ static int old_parser_disk_has_backing_file (guestfs_h *g, const char *filename)
 char *
 guestfs__disk_format (guestfs_h *g, const char *filename)
 {
+  char *format;
+
+  if (guestfs___native_disk_info (g, filename, &format, NULL, NULL) == 0)
+    return format;
+
   switch (which_parser (g)) {
   case QEMU_IMG_INFO_NEW_PARSER:
     return get_disk_format (g, filename);
@@ -68,6 +73,11 @@ guestfs__disk_format (guestfs_h *g, const char *filename)
 int64_t
 guestfs__disk_virtual_size (guestfs_h *g, const char *filename)
 {
+  int64_t size;
+
+  if (guestfs___native_disk_info (g, filename, NULL, &size, NULL) == 0)
+    return size;
+
   switch (which_parser (g)) {
   case QEMU_IMG_INFO_NEW_PARSER:
     return get_disk_virtual_size (g, filename);
@@ -83,6 +93,12 @@ guestfs__disk_virtual_size (guestfs_h *g, const char *filename)
 int
 guestfs__disk_has_backing_file (guestfs_h *g, const char *filename)
 {
+  int has_backing_file;
+
+  if (guestfs___native_disk_info (g, filename,
+                                  NULL, NULL, &has_backing_file) == 0)
+    return has_backing_file;
+
   switch (which_parser (g)) {
   case QEMU_IMG_INFO_NEW_PARSER:
     return get_disk_has_backing_file (g, filename);
@@ -168,6 +168,8 @@ static char *resolve_fstab_device (guestfs_h *g, const char *spec,
                                    Hash_table *md_map);
 static int inspect_with_augeas (guestfs_h *g, struct inspect_fs *fs, const char **configfiles, int (*f) (guestfs_h *, struct inspect_fs *));
 static int is_partition (guestfs_h *g, const char *partition);
+static const char *aug_tree_child (char **node, const char *label);
+static char **aug_tree_next (char **node);
 
 /* Hash structure for uuid->path lookups */
 typedef struct md_uuid {
@@ -904,34 +906,34 @@ check_hostname_freebsd (guestfs_h *g, struct inspect_fs *fs)
 static int
 check_fstab (guestfs_h *g, struct inspect_fs *fs)
 {
-  CLEANUP_FREE_STRING_LIST char **entries = NULL;
+  CLEANUP_FREE_STRING_LIST char **tree = NULL;
   char **entry;
-  char augpath[256];
   CLEANUP_HASH_FREE Hash_table *md_map = NULL;
 
   /* Generate a map of MD device paths listed in /etc/mdadm.conf to MD device
    * paths in the guestfs appliance */
   if (map_md_devices (g, &md_map) == -1) return -1;
 
-  entries = guestfs_aug_match (g, "/files/etc/fstab/*[label() != '#comment']");
-  if (entries == NULL)
+  /* Fetch every entry and all of its fields in a single call. */
+  tree = guestfs_aug_get_tree (g, "/files/etc/fstab/*[label() != '#comment']");
+  if (tree == NULL)
     return -1;
 
-  if (entries[0] == NULL) {
+  if (tree[0] == NULL) {
     error (g, _("could not parse /etc/fstab or empty file"));
     return -1;
   }
 
-  for (entry = entries; *entry != NULL; entry++) {
-    CLEANUP_FREE char *spec = NULL;
-    CLEANUP_FREE char *mp = NULL;
+  for (entry = tree; *entry != NULL; entry = aug_tree_next (entry)) {
+    const char *spec, *mp, *vfstype;
     CLEANUP_FREE char *mountable = NULL;
-    CLEANUP_FREE char *vfstype = NULL;
 
-    snprintf (augpath, sizeof augpath, "%s/spec", *entry);
-    spec = guestfs_aug_get (g, augpath);
-    if (spec == NULL)
+    spec = aug_tree_child (entry, "spec");
+    mp = aug_tree_child (entry, "file");
+    if (spec == NULL || mp == NULL) {
+      error (g, _("%s: could not parse /etc/fstab entry"), entry[0]);
       return -1;
+    }
 
     /* Ignore /dev/fd (floppy disks) (RHBZ#642929) and CD-ROM drives.
      *
@@ -944,11 +946,6 @@ check_fstab (guestfs_h *g, struct inspect_fs *fs)
         STRPREFIX (spec, "/dev/iso9660/"))
       continue;
 
-    snprintf (augpath, sizeof augpath, "%s/file", *entry);
-    mp = guestfs_aug_get (g, augpath);
-    if (mp == NULL)
-      return -1;
-
     /* Ignore certain mountpoints. */
     if (STRPREFIX (mp, "/dev/") ||
         STREQ (mp, "/dev") ||
@@ -980,33 +977,41 @@ check_fstab (guestfs_h *g, struct inspect_fs *fs)
     if (mountable == NULL)
       continue;
 
-    snprintf (augpath, sizeof augpath, "%s/vfstype", *entry);
-    vfstype = guestfs_aug_get (g, augpath);
-    if (vfstype == NULL) return -1;
+    vfstype = aug_tree_child (entry, "vfstype");
+    if (vfstype == NULL) {
+      error (g, _("%s: could not parse /etc/fstab entry"), entry[0]);
+      return -1;
+    }
 
     if (STREQ (vfstype, "btrfs")) {
+      size_t len = strlen (entry[0]);
       char **opt;
 
-      snprintf (augpath, sizeof augpath, "%s/opt", *entry);
-      CLEANUP_FREE_STRING_LIST char **opts = guestfs_aug_match (g, augpath);
-      if (opts == NULL) return -1;
-
-      for (opt = opts; *opt; opt++) {
-        CLEANUP_FREE char *optname = guestfs_aug_get (g, augpath);
-        if (optname == NULL) return -1;
+      /* The options are children labelled "opt" (or "opt[N]" if
+       * there is more than one), and the value of an option, if any,
+       * is the child "value" of the option node.
+       */
+      for (opt = entry + 2; *opt != NULL; opt += 2) {
+        const char *label = &(*opt)[len+1];
+        const char *subvol;
+        char *new;
 
-        if (STREQ (optname, "subvol")) {
-          CLEANUP_FREE char *subvol = NULL;
-          char *new;
-
-          snprintf (augpath, sizeof augpath, "%s/value", *opt);
-          subvol = guestfs_aug_get (g, augpath);
-          if (subvol == NULL) return -1;
+        if (strncmp (*opt, entry[0], len) != 0 || (*opt)[len] != '/')
+          break;
+        if (strchr (label, '/') != NULL ||
+            !(STREQ (label, "opt") || STRPREFIX (label, "opt[")) ||
+            STRNEQ (opt[1], "subvol"))
+          continue;
 
-          new = safe_asprintf (g, "btrfsvol:%s/%s", mountable, subvol);
-          free (mountable);
-          mountable = new;
+        subvol = aug_tree_child (opt, "value");
+        if (subvol == NULL) {
+          error (g, _("%s: subvol option has no value"), *opt);
+          return -1;
         }
+
+        new = safe_asprintf (g, "btrfsvol:%s/%s", mountable, subvol);
+        free (mountable);
+        mountable = new;
       }
     }
 
@@ -1016,6 +1021,44 @@ check_fstab (guestfs_h *g, struct inspect_fs *fs)
   return 0;
 }
 
+/* 'node' points to a (path, value) pair in the list returned by
+ * guestfs_aug_get_tree.  Descendants of a node always follow it
+ * directly in the list.
+ *
+ * Return the value of the direct child of 'node' called 'label',
+ * or NULL if there is no such child.
+ */
+static const char *
+aug_tree_child (char **node, const char *label)
+{
+  size_t len = strlen (node[0]);
+  char **p;
+
+  for (p = node + 2; *p != NULL; p += 2) {
+    if (strncmp (*p, node[0], len) != 0 || (*p)[len] != '/')
+      break;
+    if (STREQ (&(*p)[len+1], label))
+      return p[1];
+  }
+
+  return NULL;
+}
+
+/* Return the next node after 'node' and all of its descendants. */
+static char **
+aug_tree_next (char **node)
+{
+  size_t len = strlen (node[0]);
+  char **p;
+
+  for (p = node + 2; *p != NULL; p += 2) {
+    if (strncmp (*p, node[0], len) != 0 || (*p)[len] != '/')
+      break;
+  }
+
+  return p;
+}
+
 /* Add a filesystem and possibly a mountpoint entry for
  * the root filesystem 'fs'.
  *
@@ -1225,7 +1268,7 @@ static int
 map_md_devices(guestfs_h *g, Hash_table **map)
 {
   CLEANUP_HASH_FREE Hash_table *app_map = NULL;
-  CLEANUP_FREE_STRING_LIST char **matches = NULL;
+  CLEANUP_FREE_STRING_LIST char **tree = NULL;
   ssize_t n_app_md_devices;
 
   *map = NULL;
@@ -1238,12 +1281,12 @@ map_md_devices(guestfs_h *g, Hash_table **map)
   if (n_app_md_devices == 0)
     return 0;
 
-  /* Get all arrays listed in mdadm.conf */
-  matches = guestfs_aug_match(g, "/files/etc/mdadm.conf/array");
-  if (!matches) goto error;
+  /* Get all arrays listed in mdadm.conf, with their fields */
+  tree = guestfs_aug_get_tree (g, "/files/etc/mdadm.conf/array");
+  if (!tree) goto error;
 
   /* Log a debug message if we've got md devices, but nothing in mdadm.conf */
-  if (matches[0] == NULL) {
+  if (tree[0] == NULL) {
     debug(g, "Appliance has MD devices, but augeas returned no array matches "
              "in mdadm.conf");
     return 0;
@@ -1253,19 +1296,20 @@ map_md_devices(guestfs_h *g, Hash_table **map)
                                    mdadm_app_free);
   if (!*map) g->abort_cb();
 
-  for (char **m = matches; *m != NULL; m++) {
+  for (char **m = tree; *m != NULL; m = aug_tree_next (m)) {
     /* Get device name and uuid for each array */
-    CLEANUP_FREE char *dev_path = safe_asprintf (g, "%s/devicename", *m);
-    char *dev = guestfs_aug_get (g, dev_path);
-    if (!dev) goto error;
-
-    CLEANUP_FREE char *uuid_path = safe_asprintf (g, "%s/uuid", *m);
-    CLEANUP_FREE char *uuid = guestfs_aug_get (g, uuid_path);
-    if (!uuid) {
-      free (dev);
+    const char *devicename = aug_tree_child (m, "devicename");
+    if (!devicename) {
+      debug(g, "inspect-os: mdadm.conf array %s has no devicename", *m);
       continue;
     }
 
+    const char *uuid = aug_tree_child (m, "uuid");
+    if (!uuid)
+      continue;
+
+    char *dev = safe_strdup (g, devicename);
+
     /* Parse the uuid into an md_uuid structure so we can look it up in the
      * uuid->appliance device map */
     md_uuid mdadm;
@@ -1548,8 +1592,6 @@ resolve_fstab_device (guestfs_h *g, const char *spec, Hash_table *md_map)
   return device;
 }
 
-static char *make_augeas_path_expression (guestfs_h *g, const char **configfiles);
-
 /* Call 'f' with Augeas opened and having parsed 'configfiles' (these
  * files must exist).  As a security measure, this bails if any file
  * is too large for a reasonable configuration file.  After the call
@@ -1563,7 +1605,6 @@ inspect_with_augeas (guestfs_h *g, struct inspect_fs *fs,
   size_t i;
   int64_t size;
   int r;
-  CLEANUP_FREE char *pathexpr = NULL;
 
   /* Security: Refuse to do this if a config file is too large. */
   for (i = 0; configfiles[i] != NULL; ++i) {
@@ -1582,61 +1623,23 @@ inspect_with_augeas (guestfs_h *g, struct inspect_fs *fs,
     }
   }
 
-  if (guestfs_aug_init (g, "/", 16|32 /* AUG_SAVE_NOOP|AUG_NO_LOAD */) == -1)
-    return -1;
-
-  r = -1;
-
   /* Tell Augeas to only load configfiles and no other files.  This
    * prevents a rogue guest from performing a denial of service attack
    * by having large, over-complicated configuration files which are
    * unrelated to the task at hand.  (Thanks Dominic Cleal).
    * Note this requires Augeas >= 1.0.0 because of RHBZ#975412.
    */
-  pathexpr = make_augeas_path_expression (g, configfiles);
-  if (guestfs_aug_rm (g, pathexpr) == -1)
-    goto out;
-
-  if (guestfs_aug_load (g) == -1)
-    goto out;
+  if (guestfs_aug_init_files (g, "/", 16 /* AUG_SAVE_NOOP */,
+                              (char * const *) configfiles) == -1)
+    return -1;
 
   r = f (g, fs);
 
- out:
   guestfs_aug_close (g);
 
   return r;
 }
 
-/* Explained here: https://bugzilla.redhat.com/show_bug.cgi?id=975412#c0 */
-static char *
-make_augeas_path_expression (guestfs_h *g, const char **configfiles)
-{
-  size_t i;
-  size_t nr_files;
-  CLEANUP_FREE_STRING_LIST char **subexprs = NULL;
-  CLEANUP_FREE char *subexpr = NULL;
-  char *ret;
-
-  nr_files = guestfs___count_strings ((char **) configfiles);
-  subexprs = safe_malloc (g, sizeof (char *) * (nr_files + 1));
-
-  for (i = 0; i < nr_files; ++i) {
-    subexprs[i] = /*         v NB trailing '/' after filename */
-      safe_asprintf (g, "\"%s/\" !~ regexp('^') + glob(incl) + regexp('/.*')",
-                     configfiles[i]);
-  }
-  subexprs[nr_files] = NULL;
-
-  subexpr = guestfs___join_strings (" and ", subexprs);
-  if (subexpr == NULL)
-    g->abort_cb ();
-
-  ret = safe_asprintf (g, "/augeas/load/*[ %s ]", subexpr);
-  debug (g, "augeas pathexpr = %s", ret);
-  return ret;
-}
-
 static int
 is_partition (guestfs_h *g, const char *partition)
 {
@@ -111,21 +111,23 @@ static char *map_registry_disk_blob (guestfs_h *g, const void *blob);
 static int
 is_systemroot (guestfs_h *const g, const char *systemroot)
 {
-  char path[256];
+  char system32[256], config[256], cmd_exe[256];
+  char *paths[] = { system32, config, cmd_exe, NULL };
+  CLEANUP_FREE_STRING_LIST char **rpaths = NULL;
 
-  snprintf (path, sizeof path, "%s/system32", systemroot);
-  if (!guestfs___is_dir_nocase (g, path))
-    return 0;
-
-  snprintf (path, sizeof path, "%s/system32/config", systemroot);
-  if (!guestfs___is_dir_nocase (g, path))
-    return 0;
+  snprintf (system32, sizeof system32, "%s/system32", systemroot);
+  snprintf (config, sizeof config, "%s/system32/config", systemroot);
+  snprintf (cmd_exe, sizeof cmd_exe, "%s/system32/cmd.exe", systemroot);
 
-  snprintf (path, sizeof path, "%s/system32/cmd.exe", systemroot);
-  if (!guestfs___is_file_nocase (g, path))
+  /* Resolve all the paths in a single round trip. */
+  rpaths = guestfs___case_sensitive_paths_silently (g, paths);
+  if (rpaths == NULL)
     return 0;
 
-  return 1;
+  return
+    STRNEQ (rpaths[0], "") && guestfs_is_dir (g, rpaths[0]) > 0 &&
+    STRNEQ (rpaths[1], "") && guestfs_is_dir (g, rpaths[1]) > 0 &&
+    STRNEQ (rpaths[2], "") && guestfs_is_file (g, rpaths[2]) > 0;
 }
 
 char *
@@ -134,19 +136,17 @@ guestfs___get_windows_systemroot (guestfs_h *g)
   /* Check a predefined list of common windows system root locations */
   static const char *systemroots[] =
     { "/windows", "/winnt", "/win32", "/win", NULL };
+  CLEANUP_FREE_STRING_LIST char **rsystemroots =
+    guestfs___case_sensitive_paths_silently (g, (char **) systemroots);
 
-  for (size_t i = 0; i < sizeof systemroots / sizeof systemroots[0]; ++i) {
-    char *systemroot =
-      guestfs___case_sensitive_path_silently (g, systemroots[i]);
-    if (!systemroot)
+  for (size_t i = 0; rsystemroots && rsystemroots[i] != NULL; ++i) {
+    if (STREQ (rsystemroots[i], ""))
       continue;
 
-    if (is_systemroot (g, systemroot)) {
-      debug (g, "windows %%SYSTEMROOT%% = %s", systemroot);
+    if (is_systemroot (g, rsystemroots[i])) {
+      debug (g, "windows %%SYSTEMROOT%% = %s", rsystemroots[i]);
 
-      return systemroot;
-    } else {
-      free (systemroot);
+      return safe_strdup (g, rsystemroots[i]);
     }
   }
 
@@ -615,6 +615,37 @@ guestfs___case_sensitive_path_silently (guestfs_h *g, const char *path)
   return ret;
 }
 
+/* As above, but for a NULL-terminated list of paths.  Paths which
+ * cannot be resolved are returned as empty strings.
+ *
+ * If the single call fails (eg. because one path is too long for the
+ * daemon), fall back to resolving the paths one at a time, so that
+ * one bad path does not hide all the others.
+ */
+char **
+guestfs___case_sensitive_paths_silently (guestfs_h *g, char *const *paths)
+{
+  char **ret;
+  size_t i, n;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  ret = guestfs_case_sensitive_paths (g, paths);
+  guestfs_pop_error_handler (g);
+  if (ret != NULL)
+    return ret;
+
+  n = guestfs___count_strings (paths);
+  ret = safe_malloc (g, (n+1) * sizeof (char *));
+  for (i = 0; i < n; ++i) {
+    ret[i] = guestfs___case_sensitive_path_silently (g, paths[i]);
+    if (ret[i] == NULL)
+      ret[i] = safe_strdup (g, "");
+  }
+  ret[n] = NULL;
+
+  return ret;
+}
+
 /* Read the data from 'valueh', assume it is UTF16LE and convert it to
  * UTF8.  This is copied from hivex_value_string which doesn't work in
  * the appliance because it uses iconv_open which doesn't work because
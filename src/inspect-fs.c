@@ -79,22 +79,218 @@ free_regexps (void)
   pcre_free (re_major_minor);
 }
 
-static int check_filesystem (guestfs_h *g, const char *mountable,
+/* Paths checked by check_filesystem.  guestfs___probe_filesystems
+ * passes these to the daemon, which checks them on all filesystems in
+ * parallel and returns a fingerprint for each filesystem with one
+ * character per path.  Paths prefixed by "nocase:" are looked up
+ * ignoring case.
+ */
+enum probe_path_index {
+  P_ETC, P_BIN, P_SHARE, P_USR_BIN, P_LOCAL, P_LOG, P_RUN, P_SPOOL,
+  P_GRUB_MENU_LST, P_GRUB_GRUB_CONF, P_GRUB2_GRUB_CFG,
+  P_ETC_FREEBSD_UPDATE_CONF, P_ETC_FSTAB, P_ETC_RELEASE,
+  P_HURD_CONSOLE, P_HURD_HELLO, P_HURD_NULL,
+  P_WINDOWS, P_WINNT, P_WIN32, P_WIN,
+  P_SYSTEM_VOLUME_INFORMATION, P_PROGRAM_FILES,
+  P_FDOS, P_FDOS_FREEDOS_BSS,
+  P_ISOLINUX_CFG, P_EFI_BOOT, P_IMAGES_INSTALL_IMG, P_DISK,
+  P_DISCINFO, P_I386_TXTSETUP_SIF, P_AMD64_TXTSETUP_SIF,
+  P_FREEDOS_ICO, P_BOOT_LOADER_RC,
+  NR_PROBE_PATHS
+};
+
+static const char *probe_paths[NR_PROBE_PATHS+1] = {
+  [P_ETC] = "/etc",
+  [P_BIN] = "/bin",
+  [P_SHARE] = "/share",
+  [P_USR_BIN] = "/usr/bin",
+  [P_LOCAL] = "/local",
+  [P_LOG] = "/log",
+  [P_RUN] = "/run",
+  [P_SPOOL] = "/spool",
+  [P_GRUB_MENU_LST] = "/grub/menu.lst",
+  [P_GRUB_GRUB_CONF] = "/grub/grub.conf",
+  [P_GRUB2_GRUB_CFG] = "/grub2/grub.cfg",
+  [P_ETC_FREEBSD_UPDATE_CONF] = "/etc/freebsd-update.conf",
+  [P_ETC_FSTAB] = "/etc/fstab",
+  [P_ETC_RELEASE] = "/etc/release",
+  [P_HURD_CONSOLE] = "/hurd/console",
+  [P_HURD_HELLO] = "/hurd/hello",
+  [P_HURD_NULL] = "/hurd/null",
+  [P_WINDOWS] = "nocase:/windows",
+  [P_WINNT] = "nocase:/winnt",
+  [P_WIN32] = "nocase:/win32",
+  [P_WIN] = "nocase:/win",
+  [P_SYSTEM_VOLUME_INFORMATION] = "nocase:/System Volume Information",
+  [P_PROGRAM_FILES] = "nocase:/Program Files",
+  [P_FDOS] = "nocase:/FDOS",
+  [P_FDOS_FREEDOS_BSS] = "nocase:/FDOS/FREEDOS.BSS",
+  [P_ISOLINUX_CFG] = "/isolinux/isolinux.cfg",
+  [P_EFI_BOOT] = "/EFI/BOOT",
+  [P_IMAGES_INSTALL_IMG] = "/images/install.img",
+  [P_DISK] = "/.disk",
+  [P_DISCINFO] = "/.discinfo",
+  [P_I386_TXTSETUP_SIF] = "/i386/txtsetup.sif",
+  [P_AMD64_TXTSETUP_SIF] = "/amd64/txtsetup.sif",
+  [P_FREEDOS_ICO] = "/freedos/freedos.ico",
+  [P_BOOT_LOADER_RC] = "/boot/loader.rc",
+  [NR_PROBE_PATHS] = NULL
+};
+
+/* The filesystem being checked by check_filesystem.  If the daemon
+ * probed it, the fingerprint answers all the questions in
+ * probe_paths, and the filesystem is only mounted if a closer look
+ * is needed (eg. because it is a root filesystem).
+ */
+struct probe {
+  const char *mountable;
+  const char *vfs_type;
+  const char *fingerprint;      /* NULL if not probed by the daemon. */
+  int mounted;
+};
+
+static int check_filesystem (guestfs_h *g, struct probe *p,
                              const struct guestfs_internal_mountable *m,
                              int whole_device);
 static int extend_fses (guestfs_h *g);
 
+/* Ask the daemon to probe all the filesystems in one go.  This
+ * returns a list of fingerprints in the same order as 'mountables',
+ * or NULL if probing failed, in which case each filesystem is
+ * checked separately.
+ */
+char **
+guestfs___probe_filesystems (guestfs_h *g, char *const *mountables)
+{
+  char **ret;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  ret = guestfs_internal_probe_filesystems (g, mountables,
+                                            (char * const *) probe_paths);
+  guestfs_pop_error_handler (g);
+
+  if (ret == NULL) {
+    debug (g, "probe_filesystems: %s", guestfs_last_error (g));
+    return NULL;
+  }
+
+  if (guestfs___count_strings (ret) != guestfs___count_strings (mountables)) {
+    debug (g, "probe_filesystems: wrong number of fingerprints returned");
+    guestfs___free_string_list (ret);
+    return NULL;
+  }
+
+  return ret;
+}
+
+/* Mount the filesystem read-only if it is not mounted already.
+ * Errors are ignored (but -1 is returned) since a filesystem which
+ * cannot be mounted is simply not inspected.
+ */
+static int
+probe_mount (guestfs_h *g, struct probe *p)
+{
+  int r;
+
+  if (p->mounted)
+    return 0;
+
+  guestfs_push_error_handler (g, NULL, NULL);
+  if (p->vfs_type && STREQ (p->vfs_type, "ufs")) { /* Hack for the *BSDs. */
+    /* FreeBSD fs is a variant of ufs called ufs2 ... */
+    r = guestfs_mount_vfs (g, "ro,ufstype=ufs2", "ufs", p->mountable, "/");
+    if (r == -1)
+      /* while NetBSD and OpenBSD use another variant labeled 44bsd */
+      r = guestfs_mount_vfs (g, "ro,ufstype=44bsd", "ufs", p->mountable, "/");
+  } else {
+    r = guestfs_mount_ro (g, p->mountable, "/");
+  }
+  guestfs_pop_error_handler (g);
+
+  if (r == 0)
+    p->mounted = 1;
+  return r;
+}
+
+/* Return true iff probe path 'i' has 'type' ('f', 'd' or 'l'). */
+static int
+probe_check (guestfs_h *g, struct probe *p, enum probe_path_index i,
+             char type)
+{
+  const char *path = probe_paths[i];
+
+  if (p->fingerprint)
+    return p->fingerprint[i] == type;
+
+  /* Otherwise the filesystem was mounted by check_for_filesystem_on. */
+  if (STRPREFIX (path, "nocase:")) {
+    path += strlen ("nocase:");
+    switch (type) {
+    case 'f': return guestfs___is_file_nocase (g, path);
+    case 'd': return guestfs___is_dir_nocase (g, path);
+    }
+    abort ();
+  }
+
+  switch (type) {
+  case 'f': return guestfs_is_file (g, path) > 0;
+  case 'd': return guestfs_is_dir (g, path) > 0;
+  case 'l': return guestfs_is_symlink (g, path) > 0;
+  }
+  abort ();
+}
+
+static int
+is_file (guestfs_h *g, struct probe *p, enum probe_path_index i)
+{
+  return probe_check (g, p, i, 'f');
+}
+
+static int
+is_dir (guestfs_h *g, struct probe *p, enum probe_path_index i)
+{
+  return probe_check (g, p, i, 'd');
+}
+
+static int
+is_symlink (guestfs_h *g, struct probe *p, enum probe_path_index i)
+{
+  return probe_check (g, p, i, 'l');
+}
+
+/* If the filesystem was probed, return true iff one of the usual
+ * Windows system root directories exists.  Without a fingerprint
+ * this always returns true, and guestfs___get_windows_systemroot
+ * does the full check.
+ */
+static int
+may_be_windows_root (struct probe *p)
+{
+  const char *f = p->fingerprint;
+
+  if (f == NULL)
+    return 1;
+
+  return f[P_WINDOWS] == 'd' || f[P_WINNT] == 'd' ||
+    f[P_WIN32] == 'd' || f[P_WIN] == 'd';
+}
+
 /* Find out if 'device' contains a filesystem.  If it does, add
  * another entry in g->fses.
+ *
+ * 'fingerprint' is the result of guestfs___probe_filesystems for
+ * this filesystem, or NULL if not available.
  */
 int
-guestfs___check_for_filesystem_on (guestfs_h *g, const char *mountable)
+guestfs___check_for_filesystem_on (guestfs_h *g, const char *mountable,
+                                   const char *fingerprint)
 {
   CLEANUP_FREE char *vfs_type = NULL;
   int is_swap, r;
   struct inspect_fs *fs;
   CLEANUP_FREE_INTERNAL_MOUNTABLE struct guestfs_internal_mountable *m = NULL;
   int whole_device = 0;
+  struct probe probe;
 
   /* Get vfs-type in order to check if it's a Linux(?) swap device.
    * If there's an error we should ignore it, so to do that we have to
@@ -145,33 +341,30 @@ guestfs___check_for_filesystem_on (guestfs_h *g, const char *mountable)
     g->nr_fses--;
   }
 
-  /* Try mounting the device.  As above, ignore errors. */
-  guestfs_push_error_handler (g, NULL, NULL);
-  if (vfs_type && STREQ (vfs_type, "ufs")) { /* Hack for the *BSDs. */
-    /* FreeBSD fs is a variant of ufs called ufs2 ... */
-    r = guestfs_mount_vfs (g, "ro,ufstype=ufs2", "ufs", mountable, "/");
-    if (r == -1)
-      /* while NetBSD and OpenBSD use another variant labeled 44bsd */
-      r = guestfs_mount_vfs (g, "ro,ufstype=44bsd", "ufs", mountable, "/");
-  } else {
-    r = guestfs_mount_ro (g, mountable, "/");
-  }
-  guestfs_pop_error_handler (g);
-  if (r == -1)
+  probe.mountable = mountable;
+  probe.vfs_type = vfs_type;
+  probe.fingerprint = NULL;
+  probe.mounted = 0;
+
+  if (fingerprint && fingerprint[0] != '?' &&
+      strlen (fingerprint) == NR_PROBE_PATHS)
+    probe.fingerprint = fingerprint;
+  else if (probe_mount (g, &probe) == -1)
+    /* Try mounting the device.  As above, ignore errors. */
     return 0;
 
   /* Do the rest of the checks. */
-  r = check_filesystem (g, mountable, m, whole_device);
+  r = check_filesystem (g, &probe, m, whole_device);
 
   /* Unmount the filesystem. */
-  if (guestfs_umount_all (g) == -1)
+  if (probe.mounted && guestfs_umount_all (g) == -1)
     return -1;
 
   return r;
 }
 
 static int
-check_filesystem (guestfs_h *g, const char *mountable,
+check_filesystem (guestfs_h *g, struct probe *p,
                   const struct guestfs_internal_mountable *m,
                   int whole_device)
 {
@@ -190,23 +383,23 @@ check_filesystem (guestfs_h *g, const char *mountable,
 
   struct inspect_fs *fs = &g->fses[g->nr_fses-1];
 
-  fs->mountable = safe_strdup (g, mountable);
+  fs->mountable = safe_strdup (g, p->mountable);
 
   /* Optimize some of the tests by avoiding multiple tests of the same thing. */
-  int is_dir_etc = guestfs_is_dir (g, "/etc") > 0;
-  int is_dir_bin = guestfs_is_dir (g, "/bin") > 0;
-  int is_dir_share = guestfs_is_dir (g, "/share") > 0;
+  int is_dir_etc = is_dir (g, p, P_ETC);
+  int is_dir_bin = is_dir (g, p, P_BIN);
+  int is_dir_share = is_dir (g, p, P_SHARE);
 
   /* Grub /boot? */
-  if (guestfs_is_file (g, "/grub/menu.lst") > 0 ||
-      guestfs_is_file (g, "/grub/grub.conf") > 0 ||
-      guestfs_is_file (g, "/grub2/grub.cfg") > 0)
+  if (is_file (g, p, P_GRUB_MENU_LST) ||
+      is_file (g, p, P_GRUB_GRUB_CONF) ||
+      is_file (g, p, P_GRUB2_GRUB_CFG))
     ;
   /* FreeBSD root? */
   else if (is_dir_etc &&
            is_dir_bin &&
-           guestfs_is_file (g, "/etc/freebsd-update.conf") > 0 &&
-           guestfs_is_file (g, "/etc/fstab") > 0) {
+           is_file (g, p, P_ETC_FREEBSD_UPDATE_CONF) &&
+           is_file (g, p, P_ETC_FSTAB)) {
     /* Ignore /dev/sda1 which is a shadow of the real root filesystem
      * that is probably /dev/sda5 (see:
      * http://www.freebsd.org/doc/handbook/disk-organization.html)
@@ -215,6 +408,8 @@ check_filesystem (guestfs_h *g, const char *mountable,
         match (g, m->im_device, re_first_partition))
       return 0;
 
+    if (probe_mount (g, p) == -1)
+      return 0;
     fs->is_root = 1;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs___check_freebsd_root (g, fs) == -1)
@@ -222,8 +417,8 @@ check_filesystem (guestfs_h *g, const char *mountable,
   }
   else if (is_dir_etc &&
            is_dir_bin &&
-           guestfs_is_file (g, "/etc/fstab") > 0 &&
-           guestfs_is_file (g, "/etc/release") > 0) {
+           is_file (g, p, P_ETC_FSTAB) &&
+           is_file (g, p, P_ETC_RELEASE)) {
     /* Ignore /dev/sda1 which is a shadow of the real root filesystem
      * that is probably /dev/sda5 (see:
      * http://www.freebsd.org/doc/handbook/disk-organization.html)
@@ -232,15 +427,19 @@ check_filesystem (guestfs_h *g, const char *mountable,
         match (g, m->im_device, re_first_partition))
       return 0;
 
+    if (probe_mount (g, p) == -1)
+      return 0;
     fs->is_root = 1;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs___check_netbsd_root (g, fs) == -1)
       return -1;
   }
   /* Hurd root? */
-  else if (guestfs_is_file (g, "/hurd/console") > 0 &&
-           guestfs_is_file (g, "/hurd/hello") > 0 &&
-           guestfs_is_file (g, "/hurd/null") > 0) {
+  else if (is_file (g, p, P_HURD_CONSOLE) &&
+           is_file (g, p, P_HURD_HELLO) &&
+           is_file (g, p, P_HURD_NULL)) {
+    if (probe_mount (g, p) == -1)
+      return 0;
     fs->is_root = 1;
     fs->format = OS_FORMAT_INSTALLED; /* XXX could be more specific */
     if (guestfs___check_hurd_root (g, fs) == -1)
@@ -249,9 +448,11 @@ check_filesystem (guestfs_h *g, const char *mountable,
   /* Linux root? */
   else if (is_dir_etc &&
            (is_dir_bin ||
-            (guestfs_is_symlink (g, "/bin") > 0 &&
-             guestfs_is_dir (g, "/usr/bin") > 0)) &&
-           guestfs_is_file (g, "/etc/fstab") > 0) {
+            (is_symlink (g, p, P_BIN) &&
+             is_dir (g, p, P_USR_BIN))) &&
+           is_file (g, p, P_ETC_FSTAB)) {
+    if (probe_mount (g, p) == -1)
+      return 0;
     fs->is_root = 1;
     fs->format = OS_FORMAT_INSTALLED;
     if (guestfs___check_linux_root (g, fs) == -1)
@@ -261,23 +462,25 @@ check_filesystem (guestfs_h *g, const char *mountable,
   else if (is_dir_etc &&
            is_dir_bin &&
            is_dir_share &&
-           guestfs_is_dir (g, "/local") == 0 &&
-           guestfs_is_file (g, "/etc/fstab") == 0)
+           !is_dir (g, p, P_LOCAL) &&
+           !is_file (g, p, P_ETC_FSTAB))
     ;
   /* Linux /usr? */
   else if (is_dir_etc &&
            is_dir_bin &&
            is_dir_share &&
-           guestfs_is_dir (g, "/local") > 0 &&
-           guestfs_is_file (g, "/etc/fstab") == 0)
+           is_dir (g, p, P_LOCAL) &&
+           !is_file (g, p, P_ETC_FSTAB))
     ;
   /* Linux /var? */
-  else if (guestfs_is_dir (g, "/log") > 0 &&
-           guestfs_is_dir (g, "/run") > 0 &&
-           guestfs_is_dir (g, "/spool") > 0)
+  else if (is_dir (g, p, P_LOG) &&
+           is_dir (g, p, P_RUN) &&
+           is_dir (g, p, P_SPOOL))
     ;
-  /* Windows root? */
-  else if ((windows_systemroot = guestfs___get_windows_systemroot (g)) != NULL)
+  /* Windows root?  This has to be checked on the mounted filesystem. */
+  else if (may_be_windows_root (p) &&
+           probe_mount (g, p) == 0 &&
+           (windows_systemroot = guestfs___get_windows_systemroot (g)) != NULL)
   {
     fs->is_root = 1;
     fs->format = OS_FORMAT_INSTALLED;
@@ -285,15 +488,15 @@ check_filesystem (guestfs_h *g, const char *mountable,
       return -1;
   }
   /* Windows volume with installed applications (but not root)? */
-  else if (guestfs___is_dir_nocase (g, "/System Volume Information") > 0 &&
-           guestfs___is_dir_nocase (g, "/Program Files") > 0)
+  else if (is_dir (g, p, P_SYSTEM_VOLUME_INFORMATION) &&
+           is_dir (g, p, P_PROGRAM_FILES))
     ;
   /* Windows volume (but not root)? */
-  else if (guestfs___is_dir_nocase (g, "/System Volume Information") > 0)
+  else if (is_dir (g, p, P_SYSTEM_VOLUME_INFORMATION))
     ;
   /* FreeDOS? */
-  else if (guestfs___is_dir_nocase (g, "/FDOS") > 0 &&
-           guestfs___is_file_nocase (g, "/FDOS/FREEDOS.BSS") > 0) {
+  else if (is_dir (g, p, P_FDOS) &&
+           is_file (g, p, P_FDOS_FREEDOS_BSS)) {
     fs->is_root = 1;
     fs->format = OS_FORMAT_INSTALLED;
     fs->type = OS_TYPE_DOS;
@@ -313,15 +516,17 @@ check_filesystem (guestfs_h *g, const char *mountable,
    * first partition (eg. bootable USB key).
    */
   else if ((whole_device || partnum == 1) &&
-           (guestfs_is_file (g, "/isolinux/isolinux.cfg") > 0 ||
-            guestfs_is_dir (g, "/EFI/BOOT") > 0 ||
-            guestfs_is_file (g, "/images/install.img") > 0 ||
-            guestfs_is_dir (g, "/.disk") > 0 ||
-            guestfs_is_file (g, "/.discinfo") > 0 ||
-            guestfs_is_file (g, "/i386/txtsetup.sif") > 0 ||
-            guestfs_is_file (g, "/amd64/txtsetup.sif") > 0 ||
-            guestfs_is_file (g, "/freedos/freedos.ico") > 0 ||
-            guestfs_is_file (g, "/boot/loader.rc") > 0)) {
+           (is_file (g, p, P_ISOLINUX_CFG) ||
+            is_dir (g, p, P_EFI_BOOT) ||
+            is_file (g, p, P_IMAGES_INSTALL_IMG) ||
+            is_dir (g, p, P_DISK) ||
+            is_file (g, p, P_DISCINFO) ||
+            is_file (g, p, P_I386_TXTSETUP_SIF) ||
+            is_file (g, p, P_AMD64_TXTSETUP_SIF) ||
+            is_file (g, p, P_FREEDOS_ICO) ||
+            is_file (g, p, P_BOOT_LOADER_RC))) {
+    if (probe_mount (g, p) == -1)
+      return 0;
     fs->is_root = 1;
     fs->format = OS_FORMAT_INSTALLER;
     if (guestfs___check_installer_root (g, fs) == -1)
@@ -42,7 +42,10 @@ char **
 guestfs__inspect_os (guestfs_h *g)
 {
   CLEANUP_FREE_STRING_LIST char **fses = NULL;
-  char **fs, **ret;
+  CLEANUP_FREE char **mountables = NULL;
+  CLEANUP_FREE_STRING_LIST char **fingerprints = NULL;
+  char **ret;
+  size_t i, nr_fses;
 
   /* Remove any information previously stored in the handle. */
   guestfs___free_inspect_info (g);
@@ -57,8 +60,23 @@ guestfs__inspect_os (guestfs_h *g)
   fses = guestfs_list_filesystems (g);
   if (fses == NULL) return NULL;
 
-  for (fs = fses; *fs; fs += 2) {
-    if (guestfs___check_for_filesystem_on (g, *fs)) {
+  /* Let the daemon look at all the filesystems in parallel first.
+   * This is only an optimization: if it fails, each filesystem is
+   * mounted and checked in turn.
+   */
+  nr_fses = guestfs___count_strings (fses) / 2;
+  mountables = safe_malloc (g, (nr_fses + 1) * sizeof (char *));
+  for (i = 0; i < nr_fses; ++i)
+    mountables[i] = fses[i*2];
+  mountables[nr_fses] = NULL;
+
+  if (nr_fses > 0)
+    fingerprints = guestfs___probe_filesystems (g, mountables);
+
+  for (i = 0; i < nr_fses; ++i) {
+    if (guestfs___check_for_filesystem_on (g, mountables[i],
+                                           fingerprints ?
+                                           fingerprints[i] : NULL)) {
       guestfs___free_inspect_info (g);
       return NULL;
     }
@@ -32,9 +32,15 @@
 #include <signal.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/ioctl.h>
 #include <grp.h>
 #include <assert.h>
 
+#if defined(HAVE_LINUX_VM_SOCKETS_H) && defined(HAVE_LINUX_VHOST_H)
+#include <linux/vm_sockets.h>
+#include <linux/vhost.h>
+#endif
+
 #include <pcre.h>
 
 #include <libxml/uri.h>
@@ -103,6 +109,8 @@ static int qemu_supports (guestfs_h *g, struct backend_direct_data *, const char
 static int qemu_supports_device (guestfs_h *g, struct backend_direct_data *, const char *device_name);
 static int qemu_supports_virtio_scsi (guestfs_h *g, struct backend_direct_data *);
 static char *qemu_escape_param (guestfs_h *g, const char *param);
+static int setup_vsock (guestfs_h *g, struct backend_direct_data *data, int *vhost_fd_rtn, unsigned int *guest_cid_rtn, int *sock_rtn, unsigned int *port_rtn);
+static int appliance_dax (guestfs_h *g, struct backend_direct_data *data, const char *appliance, int64_t *size_rtn, int *readonly_rtn);
 
 static char *
 create_cow_overlay_direct (guestfs_h *g, void *datav, struct drive *drv)
@@ -279,6 +287,11 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   struct hv_param *hp;
   bool has_kvm;
   int force_tcg;
+  int vsock;
+  int vhost_fd = -1;
+  unsigned int guest_cid = 0, vsock_port = 0;
+  int dax = 0, dax_readonly = 0;
+  int64_t appliance_size = 0;
 
   /* At present you must add drives before starting the appliance.  In
    * future when we enable hotplugging you won't need to do this.
@@ -307,6 +320,7 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   TRACE0 (launch_build_appliance_end);
 
   guestfs___launch_send_progress (g, 3);
+  guestfs___launch_milestone (g, LAUNCH_APPLIANCE_BUILT);
 
   if (g->verbose)
     guestfs___print_timestamped_message (g, "begin testing qemu features");
@@ -315,30 +329,52 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   if (qemu_supports (g, data, NULL) == -1)
     goto cleanup0;
 
-  /* Using virtio-serial, we need to create a local Unix domain socket
-   * for qemu to connect to.
+  /* If the host supports it, the daemon connects straight back to us
+   * over virtio-vsock, avoiding the virtio-serial port and qemu's
+   * chardev layer.
    */
-  snprintf (guestfsd_sock, sizeof guestfsd_sock, "%s/guestfsd.sock", g->tmpdir);
-  unlink (guestfsd_sock);
-
-  daemon_accept_sock = socket (AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
-  if (daemon_accept_sock == -1) {
-    perrorf (g, "socket");
+  vsock = setup_vsock (g, data, &vhost_fd, &guest_cid,
+                       &daemon_accept_sock, &vsock_port);
+  if (vsock == -1)
     goto cleanup0;
+
+  /* Optionally map the appliance root into the guest instead of
+   * adding it as a disk, so concurrent appliances share its pages.
+   */
+  if (has_appliance_drive) {
+    dax = appliance_dax (g, data, appliance, &appliance_size,
+                         &dax_readonly);
+    if (dax == -1)
+      goto cleanup0;
   }
 
-  addr.sun_family = AF_UNIX;
-  strncpy (addr.sun_path, guestfsd_sock, UNIX_PATH_MAX);
-  addr.sun_path[UNIX_PATH_MAX-1] = '\0';
+  if (!vsock) {
+    /* Using virtio-serial, we need to create a local Unix domain
+     * socket for qemu to connect to.
+     */
+    snprintf (guestfsd_sock, sizeof guestfsd_sock,
+              "%s/guestfsd.sock", g->tmpdir);
+    unlink (guestfsd_sock);
 
-  if (bind (daemon_accept_sock, &addr, sizeof addr) == -1) {
-    perrorf (g, "bind");
-    goto cleanup0;
-  }
+    daemon_accept_sock = socket (AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (daemon_accept_sock == -1) {
+      perrorf (g, "socket");
+      goto cleanup0;
+    }
 
-  if (listen (daemon_accept_sock, 1) == -1) {
-    perrorf (g, "listen");
-    goto cleanup0;
+    addr.sun_family = AF_UNIX;
+    strncpy (addr.sun_path, guestfsd_sock, UNIX_PATH_MAX);
+    addr.sun_path[UNIX_PATH_MAX-1] = '\0';
+
+    if (bind (daemon_accept_sock, &addr, sizeof addr) == -1) {
+      perrorf (g, "bind");
+      goto cleanup0;
+    }
+
+    if (listen (daemon_accept_sock, 1) == -1) {
+      perrorf (g, "listen");
+      goto cleanup0;
+    }
   }
 
   if (!g->direct_mode) {
@@ -447,7 +483,13 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   }
 
   ADD_CMDLINE ("-m");
-  ADD_CMDLINE_PRINTF ("%d", g->memsize);
+  if (!dax)
+    ADD_CMDLINE_PRINTF ("%d", g->memsize);
+  else
+    /* The virtio-pmem device is plugged into a memory slot. */
+    ADD_CMDLINE_PRINTF ("%d,slots=1,maxmem=%" PRIi64 "M",
+                        g->memsize,
+                        g->memsize + appliance_size / (1024 * 1024));
 
   /* Force exit instead of reboot on panic */
   ADD_CMDLINE ("-no-reboot");
@@ -510,6 +552,11 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
          */
         if (major > 1 || (major == 1 && minor >= 5))
           discard_mode = ",discard=unmap";
+        /* If requested, also turn writes of zeroes into discards.
+         * This needs qemu >= 2.1.
+         */
+        if (drv->detect_zeroes && (major > 2 || (major == 2 && minor >= 1)))
+          discard_mode = ",discard=unmap,detect-zeroes=unmap";
         break;
       }
 
@@ -574,7 +621,24 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   }
 
   /* Add the ext2 appliance drive (after all the drives). */
-  if (has_appliance_drive) {
+  if (dax) {
+    /* share=off maps the file privately: pages the guest doesn't
+     * write are the host page cache pages of the appliance, shared by
+     * every appliance, and writes stay private to this qemu.
+     * readonly=on makes qemu open the file read-only, so it can never
+     * be modified, and rom=off keeps the private mapping writable.
+     */
+    ADD_CMDLINE ("-object");
+    ADD_CMDLINE_PRINTF ("memory-backend-file,id=appliance-mem,"
+                        "mem-path=%s,size=%" PRIi64 ",share=off%s",
+                        appliance, appliance_size,
+                        dax_readonly ? ",readonly=on,rom=off" : "");
+    ADD_CMDLINE ("-device");
+    ADD_CMDLINE ("virtio-pmem-pci,memdev=appliance-mem,id=appliance");
+
+    appliance_dev = safe_strdup (g, "/dev/pmem0");
+  }
+  else if (has_appliance_drive) {
     ADD_CMDLINE ("-drive");
     ADD_CMDLINE_PRINTF ("file=%s,snapshot=on,id=appliance,cache=unsafe,if=none",
                         appliance);
@@ -592,8 +656,10 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   }
 
   /* Create the virtio serial bus. */
-  ADD_CMDLINE ("-device");
-  ADD_CMDLINE (VIRTIO_SERIAL);
+  if (!vsock) {
+    ADD_CMDLINE ("-device");
+    ADD_CMDLINE (VIRTIO_SERIAL);
+  }
 
 #if 0
   /* Use virtio-console (a variant form of virtio-serial) for the
@@ -620,11 +686,21 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
     ADD_CMDLINE ("sga");
   }
 
-  /* Set up virtio-serial for the communications channel. */
-  ADD_CMDLINE ("-chardev");
-  ADD_CMDLINE_PRINTF ("socket,path=%s,id=channel0", guestfsd_sock);
-  ADD_CMDLINE ("-device");
-  ADD_CMDLINE ("virtserialport,chardev=channel0,name=org.libguestfs.channel.0");
+  if (vsock) {
+    /* Set up virtio-vsock for the communications channel.  qemu
+     * inherits the vhost fd on which we already reserved the CID.
+     */
+    ADD_CMDLINE ("-device");
+    ADD_CMDLINE_PRINTF ("vhost-vsock-pci,guest-cid=%u,vhostfd=%d",
+                        guest_cid, vhost_fd);
+  }
+  else {
+    /* Set up virtio-serial for the communications channel. */
+    ADD_CMDLINE ("-chardev");
+    ADD_CMDLINE_PRINTF ("socket,path=%s,id=channel0", guestfsd_sock);
+    ADD_CMDLINE ("-device");
+    ADD_CMDLINE ("virtserialport,chardev=channel0,name=org.libguestfs.channel.0");
+  }
 
   /* Enable user networking. */
   if (g->enable_network) {
@@ -638,8 +714,11 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   flags = 0;
   if (!has_kvm || force_tcg)
     flags |= APPLIANCE_COMMAND_LINE_IS_TCG;
+  if (dax)
+    flags |= APPLIANCE_COMMAND_LINE_DAX;
   ADD_CMDLINE_STRING_NODUP (guestfs___appliance_command_line (g, appliance_dev,
-                                                              flags));
+                                                              flags,
+                                                              vsock_port));
 
   /* Note: custom command line parameters must come last so that
    * qemu -set parameters can modify previously added options.
@@ -707,6 +786,10 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
       close (sv[1]);
     }
 
+    /* qemu must inherit the vhost fd, see setup_vsock. */
+    if (vhost_fd >= 0)
+      set_cloexec_flag (vhost_fd, 0);
+
     /* Dump the command line (after setting up stderr above). */
     if (g->verbose)
       print_qemu_command_line (g, cmdline.argv);
@@ -727,6 +810,7 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
 
   /* Parent (library). */
   data->pid = r;
+  guestfs___launch_milestone (g, LAUNCH_HV_STARTED);
 
   /* Fork the recovery process off which will kill qemu if the parent
    * process fails to do so (eg. if the parent segfaults).
@@ -798,6 +882,12 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
     data->recoverypid = r;
   }
 
+  /* qemu has its own copy of the vhost fd now. */
+  if (vhost_fd >= 0) {
+    close (vhost_fd);
+    vhost_fd = -1;
+  }
+
   if (!g->direct_mode) {
     /* Close the other end of the socketpair. */
     close (sv[1]);
@@ -809,10 +899,16 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   g->state = LAUNCHING;
 
   /* Wait for qemu to start and to connect back to us via
-   * virtio-serial and send the GUESTFS_LAUNCH_FLAG message.
+   * virtio-serial or virtio-vsock and send the GUESTFS_LAUNCH_FLAG
+   * message.
    */
-  g->conn =
-    guestfs___new_conn_socket_listening (g, daemon_accept_sock, console_sock);
+  if (vsock)
+    g->conn =
+      guestfs___new_conn_vsock_listening (g, daemon_accept_sock, console_sock,
+                                          guest_cid);
+  else
+    g->conn =
+      guestfs___new_conn_socket_listening (g, daemon_accept_sock, console_sock);
   if (!g->conn)
     goto cleanup1;
 
@@ -859,11 +955,13 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
     goto cleanup1;
   }
 
+  guestfs___launch_milestone (g, LAUNCH_APPLIANCE_UP);
+
   TRACE0 (launch_end);
 
   guestfs___launch_send_progress (g, 12);
 
-  if (has_appliance_drive)
+  if (has_appliance_drive && !dax)
     guestfs___add_dummy_appliance_drive (g);
 
   return 0;
@@ -880,6 +978,8 @@ launch_direct (guestfs_h *g, void *datav, const char *arg)
   memset (&g->launch_t, 0, sizeof g->launch_t);
 
  cleanup0:
+  if (vhost_fd >= 0)
+    close (vhost_fd);
   if (daemon_accept_sock >= 0)
     close (daemon_accept_sock);
   if (console_sock >= 0)
@@ -962,17 +1062,73 @@ print_qemu_command_line (guestfs_h *g, char **argv)
 static void parse_qemu_version (guestfs_h *g, struct backend_direct_data *data);
 static void read_all (guestfs_h *g, void *retv, const char *buf, size_t len);
 
+static int run_test_qemu (guestfs_h *g, struct backend_direct_data *data);
+
 /* Test qemu binary (or wrapper) runs, and do 'qemu -help' and
  * 'qemu -version' so we know what options this qemu supports and
  * the version.
+ *
+ * Running qemu three times is a noticeable part of the time taken to
+ * launch a short-lived handle, so the output is cached in the
+ * cachedir.  The cache is keyed on the path, device, inode, size and
+ * mtime of the qemu binary, so it is invalidated when qemu is
+ * upgraded.  (If g->hv is a wrapper script, changes to the real qemu
+ * binary are not noticed.)
+ *
+ * qemu can also load devices and block drivers from modules, which
+ * can be installed or removed without touching the binary, so the
+ * mtimes of the module directories are part of the key too.
  */
+static const char *qemu_module_dirs[] = {
+  "/usr/lib64/qemu",
+  "/usr/lib/qemu",
+  "/usr/local/lib64/qemu",
+  "/usr/local/lib/qemu",
+  NULL
+};
+
+static char *
+qemu_cache_key (guestfs_h *g, const struct stat *statbuf)
+{
+  char *key, *t;
+  const char *env;
+  struct stat dirbuf;
+  size_t i;
+
+  key = safe_asprintf (g, "%s %ju %ju %jd %jd",
+                       g->hv,
+                       (uintmax_t) statbuf->st_dev,
+                       (uintmax_t) statbuf->st_ino,
+                       (intmax_t) statbuf->st_size,
+                       (intmax_t) statbuf->st_mtime);
+
+  /* qemu looks in $QEMU_MODULE_DIR first. */
+  env = getenv ("QEMU_MODULE_DIR");
+  if (env && strchr (env, '\n') == NULL && stat (env, &dirbuf) == 0) {
+    t = safe_asprintf (g, "%s %s %jd", key, env, (intmax_t) dirbuf.st_mtime);
+    free (key);
+    key = t;
+  }
+
+  for (i = 0; qemu_module_dirs[i] != NULL; ++i) {
+    if (stat (qemu_module_dirs[i], &dirbuf) == 0) {
+      t = safe_asprintf (g, "%s %s %jd", key, qemu_module_dirs[i],
+                         (intmax_t) dirbuf.st_mtime);
+      free (key);
+      key = t;
+    }
+  }
+
+  return key;
+}
+
 static int
 test_qemu (guestfs_h *g, struct backend_direct_data *data)
 {
-  CLEANUP_CMD_CLOSE struct command *cmd1 = guestfs___new_command (g);
-  CLEANUP_CMD_CLOSE struct command *cmd2 = guestfs___new_command (g);
-  CLEANUP_CMD_CLOSE struct command *cmd3 = guestfs___new_command (g);
-  int r;
+  CLEANUP_FREE char *key = NULL;
+  CLEANUP_FREE char *help_file = NULL, *version_file = NULL,
+    *devices_file = NULL;
+  struct stat statbuf;
 
   free (data->qemu_help);
   data->qemu_help = NULL;
@@ -981,6 +1137,55 @@ test_qemu (guestfs_h *g, struct backend_direct_data *data)
   free (data->qemu_devices);
   data->qemu_devices = NULL;
 
+  if (stat (g->hv, &statbuf) == -1 || strchr (g->hv, '\n') != NULL)
+    return run_test_qemu (g, data);
+
+  key = qemu_cache_key (g, &statbuf);
+  help_file = safe_asprintf (g, "qemu-%ju-%ju.help",
+                             (uintmax_t) statbuf.st_dev,
+                             (uintmax_t) statbuf.st_ino);
+  version_file = safe_asprintf (g, "qemu-%ju-%ju.version",
+                                (uintmax_t) statbuf.st_dev,
+                                (uintmax_t) statbuf.st_ino);
+  devices_file = safe_asprintf (g, "qemu-%ju-%ju.devices",
+                                (uintmax_t) statbuf.st_dev,
+                                (uintmax_t) statbuf.st_ino);
+
+  data->qemu_help = guestfs___cache_lookup (g, help_file, key);
+  data->qemu_version = guestfs___cache_lookup (g, version_file, key);
+  data->qemu_devices = guestfs___cache_lookup (g, devices_file, key);
+  if (data->qemu_help && data->qemu_version && data->qemu_devices) {
+    parse_qemu_version (g, data);
+    return 0;
+  }
+
+  free (data->qemu_help);
+  data->qemu_help = NULL;
+  free (data->qemu_version);
+  data->qemu_version = NULL;
+  free (data->qemu_devices);
+  data->qemu_devices = NULL;
+
+  if (run_test_qemu (g, data) == -1)
+    return -1;
+
+  if (data->qemu_help && data->qemu_version && data->qemu_devices) {
+    guestfs___cache_store (g, help_file, key, data->qemu_help);
+    guestfs___cache_store (g, version_file, key, data->qemu_version);
+    guestfs___cache_store (g, devices_file, key, data->qemu_devices);
+  }
+
+  return 0;
+}
+
+static int
+run_test_qemu (guestfs_h *g, struct backend_direct_data *data)
+{
+  CLEANUP_CMD_CLOSE struct command *cmd1 = guestfs___new_command (g);
+  CLEANUP_CMD_CLOSE struct command *cmd2 = guestfs___new_command (g);
+  CLEANUP_CMD_CLOSE struct command *cmd3 = guestfs___new_command (g);
+  int r;
+
   guestfs___cmd_add_arg (cmd1, g->hv);
   guestfs___cmd_add_arg (cmd1, "-display");
   guestfs___cmd_add_arg (cmd1, "none");
@@ -1116,6 +1321,180 @@ qemu_supports_device (guestfs_h *g, struct backend_direct_data *data,
   return strstr (data->qemu_devices, device_name) != NULL;
 }
 
+/* Decide whether to map the appliance root into the guest using
+ * virtio-pmem, which the appliance mounts with DAX (see guestfs.pod /
+ * appliance_dax).  The guest then reads the root filesystem directly
+ * from the host page cache, instead of every appliance keeping its
+ * own copy in its own page cache.
+ *
+ * Returns 1 if DAX should be used, 0 if the appliance should be
+ * added as a disk, or -1 on error.  '*readonly_rtn' is set if qemu
+ * can open the file read-only.
+ */
+#define PMEM_ALIGNMENT (2 * 1024 * 1024)
+
+static int
+appliance_dax (guestfs_h *g, struct backend_direct_data *data,
+               const char *appliance, int64_t *size_rtn, int *readonly_rtn)
+{
+  struct stat statbuf;
+  int r;
+
+  r = guestfs___get_backend_setting_bool (g, "appliance_dax");
+  if (r <= 0)
+    return r;
+
+  r = qemu_supports_device (g, data, "virtio-pmem-pci");
+  if (r == -1)
+    return -1;
+  if (r == 0) {
+    debug (g, "appliance_dax: qemu does not support virtio-pmem-pci");
+    return 0;
+  }
+
+  if (stat (appliance, &statbuf) == -1) {
+    perrorf (g, "stat: %s", appliance);
+    return -1;
+  }
+
+  /* The size of the memory device must be aligned, and qemu would
+   * otherwise extend the file.
+   */
+  if (!S_ISREG (statbuf.st_mode) || statbuf.st_size == 0 ||
+      statbuf.st_size % PMEM_ALIGNMENT != 0) {
+    debug (g, "appliance_dax: %s: size is not a multiple of %d bytes",
+           appliance, PMEM_ALIGNMENT);
+    return 0;
+  }
+
+  /* Before qemu 8.2, a private mapping which the guest can write
+   * requires qemu to open the file read-write (although it is never
+   * written to).  If we cannot write the appliance (eg. a fixed
+   * appliance owned by root), use a disk instead.
+   */
+  if (data->qemu_version_major > 8 ||
+      (data->qemu_version_major == 8 && data->qemu_version_minor >= 2))
+    *readonly_rtn = 1;
+  else if (access (appliance, W_OK) == -1) {
+    debug (g, "appliance_dax: %s: not writable, and qemu < 8.2 cannot open it read-only",
+           appliance);
+    return 0;
+  }
+  else
+    *readonly_rtn = 0;
+
+  *size_rtn = statbuf.st_size;
+  return 1;
+}
+
+/* Decide whether to use virtio-vsock for the daemon channel, and if
+ * so set it up.  We need a kernel with vhost-vsock (host side) and a
+ * qemu with the vhost-vsock-pci device.
+ *
+ * A free guest context ID is reserved by opening /dev/vhost-vsock and
+ * trying CIDs until the kernel accepts one.  The fd is then passed to
+ * qemu ('vhostfd'), so two appliances can never race for the same
+ * CID.  We listen on an ephemeral vsock port which is passed to the
+ * daemon on the kernel command line.
+ *
+ * Returns 1 if vsock is set up, 0 if it is not available (use
+ * virtio-serial), or -1 on error.
+ */
+static int
+setup_vsock (guestfs_h *g, struct backend_direct_data *data,
+             int *vhost_fd_rtn, unsigned int *guest_cid_rtn,
+             int *sock_rtn, unsigned int *port_rtn)
+{
+#if defined(HAVE_LINUX_VM_SOCKETS_H) && defined(HAVE_LINUX_VHOST_H) && \
+  defined(VHOST_VSOCK_SET_GUEST_CID)
+  int vhost_fd = -1, sock = -1;
+  uint64_t cid;
+  struct sockaddr_vm addr;
+  socklen_t addrlen = sizeof addr;
+  int r;
+
+  r = guestfs___get_backend_setting_bool (g, "novsock");
+  if (r == -1)
+    return -1;
+  if (r > 0)
+    return 0;
+
+  r = qemu_supports_device (g, data, "vhost-vsock-pci");
+  if (r <= 0)
+    return r;
+
+  /* Close-on-exec, so that the fd (and with it the guest CID) is not
+   * held by any other process we fork.  The flag is cleared in the
+   * qemu child just before exec.
+   */
+  vhost_fd = open ("/dev/vhost-vsock", O_RDWR|O_CLOEXEC);
+  if (vhost_fd == -1) {
+    debug (g, "vsock: /dev/vhost-vsock: %m");
+    return 0;
+  }
+
+  /* CIDs 0-2 are reserved (2 is the host). */
+  for (cid = 3; cid < 65536; ++cid) {
+    if (ioctl (vhost_fd, VHOST_VSOCK_SET_GUEST_CID, &cid) == 0)
+      break;
+    if (errno != EADDRINUSE) {
+      debug (g, "vsock: VHOST_VSOCK_SET_GUEST_CID: %m");
+      goto unavailable;
+    }
+  }
+  if (cid >= 65536) {
+    debug (g, "vsock: no free guest CID");
+    goto unavailable;
+  }
+
+  sock = socket (AF_VSOCK, SOCK_STREAM|SOCK_CLOEXEC, 0);
+  if (sock == -1) {
+    debug (g, "vsock: socket: %m");
+    goto unavailable;
+  }
+
+  memset (&addr, 0, sizeof addr);
+  addr.svm_family = AF_VSOCK;
+  addr.svm_cid = VMADDR_CID_ANY;
+  addr.svm_port = VMADDR_PORT_ANY;
+
+  if (bind (sock, (struct sockaddr *) &addr, sizeof addr) == -1) {
+    debug (g, "vsock: bind: %m");
+    goto unavailable;
+  }
+  if (listen (sock, 1) == -1) {
+    perrorf (g, "listen");
+    goto error;
+  }
+  if (getsockname (sock, (struct sockaddr *) &addr, &addrlen) == -1) {
+    perrorf (g, "getsockname");
+    goto error;
+  }
+
+  debug (g, "using virtio-vsock, guest CID %u, port %u",
+         (unsigned) cid, (unsigned) addr.svm_port);
+
+  *vhost_fd_rtn = vhost_fd;
+  *guest_cid_rtn = cid;
+  *sock_rtn = sock;
+  *port_rtn = addr.svm_port;
+  return 1;
+
+ unavailable:
+  r = 0;
+  goto out;
+ error:
+  r = -1;
+ out:
+  if (sock >= 0)
+    close (sock);
+  close (vhost_fd);
+  return r;
+#else
+  return 0;
+#endif
+}
+
 /* Check if a file can be opened. */
 static int
 is_openable (guestfs_h *g, const char *path, int flags)
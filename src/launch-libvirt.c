@@ -108,6 +108,7 @@ struct backend_libvirt_data {
   char name[DOMAIN_NAME_LEN];   /* random name */
   bool is_kvm;                  /* false = qemu, true = kvm (from capabilities)*/
   unsigned long qemu_version;   /* qemu version (from libvirt) */
+  unsigned long libvirt_version; /* libvirt version */
 };
 
 /* Parameters passed to construct_libvirt_xml and subfunctions.  We
@@ -244,6 +245,7 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
            MIN_LIBVIRT_MAJOR, MIN_LIBVIRT_MINOR, MIN_LIBVIRT_MICRO);
     return -1;
   }
+  data->libvirt_version = version;
 
   guestfs___launch_send_progress (g, 0);
   TRACE0 (launch_libvirt_start);
@@ -338,6 +340,7 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
     goto cleanup;
 
   guestfs___launch_send_progress (g, 3);
+  guestfs___launch_milestone (g, LAUNCH_APPLIANCE_BUILT);
   TRACE0 (launch_build_libvirt_appliance_end);
 
   /* Note that appliance can be NULL if using the old-style appliance. */
@@ -485,6 +488,8 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
     goto cleanup;
   }
 
+  guestfs___launch_milestone (g, LAUNCH_HV_STARTED);
+
   g->state = LAUNCHING;
 
   /* Wait for console socket to be opened (by qemu). */
@@ -555,6 +560,8 @@ launch_libvirt (guestfs_h *g, void *datav, const char *libvirt_uri)
   if (appliance)
     guestfs___add_dummy_appliance_drive (g);
 
+  guestfs___launch_milestone (g, LAUNCH_APPLIANCE_UP);
+
   TRACE0 (launch_libvirt_end);
 
   guestfs___launch_send_progress (g, 12);
@@ -1070,7 +1077,8 @@ construct_libvirt_xml_boot (guestfs_h *g,
   flags = 0;
   if (!params->data->is_kvm)
     flags |= APPLIANCE_COMMAND_LINE_IS_TCG;
-  cmdline = guestfs___appliance_command_line (g, params->appliance_dev, flags);
+  cmdline = guestfs___appliance_command_line (g, params->appliance_dev,
+                                              flags, 0);
 
   start_element ("os") {
     start_element ("type") {
@@ -1448,6 +1456,7 @@ construct_libvirt_xml_disk_driver_qemu (guestfs_h *g,
                                         enum discard discard)
 {
   bool discard_unmap = false;
+  bool detect_zeroes = false;
 
   /* When adding the appliance disk, we don't have a 'drv' struct.
    * However the caller will use discard_disable, so we don't need it.
@@ -1470,6 +1479,12 @@ construct_libvirt_xml_disk_driver_qemu (guestfs_h *g,
      */
     if (data->qemu_version >= 1005000)
       discard_unmap = true;
+    /* If requested, also turn writes of zeroes into discards.
+     * This needs qemu >= 2.1 and libvirt >= 2.0.
+     */
+    if (drv->detect_zeroes &&
+        data->qemu_version >= 2001000 && data->libvirt_version >= 2000000)
+      detect_zeroes = true;
     break;
   }
 
@@ -1479,6 +1494,8 @@ construct_libvirt_xml_disk_driver_qemu (guestfs_h *g,
     attribute ("cache", cachemode);
     if (discard_unmap)
       attribute ("discard", "unmap");
+    if (detect_zeroes)
+      attribute ("detect_zeroes", "unmap");
   } end_element ();
 
   return 0;
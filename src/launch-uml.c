@@ -170,6 +170,7 @@ launch_uml (guestfs_h *g, void *datav, const char *arg)
   if (guestfs___build_appliance (g, &kernel, &dtb, &initrd, &appliance) == -1)
     return -1;
   has_appliance_drive = appliance != NULL;
+  guestfs___launch_milestone (g, LAUNCH_APPLIANCE_BUILT);
 
   /* Create COW overlays for the appliance.  Note that the documented
    * syntax ubd0=cow,orig does not work since kernel 3.3.  See:
@@ -352,6 +353,7 @@ launch_uml (guestfs_h *g, void *datav, const char *arg)
 
   /* Parent (library). */
   data->pid = r;
+  guestfs___launch_milestone (g, LAUNCH_HV_STARTED);
 
   /* Fork the recovery process off which will kill vmlinux if the
    * parent process fails to do so (eg. if the parent segfaults).
@@ -480,6 +482,8 @@ launch_uml (guestfs_h *g, void *datav, const char *arg)
   if (has_appliance_drive)
     guestfs___add_dummy_appliance_drive (g);
 
+  guestfs___launch_milestone (g, LAUNCH_APPLIANCE_UP);
+
   return 0;
 
  cleanup1:
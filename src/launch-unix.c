@@ -92,6 +92,8 @@ launch_unix (guestfs_h *g, void *datav, const char *sockpath)
     goto cleanup;
   }
 
+  guestfs___launch_milestone (g, LAUNCH_APPLIANCE_UP);
+
   return 0;
 
  cleanup:
@@ -58,6 +58,10 @@ guestfs__launch (guestfs_h *g)
   gettimeofday (&g->launch_t, NULL);
   TRACE0 (launch_start);
 
+  memset (g->launch_milestones, 0, sizeof g->launch_milestones);
+  guestfs___free_string_list (g->boot_timings);
+  g->boot_timings = NULL;
+
   /* Make the temporary directory. */
   if (guestfs___lazy_make_tmpdir (g) == -1)
     return -1;
@@ -126,6 +130,138 @@ guestfs___launch_send_progress (guestfs_h *g, int perdozen)
   }
 }
 
+/* Record that launch reached milestone 'm', for
+ * guestfs_launch_timings.
+ */
+void
+guestfs___launch_milestone (guestfs_h *g, enum launch_milestone m)
+{
+  struct timeval tv;
+  int64_t usec;
+
+  gettimeofday (&tv, NULL);
+  usec = (tv.tv_sec - g->launch_t.tv_sec) * INT64_C (1000000) +
+    (tv.tv_usec - g->launch_t.tv_usec);
+  g->launch_milestones[m] = usec > 0 ? usec : 1;
+}
+
+/* Look up a milestone in the list returned by
+ * guestfs_internal_boot_timings.  Returns -1 if not found.
+ */
+static int64_t
+get_boot_timing (char **timings, const char *name)
+{
+  int64_t usec;
+  size_t i;
+
+  for (i = 0; timings[i] != NULL && timings[i+1] != NULL; i += 2) {
+    if (STREQ (timings[i], name)) {
+      if (sscanf (timings[i+1], "%" SCNi64, &usec) != 1)
+        return -1;
+      return usec;
+    }
+  }
+  return -1;
+}
+
+static void
+add_timing (guestfs_h *g, struct guestfs_launch_timing_list *ret,
+            const char *phase, int64_t usec)
+{
+  struct guestfs_launch_timing *t;
+
+  ret->val = safe_realloc (g, ret->val, (ret->len+1) * sizeof *ret->val);
+  t = &ret->val[ret->len++];
+  t->lt_phase = safe_strdup (g, phase);
+  t->lt_usec = usec > 0 ? usec : 0;
+}
+
+/* Phases measured inside the appliance, and the milestones (recorded
+ * by the appliance /init script and the daemon) which end them.  The
+ * kernel phase starts when the guest clock starts.
+ */
+static const struct {
+  const char *phase;
+  const char *end;
+} boot_phases[] = {
+  { "kernel", "init" },
+  { "init", "udev_start" },
+  { "udev", "udev_settled" },
+  { "devices", "devices_scanned" },
+  { "daemon", "daemon_ready" },
+};
+#define NR_BOOT_PHASES (sizeof boot_phases / sizeof boot_phases[0])
+
+struct guestfs_launch_timing_list *
+guestfs__launch_timings (guestfs_h *g)
+{
+  struct guestfs_launch_timing_list *ret;
+  const int64_t *m = g->launch_milestones;
+  int64_t start = 0, boot, guest_usec[NR_BOOT_PHASES], prev;
+  size_t i;
+
+  if (m[LAUNCH_APPLIANCE_UP] == 0) {
+    error (g, _("the libguestfs handle has not been launched"));
+    return NULL;
+  }
+
+  /* The guest milestones can only be fetched while the appliance is
+   * running, so keep them for later calls.  Failure here is not an
+   * error: we just can't split up the boot phase.
+   */
+  if (g->boot_timings == NULL && g->state == READY) {
+    guestfs_push_error_handler (g, NULL, NULL);
+    g->boot_timings = guestfs_internal_boot_timings (g);
+    guestfs_pop_error_handler (g);
+  }
+
+  ret = safe_malloc (g, sizeof *ret);
+  ret->len = 0;
+  ret->val = NULL;
+
+  /* Backends which don't run an appliance (eg. unix) don't record
+   * every milestone.
+   */
+  if (m[LAUNCH_APPLIANCE_BUILT] > 0) {
+    add_timing (g, ret, "appliance", m[LAUNCH_APPLIANCE_BUILT]);
+    start = m[LAUNCH_APPLIANCE_BUILT];
+  }
+  if (m[LAUNCH_HV_STARTED] > 0) {
+    add_timing (g, ret, "qemu", m[LAUNCH_HV_STARTED] - start);
+    start = m[LAUNCH_HV_STARTED];
+  }
+  boot = m[LAUNCH_APPLIANCE_UP] - start;
+
+  /* Split up the boot phase if the appliance recorded all of its
+   * milestones.  The guest clock starts when the kernel starts, so
+   * whatever is left over is time spent in the firmware (and in qemu
+   * setting up the guest).
+   */
+  prev = 0;
+  for (i = 0; i < NR_BOOT_PHASES; ++i) {
+    int64_t end = -1;
+
+    if (g->boot_timings)
+      end = get_boot_timing (g->boot_timings, boot_phases[i].end);
+    if (end < prev)
+      break;
+    guest_usec[i] = end - prev;
+    prev = end;
+  }
+
+  if (i == NR_BOOT_PHASES) {
+    add_timing (g, ret, "firmware", boot - prev);
+    for (i = 0; i < NR_BOOT_PHASES; ++i)
+      add_timing (g, ret, boot_phases[i].phase, guest_usec[i]);
+  }
+  else
+    add_timing (g, ret, "boot", boot);
+
+  add_timing (g, ret, "total", m[LAUNCH_APPLIANCE_UP]);
+
+  return ret;
+}
+
 /* Note that since this calls 'debug' it should only be called
  * from the parent process.
  */
@@ -299,6 +435,13 @@ guestfs__config (guestfs_h *g,
  * TCG guest (ie. KVM is known to be disabled or unavailable).  If you
  * don't know, don't pass this flag.
  *
+ * GUESTFS___APPLIANCE_COMMAND_LINE_DAX: The appliance root is a
+ * persistent memory device which should be mounted with DAX.
+ *
+ * If 'vsock_port' is non-zero, the daemon is told to connect back to
+ * the library on that virtio-vsock port instead of opening the
+ * virtio-serial channel.
+ *
  * Note that this returns a newly allocated buffer which must be freed
  * by the caller.
  */
@@ -310,16 +453,19 @@ guestfs__config (guestfs_h *g,
 
 char *
 guestfs___appliance_command_line (guestfs_h *g, const char *appliance_dev,
-                                  int flags)
+                                  int flags, unsigned int vsock_port)
 {
   char root[64] = "";
+  char vsock[64] = "";
   char *term = getenv ("TERM");
   char *ret;
   bool tcg = flags & APPLIANCE_COMMAND_LINE_IS_TCG;
+  bool dax = flags & APPLIANCE_COMMAND_LINE_DAX;
   char lpj_s[64] = "";
 
   if (appliance_dev)
-    snprintf (root, sizeof root, " root=%s", appliance_dev);
+    snprintf (root, sizeof root, " root=%s%s",
+              appliance_dev, dax ? " rootflags=dax" : "");
 
   if (tcg) {
     int lpj = guestfs___get_lpj (g);
@@ -327,6 +473,9 @@ guestfs___appliance_command_line (guestfs_h *g, const char *appliance_dev,
       snprintf (lpj_s, sizeof lpj_s, " lpj=%d", lpj);
   }
 
+  if (vsock_port > 0)
+    snprintf (vsock, sizeof vsock, " guestfs_vsock=%u", vsock_port);
+
   ret = safe_asprintf
     (g,
      "panic=1"             /* force kernel to panic if daemon exits */
@@ -350,6 +499,7 @@ guestfs___appliance_command_line (guestfs_h *g, const char *appliance_dev,
      " %s"                      /* selinux */
      "%s"                       /* verbose */
      "%s"                       /* network */
+     "%s"                       /* vsock */
      " TERM=%s"                 /* TERM environment variable */
      "%s%s",                    /* append */
 #ifdef __arm__
@@ -360,6 +510,7 @@ guestfs___appliance_command_line (guestfs_h *g, const char *appliance_dev,
      g->selinux ? "selinux=1 enforcing=0" : "selinux=0",
      g->verbose ? " guestfs_verbose=1" : "",
      g->enable_network ? " guestfs_network=1" : "",
+     vsock,
      term ? term : "linux",
      g->append ? " " : "", g->append ? g->append : "");
 
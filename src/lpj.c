@@ -41,7 +41,9 @@
  *
  * Notes:
  *
- * - We only try to calculate lpj once.
+ * - We only try to calculate lpj once.  The result is also cached in
+ *   the cachedir, keyed on the host boot ID, so that other processes
+ *   don't have to run dmesg again until the host is rebooted.
  *
  * - Trying to calculate lpj must not fail.  If the return value is
  *   <= 0, it is ignored by the caller.
@@ -57,16 +59,29 @@ static int lpj = 0;
 static int read_lpj_from_dmesg (guestfs_h *g);
 static int read_lpj_from_files (guestfs_h *g);
 static int read_lpj_common (guestfs_h *g, const char *func, struct command *cmd);
+static char *read_boot_id (guestfs_h *g);
 
 int
 guestfs___get_lpj (guestfs_h *g)
 {
+  CLEANUP_FREE char *boot_id = NULL;
+  CLEANUP_FREE char *cached = NULL;
+  char buf[32];
   int r;
 
   gl_lock_lock (lpj_lock);
   if (lpj != 0)
     goto out;
 
+  boot_id = read_boot_id (g);
+  if (boot_id) {
+    cached = guestfs___cache_lookup (g, "lpj", boot_id);
+    if (cached && sscanf (cached, "%d", &r) == 1 && r > 0) {
+      lpj = r;
+      goto out;
+    }
+  }
+
   /* Try reading lpj from these sources:
    * - /proc/cpuinfo [in future]
    * - dmesg
@@ -77,15 +92,50 @@ guestfs___get_lpj (guestfs_h *g)
   r = read_lpj_from_dmesg (g);
   if (r > 0) {
     lpj = r;
-    goto out;
+    goto store;
   }
   lpj = read_lpj_from_files (g);
 
+ store:
+  /* Don't cache a failure, since it may be temporary (eg. the boot
+   * messages were not readable by this user).
+   */
+  if (boot_id && lpj > 0) {
+    snprintf (buf, sizeof buf, "%d", lpj);
+    guestfs___cache_store (g, "lpj", boot_id, buf);
+  }
+
  out:
   gl_lock_unlock (lpj_lock);
   return lpj;
 }
 
+/* The boot ID changes every time the host is rebooted. */
+static char *
+read_boot_id (guestfs_h *g)
+{
+  char buf[64];
+  FILE *fp;
+  size_t len;
+
+  fp = fopen ("/proc/sys/kernel/random/boot_id", "re");
+  if (fp == NULL)
+    return NULL;
+  if (fgets (buf, sizeof buf, fp) == NULL) {
+    fclose (fp);
+    return NULL;
+  }
+  fclose (fp);
+
+  len = strlen (buf);
+  if (len > 0 && buf[len-1] == '\n')
+    buf[--len] = '\0';
+  if (len == 0)
+    return NULL;
+
+  return safe_strdup (g, buf);
+}
+
 /* Grep the output, and print just the matching string "lpj=NNN". */
 #define GREP_FLAGS "-Eoh"
 #define GREP_REGEX "lpj=[[:digit:]]+"
@@ -100,6 +100,7 @@ child_cleanup (guestfs_h *g)
     g->conn->ops->free_connection (g, g->conn);
     g->conn = NULL;
   }
+  guestfs___async_reset (g);
   memset (&g->launch_t, 0, sizeof g->launch_t);
   guestfs___free_drives (g);
   g->state = CONFIG;
@@ -224,6 +225,11 @@ guestfs___send (guestfs_h *g, int proc_nr,
     return -1;
   }
 
+  if (g->async_proc != 0) {
+    error (g, _("cannot make a call while an asynchronous call is in progress on this handle"));
+    return -1;
+  }
+
   /* We have to allocate this message buffer on the heap because
    * it is quite large (although will be mostly unused).  We
    * can't allocate it on the stack because in some environments
@@ -293,6 +299,8 @@ guestfs___send (guestfs_h *g, int proc_nr,
     return -1;
   }
 
+  guestfs___rpc_stats_call (g, proc_nr, msg_out_size);
+
   return serial;
 }
 
@@ -470,6 +478,8 @@ send_file_chunk (guestfs_h *g, int cancel, const char *buf, size_t buflen)
     return -1;
   }
 
+  guestfs___rpc_stats_chunk (g, 1, msg_out_size);
+
   return 0;
 }
 
@@ -638,6 +648,41 @@ guestfs___recv_from_daemon (guestfs_h *g, uint32_t *size_rtn, void **buf_rtn)
   return 0;
 }
 
+/* Decode a reply message (without the length word). */
+static int
+decode_reply (guestfs_h *g, const char *fn, void *buf, uint32_t size,
+              guestfs_message_header *hdr,
+              guestfs_message_error *err,
+              xdrproc_t xdrp, char *ret)
+{
+  XDR xdr;
+
+  xdrmem_create (&xdr, buf, size, XDR_DECODE);
+
+  if (!xdr_guestfs_message_header (&xdr, hdr)) {
+    error (g, "%s: failed to parse reply header", fn);
+    xdr_destroy (&xdr);
+    return -1;
+  }
+  guestfs___rpc_stats_reply (g, fn, hdr->status, size + 4);
+  if (hdr->status == GUESTFS_STATUS_ERROR) {
+    if (!xdr_guestfs_message_error (&xdr, err)) {
+      error (g, "%s: failed to parse reply error", fn);
+      xdr_destroy (&xdr);
+      return -1;
+    }
+  } else {
+    if (xdrp && ret && !xdrp (&xdr, ret)) {
+      error (g, "%s: failed to parse reply", fn);
+      xdr_destroy (&xdr);
+      return -1;
+    }
+  }
+  xdr_destroy (&xdr);
+
+  return 0;
+}
+
 /* Receive a reply. */
 int
 guestfs___recv (guestfs_h *g, const char *fn,
@@ -645,7 +690,6 @@ guestfs___recv (guestfs_h *g, const char *fn,
                 guestfs_message_error *err,
                 xdrproc_t xdrp, char *ret)
 {
-  XDR xdr;
   CLEANUP_FREE void *buf = NULL;
   uint32_t size;
   int r;
@@ -667,29 +711,7 @@ guestfs___recv (guestfs_h *g, const char *fn,
     return -1;
   }
 
-  xdrmem_create (&xdr, buf, size, XDR_DECODE);
-
-  if (!xdr_guestfs_message_header (&xdr, hdr)) {
-    error (g, "%s: failed to parse reply header", fn);
-    xdr_destroy (&xdr);
-    return -1;
-  }
-  if (hdr->status == GUESTFS_STATUS_ERROR) {
-    if (!xdr_guestfs_message_error (&xdr, err)) {
-      error (g, "%s: failed to parse reply error", fn);
-      xdr_destroy (&xdr);
-      return -1;
-    }
-  } else {
-    if (xdrp && ret && !xdrp (&xdr, ret)) {
-      error (g, "%s: failed to parse reply", fn);
-      xdr_destroy (&xdr);
-      return -1;
-    }
-  }
-  xdr_destroy (&xdr);
-
-  return 0;
+  return decode_reply (g, fn, buf, size, hdr, err, xdrp, ret);
 }
 
 /* Same as guestfs___recv, but it discards the reply message.
@@ -722,6 +744,9 @@ guestfs___recv_discard (guestfs_h *g, const char *fn)
     return -1;
   }
 
+  /* Only called on error paths, so count it as a failed call. */
+  guestfs___rpc_stats_reply (g, fn, GUESTFS_STATUS_ERROR, size + 4);
+
   return 0;
 }
 
@@ -838,6 +863,8 @@ receive_file_data (guestfs_h *g, void **buf_r)
     return -1;
   }
 
+  guestfs___rpc_stats_chunk (g, 0, len + 4);
+
   memset (&chunk, 0, sizeof chunk);
 
   xdrmem_create (&xdr, buf, len, XDR_DECODE);
@@ -875,3 +902,187 @@ guestfs_user_cancel (guestfs_h *g)
   g->user_cancel = 1;
   return 0;
 }
+
+/* Asynchronous calls.
+ *
+ * guestfs_<name>_async_send (generated) sends the call in the same
+ * way as the synchronous stub, and then records it here.  The caller
+ * polls the file descriptors returned by guestfs_async_fds and calls
+ * guestfs_async_poll, which reads as much of the reply as is
+ * available without blocking.  Finally guestfs_<name>_async_recv
+ * (generated) decodes the reply.
+ *
+ * Only one call can be in progress on a handle, since the daemon
+ * processes calls one at a time anyway.  To keep many appliances
+ * busy from one thread, use one handle per appliance.
+ */
+void
+guestfs___async_sent (guestfs_h *g, int proc_nr, int serial)
+{
+  g->async_proc = proc_nr;
+  g->async_serial = serial;
+  g->async_pos = 0;
+  g->async_done = false;
+}
+
+void
+guestfs___async_reset (guestfs_h *g)
+{
+  free (g->async_buf);
+  g->async_buf = NULL;
+  g->async_proc = 0;
+  g->async_pos = 0;
+  g->async_done = false;
+}
+
+/* Read more of the reply to the call in progress.  If 'block' is
+ * false, only read what is available without blocking.  Progress
+ * messages and stray cancellation flags are handled the same way as
+ * in guestfs___recv_from_daemon and guestfs___recv.
+ *
+ * Returns 1 if the whole reply has arrived, 0 if not yet, -1 on error.
+ */
+static int
+async_read (guestfs_h *g, int block)
+{
+  XDR xdr;
+  ssize_t n;
+
+  while (!g->async_done) {
+    char *p;
+    size_t len;
+
+    if (!g->conn) {
+      guestfs___unexpected_close_error (g);
+      return -1;
+    }
+
+    if (g->async_buf == NULL) {
+      p = g->async_lenbuf + g->async_pos;
+      len = 4 - g->async_pos;
+    } else {
+      p = g->async_buf + g->async_pos;
+      len = g->async_size - g->async_pos;
+    }
+
+    if (block)
+      n = g->conn->ops->read_data (g, g->conn, p, len);
+    else
+      n = g->conn->ops->try_read_data (g, g->conn, p, len);
+    if (n == -2)                /* Nothing available yet. */
+      return 0;
+    if (n == -1)
+      return -1;
+    if (n == 0) {
+      guestfs___unexpected_close_error (g);
+      child_cleanup (g);
+      return -1;
+    }
+    g->async_pos += n;
+
+    if (g->async_buf == NULL) {
+      /* Still reading the length word? */
+      if (g->async_pos < 4)
+        continue;
+
+      xdrmem_create (&xdr, g->async_lenbuf, 4, XDR_DECODE);
+      xdr_uint32_t (&xdr, &g->async_len);
+      xdr_destroy (&xdr);
+      g->async_pos = 0;
+
+      if (g->async_len == GUESTFS_CANCEL_FLAG)
+        continue;
+      if (g->async_len == GUESTFS_LAUNCH_FLAG) {
+        error (g, _("received unexpected launch flag from daemon when expecting reply"));
+        return -1;
+      }
+      if (g->async_len == GUESTFS_PROGRESS_FLAG)
+        g->async_size = PROGRESS_MESSAGE_SIZE;
+      else if (g->async_len > GUESTFS_MESSAGE_MAX) {
+        error (g, _("message length (%u) > maximum possible size (%d)"),
+               (unsigned) g->async_len, GUESTFS_MESSAGE_MAX);
+        return -1;
+      }
+      else
+        g->async_size = g->async_len;
+      g->async_buf = safe_malloc (g, g->async_size);
+      continue;
+    }
+
+    if (g->async_pos < g->async_size)
+      continue;
+
+    if (g->async_len == GUESTFS_PROGRESS_FLAG) {
+      guestfs_progress message;
+
+      xdrmem_create (&xdr, g->async_buf, PROGRESS_MESSAGE_SIZE, XDR_DECODE);
+      xdr_guestfs_progress (&xdr, &message);
+      xdr_destroy (&xdr);
+
+      guestfs___progress_message_callback (g, &message);
+
+      free (g->async_buf);
+      g->async_buf = NULL;
+      g->async_pos = 0;
+      continue;
+    }
+
+    g->async_done = true;
+  }
+
+  return 1;
+}
+
+int
+guestfs___async_recv (guestfs_h *g, const char *fn, int proc_nr,
+                      int *serial_rtn,
+                      guestfs_message_header *hdr,
+                      guestfs_message_error *err,
+                      xdrproc_t xdrp, char *ret)
+{
+  int r;
+
+  if (g->async_proc != proc_nr) {
+    error (g, _("%s: no asynchronous call to this function is in progress"),
+           fn);
+    return -1;
+  }
+
+  /* This blocks if the reply hasn't arrived yet. */
+  r = async_read (g, 1);
+  if (r == 1) {
+    *serial_rtn = g->async_serial;
+    r = decode_reply (g, fn, g->async_buf, g->async_size,
+                      hdr, err, xdrp, ret);
+  }
+
+  guestfs___async_reset (g);
+  return r;
+}
+
+int
+guestfs_async_fds (guestfs_h *g, int fds[GUESTFS_ASYNC_MAX_FDS])
+{
+  if (!g->conn) {
+    error (g, _("guestfs_async_fds: call launch before using this function"));
+    return -1;
+  }
+
+  return g->conn->ops->get_fds (g, g->conn, fds);
+}
+
+int
+guestfs_async_poll (guestfs_h *g)
+{
+  int r;
+
+  if (g->async_proc == 0) {
+    error (g, _("guestfs_async_poll: no asynchronous call is in progress"));
+    return -1;
+  }
+
+  r = async_read (g, 0);
+  if (r == -1)
+    guestfs___async_reset (g);
+  return r;
+}
@@ -0,0 +1,329 @@
+/* libguestfs
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Native handling of the two common disk formats (raw and qcow2), so
+ * that adding read-only drives and querying disk images doesn't have
+ * to run qemu-img each time.  Anything unusual is left to qemu-img:
+ * these functions return -1 without setting an error in that case,
+ * and the caller falls back to the external command.
+ *
+ * The qcow2 format is described in docs/specs/qcow2.txt in the qemu
+ * sources.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+
+#include "full-write.h"
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+
+#define QCOW2_MAGIC "QFI\xfb"
+#define QCOW2_CLUSTER_BITS 16
+#define QCOW2_CLUSTER_SIZE (1 << QCOW2_CLUSTER_BITS)
+#define QCOW2_HEADER_LENGTH 104
+#define QCOW2_EXT_BACKING_FORMAT 0xE2792ACA
+
+/* Signatures of other formats which qemu can detect.  If any of these
+ * match, we don't try to say anything about the image and qemu-img is
+ * used instead.  If nothing matches, qemu would treat it as raw.
+ */
+static const struct {
+  size_t offset;
+  size_t len;
+  const char *magic;
+} other_formats[] = {
+  { 0, 4, "QFI\xfb" },          /* qcow version 1 (v2/v3 handled above) */
+  { 0, 4, "KDMV" },             /* vmdk */
+  { 0, 4, "COWD" },             /* vmdk3 */
+  { 0, 20, "# Disk DescriptorFile" },
+  { 0, 8, "conectix" },         /* vpc */
+  { 0, 4, "QED\0" },            /* qed */
+  { 0, 8, "vhdxfile" },         /* vhdx */
+  { 0, 16, "WithoutFreeSpace" }, /* parallels */
+  { 0, 16, "WithouFreSpacExt" },
+  { 0, 6, "LUKS\xba\xbe" },     /* luks */
+  { 0, 22, "Bochs Virtual HD Image" },
+  { 0, 20, "#!/bin/sh\n#V2.0 Format" }, /* cloop */
+  { 64, 4, "\x7f\x10\xda\xbe" }, /* vdi */
+};
+
+static uint32_t
+get_be32 (const unsigned char *p)
+{
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+    (uint32_t) p[2] << 8 | p[3];
+}
+
+static uint64_t
+get_be64 (const unsigned char *p)
+{
+  return (uint64_t) get_be32 (p) << 32 | get_be32 (p+4);
+}
+
+static void
+put_be16 (unsigned char *p, uint16_t v)
+{
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void
+put_be32 (unsigned char *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void
+put_be64 (unsigned char *p, uint64_t v)
+{
+  put_be32 (p, v >> 32);
+  put_be32 (p+4, v);
+}
+
+/* Find out the format, virtual size and whether 'filename' has a
+ * backing file, without running qemu-img.  Any of the return
+ * pointers may be NULL.
+ *
+ * Returns 0 on success.  Returns -1 if the file is not a local raw or
+ * qcow2 image, or cannot be read, in which case no error is set and
+ * the caller should ask qemu-img.
+ */
+int
+guestfs___native_disk_info (guestfs_h *g, const char *filename,
+                            char **format_r, int64_t *size_r,
+                            int *has_backing_file_r)
+{
+  unsigned char buf[512];
+  struct stat statbuf;
+  const char *format = "raw";
+  int64_t size;
+  int has_backing_file = 0;
+  ssize_t r;
+  size_t i;
+  int fd;
+
+  fd = open (filename, O_RDONLY|O_NOCTTY|O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+
+  if (fstat (fd, &statbuf) == -1)
+    goto fallback;
+
+  if (S_ISREG (statbuf.st_mode))
+    size = statbuf.st_size;
+#ifdef BLKGETSIZE64
+  else if (S_ISBLK (statbuf.st_mode)) {
+    uint64_t bsize;
+
+    if (ioctl (fd, BLKGETSIZE64, &bsize) == -1)
+      goto fallback;
+    size = bsize;
+  }
+#endif
+  else
+    goto fallback;
+
+  memset (buf, 0, sizeof buf);
+  r = pread (fd, buf, sizeof buf, 0);
+  if (r == -1)
+    goto fallback;
+
+  if (memcmp (buf, QCOW2_MAGIC, 4) == 0 &&
+      (get_be32 (&buf[4]) == 2 || get_be32 (&buf[4]) == 3)) {
+    format = "qcow2";
+    size = get_be64 (&buf[24]);
+    has_backing_file = get_be64 (&buf[8]) != 0;
+    if (size < 0)
+      goto fallback;
+  }
+  else {
+    for (i = 0; i < sizeof other_formats / sizeof other_formats[0]; ++i) {
+      if (memcmp (&buf[other_formats[i].offset],
+                  other_formats[i].magic, other_formats[i].len) == 0)
+        goto fallback;
+    }
+
+    /* dmg has its signature in the last 512 bytes. */
+    if (size >= 512 &&
+        pread (fd, buf, 4, size - 512) == 4 &&
+        memcmp (buf, "koly", 4) == 0)
+      goto fallback;
+  }
+
+  close (fd);
+
+  debug (g, "%s: %s: format %s, virtual size %" PRIi64 "%s",
+         __func__, filename, format, size,
+         has_backing_file ? ", has backing file" : "");
+
+  if (format_r)
+    *format_r = safe_strdup (g, format);
+  if (size_r)
+    *size_r = size;
+  if (has_backing_file_r)
+    *has_backing_file_r = has_backing_file;
+  return 0;
+
+ fallback:
+  close (fd);
+  return -1;
+}
+
+/* Create a qcow2 (version 3) image called 'filename', optionally
+ * backed by 'backingfile', without running qemu-img.  If there is a
+ * backing file then 'size' must be -1, and it must be a local raw or
+ * qcow2 file.
+ *
+ * The image consists of the header cluster (with the backing format
+ * extension and backing file name), a refcount table, a single
+ * refcount block, and the (empty) L1 table.
+ *
+ * Returns 0 on success, or -1 on error.  If the image cannot be
+ * created natively (eg. the backing file is not a local file), this
+ * returns -2 without setting an error and the caller should use
+ * qemu-img.
+ */
+int
+guestfs___native_create_qcow2 (guestfs_h *g, const char *filename,
+                               int64_t size, const char *backingfile,
+                               const char *backingformat)
+{
+  CLEANUP_FREE unsigned char *buf = NULL;
+  CLEANUP_FREE char *probed_format = NULL;
+  const uint64_t l2_coverage =
+    (uint64_t) QCOW2_CLUSTER_SIZE * (QCOW2_CLUSTER_SIZE / 8);
+  uint64_t l1_size, l1_clusters, nr_clusters, i;
+  size_t offset, len;
+  int fd;
+
+  if (backingfile) {
+    if (backingfile[0] != '/' ||
+        guestfs___native_disk_info (g, backingfile, &probed_format,
+                                    &size, NULL) == -1)
+      return -2;
+    if (backingformat == NULL)
+      backingformat = probed_format;
+    else if (STRNEQ (backingformat, probed_format))
+      return -2;
+    if (strlen (backingfile) > 1023)
+      return -2;
+  }
+
+  l1_size = (size + l2_coverage - 1) / l2_coverage;
+  if (l1_size == 0)
+    l1_size = 1;
+  l1_clusters = (l1_size * 8 + QCOW2_CLUSTER_SIZE - 1) / QCOW2_CLUSTER_SIZE;
+
+  /* Header, refcount table, refcount block, L1 table.  A single
+   * refcount block with 16 bit refcounts covers 32768 clusters, which
+   * is enough for a virtual size of many petabytes.
+   */
+  nr_clusters = 3 + l1_clusters;
+  if (nr_clusters > QCOW2_CLUSTER_SIZE / 2)
+    return -2;
+
+  buf = safe_calloc (g, 3, QCOW2_CLUSTER_SIZE);
+
+  /* Header. */
+  memcpy (buf, QCOW2_MAGIC, 4);
+  put_be32 (&buf[4], 3);                /* version */
+  put_be32 (&buf[20], QCOW2_CLUSTER_BITS);
+  put_be64 (&buf[24], size);
+  put_be32 (&buf[36], l1_size);
+  put_be64 (&buf[40], 3 * QCOW2_CLUSTER_SIZE); /* L1 table offset */
+  put_be64 (&buf[48], QCOW2_CLUSTER_SIZE);     /* refcount table offset */
+  put_be32 (&buf[56], 1);               /* refcount table clusters */
+  put_be32 (&buf[96], 4);               /* refcount order (16 bits) */
+  put_be32 (&buf[100], QCOW2_HEADER_LENGTH);
+
+  /* Header extensions, then the backing file name. */
+  offset = QCOW2_HEADER_LENGTH;
+  if (backingfile) {
+    len = strlen (backingformat);
+    put_be32 (&buf[offset], QCOW2_EXT_BACKING_FORMAT);
+    put_be32 (&buf[offset+4], len);
+    memcpy (&buf[offset+8], backingformat, len);
+    offset += 8 + ((len + 7) & ~7);
+  }
+  offset += 8;                          /* end of extensions */
+  if (backingfile) {
+    len = strlen (backingfile);
+    put_be64 (&buf[8], offset);
+    put_be32 (&buf[16], len);
+    memcpy (&buf[offset], backingfile, len);
+  }
+
+  /* Refcount table, pointing to the refcount block. */
+  put_be64 (&buf[QCOW2_CLUSTER_SIZE], 2 * QCOW2_CLUSTER_SIZE);
+
+  /* Refcount block: every cluster in the file is used once. */
+  for (i = 0; i < nr_clusters; ++i)
+    put_be16 (&buf[2 * QCOW2_CLUSTER_SIZE + i*2], 1);
+
+  fd = open (filename, O_WRONLY|O_CREAT|O_NOCTTY|O_TRUNC|O_CLOEXEC, 0666);
+  if (fd == -1) {
+    perrorf (g, _("cannot create qcow2 file: %s"), filename);
+    return -1;
+  }
+
+  if (full_write (fd, buf, 3 * QCOW2_CLUSTER_SIZE) != 3 * QCOW2_CLUSTER_SIZE) {
+    perrorf (g, _("%s: write"), filename);
+    goto error;
+  }
+
+  /* The L1 table is all zeroes. */
+  if (ftruncate (fd, nr_clusters * QCOW2_CLUSTER_SIZE) == -1) {
+    perrorf (g, _("%s: truncate"), filename);
+    goto error;
+  }
+
+  if (close (fd) == -1) {
+    perrorf (g, _("%s: close"), filename);
+    unlink (filename);
+    return -1;
+  }
+
+  debug (g, "%s: created %s%s%s", __func__, filename,
+         backingfile ? " backed by " : "", backingfile ? backingfile : "");
+  return 0;
+
+ error:
+  close (fd);
+  unlink (filename);
+  return -1;
+}
@@ -0,0 +1,185 @@
+/* libguestfs
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Per-procedure statistics about calls made to the daemon.  These are
+ * always collected: the cost is a couple of gettimeofday calls and
+ * some additions per RPC, which is nothing compared to the round trip
+ * to the appliance.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include <rpc/types.h>
+#include <rpc/xdr.h>
+
+#include "guestfs.h"
+#include "guestfs-internal.h"
+#include "guestfs-internal-actions.h"
+#include "guestfs_protocol.h"
+
+static struct rpc_stats *
+get_stats (guestfs_h *g, int proc_nr)
+{
+  if (proc_nr <= 0 || proc_nr > GUESTFS_MAX_PROC_NR)
+    return NULL;
+
+  if (g->rpc_stats == NULL)
+    g->rpc_stats = safe_calloc (g, GUESTFS_MAX_PROC_NR + 1,
+                                sizeof (struct rpc_stats));
+
+  return &g->rpc_stats[proc_nr];
+}
+
+/* Called when the call message for proc_nr has been sent. */
+void
+guestfs___rpc_stats_call (guestfs_h *g, int proc_nr, size_t bytes)
+{
+  struct rpc_stats *st = get_stats (g, proc_nr);
+
+  if (st == NULL)
+    return;
+
+  g->rpc_proc = proc_nr;
+  gettimeofday (&g->rpc_start_t, NULL);
+  st->bytes_sent += bytes;
+}
+
+/* Called when the reply to the current call has been received. */
+void
+guestfs___rpc_stats_reply (guestfs_h *g, const char *fn, int status,
+                           size_t bytes)
+{
+  struct rpc_stats *st = get_stats (g, g->rpc_proc);
+  struct timeval end_t;
+  int64_t usec;
+  size_t i;
+
+  if (st == NULL)
+    return;
+
+  gettimeofday (&end_t, NULL);
+  usec = (int64_t) (end_t.tv_sec - g->rpc_start_t.tv_sec) * 1000000 +
+    (end_t.tv_usec - g->rpc_start_t.tv_usec);
+  if (usec < 0)
+    usec = 0;
+
+  /* 'fn' is always a string literal in the generated code. */
+  st->name = fn;
+  st->calls++;
+  if (status == GUESTFS_STATUS_ERROR)
+    st->errors++;
+  st->total_usec += usec;
+  if ((uint64_t) usec > st->max_usec)
+    st->max_usec = usec;
+
+  /* Buckets are < 1ms, < 10ms, < 100ms, < 1s, >= 1s. */
+  for (i = 0; i < NR_RPC_LATENCY_BUCKETS - 1 && usec >= 1000; ++i)
+    usec /= 10;
+  st->latency[i]++;
+
+  st->bytes_received += bytes;
+}
+
+/* Called for each FileIn chunk sent or FileOut chunk received. */
+void
+guestfs___rpc_stats_chunk (guestfs_h *g, int sent, size_t bytes)
+{
+  struct rpc_stats *st = get_stats (g, g->rpc_proc);
+
+  if (st == NULL)
+    return;
+
+  if (sent) {
+    st->chunks_sent++;
+    st->bytes_sent += bytes;
+  }
+  else {
+    st->chunks_received++;
+    st->bytes_received += bytes;
+  }
+}
+
+struct guestfs_rpc_stat_list *
+guestfs__rpc_stats (guestfs_h *g, const struct guestfs_rpc_stats_argv *optargs)
+{
+  struct guestfs_rpc_stat_list *ret;
+  size_t i, j;
+
+  if ((optargs->bitmask & GUESTFS_RPC_STATS_DAEMON_BITMASK) &&
+      optargs->daemon)
+    return guestfs_internal_rpc_stats (g);
+
+  ret = safe_malloc (g, sizeof *ret);
+  ret->len = 0;
+  ret->val = NULL;
+
+  if (g->rpc_stats == NULL)
+    return ret;
+
+  for (i = 1; i <= GUESTFS_MAX_PROC_NR; ++i)
+    if (g->rpc_stats[i].name != NULL)
+      ret->len++;
+
+  ret->val = safe_calloc (g, ret->len, sizeof (struct guestfs_rpc_stat));
+
+  for (i = 1, j = 0; i <= GUESTFS_MAX_PROC_NR; ++i) {
+    const struct rpc_stats *st = &g->rpc_stats[i];
+    struct guestfs_rpc_stat *r;
+
+    if (st->name == NULL)
+      continue;
+
+    r = &ret->val[j++];
+    r->rpc_proc = i;
+    r->rpc_name = safe_strdup (g, st->name);
+    r->rpc_calls = st->calls;
+    r->rpc_errors = st->errors;
+    r->rpc_total_usec = st->total_usec;
+    r->rpc_max_usec = st->max_usec;
+    r->rpc_lat_1ms = st->latency[0];
+    r->rpc_lat_10ms = st->latency[1];
+    r->rpc_lat_100ms = st->latency[2];
+    r->rpc_lat_1s = st->latency[3];
+    r->rpc_lat_slow = st->latency[4];
+    r->rpc_bytes_sent = st->bytes_sent;
+    r->rpc_bytes_received = st->bytes_received;
+    r->rpc_chunks_sent = st->chunks_sent;
+    r->rpc_chunks_received = st->chunks_received;
+  }
+
+  return ret;
+}
+
+int
+guestfs__rpc_stats_reset (guestfs_h *g)
+{
+  /* Reset the daemon first, so that call is not left in our stats. */
+  if (g->state == READY && guestfs_internal_rpc_stats_reset (g) == -1)
+    return -1;
+
+  free (g->rpc_stats);
+  g->rpc_stats = NULL;
+  g->rpc_proc = 0;
+
+  return 0;
+}
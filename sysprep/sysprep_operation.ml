@@ -29,6 +29,12 @@ object
   val mutable m_created_file = false
   method created_file () = m_created_file <- true
   method get_created_file = m_created_file
+  val mutable m_removed_globs = []
+  method remove_globs globs = m_removed_globs <- m_removed_globs @ globs
+  method take_removed_globs () =
+    let globs = m_removed_globs in
+    m_removed_globs <- [];
+    globs
 end
 
 class device_side_effects = object end
@@ -291,13 +297,35 @@ let perform_operations_on_filesystems ?operations ~debug ~quiet g root
   (* Perform the operations in alphabetical, rathern than random order. *)
   let ops = List.sort compare_operations ops in
 
+  (* Operations queue the files they want to delete using
+   * side_effects#remove_globs, and these are all removed in a single
+   * call.  The queue is flushed whenever the order changes so that
+   * later operations (eg. customize) don't see, or lose, files
+   * removed by earlier ones.
+   *)
+  let flush_removed_globs () =
+    match side_effects#take_removed_globs () with
+    | [] -> ()
+    | globs ->
+      let n = g#rm_rf_globs (Array.of_list globs) in
+      if debug then
+        eprintf "%d glob(s) matched and removed %d path(s)\n%!"
+          (List.length globs) n
+  in
+
+  let last_order = ref None in
   List.iter (
     function
-    | { name = name; perform_on_filesystems = Some fn } ->
+    | { name = name; order = order; perform_on_filesystems = Some fn } ->
+      if !last_order <> Some order then (
+        flush_removed_globs ();
+        last_order := Some order
+      );
       msg "Performing %S ..." name;
       fn ~debug ~quiet g root side_effects
     | { perform_on_filesystems = None } -> ()
-  ) ops
+  ) ops;
+  flush_removed_globs ()
 
 let perform_operations_on_devices ?operations ~debug ~quiet g root
     side_effects =
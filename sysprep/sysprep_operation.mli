@@ -23,9 +23,16 @@ val prog : string
 class filesystem_side_effects : object
   method created_file : unit -> unit
   method get_created_file : bool
+  method remove_globs : string list -> unit
+  method take_removed_globs : unit -> string list
 end
 (** The callback should indicate if it has side effects by calling
-    methods in this class. *)
+    methods in this class.
+
+    Rather than removing files itself, the callback can pass
+    wildcard patterns to [remove_globs].  Everything matching them is
+    removed (as by [g#rm_rf]) in a single call after all the
+    operations with the same [order] have run. *)
 
 class device_side_effects : object end
 (** There are currently no device side-effects.  For future use. *)
@@ -24,10 +24,7 @@ module G = Guestfs
 let abrt_data_perform ~debug ~quiet g root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = g#glob_expand "/var/spool/abrt/*" in
-    Array.iter (
-      fun path -> g#rm_rf path;
-    ) paths
+    side_effects#remove_globs [ "/var/spool/abrt/*" ]
   )
 
 let op = {
@@ -22,7 +22,7 @@ open Common_gettext.Gettext
 module G = Guestfs
 
 let cron_spool_perform ~debug ~quiet (g : Guestfs.guestfs) root side_effects =
-  Array.iter g#rm_rf (g#glob_expand "/var/spool/cron/*");
+  side_effects#remove_globs [ "/var/spool/cron/*" ];
   Array.iter g#rm (g#glob_expand "/var/spool/atjobs/*");
   Array.iter g#rm (g#glob_expand "/var/spool/atjobs/.SEQ");
   Array.iter g#rm (g#glob_expand "/var/spool/atspool/*");
@@ -24,9 +24,8 @@ module G = Guestfs
 let dhcp_client_state_perform ~debug ~quiet g root side_effects =
   let typ = g#inspect_get_type root in
   if typ = "linux" then (
-    List.iter (
-      fun glob -> Array.iter g#rm_rf (g#glob_expand glob)
-    ) [ "/var/lib/dhclient/*"; "/var/lib/dhcp/*" (* RHEL 3 *) ]
+    side_effects#remove_globs
+      [ "/var/lib/dhclient/*"; "/var/lib/dhcp/*" (* RHEL 3 *) ]
   )
 
 let op = {
@@ -22,7 +22,7 @@ open Common_gettext.Gettext
 module G = Guestfs
 
 let dhcp_server_state_perform ~debug ~quiet g root side_effects =
-  Array.iter g#rm_rf (g#glob_expand "/var/lib/dhcpd/*")
+  side_effects#remove_globs [ "/var/lib/dhcpd/*" ]
 
 let op = {
   defaults with
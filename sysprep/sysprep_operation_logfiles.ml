@@ -131,7 +131,7 @@ let globs_as_pod = String.concat "\n" (List.map ((^) " ") globs)
 let logfiles_perform ~debug ~quiet g root side_effects =
   let typ = g#inspect_get_type root in
   if typ = "linux" then (
-    List.iter (fun glob -> Array.iter g#rm_rf (g#glob_expand glob)) globs
+    side_effects#remove_globs globs
   )
 
 let op = {
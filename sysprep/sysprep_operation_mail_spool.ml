@@ -22,9 +22,7 @@ open Common_gettext.Gettext
 module G = Guestfs
 
 let mail_spool_perform ~debug ~quiet g root side_effects =
-  List.iter (
-    fun glob -> Array.iter g#rm_rf (g#glob_expand glob)
-  ) [
+  side_effects#remove_globs [
     "/var/spool/mail/*";
     "/var/mail/*";
   ]
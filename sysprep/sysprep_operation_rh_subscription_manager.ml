@@ -27,8 +27,8 @@ let rh_subscription_manager_perform ~debug ~quiet g root side_effects =
 
   match typ, distro with
   | "linux", "rhel" ->
-    Array.iter g#rm_rf (g#glob_expand "/etc/pki/consumer/*");
-    Array.iter g#rm_rf (g#glob_expand "/etc/pki/entitlement/*")
+    side_effects#remove_globs [ "/etc/pki/consumer/*";
+                                "/etc/pki/entitlement/*" ]
   | _ -> ()
 
 let op = {
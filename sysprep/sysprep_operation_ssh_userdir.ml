@@ -24,11 +24,7 @@ module G = Guestfs
 let ssh_userdir_perform ~debug ~quiet g root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let dirs = g#glob_expand "/home/*/.ssh" in
-    Array.iter (
-      fun dir -> g#rm_rf dir;
-    ) dirs;
-    g#rm_rf "/root/.ssh"
+    side_effects#remove_globs [ "/home/*/.ssh"; "/root/.ssh" ]
   )
 
 let op = {
@@ -24,23 +24,9 @@ module G = Guestfs
 let tmp_files_perform ~debug ~quiet g root side_effects =
   let typ = g#inspect_get_type root in
   if typ <> "windows" then (
-    let paths = [ "/tmp";
-                  "/var/tmp"; ] in
-    List.iter (
-      fun path ->
-        let files = g#glob_expand (path ^ "/*") in
-        Array.iter (
-          fun file ->
-            g#rm_rf file;
-        ) files;
-        (try
-          let files = g#ls path in
-          Array.iter (
-            fun file ->
-              g#rm_rf (path ^ "/" ^ file);
-          ) files
-        with G.Error _ -> ());
-    ) paths
+    (* ".*" catches the hidden files, "." and ".." are skipped. *)
+    side_effects#remove_globs [ "/tmp/*"; "/tmp/.*";
+                                "/var/tmp/*"; "/var/tmp/.*"; ]
   )
 
 let op = {
@@ -45,6 +45,7 @@
 #define DEFAULT_TIMEOUT 600
 
 static int timeout = DEFAULT_TIMEOUT;
+static int timings = 0;
 
 static void set_qemu (guestfs_h *g, const char *path, int use_wrapper);
 
@@ -61,6 +62,7 @@ usage (void)
             "  --qemu qemu    Specify QEMU binary\n"
             "  --timeout n\n"
             "  -t n           Set launch timeout (default: %d seconds)\n"
+            "  --timings      Display how long each phase of launch took\n"
             "  --version\n"
             "  -V             Display libguestfs version and exit\n"
             ),
@@ -82,6 +84,7 @@ main (int argc, char *argv[])
     { "qemu", 1, 0, 0 },
     { "qemudir", 1, 0, 0 },
     { "timeout", 1, 0, 't' },
+    { "timings", 0, 0, 0 },
     { "version", 0, 0, 'V' },
     { 0, 0, 0, 0 }
   };
@@ -109,6 +112,8 @@ main (int argc, char *argv[])
         qemu = optarg;
         qemu_use_wrapper = 1;
       }
+      else if (STREQ (long_options[option_index].name, "timings"))
+        timings = 1;
       else {
         fprintf (stderr,
                  _("libguestfs-test-tool: unknown long option: %s (%d)\n"),
@@ -280,6 +285,21 @@ main (int argc, char *argv[])
   alarm (0);
 
   printf ("Guest launched OK.\n");
+
+  if (timings) {
+    struct guestfs_launch_timing_list *lt = guestfs_launch_timings (g);
+
+    if (lt == NULL) {
+      fprintf (stderr,
+               _("libguestfs-test-tool: failed to get launch timings\n"));
+      exit (EXIT_FAILURE);
+    }
+    printf ("Launch timings:\n");
+    for (i = 0; i < lt->len; ++i)
+      printf ("  %-12s %8.1f ms\n",
+              lt->val[i].lt_phase, lt->val[i].lt_usec / 1000.0);
+    guestfs_free_launch_timing_list (lt);
+  }
   fflush (stdout);
 
   /* Create the filesystem and mount everything. */
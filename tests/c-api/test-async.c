@@ -0,0 +1,144 @@
+/* libguestfs
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Test the asynchronous call API by driving several appliances from
+ * a single thread with poll(2).
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+
+#include "guestfs.h"
+#include "guestfs-internal-frontend.h"
+
+#define NR_HANDLES 3
+#define NR_ROUNDS 10
+
+int
+main (int argc, char *argv[])
+{
+  guestfs_h *g[NR_HANDLES];
+  int pending[NR_HANDLES];
+  size_t owner[NR_HANDLES * GUESTFS_ASYNC_MAX_FDS];
+  struct pollfd pfds[NR_HANDLES * GUESTFS_ASYNC_MAX_FDS];
+  const char *words[] = { "hello", NULL };
+  size_t i, j, round, nfds, nr_pending;
+  int fds[GUESTFS_ASYNC_MAX_FDS];
+  int r;
+  char *s;
+
+  for (i = 0; i < NR_HANDLES; ++i) {
+    g[i] = guestfs_create ();
+    if (g[i] == NULL) {
+      fprintf (stderr, "failed to create handle\n");
+      exit (EXIT_FAILURE);
+    }
+    if (guestfs_add_drive_scratch (g[i], 1024*1024, -1) == -1)
+      exit (EXIT_FAILURE);
+    if (guestfs_launch (g[i]) == -1)
+      exit (EXIT_FAILURE);
+  }
+
+  for (round = 0; round < NR_ROUNDS; ++round) {
+    for (i = 0; i < NR_HANDLES; ++i) {
+      if (guestfs_echo_daemon_async_send (g[i], (char **) words) == -1)
+        exit (EXIT_FAILURE);
+      pending[i] = 1;
+    }
+    nr_pending = NR_HANDLES;
+
+    while (nr_pending > 0) {
+      nfds = 0;
+      for (i = 0; i < NR_HANDLES; ++i) {
+        if (!pending[i])
+          continue;
+        r = guestfs_async_fds (g[i], fds);
+        if (r == -1)
+          exit (EXIT_FAILURE);
+        for (j = 0; j < (size_t) r; ++j) {
+          pfds[nfds].fd = fds[j];
+          pfds[nfds].events = POLLIN;
+          pfds[nfds].revents = 0;
+          owner[nfds] = i;
+          nfds++;
+        }
+      }
+
+      if (poll (pfds, nfds, -1) == -1) {
+        perror ("poll");
+        exit (EXIT_FAILURE);
+      }
+
+      for (j = 0; j < nfds; ++j) {
+        i = owner[j];
+        if (!pending[i] || (pfds[j].revents & (POLLIN|POLLHUP)) == 0)
+          continue;
+
+        r = guestfs_async_poll (g[i]);
+        if (r == -1)
+          exit (EXIT_FAILURE);
+        if (r == 0)
+          continue;
+
+        s = guestfs_echo_daemon_async_recv (g[i]);
+        if (s == NULL)
+          exit (EXIT_FAILURE);
+        if (STRNEQ (s, "hello")) {
+          fprintf (stderr, "test-async: unexpected reply '%s'\n", s);
+          exit (EXIT_FAILURE);
+        }
+        free (s);
+        pending[i] = 0;
+        nr_pending--;
+      }
+    }
+  }
+
+  /* Errors from the daemon are returned by the _async_recv function. */
+  if (guestfs_mkdir_async_send (g[0], "/no/such/directory") == -1)
+    exit (EXIT_FAILURE);
+
+  /* Synchronous calls are refused while a call is in progress. */
+  guestfs_push_error_handler (g[0], NULL, NULL);
+  if (guestfs_ping_daemon (g[0]) != -1) {
+    fprintf (stderr, "test-async: call while async call in progress did not fail\n");
+    exit (EXIT_FAILURE);
+  }
+  r = guestfs_mkdir_async_recv (g[0]);
+  guestfs_pop_error_handler (g[0]);
+  if (r != -1) {
+    fprintf (stderr, "test-async: mkdir in unmounted filesystem did not fail\n");
+    exit (EXIT_FAILURE);
+  }
+
+  /* The handle can be used normally afterwards. */
+  if (guestfs_ping_daemon (g[0]) == -1)
+    exit (EXIT_FAILURE);
+
+  for (i = 0; i < NR_HANDLES; ++i) {
+    if (guestfs_shutdown (g[i]) == -1)
+      exit (EXIT_FAILURE);
+    guestfs_close (g[i]);
+  }
+
+  exit (EXIT_SUCCESS);
+}
@@ -38,6 +38,10 @@ rm -f disk*.img file:*.img
   disk-create disk10.img qcow2 -1   backingfile:disk2.img backingformat:raw
   disk-create disk11.img qcow2 -1   backingfile:disk4.img backingformat:qcow2
 
+  # Overlays on local absolute paths are created without qemu-img.
+  disk-create disk12.img qcow2 -1   backingfile:$PWD/disk1.img
+  disk-create disk13.img qcow2 -1   backingfile:$PWD/disk4.img backingformat:qcow2
+
   # Some annoying corner-cases in qemu-img.
   disk-create disk:0.img qcow2 256K
   disk-create file:0.img qcow2 256K
@@ -57,6 +61,8 @@ output="$(../../fish/guestfish <<EOF
   disk-format disk9.img
   disk-format disk10.img
   disk-format disk11.img
+  disk-format disk12.img
+  disk-format disk13.img
   disk-format disk:0.img
   disk-format file:0.img
   disk-format disk,0.img
@@ -73,6 +79,8 @@ output="$(../../fish/guestfish <<EOF
   disk-has-backing-file disk9.img
   disk-has-backing-file disk10.img
   disk-has-backing-file disk11.img
+  disk-has-backing-file disk12.img
+  disk-has-backing-file disk13.img
   disk-has-backing-file disk:0.img
   disk-has-backing-file file:0.img
   disk-has-backing-file disk,0.img
@@ -89,6 +97,8 @@ output="$(../../fish/guestfish <<EOF
   disk-virtual-size disk9.img
   disk-virtual-size disk10.img
   disk-virtual-size disk11.img
+  disk-virtual-size disk12.img
+  disk-virtual-size disk13.img
   disk-virtual-size disk:0.img
   disk-virtual-size file:0.img
   disk-virtual-size disk,0.img
@@ -111,6 +121,8 @@ qcow2
 qcow2
 qcow2
 qcow2
+qcow2
+qcow2
 false
 false
 false
@@ -122,6 +134,8 @@ false
 true
 true
 true
+true
+true
 false
 false
 false
@@ -140,10 +154,19 @@ false
 262144
 262144
 262144
+262144
+262144
 262144" ]; then
     echo "$0: unexpected output:"
     echo "$output"
     exit 1
 fi
 
+# Check the images created without qemu-img are valid.
+if qemu-img --help >/dev/null 2>&1; then
+    for f in disk4.img disk12.img disk13.img; do
+        qemu-img check $f
+    done
+fi
+
 rm disk*.img file:*.img
@@ -0,0 +1,96 @@
+#!/usr/bin/perl
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Test hot-adding several disks at once with add_drives.
+
+use strict;
+use warnings;
+
+use Sys::Guestfs;
+
+my $g = Sys::Guestfs->new ();
+
+# Skip the test if the default backend isn't libvirt, since only
+# the libvirt backend supports hotplugging.
+my $backend = $g->get_backend ();
+unless ($backend eq "libvirt" || $backend =~ /^libvirt:/) {
+    print "$0: test skipped because backend ($backend) is not libvirt\n";
+    exit 77
+}
+
+# Create some temporary disks.
+$g->disk_create ("test-hot-add-drives-1.img", "raw", 512 * 1024 * 1024);
+$g->disk_create ("test-hot-add-drives-2.img", "raw", 512 * 1024 * 1024);
+$g->disk_create ("test-hot-add-drives-3.img", "raw", 512 * 1024 * 1024);
+$g->disk_create ("test-hot-add-drives-4.img", "raw", 512 * 1024 * 1024);
+
+# Before launch, add_drives adds the drives as usual.
+$g->add_drives (["test-hot-add-drives-1.img"], ["a"], format => "raw");
+
+$g->launch ();
+
+# The lists must be the same length.
+eval {
+    $g->add_drives (["test-hot-add-drives-2.img",
+                     "test-hot-add-drives-3.img"], ["b"]);
+};
+die "$0: add_drives with mismatched lists did not fail\n" unless $@;
+
+# Hot-add a batch of drives.
+$g->add_drives (["test-hot-add-drives-2.img", "test-hot-add-drives-3.img"],
+                ["b", "c"], format => "raw");
+
+# Check we can use the disks immediately, using their labels.
+$g->part_disk ("/dev/disk/guestfs/b", "mbr");
+$g->mkfs ("ext2", "/dev/disk/guestfs/c");
+$g->mkfs ("ext2", "/dev/disk/guestfs/b1");
+$g->mkfs ("ext2", "/dev/disk/guestfs/a");
+
+my @devices = $g->list_devices ();
+die "$0: expected 3 devices, got ", scalar (@devices), "\n"
+    unless 3 == @devices;
+
+# If one drive in the batch cannot be added, the drives before it
+# are added (and usable), and the ones after it are not.
+eval {
+    $g->add_drives (["test-hot-add-drives-4.img",
+                     "test-hot-add-drives-missing.img",
+                     "test-hot-add-drives-1.img"],
+                    ["d", "e", "f"], format => "raw");
+};
+die "$0: add_drives with a missing file did not fail\n" unless $@;
+
+$g->mkfs ("ext2", "/dev/disk/guestfs/d");
+my %labels = $g->list_disk_labels ();
+die "$0: drive 'e' should not have been added\n"
+    if exists $labels{e};
+die "$0: drive 'f' should not have been added\n"
+    if exists $labels{f};
+
+@devices = $g->list_devices ();
+die "$0: expected 4 devices, got ", scalar (@devices), "\n"
+    unless 4 == @devices;
+
+$g->shutdown ();
+$g->close ();
+
+unlink "test-hot-add-drives-1.img";
+unlink "test-hot-add-drives-2.img";
+unlink "test-hot-add-drives-3.img";
+unlink "test-hot-add-drives-4.img";
+
+exit 0
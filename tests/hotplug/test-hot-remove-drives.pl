@@ -0,0 +1,115 @@
+#!/usr/bin/perl
+# Copyright (C) 2014 Red Hat Inc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Test hot-removing several disks at once with remove_drives.
+
+use strict;
+use warnings;
+
+use Sys::Guestfs;
+
+my $g = Sys::Guestfs->new ();
+
+# Skip the test if the default backend isn't libvirt, since only
+# the libvirt backend supports hotplugging.
+my $backend = $g->get_backend ();
+unless ($backend eq "libvirt" || $backend =~ /^libvirt:/) {
+    print "$0: test skipped because backend ($backend) is not libvirt\n";
+    exit 77
+}
+
+# Create some temporary disks.
+$g->disk_create ("test-hot-remove-drives-1.img", "raw", 512 * 1024 * 1024);
+$g->disk_create ("test-hot-remove-drives-2.img", "raw", 512 * 1024 * 1024);
+$g->disk_create ("test-hot-remove-drives-3.img", "raw", 512 * 1024 * 1024);
+
+my @images = ("test-hot-remove-drives-1.img",
+              "test-hot-remove-drives-2.img",
+              "test-hot-remove-drives-3.img");
+
+# Add and remove them before launch.
+$g->add_drives (\@images, ["a", "b", "c"], format => "raw");
+$g->remove_drives (["a", "c"]);
+$g->remove_drives (["b"]);
+
+$g->launch ();
+
+# There should be no drives yet.
+my @devices = $g->list_devices ();
+die "$0: expected no devices, got ", scalar (@devices), "\n"
+    unless 0 == @devices;
+
+# Hot-add them again.
+$g->add_drives (\@images, ["a", "b", "c"], format => "raw");
+$g->mkfs ("ext2", "/dev/disk/guestfs/a");
+$g->mkfs ("ext2", "/dev/disk/guestfs/b");
+
+# If any label is not found, nothing is removed.
+eval { $g->remove_drives (["a", "nosuchlabel"]) };
+die "$0: remove_drives with an unknown label did not fail\n" unless $@;
+my %labels = $g->list_disk_labels ();
+die "$0: drive 'a' was removed after an error\n"
+    unless exists $labels{a};
+
+# A label given twice is an error, and nothing is removed.
+eval { $g->remove_drives (["a", "a"]) };
+die "$0: remove_drives with a repeated label did not fail\n" unless $@;
+%labels = $g->list_disk_labels ();
+die "$0: drive 'a' was removed after an error\n"
+    unless exists $labels{a};
+
+# If any of the disks is in use, nothing is removed.
+$g->mount ("/dev/disk/guestfs/b", "/");
+eval { $g->remove_drives (["a", "b"]) };
+die "$0: remove_drives of a mounted disk did not fail\n" unless $@;
+%labels = $g->list_disk_labels ();
+die "$0: drive 'a' was removed after an error\n"
+    unless exists $labels{a};
+die "$0: drive 'b' was removed after an error\n"
+    unless exists $labels{b};
+$g->umount_all ();
+
+@devices = $g->list_devices ();
+die "$0: expected 3 devices, got ", scalar (@devices), "\n"
+    unless 3 == @devices;
+
+# Remove a batch (hotplug this time).
+$g->remove_drives (["a", "c"]);
+%labels = $g->list_disk_labels ();
+die "$0: drive 'a' was not removed\n"
+    if exists $labels{a};
+die "$0: drive 'c' was not removed\n"
+    if exists $labels{c};
+
+# The remaining drive is still usable.
+$g->mkfs ("ext2", "/dev/disk/guestfs/b");
+
+$g->remove_drives (["b"]);
+
+# There should be no drives remaining.
+@devices = $g->list_devices ();
+die "$0: expected no devices, got ", scalar (@devices), "\n"
+    unless 0 == @devices;
+
+$g->shutdown ();
+$g->close ();
+
+unlink "test-hot-remove-drives-1.img";
+unlink "test-hot-remove-drives-2.img";
+unlink "test-hot-remove-drives-3.img";
+
+exit 0
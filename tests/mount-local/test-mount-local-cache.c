@@ -0,0 +1,317 @@
+/* libguestfs
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Test the mount-local directory caches (src/fuse.c) when they are
+ * smaller than the tree being read, so that entries are evicted, and
+ * check that stat and readdir results stay correct.  The number of
+ * readdir calls which reach the daemon is counted using trace events
+ * to check that read-only listings are cached, and that they are
+ * evicted when the cache is full.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <error.h>
+
+#include "guestfs.h"
+#include "guestfs-internal-frontend.h"
+
+#define MP "mp-cache"
+
+#define NR_DIRS 40
+#define NR_FILES 10
+#define NR_PASSES 3
+
+/* Smaller than the number of directories, and than the number of
+ * files, so that every cache has to evict entries.
+ */
+#define SMALL_CACHE 16
+
+static void test_mountpoint (const char *mp, int readonly);
+static size_t run_test (guestfs_h *g, int readonly, int cachemaxentries);
+
+/* Size of file 'f' in directory 'd'.  In read-write mode the test
+ * changes the sizes in every pass.
+ */
+static off_t
+file_size (int d, int f, int pass)
+{
+  return d * NR_FILES + f + 1 + pass * 1000;
+}
+
+int
+main (int argc, char *argv[])
+{
+  guestfs_h *g;
+  char *skip;
+  char path[64];
+  int d, f;
+  size_t n;
+
+  /* If the --test flag is given, then this is the test subprocess. */
+  if (argc == 4 && STREQ (argv[1], "--test")) {
+    test_mountpoint (argv[2], STREQ (argv[3], "ro"));
+    exit (EXIT_SUCCESS);
+  }
+
+  /* Allow the test to be skipped by setting an environment variable. */
+  skip = getenv ("SKIP_TEST_MOUNT_LOCAL_CACHE");
+  if (skip && STREQ (skip, "1")) {
+    fprintf (stderr, "%s: test skipped because environment variable set.\n",
+             program_name);
+    exit (77);
+  }
+
+  if (access ("/dev/fuse", W_OK) == -1) {
+    fprintf (stderr, "%s: test skipped because /dev/fuse is not writable.\n",
+             program_name);
+    exit (77);
+  }
+
+  g = guestfs_create ();
+  if (g == NULL)
+    error (EXIT_FAILURE, errno, "guestfs_create");
+
+  if (guestfs_add_drive_scratch (g, 64*1024*1024, -1) == -1 ||
+      guestfs_launch (g) == -1 ||
+      guestfs_part_disk (g, "/dev/sda", "mbr") == -1 ||
+      guestfs_mkfs (g, "ext2", "/dev/sda1") == -1 ||
+      guestfs_mount (g, "/dev/sda1", "/") == -1)
+    exit (EXIT_FAILURE);
+
+  for (d = 0; d < NR_DIRS; ++d) {
+    snprintf (path, sizeof path, "/d%d", d);
+    if (guestfs_mkdir (g, path) == -1)
+      exit (EXIT_FAILURE);
+    for (f = 0; f < NR_FILES; ++f) {
+      snprintf (path, sizeof path, "/d%d/f%d", d, f);
+      if (guestfs_touch (g, path) == -1 ||
+          guestfs_truncate_size (g, path, file_size (d, f, 0)) == -1)
+        exit (EXIT_FAILURE);
+    }
+  }
+
+  rmdir (MP);
+  if (mkdir (MP, 0700) == -1)
+    error (EXIT_FAILURE, errno, "mkdir: %s", MP);
+
+  /* Read-only, default cache size: each listing is read once. */
+  n = run_test (g, 1, 0);
+  if (n != NR_DIRS) {
+    fprintf (stderr, "%s: read-only: expected %d readdir calls, got %zu\n",
+             program_name, NR_DIRS, n);
+    exit (EXIT_FAILURE);
+  }
+
+  /* Read-only, small cache: reading the directories in order evicts
+   * every listing before it is used again.
+   */
+  n = run_test (g, 1, SMALL_CACHE);
+  if (n < NR_DIRS * NR_PASSES) {
+    fprintf (stderr, "%s: read-only, small cache: expected at least %d readdir calls, got %zu\n",
+             program_name, NR_DIRS * NR_PASSES, n);
+    exit (EXIT_FAILURE);
+  }
+
+  /* Read-write, small cache, changing the files as we go. */
+  run_test (g, 0, SMALL_CACHE);
+
+  rmdir (MP);
+
+  if (guestfs_shutdown (g) == -1)
+    exit (EXIT_FAILURE);
+  guestfs_close (g);
+
+  exit (EXIT_SUCCESS);
+}
+
+static size_t nr_readdirs;
+
+static void
+count_readdirs (guestfs_h *g, void *opaque, uint64_t event, int event_handle,
+                int flags, const char *buf, size_t buf_len,
+                const uint64_t *array, size_t array_len)
+{
+  /* Calls are traced as 'readdir "/path"', and returns as
+   * 'readdir = ...'.
+   */
+  if (buf_len >= 9 && STRPREFIX (buf, "readdir \""))
+    nr_readdirs++;
+}
+
+/* Mount the filesystem, run the test in a subprocess, and return the
+ * number of readdir calls made by mount-local.  If 'cachemaxentries'
+ * is 0, the default is used.
+ */
+static size_t
+run_test (guestfs_h *g, int readonly, int cachemaxentries)
+{
+  pid_t pid;
+  int eh, status, r;
+
+  if (cachemaxentries > 0)
+    r = guestfs_mount_local (g, MP,
+                             GUESTFS_MOUNT_LOCAL_READONLY, readonly,
+                             GUESTFS_MOUNT_LOCAL_CACHEMAXENTRIES,
+                             cachemaxentries,
+                             -1);
+  else
+    r = guestfs_mount_local (g, MP,
+                             GUESTFS_MOUNT_LOCAL_READONLY, readonly,
+                             -1);
+  if (r == -1)
+    exit (EXIT_FAILURE);
+
+  /* Run the test in an exec'd subprocess, see
+   * test-parallel-mount-local.c.
+   */
+  pid = fork ();
+  if (pid == -1)
+    error (EXIT_FAILURE, errno, "fork");
+  if (pid == 0) {               /* child */
+    execlp ("./test-mount-local-cache", "test-mount-local-cache",
+            "--test", MP, readonly ? "ro" : "rw", NULL);
+    perror ("execlp");
+    _exit (EXIT_FAILURE);
+  }
+
+  nr_readdirs = 0;
+  eh = guestfs_set_event_callback (g, count_readdirs, GUESTFS_EVENT_TRACE,
+                                   0, NULL);
+  if (eh == -1)
+    exit (EXIT_FAILURE);
+  guestfs_set_trace (g, 1);
+
+  r = guestfs_mount_local_run (g);
+
+  guestfs_set_trace (g, 0);
+  guestfs_delete_event_callback (g, eh);
+
+ again:
+  if (waitpid (pid, &status, 0) == -1) {
+    if (errno == EINTR)
+      goto again;
+    error (EXIT_FAILURE, errno, "waitpid");
+  }
+  if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+    char status_string[80];
+
+    fprintf (stderr, "%s: %s\n", program_name,
+             guestfs___exit_status_to_string (status, "test",
+                                              status_string,
+                                              sizeof status_string));
+    exit (EXIT_FAILURE);
+  }
+
+  if (r == -1)
+    exit (EXIT_FAILURE);
+
+  return nr_readdirs;
+}
+
+/* Check one directory listing. */
+static int
+check_dir (const char *path)
+{
+  DIR *dir;
+  struct dirent *d;
+  int seen[NR_FILES] = { 0 };
+  int f, n = 0;
+
+  dir = opendir (path);
+  if (dir == NULL) {
+    perror (path);
+    return -1;
+  }
+  while ((d = readdir (dir)) != NULL) {
+    if (STREQ (d->d_name, ".") || STREQ (d->d_name, ".."))
+      continue;
+    if (sscanf (d->d_name, "f%d", &f) != 1 || f < 0 || f >= NR_FILES ||
+        seen[f]) {
+      fprintf (stderr, "%s: unexpected entry %s\n", path, d->d_name);
+      closedir (dir);
+      return -1;
+    }
+    seen[f] = 1;
+    n++;
+  }
+  closedir (dir);
+
+  if (n != NR_FILES) {
+    fprintf (stderr, "%s: expected %d entries, got %d\n", path, NR_FILES, n);
+    return -1;
+  }
+  return 0;
+}
+
+/* This runs as a subprocess and must test the mountpoint at 'mp'. */
+static void
+test_mountpoint (const char *mp, int readonly)
+{
+  char path[256], cmd[256];
+  struct stat statbuf;
+  int ret = EXIT_FAILURE;
+  int pass, d, f;
+
+  for (pass = 0; pass < NR_PASSES; ++pass) {
+    for (d = 0; d < NR_DIRS; ++d) {
+      snprintf (path, sizeof path, "%s/d%d", mp, d);
+      if (check_dir (path) == -1)
+        goto error;
+
+      for (f = 0; f < NR_FILES; ++f) {
+        snprintf (path, sizeof path, "%s/d%d/f%d", mp, d, f);
+        if (stat (path, &statbuf) == -1) {
+          perror (path);
+          goto error;
+        }
+        if (statbuf.st_size != file_size (d, f, readonly ? 0 : pass)) {
+          fprintf (stderr, "%s: expected size %jd, got %jd\n", path,
+                   (intmax_t) file_size (d, f, readonly ? 0 : pass),
+                   (intmax_t) statbuf.st_size);
+          goto error;
+        }
+
+        /* The change must invalidate the cached attributes. */
+        if (!readonly &&
+            truncate (path, file_size (d, f, pass+1)) == -1) {
+          perror (path);
+          goto error;
+        }
+      }
+    }
+  }
+
+  ret = EXIT_SUCCESS;
+ error:
+  snprintf (cmd, sizeof cmd, "../../fuse/guestunmount %s", mp);
+  if (system (cmd) != 0)
+    error (EXIT_FAILURE, 0, "guestunmount %s: failed, see earlier errors", mp);
+
+  exit (ret);
+}
@@ -0,0 +1,688 @@
+/* libguestfs
+ * Copyright (C) 2014 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Performance benchmarks.  This is not a pass/fail test: it measures
+ * launch time, RPC latency, guestfish remote control, transfer and
+ * compression throughput, mount-local reads, inspection and parallel
+ * scaling, and prints one result per line:
+ *
+ *   <name> <tab> <value> <tab> <unit>
+ *
+ * so that results from different versions can be compared easily.
+ * Run it using 'make check-perf' from the top level directory.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <error.h>
+
+#include <pthread.h>
+
+#include "guestfs.h"
+#include "guestfs-internal-frontend.h"
+#include "estimate-max-threads.h"
+
+#include "ignore-value.h"
+
+#define GUEST "../guests/fedora.img"
+
+#define WARM_LAUNCHES 5
+#define RPC_CALLS 2000
+#define REMOTE_CLIENTS 100
+#define REMOTE_CALLS 2000
+#define TRANSFER_MB 256
+#define COMPRESS_MB 128
+#define MAX_COMPRESS_SMP 4
+#define PARALLEL_RPC_CALLS 500
+#define MAX_PARALLEL 16
+
+static void test_launch (void);
+static void test_appliance_stamp (const char *cachedir);
+static void test_rpc (guestfs_h *g);
+static void test_remote (void);
+static void test_transfer (guestfs_h *g);
+static void test_compress (void);
+static void test_mount_local (guestfs_h *g);
+static void test_inspect (void);
+static void test_parallel (void);
+static void read_file (const char *mp, const char *filename);
+
+/* Print one result. */
+static void
+result (const char *name, double value, const char *unit)
+{
+  printf ("%s\t%.3f\t%s\n", name, value, unit);
+  fflush (stdout);
+}
+
+/* Current time in milliseconds. */
+static double
+now_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int
+compare_doubles (const void *av, const void *bv)
+{
+  double a = * (const double *) av, b = * (const double *) bv;
+
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static guestfs_h *
+create_handle (void)
+{
+  guestfs_h *g;
+
+  g = guestfs_create ();
+  if (g == NULL)
+    error (EXIT_FAILURE, errno, "guestfs_create");
+  return g;
+}
+
+/* Create a handle with a scratch disk containing a mounted
+ * filesystem big enough for the transfer tests.
+ */
+static guestfs_h *
+create_scratch_handle (void)
+{
+  guestfs_h *g = create_handle ();
+
+  if (guestfs_add_drive_scratch (g, (TRANSFER_MB + 256) * INT64_C (1048576),
+                                 -1) == -1 ||
+      guestfs_launch (g) == -1 ||
+      guestfs_mkfs (g, "ext4", "/dev/sda") == -1 ||
+      guestfs_mount (g, "/dev/sda", "/") == -1)
+    exit (EXIT_FAILURE);
+  return g;
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *skip;
+  guestfs_h *g;
+
+  /* If the --read flag is given, then this is the mount-local
+   * reader subprocess.
+   */
+  if (argc == 4 && STREQ (argv[1], "--read")) {
+    read_file (argv[2], argv[3]);
+    exit (EXIT_SUCCESS);
+  }
+
+  /* Allow the test to be skipped by setting an environment variable. */
+  skip = getenv ("SKIP_TEST_PERF");
+  if (skip && STREQ (skip, "1")) {
+    fprintf (stderr, "%s: test skipped because environment variable set.\n",
+             program_name);
+    exit (77);
+  }
+
+  if (access (GUEST, R_OK) == -1) {
+    fprintf (stderr, "%s: test skipped because %s is missing.\n",
+             program_name, GUEST);
+    exit (77);
+  }
+
+  test_launch ();
+  test_remote ();
+
+  g = create_scratch_handle ();
+  test_rpc (g);
+  test_transfer (g);
+  test_mount_local (g);
+  if (guestfs_shutdown (g) == -1)
+    exit (EXIT_FAILURE);
+  guestfs_close (g);
+
+  test_compress ();
+  test_inspect ();
+  test_parallel ();
+
+  exit (EXIT_SUCCESS);
+}
+
+/* Cold launch uses an empty cache directory, so the appliance has to
+ * be built and qemu has to be probed.  Warm launches reuse it.
+ */
+static void
+test_launch (void)
+{
+  char cachedir[] = "perf-cache.XXXXXX";
+  char cmd[64];
+  double times[WARM_LAUNCHES], start;
+  guestfs_h *g;
+  struct guestfs_launch_timing_list *timings = NULL;
+  size_t i;
+
+  if (mkdtemp (cachedir) == NULL)
+    error (EXIT_FAILURE, errno, "mkdtemp");
+
+  for (i = 0; i <= WARM_LAUNCHES; ++i) {
+    g = create_handle ();
+    if (guestfs_set_cachedir (g, cachedir) == -1 ||
+        guestfs_add_drive_ro (g, GUEST) == -1)
+      exit (EXIT_FAILURE);
+    start = now_ms ();
+    if (guestfs_launch (g) == -1)
+      exit (EXIT_FAILURE);
+    if (i == 0)
+      result ("launch_cold", now_ms () - start, "ms");
+    else
+      times[i-1] = now_ms () - start;
+
+    if (i == WARM_LAUNCHES) {
+      timings = guestfs_launch_timings (g);
+      if (timings == NULL)
+        exit (EXIT_FAILURE);
+    }
+
+    if (guestfs_shutdown (g) == -1)
+      exit (EXIT_FAILURE);
+    guestfs_close (g);
+  }
+
+  qsort (times, WARM_LAUNCHES, sizeof times[0], compare_doubles);
+  result ("launch_warm_median", times[WARM_LAUNCHES/2], "ms");
+  result ("launch_warm_min", times[0], "ms");
+
+  /* Break down the last warm launch. */
+  for (i = 0; i < timings->len; ++i) {
+    char name[64];
+
+    snprintf (name, sizeof name, "launch_phase_%s", timings->val[i].lt_phase);
+    result (name, timings->val[i].lt_usec / 1000.0, "ms");
+  }
+  guestfs_free_launch_timing_list (timings);
+
+  test_appliance_stamp (cachedir);
+
+  snprintf (cmd, sizeof cmd, "rm -rf %s", cachedir);
+  ignore_value (system (cmd));
+}
+
+/* Time taken to check or rebuild the supermin appliance, with and
+ * without the stamp which lets us skip running supermin (see
+ * src/appliance.c).  Removing the stamp makes launch run
+ * 'supermin --build --if-newer', which finds that the appliance is
+ * up to date, as it did before the stamp was added.  The two cases
+ * are interleaved so that they see the same host page cache.
+ */
+static void
+test_appliance_stamp (const char *cachedir)
+{
+  char stamp[256];
+  double hit[WARM_LAUNCHES] = { 0 }, miss[WARM_LAUNCHES] = { 0 };
+  guestfs_h *g;
+  struct guestfs_launch_timing_list *timings;
+  size_t i, j;
+  int remove_stamp;
+
+  snprintf (stamp, sizeof stamp, "%s/.guestfs-%d/appliance.stamp",
+            cachedir, (int) geteuid ());
+
+  for (i = 0; i < 2 * WARM_LAUNCHES; ++i) {
+    remove_stamp = i & 1;
+    if (remove_stamp)
+      unlink (stamp);
+
+    g = create_handle ();
+    if (guestfs_set_cachedir (g, cachedir) == -1 ||
+        guestfs_add_drive_ro (g, GUEST) == -1 ||
+        guestfs_launch (g) == -1)
+      exit (EXIT_FAILURE);
+    timings = guestfs_launch_timings (g);
+    if (timings == NULL)
+      exit (EXIT_FAILURE);
+    for (j = 0; j < timings->len; ++j) {
+      if (STREQ (timings->val[j].lt_phase, "appliance")) {
+        if (remove_stamp)
+          miss[i/2] = timings->val[j].lt_usec / 1000.0;
+        else
+          hit[i/2] = timings->val[j].lt_usec / 1000.0;
+      }
+    }
+    guestfs_free_launch_timing_list (timings);
+
+    if (guestfs_shutdown (g) == -1)
+      exit (EXIT_FAILURE);
+    guestfs_close (g);
+  }
+
+  qsort (hit, WARM_LAUNCHES, sizeof hit[0], compare_doubles);
+  qsort (miss, WARM_LAUNCHES, sizeof miss[0], compare_doubles);
+  result ("appliance_stamp_hit_median", hit[WARM_LAUNCHES/2], "ms");
+  result ("appliance_stamp_miss_median", miss[WARM_LAUNCHES/2], "ms");
+}
+
+/* Small RPC round trip. */
+static void
+test_rpc (guestfs_h *g)
+{
+  double start, elapsed;
+  size_t i;
+
+  start = now_ms ();
+  for (i = 0; i < RPC_CALLS; ++i) {
+    if (guestfs_ping_daemon (g) == -1)
+      exit (EXIT_FAILURE);
+  }
+  elapsed = now_ms () - start;
+
+  result ("rpc_latency", elapsed * 1000.0 / RPC_CALLS, "us");
+  result ("rpc_calls_per_sec", RPC_CALLS * 1000.0 / elapsed, "calls/s");
+}
+
+/* guestfish --remote commands per second, starting one client for
+ * each command and sending a whole script through one client, which
+ * keeps its connection to the server open (see fish/rc.c).  The
+ * command doesn't need the appliance, so this only measures the
+ * remote control overhead.
+ */
+static void
+test_remote (void)
+{
+  char script[] = "perf-script.XXXXXX";
+  char cmd[256];
+  FILE *fp;
+  double start;
+  size_t i;
+  int fd, pid;
+
+  fp = popen ("guestfish --listen", "r");
+  if (fp == NULL)
+    error (EXIT_FAILURE, errno, "popen: guestfish --listen");
+  if (fscanf (fp, "GUESTFISH_PID=%d", &pid) != 1)
+    error (EXIT_FAILURE, 0, "could not parse the output of guestfish --listen");
+  if (pclose (fp) != 0)
+    error (EXIT_FAILURE, 0, "guestfish --listen failed");
+
+  fd = mkstemp (script);
+  if (fd == -1)
+    error (EXIT_FAILURE, errno, "mkstemp");
+  fp = fdopen (fd, "w");
+  if (fp == NULL)
+    error (EXIT_FAILURE, errno, "fdopen: %s", script);
+  for (i = 0; i < REMOTE_CALLS; ++i)
+    fprintf (fp, "get-verbose\n");
+  if (fclose (fp) == EOF)
+    error (EXIT_FAILURE, errno, "fclose: %s", script);
+
+  snprintf (cmd, sizeof cmd,
+            "guestfish --remote=%d get-verbose >/dev/null", pid);
+  start = now_ms ();
+  for (i = 0; i < REMOTE_CLIENTS; ++i) {
+    if (system (cmd) != 0)
+      error (EXIT_FAILURE, 0, "%s: failed", cmd);
+  }
+  result ("remote_cmds_per_sec_one_per_client",
+          REMOTE_CLIENTS * 1000.0 / (now_ms () - start), "cmds/s");
+
+  snprintf (cmd, sizeof cmd,
+            "guestfish --remote=%d -f %s >/dev/null", pid, script);
+  start = now_ms ();
+  if (system (cmd) != 0)
+    error (EXIT_FAILURE, 0, "%s: failed", cmd);
+  result ("remote_cmds_per_sec_one_client",
+          REMOTE_CALLS * 1000.0 / (now_ms () - start), "cmds/s");
+
+  unlink (script);
+  snprintf (cmd, sizeof cmd, "guestfish --remote=%d exit", pid);
+  if (system (cmd) != 0)
+    error (EXIT_FAILURE, 0, "%s: failed", cmd);
+}
+
+/* Upload, download and tar-out throughput.  This leaves /file in
+ * the filesystem for test_mount_local.
+ */
+static void
+test_transfer (guestfs_h *g)
+{
+  char tmpfile[] = "perf-file.XXXXXX";
+  char buf[65536];
+  double start;
+  size_t i, j;
+  int fd;
+
+  fd = mkstemp (tmpfile);
+  if (fd == -1)
+    error (EXIT_FAILURE, errno, "mkstemp");
+  for (i = 0; i < TRANSFER_MB * 16; ++i) {
+    /* Data which doesn't compress to nothing. */
+    for (j = 0; j < sizeof buf; ++j)
+      buf[j] = random ();
+    if (write (fd, buf, sizeof buf) != (ssize_t) sizeof buf)
+      error (EXIT_FAILURE, errno, "write: %s", tmpfile);
+  }
+  if (close (fd) == -1)
+    error (EXIT_FAILURE, errno, "close: %s", tmpfile);
+
+  start = now_ms ();
+  if (guestfs_upload (g, tmpfile, "/file") == -1 ||
+      guestfs_sync (g) == -1)
+    exit (EXIT_FAILURE);
+  result ("upload", TRANSFER_MB * 1000.0 / (now_ms () - start), "MB/s");
+  unlink (tmpfile);
+
+  if (guestfs_drop_caches (g, 3) == -1)
+    exit (EXIT_FAILURE);
+  start = now_ms ();
+  if (guestfs_download (g, "/file", "/dev/null") == -1)
+    exit (EXIT_FAILURE);
+  result ("download", TRANSFER_MB * 1000.0 / (now_ms () - start), "MB/s");
+
+  if (guestfs_drop_caches (g, 3) == -1)
+    exit (EXIT_FAILURE);
+  start = now_ms ();
+  if (guestfs_tar_out (g, "/", "/dev/null") == -1)
+    exit (EXIT_FAILURE);
+  result ("tar_out", TRANSFER_MB * 1000.0 / (now_ms () - start), "MB/s");
+}
+
+/* tar-out and compress-out throughput for the compression types
+ * which can use several vCPUs in the appliance (pigz for gzip, and
+ * threads for xz and zstd), so the appliance is given up to
+ * MAX_COMPRESS_SMP of them.  The data is random letters, which
+ * compresses to about half its size.
+ */
+static void
+test_compress (void)
+{
+  static const char *ctypes[] = { "gzip", "xz", "zstd", NULL };
+  char tmpfile[] = "perf-file.XXXXXX";
+  char buf[65536], name[64];
+  guestfs_h *g;
+  double start;
+  long smp;
+  size_t i, j;
+  int fd;
+
+  smp = sysconf (_SC_NPROCESSORS_ONLN);
+  if (smp < 1)
+    smp = 1;
+  if (smp > MAX_COMPRESS_SMP)
+    smp = MAX_COMPRESS_SMP;
+
+  fd = mkstemp (tmpfile);
+  if (fd == -1)
+    error (EXIT_FAILURE, errno, "mkstemp");
+  for (i = 0; i < COMPRESS_MB * 16; ++i) {
+    for (j = 0; j < sizeof buf; ++j)
+      buf[j] = 'a' + random () % 16;
+    if (write (fd, buf, sizeof buf) != (ssize_t) sizeof buf)
+      error (EXIT_FAILURE, errno, "write: %s", tmpfile);
+  }
+  if (close (fd) == -1)
+    error (EXIT_FAILURE, errno, "close: %s", tmpfile);
+
+  g = create_handle ();
+  if (guestfs_set_smp (g, smp) == -1 ||
+      guestfs_add_drive_scratch (g, (COMPRESS_MB + 256) * INT64_C (1048576),
+                                 -1) == -1 ||
+      guestfs_launch (g) == -1 ||
+      guestfs_mkfs (g, "ext4", "/dev/sda") == -1 ||
+      guestfs_mount (g, "/dev/sda", "/") == -1 ||
+      guestfs_upload (g, tmpfile, "/file") == -1 ||
+      guestfs_sync (g) == -1)
+    exit (EXIT_FAILURE);
+  unlink (tmpfile);
+  result ("compress_smp", smp, "vCPUs");
+
+  for (i = 0; ctypes[i] != NULL; ++i) {
+    if (guestfs_drop_caches (g, 3) == -1)
+      exit (EXIT_FAILURE);
+    start = now_ms ();
+    if (guestfs_tar_out_opts (g, "/", "/dev/null",
+                              GUESTFS_TAR_OUT_OPTS_COMPRESS, ctypes[i],
+                              -1) == -1)
+      exit (EXIT_FAILURE);
+    snprintf (name, sizeof name, "tar_out_%s", ctypes[i]);
+    result (name, COMPRESS_MB * 1000.0 / (now_ms () - start), "MB/s");
+
+    if (guestfs_drop_caches (g, 3) == -1)
+      exit (EXIT_FAILURE);
+    start = now_ms ();
+    if (guestfs_compress_out (g, ctypes[i], "/file", "/dev/null", -1) == -1)
+      exit (EXIT_FAILURE);
+    snprintf (name, sizeof name, "compress_out_%s", ctypes[i]);
+    result (name, COMPRESS_MB * 1000.0 / (now_ms () - start), "MB/s");
+  }
+
+  if (guestfs_shutdown (g) == -1)
+    exit (EXIT_FAILURE);
+  guestfs_close (g);
+}
+
+/* Sequential read of /file through mount-local.  The reads happen in
+ * an exec'd subprocess (see tests/mount-local) which prints the
+ * result and unmounts the filesystem.
+ */
+static void
+test_mount_local (guestfs_h *g)
+{
+  char mp[] = "perf-mp.XXXXXX";
+  pid_t pid;
+  int status, r;
+
+  if (access ("/dev/fuse", W_OK) == -1) {
+    fprintf (stderr, "%s: mount-local test skipped because /dev/fuse is not writable.\n",
+             program_name);
+    return;
+  }
+
+  if (mkdtemp (mp) == NULL)
+    error (EXIT_FAILURE, errno, "mkdtemp");
+
+  if (guestfs_drop_caches (g, 3) == -1 ||
+      guestfs_mount_local (g, mp, -1) == -1)
+    exit (EXIT_FAILURE);
+
+  pid = fork ();
+  if (pid == -1)
+    error (EXIT_FAILURE, errno, "fork");
+  if (pid == 0) {               /* child */
+    execlp ("./test-perf", "test-perf", "--read", mp, "file", NULL);
+    perror ("execlp");
+    _exit (EXIT_FAILURE);
+  }
+
+  r = guestfs_mount_local_run (g);
+
+  if (waitpid (pid, &status, 0) == -1)
+    error (EXIT_FAILURE, errno, "waitpid");
+  if (r == -1 || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    exit (EXIT_FAILURE);
+
+  rmdir (mp);
+}
+
+static void
+read_file (const char *mp, const char *filename)
+{
+  CLEANUP_FREE char *path = NULL;
+  char cmd[256];
+  char buf[131072];
+  double start;
+  ssize_t r;
+  int64_t total = 0;
+  int fd;
+
+  if (asprintf (&path, "%s/%s", mp, filename) == -1)
+    error (EXIT_FAILURE, errno, "asprintf");
+
+  start = now_ms ();
+  fd = open (path, O_RDONLY);
+  if (fd == -1)
+    error (EXIT_FAILURE, errno, "open: %s", path);
+  while ((r = read (fd, buf, sizeof buf)) > 0)
+    total += r;
+  if (r == -1)
+    error (EXIT_FAILURE, errno, "read: %s", path);
+  close (fd);
+
+  result ("mount_local_read",
+          total / 1048576.0 * 1000.0 / (now_ms () - start), "MB/s");
+
+  snprintf (cmd, sizeof cmd, "../../fuse/guestunmount %s", mp);
+  if (system (cmd) != 0)
+    error (EXIT_FAILURE, 0, "%s: failed", cmd);
+}
+
+static int
+compare_keys_len (const void *p1, const void *p2)
+{
+  const char *key1 = * (char * const *) p1;
+  const char *key2 = * (char * const *) p2;
+
+  return strlen (key1) - strlen (key2);
+}
+
+/* Full inspection of the guest, including listing applications. */
+static void
+test_inspect (void)
+{
+  guestfs_h *g = create_handle ();
+  CLEANUP_FREE_STRING_LIST char **roots = NULL;
+  double start;
+  size_t i, j, nr_apps = 0;
+
+  if (guestfs_add_drive_ro (g, GUEST) == -1 ||
+      guestfs_launch (g) == -1)
+    exit (EXIT_FAILURE);
+
+  start = now_ms ();
+  roots = guestfs_inspect_os (g);
+  if (roots == NULL)
+    exit (EXIT_FAILURE);
+  result ("inspect_os", now_ms () - start, "ms");
+
+  start = now_ms ();
+  for (i = 0; roots[i] != NULL; ++i) {
+    CLEANUP_FREE_STRING_LIST char **mps = NULL;
+    struct guestfs_application2_list *apps;
+    size_t n;
+
+    mps = guestfs_inspect_get_mountpoints (g, roots[i]);
+    if (mps == NULL)
+      exit (EXIT_FAILURE);
+    n = guestfs___count_strings (mps) / 2;
+    qsort (mps, n, 2 * sizeof (char *), compare_keys_len);
+    for (j = 0; mps[j] != NULL; j += 2)
+      ignore_value (guestfs_mount_ro (g, mps[j+1], mps[j]));
+
+    apps = guestfs_inspect_list_applications2 (g, roots[i]);
+    if (apps == NULL)
+      exit (EXIT_FAILURE);
+    nr_apps += apps->len;
+    guestfs_free_application2_list (apps);
+
+    if (guestfs_umount_all (g) == -1)
+      exit (EXIT_FAILURE);
+  }
+  result ("inspect_list_applications", now_ms () - start, "ms");
+  result ("inspect_applications_found", nr_apps, "count");
+
+  guestfs_close (g);
+}
+
+struct thread_state {
+  pthread_t thread;
+  int exit_status;
+};
+
+/* Launch an appliance and make some small calls. */
+static void *
+start_thread (void *statevp)
+{
+  struct thread_state *state = statevp;
+  guestfs_h *g;
+  size_t i;
+
+  state->exit_status = 1;
+
+  g = guestfs_create ();
+  if (g == NULL)
+    return state;
+  if (guestfs_add_drive_scratch (g, 64*1024*1024, -1) == -1 ||
+      guestfs_launch (g) == -1)
+    goto error;
+  for (i = 0; i < PARALLEL_RPC_CALLS; ++i) {
+    if (guestfs_ping_daemon (g) == -1)
+      goto error;
+  }
+  if (guestfs_shutdown (g) == -1)
+    goto error;
+
+  state->exit_status = 0;
+ error:
+  guestfs_close (g);
+  return state;
+}
+
+/* Run 1, 2, 4, ... handles at the same time, as many as the host has
+ * memory for.
+ */
+static void
+test_parallel (void)
+{
+  struct thread_state threads[MAX_PARALLEL];
+  size_t max = MIN (MAX_PARALLEL, estimate_max_threads ());
+  size_t n, i;
+  double start, elapsed;
+  char name[64];
+  int r;
+
+  for (n = 1; n <= max; n *= 2) {
+    start = now_ms ();
+    for (i = 0; i < n; ++i) {
+      r = pthread_create (&threads[i].thread, NULL, start_thread, &threads[i]);
+      if (r != 0)
+        error (EXIT_FAILURE, r, "pthread_create");
+    }
+    for (i = 0; i < n; ++i) {
+      r = pthread_join (threads[i].thread, NULL);
+      if (r != 0)
+        error (EXIT_FAILURE, r, "pthread_join");
+      if (threads[i].exit_status != 0)
+        exit (EXIT_FAILURE);
+    }
+    elapsed = now_ms () - start;
+
+    snprintf (name, sizeof name, "parallel_%zu_wall", n);
+    result (name, elapsed, "ms");
+    snprintf (name, sizeof name, "parallel_%zu_rpc_per_sec", n);
+    result (name, n * PARALLEL_RPC_CALLS * 1000.0 / elapsed, "calls/s");
+  }
+}